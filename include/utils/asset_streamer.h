@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <utils/job_system.h>
+#include <utils/model_import.h>
+#include <utils/texture_cache.h>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Asynchronous loading of the assets.
+// Background jobs of the job system open (or build) the texture caches and import models in parallel. The cached levels are
+// uploaded on the OpenGL thread by Update, through a ring of pixel unpack buffers, within a time budget per frame.
+// The textures are created immediately with a 1x1 placeholder content, so they can be bound and sampled at once;
+// the real content replaces the placeholder (with the same texture name) when it is resident.
+class AssetStreamer
+{
+public:
+    // texture unit used for the uploads, never used by the shaders
+    static constexpr GLuint StreamingTextureUnit = 15;
+
+    explicit AssetStreamer(JobSystem &jobs, size_t ringSize = 3, size_t slotSize = 16 * 1024 * 1024);
+    ~AssetStreamer() noexcept;
+    AssetStreamer(const AssetStreamer &) = delete;
+    AssetStreamer &operator=(const AssetStreamer &) = delete;
+
+    // the texture must have been generated by the caller: its parameters (filters, wrapping) are preserved
+    void StreamTexture2D(GLuint texture, const std::string &path);
+    // faces in the order +X, -X, +Y, -Y, +Z, -Z
+    void StreamCubeMap(GLuint texture, const std::array<std::string, 6> &facePaths, const std::string &cachePath);
+    // the OpenGL meshes must be created by the caller on the OpenGL thread (see Model(vector<MeshData>&)); a load
+    // cancelled by the destruction of the streamer gives no meshes
+    std::future<std::vector<MeshData>> StreamModelData(const std::string &path);
+
+    // to be called once per frame on the OpenGL thread
+    void Update(double budgetMs);
+    // number of textures not yet resident
+    size_t GetPendingCount() const;
+    double GetLastUpdateMs() const;
+
+private:
+    // a texture to upload: 1 source image for 2D textures, 6 for cube maps
+    struct UploadJob
+    {
+        GLuint Texture = 0;
+        GLenum Target = GL_TEXTURE_2D;
+        std::vector<std::string> Paths;
+        std::string CachePath;
+        TextureCacheFile Cache;
+    };
+
+    void setPlaceholder(GLuint texture, GLenum target);
+    // cancelled is called instead of work when the streamer is destroyed before the job runs
+    void enqueueWork(std::function<void()> work, std::function<void()> cancelled = nullptr);
+    void enqueueTexture(const std::shared_ptr<UploadJob> &job);
+    void upload(UploadJob &job);
+    void uploadLevel(const UploadJob &job, int face, int level);
+
+    // the jobs not started at the destruction are skipped
+    JobSystem &_jobs;
+    JobCounter _outstanding;
+    std::atomic<bool> _quit{false};
+
+    // cached textures, waiting for the upload
+    std::deque<std::shared_ptr<UploadJob>> _ready;
+    std::mutex _readyMutex;
+    std::atomic<size_t> _pending{0};
+
+    // ring of pixel unpack buffers, each one guarded by a fence
+    std::vector<GLuint> _pbos;
+    std::vector<GLsync> _fences;
+    size_t _slotSize;
+    size_t _nextSlot = 0;
+    double _lastUpdateMs = 0.0;
+};
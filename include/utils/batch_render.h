@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// A job of a batch render: a view of the scene with its medium parameters, rendered at any resolution.
+// The jobs are read from a text file with a job per line, as key=value pairs separated by spaces ('#' starts a
+// comment). The vectors are written as x,y,z. The keys not given keep the values of the previous job (the first job
+// starts from the values of the application), so a sweep lists only the parameters which change:
+//   name=fog_a camera=0,1,7 yaw=-90 pitch=0 light=0,5,0 width=3840 height=2160
+//   name=fog_b absorption=0.1,0.1,0.1 scattering=0.3,0.3,0.3 g=0.6 phase=schlick skybox=media
+// reference=<samples> also renders the view with the CPU path tracer (see path_tracer.h) once the GPU images are
+// written, and compares them (the path tracer has the sky of skybox=media)
+struct BatchJob
+{
+    std::string Name;
+    glm::vec3 CameraPos = glm::vec3(0.0f, 0.0f, 7.0f);
+    float Yaw = -90.0f;
+    float Pitch = 0.0f;
+    glm::vec3 LightPos = glm::vec3(0.0f);
+    glm::vec3 AbsorptionCoeff = glm::vec3(0.05f);
+    glm::vec3 ScatteringCoeff = glm::vec3(0.15f);
+    float G = 0.0f;
+    // in the order of the GUI: Mie, Rayleigh, Schlick, uniform
+    int PhaseFunction = 0;
+    // 0 = fog, 1 = participating media
+    int SkyboxTechnique = 0;
+    int Width = 1920;
+    int Height = 1080;
+    // samples per pixel of the reference image (0 = none)
+    int ReferenceSamples = 0;
+};
+
+// part of the image of a job, rendered in a frame (from the bottom-left corner, as in OpenGL)
+struct BatchTile
+{
+    int X, Y;
+    int Width, Height;
+};
+
+// timing of a job, in milliseconds from the start of the batch (GPU time: sum of the measured frames of its tiles), and
+// error of its image against the reference
+struct BatchJobTiming
+{
+    double SubmittedMs = 0.0;
+    double WrittenMs = 0.0;
+    double EncodeMs = 0.0;
+    double GpuMs = 0.0;
+    int Tiles = 0;
+    int GpuFramesMeasured = 0;
+    bool Written = false;
+    double ReferenceMs = 0.0;
+    // -1 when the image has not been compared
+    double ReferenceRmse = -1.0;
+    double ReferenceRelMse = -1.0;
+};
+
+// the jobs without a name are called job_<line>; returns false (with the line of the error) if the file is not valid
+bool LoadBatchJobs(const std::string &path, const BatchJob &defaults, std::vector<BatchJob> &jobs);
+// the image is split in tiles of at most maxTileSize pixels per side
+std::vector<BatchTile> SplitIntoTiles(int width, int height, int maxTileSize);
+// off-center perspective projection of the part of the view covered by the tile
+glm::mat4 GetTileProjection(float fovY, float near, float far, int imageWidth, int imageHeight, const BatchTile &tile);
+// CSV file with a line per job
+bool WriteBatchReport(const std::string &path, const std::vector<BatchJob> &jobs, const std::vector<std::string> &files,
+                      const std::vector<BatchJobTiming> &timings);
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU block compression encoders, used to build the texture cache.
+// The input is a RGBA8 image; blocks on the right and bottom borders are padded by replicating the border pixels.
+// The output is the sequence of 4x4 blocks, in row order (8 bytes per block for BC1, 16 bytes for BC3 and BC7).
+
+// opaque images (the alpha channel is ignored)
+void CompressBC1(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out);
+// images with alpha: interpolated alpha block + BC1 color block
+void CompressBC3(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out);
+// BC7 with mode 6 only (single subset, RGBA endpoints with p-bits, 4-bit indices)
+void CompressBC7(const uint8_t *rgba, int width, int height, std::vector<uint8_t> &out);
+
+size_t CompressedSize(int width, int height, size_t blockSize);
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <limits>
+#include <glm/glm.hpp>
+#include <utils/mesh.h>
+#include <utils/model.h>
+
+// Axis aligned bounding box
+struct AABB
+{
+    glm::vec3 Min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 Max = glm::vec3(-std::numeric_limits<float>::max());
+
+    AABB() = default;
+    AABB(const glm::vec3 &min, const glm::vec3 &max);
+
+    bool IsValid() const;
+    glm::vec3 Center() const;
+    glm::vec3 Extents() const;
+    float SurfaceArea() const;
+
+    void Expand(const glm::vec3 &point);
+    void Expand(const AABB &other);
+    AABB Fattened(float margin) const;
+    bool Contains(const AABB &other) const;
+    bool Overlaps(const AABB &other) const;
+    // AABB enclosing this box once transformed by the given matrix (Arvo's method)
+    AABB Transformed(const glm::mat4 &matrix) const;
+};
+
+struct BoundingSphere
+{
+    glm::vec3 Center = glm::vec3(0.0f);
+    float Radius = 0.0f;
+
+    BoundingSphere Transformed(const glm::mat4 &matrix) const;
+};
+
+// Local space bounds of a mesh or a model, computed once at load time
+struct Bounds
+{
+    AABB Box;
+    BoundingSphere Sphere;
+};
+
+// View frustum as 6 planes (xyz = inward normal, w = distance), extracted from a view-projection matrix
+class Frustum
+{
+public:
+    Frustum() = default;
+    explicit Frustum(const glm::mat4 &viewProjection);
+
+    bool Intersects(const AABB &box) const;
+    bool Intersects(const BoundingSphere &sphere) const;
+
+private:
+    glm::vec4 _planes[6];
+};
+
+Bounds ComputeBounds(const Mesh &mesh);
+Bounds ComputeBounds(const Model &model);
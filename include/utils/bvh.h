@@ -0,0 +1,59 @@
+#pragma once
+
+#include <utils/bounds.h>
+#include <functional>
+#include <vector>
+
+// Dynamic bounding volume hierarchy over world space AABBs.
+// Leaves store a "fat" AABB, so that small movements of an object do not require a reinsertion.
+// Insertion chooses the sibling which minimizes the surface area increase, and the tree is kept
+// balanced with AVL-like rotations.
+class BVH
+{
+public:
+    static constexpr int NullNode = -1;
+
+    explicit BVH(float margin = 0.1f);
+
+    // returns the id of the proxy, to be used with Move, Remove and in the query callbacks
+    int Insert(const AABB &box, void *userData);
+    void Remove(int proxyId);
+    // returns true if the proxy has been reinserted
+    bool Move(int proxyId, const AABB &box);
+
+    void *GetUserData(int proxyId) const;
+    const AABB &GetFatAABB(int proxyId) const;
+
+    // visits the tree and calls the callback for every leaf which passes the test.
+    // The test is called also on the internal nodes, so that whole subtrees can be discarded.
+    // Returns the number of tested nodes.
+    int Query(const std::function<bool(const AABB &)> &test, const std::function<void(int)> &callback) const;
+
+    int GetHeight() const;
+    int GetProxyCount() const;
+
+private:
+    struct Node
+    {
+        AABB Box;
+        void *UserData = nullptr;
+        int Parent = NullNode; // also used as "next" in the free list
+        int Left = NullNode;
+        int Right = NullNode;
+        int Height = -1; // -1: free node, 0: leaf
+
+        bool IsLeaf() const { return Left == NullNode; }
+    };
+
+    int allocateNode();
+    void freeNode(int nodeId);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    int balance(int nodeId);
+
+    std::vector<Node> _nodes;
+    int _root = NullNode;
+    int _freeList = NullNode;
+    int _proxyCount = 0;
+    float _margin;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <utils/bounds.h>
+#include <string>
+#include <vector>
+
+// the media shaders have a sampler for each volume, on the units DensityVolumeUnit + i
+const int MaxDensityVolumes = 4;
+const GLuint DensityVolumeUnit = 8;
+// voxels per side of the blocks of the occupancy level, which is the mip level log2(OccupancyBrickSize)
+const int OccupancyBrickSize = 8;
+const int OccupancyLevel = 3;
+
+struct MediumSettings
+{
+    // density of the homogeneous medium everywhere (1 = the absorption and scattering coefficients of the GUI)
+    float AmbientDensity = 0.2f;
+    bool VolumesEnabled = true;
+    // multiplier of the density of each volume
+    float VolumeDensity[MaxDensityVolumes] = {4.0f, 4.0f, 4.0f, 4.0f};
+};
+
+// density samples of a volume, x first, then y and z, in the world bounds of the grid
+struct DensityData
+{
+    glm::ivec3 Size = glm::ivec3(0);
+    AABB Bounds;
+    std::vector<float> Voxels;
+};
+
+// Density volume file: the magic "DVOL", the size of the grid (3 int32), the world bounds (min and max, 6 float32),
+// then the voxels (float32, x first). Returns false if the file does not exist, or (with an error message) if it
+// cannot be read
+bool LoadDensityData(const std::string &path, DensityData &data);
+bool SaveDensityData(const std::string &path, const DensityData &data);
+
+// procedural volumes, used when the files are missing: a low fog bank with noisy edges, and a column of smoke
+DensityData GenerateFogBank(const AABB &bounds, const glm::ivec3 &size, unsigned int seed);
+DensityData GenerateSmokeColumn(const AABB &bounds, const glm::ivec3 &size, unsigned int seed);
+
+// 3D texture of a density volume, which multiplies the coefficients of the medium inside its bounds.
+// The level 0 has the density of the voxels; the levels up to OccupancyLevel have the minimum and the maximum density
+// (RG) of blocks of voxels, so the march can skip the blocks where the medium is empty
+class DensityVolume
+{
+public:
+    explicit DensityVolume(const DensityData &data);
+    ~DensityVolume() noexcept;
+    DensityVolume(const DensityVolume &) = delete;
+    DensityVolume &operator=(const DensityVolume &) = delete;
+
+    GLuint GetTexture() const;
+    // bounds of the texture (the grid is padded to a multiple of the brick size)
+    const AABB &GetBounds() const;
+    float GetMaxDensity() const;
+    // fraction of the blocks of the occupancy level with some medium
+    float GetOccupancy() const;
+
+private:
+    GLuint _texture = 0;
+    AABB _bounds;
+    float _maxDensity = 0.0f;
+    float _occupancy = 0.0f;
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <utils/shader.h>
+#include <glm/glm.hpp>
+#include <functional>
+
+// Ring of GL_TIME_ELAPSED queries. The result of a frame is read a few frames later, when it is available,
+// so the CPU never waits for the GPU
+class GpuTimer
+{
+public:
+    static constexpr int QueryCount = 4;
+
+    GpuTimer();
+    ~GpuTimer() noexcept;
+    GpuTimer(const GpuTimer &) = delete;
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    // if all the queries of the ring are still pending, the frame is not measured. The tag is given back with the
+    // result, to sum the time of the frames of a task
+    void Begin(int tag = -1);
+    void End();
+    // reads the available results, passed with their tag to onResult; returns true if a new measure has been read
+    bool CollectResults(const std::function<void(int, float)> &onResult = nullptr);
+    // GPU time of the last measured frame
+    float GetLastMs() const;
+
+private:
+    GLuint _queries[QueryCount] = {};
+    bool _pending[QueryCount] = {};
+    int _tags[QueryCount] = {};
+    int _next = 0;
+    // index of the query between Begin and End (-1 if the frame is not measured)
+    int _active = -1;
+    float _lastMs = 0.0f;
+};
+
+struct ResolutionSettings
+{
+    bool Enabled = true;
+    // GPU time of the frame we want to hit
+    float TargetMs = 12.0f;
+    float MinScale = 0.5f;
+    float MaxScale = 1.0f;
+    // fraction of the error corrected at each update
+    float Gain = 0.3f;
+    // relative error under which the scale does not change, to avoid oscillations
+    float Deadband = 0.05f;
+    // strength of the sharpening filter applied by the upscale (0 = plain bilinear upscale)
+    float Sharpness = 0.3f;
+};
+
+// new resolution scale (per axis) from the measured GPU time. The cost of the media passes is roughly proportional
+// to the number of pixels, so the area (scale^2) is corrected by the ratio between target and measured time
+float UpdateResolutionScale(float scale, float gpuMs, const ResolutionSettings &settings);
+
+// Offscreen target of the scene. It is allocated once at the full framebuffer size, and the scene is rendered in its
+// lower-left part (the scaled viewport), so changing the scale never reallocates it. The framebuffer is bound by the
+// frame graph, with the viewport at the scaled size.
+// The image is then upscaled on the default framebuffer with a contrast limited sharpening filter.
+// The depth is kept in a texture, so the passes after the scene can read it.
+class SceneTarget
+{
+public:
+    SceneTarget(const GLchar *vertexPath, const GLchar *fragmentPath, int width, int height);
+    ~SceneTarget() noexcept;
+    SceneTarget(const SceneTarget &) = delete;
+    SceneTarget &operator=(const SceneTarget &) = delete;
+
+    void SetScale(float scale);
+    // viewport of a given size (clamped to the textures), for the offline rendering of tiles
+    void SetSize(int width, int height);
+    float GetScale() const;
+    // size of the scaled viewport
+    int GetWidth() const;
+    int GetHeight() const;
+    // size of the textures
+    int GetFullWidth() const;
+    int GetFullHeight() const;
+    // fraction of the textures covered by the scaled viewport
+    glm::vec2 GetUvScale() const;
+    GLuint GetColorTexture() const;
+    GLuint GetDepthTexture() const;
+    GLuint GetFramebuffer() const;
+
+    // draws the scaled image on the bound framebuffer, whose viewport is at the full size (depth test and program are
+    // changed).
+    // The in-scattering texture (same size and viewport of the target, 0 if not used) is added before the sharpening
+    void Upscale(float sharpness, GLuint inscatteringTexture = 0);
+
+private:
+    Shader _shader;
+    GLuint _FBO = 0, _colorTexture = 0, _depthTexture = 0, _VAO = 0;
+    int _fullWidth, _fullHeight;
+    int _width, _height;
+    float _scale = 1.0f;
+};
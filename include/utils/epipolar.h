@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <utils/shader.h>
+#include <string>
+
+struct EpipolarSettings
+{
+    bool Enabled = false;
+    // rounded to a multiple of 4 (the same number of lines ends on each border of the screen)
+    int LineCount = 512;
+    int SamplesPerLine = 256;
+    // distance between the samples always marched along a line; the others are interpolated
+    int InitialSampleStep = 16;
+    // relative difference of the camera distance between two samples which breaks the interpolation
+    float DepthBreakThreshold = 0.1f;
+};
+
+// Epipolar sampling of the in-scattering of the point lights.
+// The in-scattered radiance varies mostly along the lines through the projection of the (first) light on the screen (the
+// epipolar lines), so it is marched only on a sparse set of samples of these lines, then interpolated along them and
+// between them. The interpolation never crosses a depth discontinuity: the samples at the two sides of a
+// discontinuity are always marched, and the pixels left without valid samples are marched individually.
+// The result is written in the framebuffer of an in-scattering texture (RGBA16F, same size and viewport of the scene
+// target, given by the frame graph), which is added to the scene by the upscale.
+// The passes read the constants of the PassData block (the media passes ones, with the inverse of the complete
+// view-projection matrix) and the phase function subroutine; they change the GL state with direct calls.
+class EpipolarScattering
+{
+public:
+    // the shaders (fullscreen.vert and epipolar_*.frag) are loaded from the given folder
+    explicit EpipolarScattering(const std::string &shadersPath);
+    ~EpipolarScattering() noexcept;
+    EpipolarScattering(const EpipolarScattering &) = delete;
+    EpipolarScattering &operator=(const EpipolarScattering &) = delete;
+
+    // computes the in-scattering of the scene with the given depth texture, rendered in the viewport
+    // (0, 0, viewportWidth, viewportHeight), on the given framebuffer (left bound). Without skyInscattering, the pixels
+    // at the far plane are left black
+    void Render(const EpipolarSettings &settings, const glm::vec4 &lightClipPos, GLuint sceneDepthTexture,
+                GLuint shadowCubes, GLuint inscatteringFramebuffer, int viewportWidth, int viewportHeight,
+                const glm::vec2 &uvScale, GLuint phaseFunction, bool skyInscattering);
+
+    // samples marched along the lines in the last measured frame
+    GLuint GetMarchedSamples() const;
+
+private:
+    struct EpipolarTarget
+    {
+        GLuint FBO = 0;
+        GLuint Texture = 0;
+    };
+
+    void createTarget(EpipolarTarget &target, GLint internalFormat, GLenum format, GLint filter, int width, int height);
+    void deleteTarget(EpipolarTarget &target);
+    // the textures of the lines are reallocated when the number of lines or of samples changes
+    void resizeLines(int lineCount, int samplesPerLine);
+    void drawFullscreen();
+
+    Shader _coordinatesShader, _sourcesShader, _marchShader, _unwarpShader;
+    // phase function subroutines of the march and unwarp shaders, in the order of the GUI (Mie, Rayleigh, Schlick, uniform)
+    GLuint _marchSubroutines[4], _unwarpSubroutines[4];
+    // samples of the lines: coordinates (pass 1), interpolation sources (pass 2), marched in-scattering (pass 3)
+    EpipolarTarget _coordinates, _sources, _scattering;
+    GLuint _VAO = 0;
+    int _lineCount = 0, _samplesPerLine = 0;
+
+    // GL_SAMPLES_PASSED query of the march pass
+    GLuint _marchQuery = 0;
+    bool _marchQueryPending = false;
+    GLuint _marchedSamples = 0;
+};
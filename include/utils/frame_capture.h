@@ -0,0 +1,138 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class CaptureFormat
+{
+    // 8 bit RGBA
+    PNG = 0,
+    // half float RGBA, for the float render targets
+    EXR = 1
+};
+
+struct CaptureSettings
+{
+    size_t RingSize = 3;
+    // threads encoding the images
+    unsigned EncoderCount = 1;
+    // the captures wait for a buffer of the ring or for a place in the queue of the encoders instead of being dropped
+    // (offline rendering, where every image is needed)
+    bool WaitWhenFull = false;
+    // the results of the images are kept until TakeResults
+    bool KeepResults = false;
+};
+
+// file of a capture; an image larger than the framebuffer is assembled from several captures, each one at its
+// position in the image (from the bottom-left corner), and encoded once all its pixels are read
+struct CaptureTarget
+{
+    std::string Path;
+    CaptureFormat Format = CaptureFormat::PNG;
+    // 0 = the size of the capture
+    int ImageWidth = 0, ImageHeight = 0;
+    int X = 0, Y = 0;
+};
+
+struct CaptureResult
+{
+    std::string Path;
+    bool Written;
+    // time of the encoding, and end of the write (ProfilerNow)
+    int64_t EncodeUs;
+    int64_t CompletedUs;
+};
+
+// Capture of frames without stalls.
+// The pixels of a framebuffer are copied by glReadPixels into a ring of pixel pack buffers, each one guarded by a
+// fence; the buffers are mapped only when their fence has signaled (2-3 frames later), then the pixels are handed to a
+// pool of background threads which encode and write the files. When the ring or the queue of the encoders is full
+// the capture is dropped (unless WaitWhenFull is set): the render loop never waits for the GPU or the disk.
+// Capture, Update and Flush are called on the OpenGL thread.
+class FrameCapture
+{
+public:
+    // images waiting for the encoders: further captures are dropped
+    static constexpr size_t MaxQueuedFrames = 8;
+
+    explicit FrameCapture(const CaptureSettings &settings = CaptureSettings());
+    ~FrameCapture() noexcept;
+    FrameCapture(const FrameCapture &) = delete;
+    FrameCapture &operator=(const FrameCapture &) = delete;
+
+    // reads the color of the framebuffer (0 = the back buffer of the window); returns false if the capture is dropped
+    bool Capture(GLuint framebuffer, int width, int height, const CaptureTarget &target);
+    // to be called once per frame: the buffers whose read has completed go to the encoder
+    void Update();
+    // completes all the captures (waiting for the GPU and the encoder), at the exit
+    void Flush();
+
+    // the counts can be read from any thread
+    int GetWrittenCount() const;
+    int GetDroppedCount() const;
+    // captures in the ring, images being assembled or in the queue of the encoders (OpenGL thread)
+    int GetPendingCount() const;
+    // results of the images written or failed since the last call (with KeepResults)
+    std::vector<CaptureResult> TakeResults();
+
+private:
+    struct Readback
+    {
+        GLuint Buffer = 0;
+        GLsync Fence = nullptr;
+        size_t Size = 0;
+        int Width = 0, Height = 0;
+        CaptureTarget Target;
+    };
+
+    struct EncodeJob
+    {
+        int Width, Height;
+        CaptureFormat Format;
+        std::string Path;
+        // rows from the bottom, as read by OpenGL
+        std::vector<unsigned char> Pixels;
+        // pixels of the image not read yet, while it is assembled
+        size_t Missing = 0;
+    };
+
+    // maps the buffer of the oldest readback; returns false if its fence has not signaled (and timeout is 0)
+    bool completeReadback(GLuint64 timeout);
+    // hands the image to the encoders; returns false if it is dropped
+    bool queueJob(EncodeJob &job);
+    void encoderLoop();
+
+    CaptureSettings _settings;
+    std::vector<Readback> _ring;
+    // oldest readback in flight, and number of readbacks in flight
+    size_t _oldest = 0, _inFlight = 0;
+
+    // images assembled from several captures, by path (OpenGL thread)
+    std::map<std::string, EncodeJob> _assemblies;
+
+    std::vector<std::thread> _encoders;
+    std::deque<EncodeJob> _jobs;
+    mutable std::mutex _jobsMutex;
+    std::condition_variable _jobsCondition;
+    bool _quit = false;
+    // the jobs taken by the encoders are not in the queue anymore
+    int _encoding = 0;
+    std::vector<CaptureResult> _results;
+
+    std::atomic<int> _written{0};
+    std::atomic<int> _dropped{0};
+};
+
+// the rows of the images are given from the bottom, as read by OpenGL
+bool WritePng(const std::string &path, int width, int height, const unsigned char *rgba);
+bool WriteExr(const std::string &path, int width, int height, const float *rgba);
+// reads the files of WriteExr (not any EXR file)
+bool ReadExr(const std::string &path, int &width, int &height, std::vector<float> &rgba);
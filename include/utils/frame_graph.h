@@ -0,0 +1,160 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// Frame graph: the passes of a frame declare the resources they read and write, then the graph
+// - culls the passes whose results are not used by an output of the frame (or by a pass with side effects),
+// - orders the passes by their dependencies (the declaration order is kept when there are no constraints),
+// - allocates the transient textures from a pool for the span of passes which use them: two transient textures with
+//   the same description and disjoint spans share the same GL texture,
+// - binds the render target of each pass, skipping the framebuffer and viewport changes equal to the current state.
+// Each write creates a new version of the resource: a pass which draws on top of the content of a target must also
+// read the version it writes on. The graph is declared again at each frame; the pool keeps its textures between the
+// frames, and releases the ones unused for a while.
+// The graph is used only by the thread owning the GL context.
+
+// version of a resource of the graph (-1 = none)
+typedef int FrameGraphResource;
+
+struct TransientTextureDesc
+{
+    int Width = 0;
+    int Height = 0;
+    // a color (non integer) or depth format: the texture gets a framebuffer with the matching attachment
+    GLenum InternalFormat = GL_RGBA8;
+    GLint Filter = GL_LINEAR;
+
+    bool operator==(const TransientTextureDesc &other) const;
+};
+
+struct FrameGraphStats
+{
+    // names of the executed passes, in the order of execution
+    std::vector<const char *> Passes;
+    std::vector<const char *> Culled;
+    int Transients = 0;
+    // GL textures of the pool used by the frame, and total size of the pool
+    int PooledTextures = 0;
+    size_t PoolBytes = 0;
+    int FramebufferBinds = 0;
+    int FramebufferBindsSkipped = 0;
+};
+
+class FrameGraph;
+
+// declarations of a pass, during its setup
+class FrameGraphBuilder
+{
+public:
+    FrameGraphResource Read(FrameGraphResource resource);
+    // the pass writes the resource with its own framebuffers; returns the new version
+    FrameGraphResource Write(FrameGraphResource resource);
+    // the pass draws on the framebuffer of the resource, bound by the graph with a viewport of its size; returns the
+    // new version. A pass has a single render target
+    FrameGraphResource RenderTo(FrameGraphResource resource);
+    // the pass is never culled
+    void SetSideEffect();
+
+private:
+    friend class FrameGraph;
+    FrameGraphBuilder(FrameGraph &graph, int pass);
+
+    FrameGraph &_graph;
+    int _pass;
+};
+
+class FrameGraph
+{
+public:
+    FrameGraph() = default;
+    ~FrameGraph() noexcept;
+    FrameGraph(const FrameGraph &) = delete;
+    FrameGraph &operator=(const FrameGraph &) = delete;
+
+    // the passes and resources of the previous frame are dropped (the pool keeps its textures)
+    void Reset();
+    // texture and framebuffer owned by the application (0 for the ones it has not); the framebuffer 0 is the default one
+    FrameGraphResource Import(const char *name, GLuint texture, GLuint framebuffer, int width, int height);
+    FrameGraphResource CreateTexture(const char *name, const TransientTextureDesc &desc);
+    // the setup is called immediately; the execution is called by Execute, if the pass is not culled
+    void AddPass(const char *name, const std::function<void(FrameGraphBuilder &)> &setup,
+                 const std::function<void(const FrameGraph &)> &execute);
+    // the resource must be up to date at the end of the frame
+    void MarkOutput(FrameGraphResource resource);
+
+    // culling, ordering and allocation of the transient textures
+    void Compile();
+    void Execute();
+
+    // texture and framebuffer of a resource used by the executing pass
+    GLuint GetTexture(FrameGraphResource resource) const;
+    GLuint GetFramebuffer(FrameGraphResource resource) const;
+    // the pool is released (the graph can still be used: the textures are created again)
+    void ReleasePool();
+    const FrameGraphStats &GetStats() const;
+
+private:
+    friend class FrameGraphBuilder;
+
+    // frames after which a texture of the pool unused by the graph is deleted
+    static constexpr int MaxUnusedFrames = 60;
+
+    struct ResourceNode
+    {
+        const char *Name;
+        bool Imported;
+        GLuint Texture, Framebuffer;
+        int Width, Height;
+        TransientTextureDesc Desc;
+        // index in the pool of a transient texture (-1 = not allocated)
+        int Pooled = -1;
+        // span of the executed passes using the resource (positions in the order of execution)
+        int FirstUse = -1, LastUse = -1;
+    };
+
+    struct VersionNode
+    {
+        int Resource;
+        // version written on by the writer (-1 for the first version)
+        int Parent = -1;
+        int Writer = -1;
+        std::vector<int> Readers;
+        bool Output = false;
+    };
+
+    struct PassNode
+    {
+        const char *Name;
+        std::function<void(const FrameGraph &)> Execute;
+        std::vector<int> Reads, Writes;
+        int RenderTarget = -1;
+        bool SideEffect = false;
+        bool Live = false;
+    };
+
+    struct PooledTexture
+    {
+        TransientTextureDesc Desc;
+        GLuint Texture = 0, Framebuffer = 0;
+        bool InUse = false;
+        int UnusedFrames = 0;
+    };
+
+    int addVersion(int resource, int parent, int writer);
+    void cullPasses();
+    void sortPasses();
+    void allocateTransients();
+    int acquireTexture(const TransientTextureDesc &desc);
+    void deletePooledTexture(PooledTexture &texture);
+
+    std::vector<ResourceNode> _resources;
+    std::vector<VersionNode> _versions;
+    std::vector<PassNode> _passes;
+    // indices of the live passes, in the order of execution
+    std::vector<int> _order;
+    std::vector<PooledTexture> _pool;
+    FrameGraphStats _stats;
+};
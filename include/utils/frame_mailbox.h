@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+// Triple-buffered mailbox between the update thread (writer) and the render thread (reader).
+// The writer fills its own buffer and publishes it by exchanging it with the ready one; the reader takes the ready
+// buffer by exchanging it with the one it has just consumed. The two threads never touch the same buffer, and a
+// published packet is never modified until the reader releases it.
+template <typename T>
+class FrameMailbox
+{
+public:
+    // buffer owned by the writer, to be filled before Publish
+    T &GetWriteBuffer()
+    {
+        return _buffers[_write];
+    }
+
+    // the writer waits until the reader has taken the previous packet, so it is never more than one frame ahead
+    // (the update of the next frame overlaps the rendering of the current one)
+    void Publish()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _consumedCondition.wait(lock, [this] { return !_hasReady || _closed; });
+        std::swap(_write, _ready);
+        _hasReady = true;
+        _readyCondition.notify_one();
+    }
+
+    // the reader waits for a new packet; returns nullptr when the mailbox is closed
+    const T *Acquire()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _readyCondition.wait(lock, [this] { return _hasReady || _closed; });
+        if (!_hasReady)
+            return nullptr;
+        std::swap(_read, _ready);
+        _hasReady = false;
+        _consumedCondition.notify_one();
+        return &_buffers[_read];
+    }
+
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _readyCondition.notify_all();
+        _consumedCondition.notify_all();
+    }
+
+private:
+    T _buffers[3];
+    int _write = 0, _ready = 1, _read = 2;
+    bool _hasReady = false;
+    bool _closed = false;
+    std::mutex _mutex;
+    std::condition_variable _readyCondition, _consumedCondition;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <array>
+#include <utility>
+#include <vector>
+
+// GL call accounting: the loader given to glad is wrapped, so the entry points used by the application are replaced by
+// functions which count the calls (per category, per pass and per entry point) before calling the driver.
+// A state set with the same value as the last set of that state seen by the layer is flagged as redundant; the shadow
+// state is forgotten at the beginning of each frame, since ImGui changes the state through its own loader.
+// The passes are the GPU profiler zones (PROFILE_GPU_SCOPE). Release builds (NDEBUG) have no layer at all: the loader is
+// not wrapped and the functions below are empty.
+#ifndef NDEBUG
+#define GL_CALL_ACCOUNTING
+#endif
+
+enum class GLCallCategory
+{
+    DRAW,
+    PROGRAM,
+    UNIFORM,
+    // glGetUniformLocation and the other lookups of names
+    LOOKUP,
+    STATE,
+    // creation, upload and deletion of the objects
+    RESOURCE,
+    // round trips to the driver (glGet*, readbacks, fences): they can stall the CPU until the GPU catches up
+    SYNC,
+    QUERY
+};
+const int GLCallCategoryCount = 8;
+
+struct GLCallCounters
+{
+    std::array<int, GLCallCategoryCount> Calls{};
+    int Redundant = 0;
+
+    int Total() const;
+};
+
+struct GLCallStats
+{
+    GLCallCounters Frame;
+    // in the order of the first call of the frame; the calls outside the passes are counted in "Other"
+    std::vector<std::pair<const char *, GLCallCounters>> Passes;
+    // entry points with the most calls of the frame
+    std::vector<std::pair<const char *, int>> TopFunctions;
+};
+
+const char *GetGLCallCategoryName(GLCallCategory category);
+
+#ifdef GL_CALL_ACCOUNTING
+
+// returns the loader to give to gladLoadGLLoader: it loads the entry points with the given loader
+GLADloadproc WrapGLLoader(GLADloadproc loader);
+// GL thread: the counters of a frame are between these calls; the frame is added to the totals of the session
+void BeginGLCallFrame();
+GLCallStats EndGLCallFrame();
+void BeginGLCallPass(const char *name);
+void EndGLCallPass();
+// average calls per frame of the session, per category and per pass
+void PrintGLCallSummary();
+
+#else
+
+inline GLADloadproc WrapGLLoader(GLADloadproc loader) { return loader; }
+inline void BeginGLCallFrame() {}
+inline GLCallStats EndGLCallFrame() { return GLCallStats(); }
+inline void BeginGLCallPass(const char *) {}
+inline void EndGLCallPass() {}
+inline void PrintGLCallSummary() {}
+
+#endif
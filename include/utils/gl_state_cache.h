@@ -0,0 +1,84 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+// Shadow copy of the OpenGL state changed by the render queue.
+// Binds and uniform writes equal to the current value are dropped before reaching the driver.
+// Code which changes the state with direct GL calls (ImGui, occlusion queries, lines) must call Invalidate afterwards.
+// The uniform values are cached per program: the uniforms written through the cache must never be written directly,
+// and a program must be forgotten before it is deleted (a new program can reuse its name).
+class GLStateCache
+{
+public:
+    static constexpr GLuint MaxTextureUnits = 16;
+    static constexpr GLuint MaxUniformBufferBindings = 8;
+
+    struct Stats
+    {
+        int Issued = 0;
+        int Skipped = 0;
+    };
+
+    GLStateCache();
+
+    // the cached binds are forgotten (uniform values are kept, they are stored in the program objects)
+    void Invalidate();
+    // the uniform values and locations cached for the program are dropped
+    void ForgetProgram(GLuint program);
+
+    void UseProgram(GLuint program);
+    void BindVertexArray(GLuint vertexArray);
+    void BindTexture(GLuint unit, GLenum target, GLuint texture);
+    void DepthFunc(GLenum func);
+    void BindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+    // the shaders of the application have a single subroutine uniform per stage; glUseProgram resets it
+    void UniformSubroutine(GLenum shaderType, GLuint index);
+
+    GLint GetUniformLocation(GLuint program, const std::string &name);
+    // the uniforms are written with glProgramUniform*, so the program does not need to be in use
+    void Uniform(GLuint program, GLint location, GLint value);
+    void Uniform(GLuint program, GLint location, GLfloat value);
+    void Uniform(GLuint program, GLint location, const glm::vec3 &value);
+    void Uniform(GLuint program, GLint location, const glm::mat3 &value);
+    void Uniform(GLuint program, GLint location, const glm::mat4 &value);
+    template <typename T>
+    void Uniform(GLuint program, const std::string &name, const T &value)
+    {
+        Uniform(program, GetUniformLocation(program, name), value);
+    }
+
+    const Stats &GetStats() const;
+    void ResetStats();
+
+private:
+    static constexpr GLuint Unknown = 0xFFFFFFFF;
+
+    struct BufferRange
+    {
+        GLuint Buffer;
+        GLintptr Offset;
+        GLsizeiptr Size;
+    };
+
+    // returns true (and stores the value) if the uniform must be written
+    bool uniformChanged(GLuint program, GLint location, const void *data, size_t size);
+    bool changed(GLuint &cached, GLuint value);
+
+    GLuint _program = Unknown;
+    GLuint _vertexArray = Unknown;
+    GLuint _activeUnit = Unknown;
+    GLuint _depthFunc = Unknown;
+    std::array<GLuint, MaxTextureUnits> _textures;
+    std::array<GLenum, MaxTextureUnits> _textureTargets;
+    std::array<BufferRange, MaxUniformBufferBindings> _uniformBuffers;
+    std::map<GLenum, GLuint> _subroutines;
+    std::unordered_map<uint64_t, std::array<unsigned char, sizeof(glm::mat4)>> _uniforms;
+    std::map<std::pair<GLuint, std::string>, GLint> _locations;
+    Stats _stats;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <utils/mesh.h>
+#include <array>
+#include <cstddef>
+
+// Registry of the GPU memory allocated by the application, and of the CPU copies kept after the upload.
+// Each allocation reports its size when it is created (or reallocated) and is removed when it is deleted; the sizes
+// are computed from the formats, so they are estimates of what the driver allocates (e.g. RGB8 and DEPTH24 take 4
+// bytes per texel, without the driver alignment and padding). The objects are identified by their GL name inside
+// their category: textures, buffers and vertex arrays never share a category.
+// The registry can be used from any thread.
+
+enum class MemoryCategory
+{
+    // vertex and index buffers of the meshes and of the lines (by vertex array)
+    GEOMETRY,
+    TEXTURE,
+    CUBE_MAP,
+    SHADOW,
+    RENDER_TARGET,
+    VOLUME,
+    // uniform, light and streaming buffers (by buffer)
+    BUFFER
+};
+const int MemoryCategoryCount = 7;
+
+struct MemorySettings
+{
+    // the report is flagged when the GPU total is over the budget (0 = no budget)
+    size_t BudgetMb = 0;
+    // the vertices and indices of the meshes are released once the scene setup has used them
+    bool DropCpuCopies = false;
+};
+
+struct MemoryReport
+{
+    std::array<size_t, MemoryCategoryCount> GpuBytes{};
+    std::array<int, MemoryCategoryCount> Objects{};
+    size_t CpuCopyBytes = 0;
+    int CpuCopies = 0;
+
+    size_t GetGpuTotal() const;
+};
+
+const char *GetMemoryCategoryName(MemoryCategory category);
+
+// a new size for an object already tracked replaces the old one
+void TrackGpuMemory(MemoryCategory category, GLuint object, size_t bytes);
+void UntrackGpuMemory(MemoryCategory category, GLuint object);
+void TrackCpuCopy(MemoryCategory category, GLuint object, size_t bytes);
+void UntrackCpuCopy(MemoryCategory category, GLuint object);
+MemoryReport GetMemoryReport();
+void PrintMemoryReport(const MemorySettings &settings);
+
+// bytes of a texture with the given number of mipmap levels
+size_t GetTextureBytes(GLenum internalFormat, int width, int height, int depth = 1, int levels = 1);
+
+// releases the vertices and indices of a mesh uploaded to the GPU; its index count is kept by the registry
+void DropCpuCopy(Mesh &mesh);
+// number of indices of the mesh, also after its CPU copy has been dropped
+GLsizei GetIndexCount(const Mesh &mesh);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Recording and replay of the input of a session, to run the same workload in different builds.
+// A session is a sequence of frames: each frame has its time stamp and time step, then the key and mouse events
+// received in the frame, then the changes of the tracked GUI parameters. The log is kept in memory and written to a
+// compact binary file when the recording stops.
+// In replay the time step of each frame is the recorded one, whatever the real frame time is, so the camera and the
+// parameters follow exactly the recorded path; the live key and mouse input is ignored until the end of the session.
+class InputLog
+{
+public:
+    // the parameters must be tracked in the same order when a session is recorded and replayed (they are identified
+    // by their index); their memory must stay valid for the whole session
+    void TrackParameter(void *data, size_t size);
+
+    bool StartRecording(const std::string &path);
+    // loads the whole session; returns false if the file cannot be read or was recorded with other parameters
+    bool StartReplay(const std::string &path);
+    // writes the file of a recording
+    void Stop();
+    bool IsRecording() const;
+    bool IsReplaying() const;
+
+    // RECORDING
+    // begins a new frame: the following events belong to it
+    void RecordFrame(double time, float deltaTime);
+    void RecordKey(int key, int action);
+    void RecordMouse(double x, double y);
+    // logs the tracked parameters changed since the last call
+    void RecordParameters();
+
+    // REPLAY
+    // dispatches the input events of the next frame; returns false (and stops the replay) at the end of the session
+    bool ReplayFrame(float &deltaTime, const std::function<void(int, int)> &onKey,
+                     const std::function<void(double, double)> &onMouse);
+    // writes the parameter changes of the current frame in the tracked parameters
+    void ReplayParameters();
+    size_t GetFrameCount() const;
+
+private:
+    enum class EventType : uint8_t
+    {
+        FRAME = 0,
+        KEY = 1,
+        MOUSE = 2,
+        PARAMETER = 3
+    };
+
+    struct Parameter
+    {
+        uint8_t *Data;
+        size_t Size;
+        // value at the last recorded change
+        std::vector<uint8_t> Last;
+    };
+
+    template <typename T>
+    void write(const T &value);
+    template <typename T>
+    bool read(T &value);
+
+    enum class Mode
+    {
+        OFF,
+        RECORD,
+        REPLAY
+    } _mode = Mode::OFF;
+    std::string _path;
+    std::vector<Parameter> _parameters;
+    std::vector<uint8_t> _data;
+    // read position in the replay
+    size_t _cursor = 0;
+    size_t _frames = 0;
+    // parameter changes of the current frame of the replay: index of the parameter and offset of its value in _data
+    std::vector<std::pair<size_t, size_t>> _pendingParameters;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using Job = std::function<void()>;
+
+enum class JobPriority
+{
+    // frame work: executed first, and by the threads waiting for a counter
+    NORMAL = 0,
+    // asset loading: executed only by the workers, so a frame never waits for a long job
+    BACKGROUND = 1
+};
+
+// Number of unfinished jobs of a group. The jobs started with a counter increment it when they are submitted and
+// decrement it when they complete; the jobs started after a counter wait for it to reach 0.
+// A counter can be reused once it has been waited for, and must outlive its jobs.
+class JobCounter
+{
+public:
+    JobCounter() = default;
+    JobCounter(const JobCounter &) = delete;
+    JobCounter &operator=(const JobCounter &) = delete;
+
+    bool IsDone() const;
+
+private:
+    friend class JobSystem;
+    struct JobEntry;
+
+    std::atomic<int> _count{0};
+    // guards the continuations, and the last decrement (so the counter can be destroyed after Wait)
+    std::mutex _mutex;
+    std::vector<JobEntry *> _continuations;
+};
+
+// Chase-Lev deque of a worker: the owner pushes and pops at the bottom without locks, the other threads steal from
+// the top. The capacity is fixed (a power of 2): Push returns false when it is full.
+template <typename T>
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(size_t capacity = 4096);
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // owner thread
+    bool Push(T *item);
+    T *Pop();
+    // any thread; returns nullptr if the deque is empty or another thread took the item
+    T *Steal();
+
+private:
+    std::atomic<int64_t> _top{0}, _bottom{0};
+    std::unique_ptr<std::atomic<T *>[]> _items;
+    int64_t _mask;
+};
+
+template <typename T>
+WorkStealingDeque<T>::WorkStealingDeque(size_t capacity) : _items(new std::atomic<T *>[capacity]), _mask((int64_t)capacity - 1)
+{
+}
+
+template <typename T>
+bool WorkStealingDeque<T>::Push(T *item)
+{
+    const int64_t bottom = _bottom.load(std::memory_order_relaxed);
+    const int64_t top = _top.load(std::memory_order_acquire);
+    if (bottom - top > _mask)
+        return false;
+    _items[bottom & _mask].store(item, std::memory_order_relaxed);
+    // the item is written before the thieves can see the new bottom
+    std::atomic_thread_fence(std::memory_order_release);
+    _bottom.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template <typename T>
+T *WorkStealingDeque<T>::Pop()
+{
+    const int64_t bottom = _bottom.load(std::memory_order_relaxed) - 1;
+    _bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = _top.load(std::memory_order_relaxed);
+    if (top > bottom)
+    {
+        // empty
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    T *item = _items[bottom & _mask].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+        // last item: the owner and the thieves race for it on the top
+        if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            item = nullptr;
+        _bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return item;
+}
+
+template <typename T>
+T *WorkStealingDeque<T>::Steal()
+{
+    int64_t top = _top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = _bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return nullptr;
+    T *item = _items[top & _mask].load(std::memory_order_relaxed);
+    if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return item;
+}
+
+// Fixed pool of worker threads with work-stealing.
+// Each worker owns a deque: the jobs submitted by a worker go to its own deque, and the idle workers steal from the
+// others. The jobs submitted by the other threads (and the overflow of the deques) go to a shared queue, the
+// background jobs to a separate queue. Waiting for a counter executes jobs meanwhile, so a job can wait for the jobs
+// it submits. The jobs calling OpenGL go to the queue of the GL thread (the thread owning the context), which runs
+// them in ExecuteGLThreadJobs or while it waits.
+class JobSystem
+{
+public:
+    // by default a worker per core, leaving a core to the main and render threads
+    explicit JobSystem(unsigned workerCount = 0);
+    ~JobSystem() noexcept;
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    void Run(Job job, JobCounter *counter = nullptr, JobPriority priority = JobPriority::NORMAL);
+    // the job is submitted when the dependency reaches 0 (at once if it is already done)
+    void RunAfter(JobCounter &dependency, Job job, JobCounter *counter = nullptr, JobPriority priority = JobPriority::NORMAL);
+    // executes jobs until the counter reaches 0; the background jobs are executed only inside a background job
+    void Wait(JobCounter &counter);
+    // body(begin, end) on ranges of at most grain items, the first one on the calling thread; returns when all are done
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body);
+
+    // the thread calling it owns the GL context from now on
+    void SetGLThread();
+    void RunOnGLThread(Job job, JobCounter *counter = nullptr);
+    // GL thread, once per frame
+    void ExecuteGLThreadJobs();
+
+    unsigned GetWorkerCount() const;
+    // jobs taken from the deque of another worker, since the start
+    uint64_t GetStealCount() const;
+
+private:
+    using JobEntry = JobCounter::JobEntry;
+
+    void workerLoop(unsigned index);
+    void submit(JobEntry *entry);
+    // takes a job from the own deque, the shared queue, the other deques, and (if allowed) the background queue
+    JobEntry *findJob(bool background);
+    void execute(JobEntry *entry);
+    void complete(JobCounter *counter);
+    bool executeGLThreadJob();
+
+    std::vector<std::thread> _workers;
+    std::vector<std::unique_ptr<WorkStealingDeque<JobEntry>>> _deques;
+
+    std::deque<JobEntry *> _shared, _background;
+    std::mutex _queueMutex;
+
+    // sleeping workers: a submission wakes one of them only if there are any
+    std::atomic<int> _queued{0};
+    std::atomic<int> _sleeping{0};
+    std::mutex _sleepMutex;
+    std::condition_variable _sleepCondition;
+    std::atomic<bool> _quit{false};
+
+    std::deque<JobEntry *> _glJobs;
+    std::mutex _glMutex;
+    std::atomic<std::thread::id> _glThread;
+
+    std::atomic<uint64_t> _steals{0};
+};
+
+// --job-benchmark: scheduling overhead of empty jobs, nested submission, parallel-for and dependency chains
+void RunJobBenchmarks(JobSystem &jobs);
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <utils/bounds.h>
+#include <cstdint>
+#include <vector>
+
+// texture units of the light buffers, read by all the shaders which shade or march the lights
+const GLuint LightDataUnit = 5;
+const GLuint ClusterLightsUnit = 6;
+const GLuint LightIndicesUnit = 7;
+
+// how often the shadow cube of a light is rendered again
+enum class ShadowUpdate
+{
+    EVERY_FRAME = 0,
+    // when the light, or a shadow caster inside its range, moves
+    ON_CHANGE = 1,
+    // once, when the light gets a layer of the shadow array
+    STATIC = 2
+};
+
+// sizes of the faces of the shadow cubes, from the lowest quality tier
+const int ShadowTierCount = 4;
+const int ShadowTierSizes[ShadowTierCount] = {512, 1024, 2048, 4096};
+
+enum class ShadowDepthFormat
+{
+    DEPTH16 = 0,
+    DEPTH24 = 1,
+    DEPTH32F = 2
+};
+
+struct ShadowSettings
+{
+    // tier of the cubes, or highest tier chosen by the automatic resolution
+    int Tier = 1;
+    // the cubes store the distance from the light over its range, which is linear: 16 bits keep it within a few
+    // millimeters for the ranges of the scene
+    ShadowDepthFormat Format = ShadowDepthFormat::DEPTH16;
+    // the tier follows the fraction of the screen height covered by the region lit by the shadowed lights
+    bool AutoResolution = false;
+    // coverage over which the tier i + 1 is used instead of tier i
+    float CoverageThresholds[ShadowTierCount - 1] = {0.15f, 0.4f, 0.8f};
+    // relative band around each threshold in which the current tier is kept: a change renders all the cubes again
+    float Hysteresis = 0.2f;
+};
+
+GLenum GetShadowInternalFormat(ShadowDepthFormat format);
+int SelectShadowTier(int currentTier, float coverage, const ShadowSettings &settings);
+
+struct PointLight
+{
+    glm::vec3 Position = glm::vec3(0.0f);
+    // radiance of the light at the reference distance (white = the original single light)
+    glm::vec3 Color = glm::vec3(1.0f);
+    // the contribution of the light goes to 0 at this distance, which is also the far plane of its shadow cube
+    float Range = 100.0f;
+    bool CastShadows = true;
+    ShadowUpdate Update = ShadowUpdate::ON_CHANGE;
+};
+
+// Assignment of the layers of the shadow cube array to the lights, and choice of the cubes rendered in a frame.
+// The layers go to the shadow casting lights in the order of the list (the others have no shadows); the dirty cubes
+// are rendered within a budget per frame, the ones waiting for longer first.
+class ShadowScheduler
+{
+public:
+    explicit ShadowScheduler(int layerCount);
+
+    // movedBoxes are the world boxes (before and after the move) of the objects moved since the last update
+    void Update(const std::vector<PointLight> &lights, const std::vector<AABB> &movedBoxes, int maxUpdates);
+    // all the cubes are rendered again (e.g. when the content of the array is lost)
+    void InvalidateAll();
+
+    // layer of the light in the shadow array (-1 if the light has no shadows)
+    int GetLayer(size_t light) const;
+    // lights whose cube is rendered in this frame
+    const std::vector<size_t> &GetUpdates() const;
+    // lights with a layer whose cube is out of date
+    int GetPendingCount() const;
+
+private:
+    struct LightState
+    {
+        glm::vec3 Position = glm::vec3(0.0f);
+        float Range = 0.0f;
+        int Layer = -1;
+        bool Dirty = true;
+        // frames since the cube became dirty
+        int Waiting = 0;
+    };
+
+    int _layerCount;
+    std::vector<LightState> _states;
+    std::vector<size_t> _updates;
+    int _pending = 0;
+};
+
+struct ClusterSettings
+{
+    int TilesX = 16;
+    int TilesY = 12;
+    // the slices are exponential in the view depth, between the near and the far plane of the camera
+    int Slices = 24;
+};
+
+// Clustered light culling: the view frustum is split in TilesX x TilesY x Slices clusters, and each cluster gets the
+// list of the lights whose range overlaps it. The lists are built on the CPU (there are no compute shaders in GL 4.1)
+// and read by the shaders from buffer textures, so a point is shaded only by the lights of its cluster.
+class LightClusters
+{
+public:
+    // the index lists are limited to the minimum size of a buffer texture
+    static constexpr size_t MaxLightIndices = 65536;
+
+    void Build(const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection, float nearPlane,
+               float farPlane, const ClusterSettings &settings);
+
+    // (offset, count) in the index lists of each cluster, x first, then y and the slice
+    const std::vector<GLuint> &GetClusterLights() const;
+    const std::vector<uint16_t> &GetLightIndices() const;
+    // tiles along x and y, slices
+    glm::ivec4 GetGridSize() const;
+    // slice of a point = log(view depth) * x + y
+    glm::vec4 GetDepthParams() const;
+
+    int GetNonEmptyClusters() const;
+    int GetMaxLightsPerCluster() const;
+    // pairs (cluster, light) dropped because the index lists were full
+    size_t GetDroppedCount() const;
+
+private:
+    glm::ivec4 _gridSize = glm::ivec4(1, 1, 1, 0);
+    glm::vec4 _depthParams = glm::vec4(0.0f);
+    std::vector<GLuint> _clusterLights;
+    std::vector<uint16_t> _lightIndices;
+    // (cluster, light) pairs found by the culling, sorted by cluster into the index lists
+    std::vector<std::pair<GLuint, uint16_t>> _pairs;
+    std::vector<GLuint> _counts;
+    int _nonEmpty = 0, _maxPerCluster = 0;
+    size_t _dropped = 0;
+};
+
+// data of each light in the light buffer: 2 texels, (position, range) and (color, shadow layer)
+void PackLights(const std::vector<PointLight> &lights, const ShadowScheduler &shadows, std::vector<glm::vec4> &data);
+
+// Buffer textures with the lights and the cluster lists, rewritten every frame
+class LightBuffers
+{
+public:
+    LightBuffers();
+    ~LightBuffers() noexcept;
+    LightBuffers(const LightBuffers &) = delete;
+    LightBuffers &operator=(const LightBuffers &) = delete;
+
+    void Upload(const std::vector<glm::vec4> &lightData, const std::vector<GLuint> &clusterLights,
+                const std::vector<uint16_t> &lightIndices);
+
+    GLuint GetLightDataTexture() const;
+    GLuint GetClusterLightsTexture() const;
+    GLuint GetLightIndicesTexture() const;
+
+private:
+    struct BufferTexture
+    {
+        GLuint Buffer = 0;
+        GLuint Texture = 0;
+    };
+
+    void createBufferTexture(BufferTexture &target, GLenum format);
+    void upload(BufferTexture &target, const void *data, size_t size);
+
+    BufferTexture _lightData, _clusterLights, _lightIndices;
+};
+
+// Cube map array with the shadow cubes of the lights (the depth is the distance from the light over its range).
+// The shadow pass renders into a layer through the layered framebuffer: the geometry shader writes layer * 6 + face
+class ShadowCubeArray
+{
+public:
+    ShadowCubeArray(int size, int layerCount, GLenum internalFormat);
+    ~ShadowCubeArray() noexcept;
+    ShadowCubeArray(const ShadowCubeArray &) = delete;
+    ShadowCubeArray &operator=(const ShadowCubeArray &) = delete;
+
+    // new size and depth format of the cubes: the texture and the framebuffers keep their names, and all the layers
+    // are cleared (the shadow scheduler must render them again)
+    void Reallocate(int size, GLenum internalFormat);
+    // clears the 6 faces of the layer (the other layers keep their cubes)
+    void ClearLayer(int layer);
+    // binds the layered framebuffer, with the viewport of a face
+    void Bind();
+
+    GLuint GetTexture() const;
+    int GetSize() const;
+    int GetLayerCount() const;
+    GLenum GetInternalFormat() const;
+
+private:
+    void allocate();
+
+    GLuint _texture = 0;
+    // layered framebuffer of the shadow pass, and framebuffer with a single face attached for the clears
+    GLuint _FBO = 0, _clearFBO = 0;
+    int _size, _layerCount;
+    GLenum _internalFormat;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <utils/bounds.h>
+#include <utils/mesh.h>
+#include <utils/model.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Settings used to generate the LOD chains at import time
+struct LodSettings
+{
+    // maximum number of levels, including the original mesh
+    int MaxLevels = 4;
+    // ratio of triangles kept between two consecutive levels
+    float Reduction = 0.5f;
+    // maximum quadric error allowed for a single collapse
+    float MaxError = 0.05f;
+};
+
+// Chain of simplified versions of a model. Level 0 is the original model, higher levels are coarser.
+class LodModel
+{
+public:
+    LodModel(Model &model, const LodSettings &settings);
+
+    int GetLevelCount() const;
+    size_t GetTriangleCount(int level) const;
+    void Draw(int level);
+    // meshes of a level, for the draws submitted to the render queue
+    size_t GetMeshCount(int level) const;
+    const Mesh &GetMesh(int level, size_t index) const;
+    // indices of a mesh of a level, also after the CPU copies are dropped
+    GLsizei GetIndexCount(int level, size_t index) const;
+    // releases the vertices and indices of the meshes of all the levels (the chain cannot be generated again)
+    void DropCpuCopies();
+
+private:
+    Model &_model;
+    // _levels[i - 1] contains the meshes of level i
+    std::vector<std::vector<std::unique_ptr<Mesh>>> _levels;
+    std::vector<size_t> _triangleCounts;
+    // _indexCounts[level][mesh], taken when the chain is generated
+    std::vector<std::vector<GLsizei>> _indexCounts;
+};
+
+// LOD chains are generated once per model and shared by all the objects using it
+class MeshLodCache
+{
+public:
+    LodModel *Build(Model &model, const LodSettings &settings = LodSettings());
+    LodModel *Find(const Model &model) const;
+    void DropCpuCopies();
+
+private:
+    std::unordered_map<const Model *, std::unique_ptr<LodModel>> _chains;
+};
+
+struct LodSelectionSettings
+{
+    // fraction of the screen height under which the level i + 1 is used instead of level i
+    std::vector<float> ScreenSizeThresholds = {0.25f, 0.12f, 0.05f};
+    // relative band around each threshold in which the current level is kept, to avoid popping
+    float Hysteresis = 0.15f;
+    // distances from the light (in bounding sphere radii) over which the level i + 1 of the shadow proxy is used
+    std::vector<float> ShadowDistanceThresholds = {10.0f, 25.0f, 50.0f};
+    // the shadow proxy is never finer than this level
+    int ShadowMinLevel = 1;
+};
+
+// fraction of the screen height covered by the sphere, for a perspective projection with the given vertical FOV
+float ProjectedScreenSize(const BoundingSphere &worldSphere, const glm::vec3 &cameraPos, float fovY);
+int SelectLod(int currentLevel, float screenSize, int levelCount, const LodSelectionSettings &settings);
+int SelectShadowLod(const BoundingSphere &worldSphere, const glm::vec3 &lightPos, int levelCount, const LodSelectionSettings &settings);
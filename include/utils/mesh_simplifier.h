@@ -0,0 +1,17 @@
+#pragma once
+
+#include <utils/mesh.h>
+#include <vector>
+
+// Quadric error metric edge collapse (Garland-Heckbert).
+// Vertices are collapsed onto one of the endpoints of the edge, so the simplified triangles reference a subset of
+// the original vertices. Vertices on mesh borders and on attribute seams (= same position, different attributes)
+// are locked, to avoid opening cracks.
+// The function stops when the number of indices falls below targetIndexCount, or when the next collapse would
+// introduce a quadric error greater than maxError (area weighted squared distance, in mesh local units).
+// It returns the error of the last performed collapse.
+float SimplifyMesh(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices,
+                   size_t targetIndexCount, float maxError, std::vector<GLuint> &outIndices);
+
+// Builds a compact vertex buffer containing only the vertices referenced by the indices, and remaps the indices
+void CompactVertices(const std::vector<Vertex> &vertices, std::vector<GLuint> &indices, std::vector<Vertex> &outVertices);
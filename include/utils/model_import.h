@@ -0,0 +1,17 @@
+#pragma once
+
+#include <utils/job_system.h>
+#include <utils/mesh.h>
+#include <string>
+#include <vector>
+
+// CPU side data of a mesh, before the creation of the OpenGL buffers
+struct MeshData
+{
+    std::vector<Vertex> Vertices;
+    std::vector<GLuint> Indices;
+};
+
+// Imports a model file with Assimp, without any OpenGL call: it can be executed by worker threads.
+// With a job system the meshes are converted in parallel. Returns false if the file cannot be loaded.
+bool ImportModel(const std::string &path, std::vector<MeshData> &meshes, JobSystem *jobs = nullptr);
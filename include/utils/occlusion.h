@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <utils/bounds.h>
+#include <utils/shader.h>
+#include <vector>
+
+enum class OcclusionMode
+{
+    DISABLED = 0,
+    // the result of the query issued in the previous frame decides if the object is drawn (CPU side skip)
+    PREVIOUS_FRAME = 1,
+    // the query issued in the current frame drives glBeginConditionalRender, without waiting for its result
+    CONDITIONAL_RENDER = 2
+};
+
+// Hardware occlusion culling with the world AABBs of the objects.
+// The boxes are rasterized with color and depth writes disabled, after the occluders have been drawn.
+// Results are read only when available, so the CPU never waits for the GPU: an object whose query is still pending
+// keeps the visibility of the last available result.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(const GLchar *vertexPath, const GLchar *fragmentPath);
+    ~OcclusionCuller() noexcept;
+    OcclusionCuller(const OcclusionCuller &) = delete;
+    OcclusionCuller &operator=(const OcclusionCuller &) = delete;
+
+    void Resize(size_t objectCount);
+    // reads the available results of the previous queries
+    void CollectResults();
+    // objects whose last available query has found no visible samples
+    bool IsOccluded(size_t objectIndex) const;
+
+    void BeginQueries(const glm::mat4 &viewProjection);
+    // rasterizes the box inside an occlusion query. Returns false if the query has not been issued
+    // (e.g. the camera is inside the box, or the previous query is still pending)
+    bool QueryBox(size_t objectIndex, const AABB &worldBox, const glm::vec3 &cameraPos, float nearPlane);
+    void EndQueries();
+
+    // query for the conditional render of a draw item (0 if it has not been issued in this frame)
+    GLuint GetConditionQuery(size_t objectIndex) const;
+
+    int GetQueriesIssued() const;
+    int GetOccludedCount() const;
+
+private:
+    struct ObjectQuery
+    {
+        GLuint Query = 0;
+        bool Pending = false;
+        bool Occluded = false;
+        // the query has been issued in the current frame
+        bool Issued = false;
+    };
+
+    Shader _shader;
+    GLuint _VAO = 0, _VBO = 0, _EBO = 0;
+    GLint _modelMatrixLocation = -1;
+    std::vector<ObjectQuery> _queries;
+    int _queriesIssued = 0;
+};
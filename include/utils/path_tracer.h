@@ -0,0 +1,202 @@
+#pragma once
+
+#include <utils/density_volumes.h>
+#include <utils/job_system.h>
+#include <utils/lights.h>
+#include <utils/mesh.h>
+#include <utils/triangle_bvh.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// effective radius of the lights in the medium (LIGHT_RADIUS of the media shaders)
+const float ReferenceLightRadius = 30.0f;
+
+// phase functions of the GUI (Mie, Rayleigh, Schlick, uniform), as in the shaders: cosTheta is the cosine between the
+// directions of propagation of the light before and after the scattering
+float EvaluatePhase(int phaseFunction, float g, float cosTheta);
+// cosine of a direction drawn with a probability density equal to the phase function (inverse of its CDF)
+float SamplePhaseCosine(int phaseFunction, float g, float u);
+
+// material of all the surfaces, with the uniforms of the illumination shader
+struct ReferenceMaterial
+{
+    float Kd = 3.0f;
+    float Alpha = 0.4f;
+    float F0 = 0.9f;
+    float Repeat = 1.0f;
+    std::string AlbedoPath;
+};
+
+// Geometry, textures and density volumes of the scene, on the CPU.
+// The meshes are added in world space (so it is built before the CPU copies of the meshes are dropped) and the images
+// are decoded by the first render which needs them. Read-only once built: the render threads share it.
+class ReferenceScene
+{
+public:
+    void AddMesh(const std::vector<Vertex> &vertices, const std::vector<GLuint> &indices, const glm::mat4 &model);
+    void AddVolume(const DensityData &data);
+    void SetMaterial(const ReferenceMaterial &material);
+    // faces of the environment cube, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i
+    void SetEnvironment(const std::array<std::string, 6> &facePaths);
+    // builds the BVH of the triangles added so far
+    void Build();
+    // decodes the albedo and the environment once (any thread); returns false if an image cannot be read
+    bool LoadImages();
+
+    const TriangleBVH &GetBVH() const;
+    size_t GetVolumeCount() const;
+
+private:
+    friend class ReferenceRenderer;
+
+    // 8 bit images as linear values, as the GPU samples them (rows in the order of the file)
+    struct Image
+    {
+        int Width = 0, Height = 0;
+        std::vector<glm::vec3> Texels;
+
+        glm::vec3 SampleBilinear(float s, float t, bool repeat) const;
+    };
+
+    // a density volume with the padding and the bounds of its texture, so the trilinear filter matches the GPU
+    struct Volume
+    {
+        glm::ivec3 Size;
+        AABB Bounds;
+        std::vector<float> Voxels;
+        float MaxDensity = 0.0f;
+
+        float Sample(const glm::vec3 &position) const;
+    };
+
+    glm::vec3 sampleEnvironment(const glm::vec3 &direction) const;
+
+    std::vector<glm::vec3> _positions;
+    // per vertex of the triangles, 3 per triangle
+    std::vector<glm::vec3> _normals;
+    std::vector<glm::vec2> _texCoords;
+    TriangleBVH _bvh;
+    std::vector<Volume> _volumes;
+
+    ReferenceMaterial _material;
+    std::array<std::string, 6> _environmentPaths;
+    Image _albedo;
+    Image _environment[6];
+    std::once_flag _imagesOnce;
+    bool _imagesLoaded = false;
+};
+
+struct ReferenceSettings
+{
+    int Samples = 256;
+    // scattering events in the medium; the paths are also ended by Russian roulette
+    int MaxBounces = 64;
+    // pixels per side of the tiles rendered by a job
+    int TileSize = 32;
+};
+
+// the view, the lights and the medium of the image (the parameters of a GPU frame)
+struct ReferenceFrame
+{
+    glm::mat4 View = glm::mat4(1.0f);
+    glm::mat4 Projection = glm::mat4(1.0f);
+    glm::vec3 CameraPos = glm::vec3(0.0f);
+    int Width = 0, Height = 0;
+    std::vector<PointLight> Lights;
+    glm::vec3 AbsorptionCoeff = glm::vec3(0.0f);
+    glm::vec3 ScatteringCoeff = glm::vec3(0.0f);
+    float G = 0.0f;
+    int PhaseFunction = 0;
+    MediumSettings Medium;
+    // the medium fills the sphere of this radius around the camera, and the environment is at its surface (the sky of
+    // the participating media skybox, drawn at the far plane)
+    float MediumRadius = 100.0f;
+};
+
+// Volumetric path tracer of the scene, the reference of the GPU images.
+// The camera rays and the scattered rays cross the heterogeneous medium by delta tracking: the collisions are drawn
+// against a majorant of the extinction along the ray, and each one is an absorption, a scattering or a null
+// collision with the probabilities of the average coefficients (the spectral weights correct the colored media).
+// At every scattering and at the surfaces, a light chosen at random is sampled with a shadow ray, whose
+// transmittance is estimated by ratio tracking. The paths scatter up to MaxBounces times in the medium; the surfaces
+// reflect the lights only, with the BRDF of the illumination shader. The lights keep the model of the shaders
+// (falloff and window of the media, no falloff on the surfaces), so the difference from a GPU frame measures the
+// estimators of the GPU: single scattering, the march, the shadow cubes and the transmittance of the light paths.
+// Each pass adds a sample per pixel, rendered in tiles by the jobs; the image is the mean of the passes.
+class ReferenceRenderer
+{
+public:
+    ReferenceRenderer(ReferenceScene &scene, JobSystem &jobs);
+    // waits for the render in progress, cancelled
+    ~ReferenceRenderer() noexcept;
+    ReferenceRenderer(const ReferenceRenderer &) = delete;
+    ReferenceRenderer &operator=(const ReferenceRenderer &) = delete;
+
+    // all the passes, on the calling thread and the workers (offline)
+    void Render(const ReferenceFrame &frame, const ReferenceSettings &settings);
+    // the passes run as background jobs, so the frames go on; a render in progress is cancelled first
+    void Start(const ReferenceFrame &frame, const ReferenceSettings &settings);
+    // the render stops after the pass in progress, without waiting for it (the image keeps the passes completed)
+    void Cancel();
+
+    bool IsRunning() const;
+    int GetCompletedSamples() const;
+    double GetElapsedMs() const;
+    int GetWidth() const;
+    int GetHeight() const;
+    // RGBA mean of the passes completed, rows from the bottom (as read by OpenGL); only when not running
+    std::vector<float> GetImage() const;
+
+private:
+    // cancels and waits for the render in progress
+    void stop();
+    void setup(const ReferenceFrame &frame, const ReferenceSettings &settings);
+    void renderPasses();
+    void renderTile(size_t tile, int pass);
+    glm::vec3 tracePath(glm::vec3 origin, glm::vec3 direction, uint32_t &rng) const;
+    // radiance of a light reaching the point, with its direction and the transmittance and visibility of the shadow ray
+    glm::vec3 sampleLight(const glm::vec3 &position, uint32_t &rng, glm::vec3 &lightDir, bool surface) const;
+    glm::vec3 estimateTransmittance(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, uint32_t &rng) const;
+    float density(const glm::vec3 &position) const;
+    // upper bound of the density along the segment
+    float majorantDensity(const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const;
+    // distance where the ray leaves the sphere of the medium
+    float mediumExit(const glm::vec3 &origin, const glm::vec3 &direction) const;
+    glm::vec3 shadeSurface(const TriangleHit &hit, const glm::vec3 &position, const glm::vec3 &viewDir, uint32_t &rng) const;
+
+    ReferenceScene &_scene;
+    JobSystem &_jobs;
+
+    ReferenceFrame _frame;
+    ReferenceSettings _settings;
+    glm::mat4 _inverseViewProjection;
+    glm::vec3 _extinction;
+    int _tileColumns = 0, _tileRows = 0;
+    // sum of the samples of each pixel (written by the tiles, which do not overlap)
+    std::vector<glm::vec3> _sum;
+
+    JobCounter _running;
+    std::atomic<bool> _cancel{false};
+    std::atomic<int> _completedSamples{0};
+    std::atomic<int64_t> _startUs{0}, _endUs{0};
+};
+
+// error of a GPU image against the reference (both RGBA, of the same size)
+struct ImageError
+{
+    double Rmse = 0.0;
+    // mean of (gpu - reference)^2 / (reference^2 + 0.01): the relative error, bounded in the dark pixels
+    double RelMse = 0.0;
+    double MeanAbsolute = 0.0;
+};
+
+// the 8 bit GPU images (the window) are compared with the reference clamped to [0, 1]; the error image has the absolute
+// difference of each pixel
+ImageError CompareImages(const std::vector<float> &gpu, const std::vector<float> &reference, bool clampReference,
+                         std::vector<float> *errorImage = nullptr);
+// PNG or EXR file written by the frame capture, as RGBA floats with the rows from the bottom; the PNG values are in [0, 1]
+bool LoadCapturedImage(const std::string &path, int &width, int &height, std::vector<float> &rgba);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Scoped CPU and GPU zones on a single timeline, exported as a Chrome trace (JSON, read by chrome://tracing and
+// Perfetto). Nothing is recorded until the capture starts, and a zone outside a capture costs an atomic load.
+// The CPU zones of each thread go to a buffer owned by that thread: the writer never locks, and the export reads only
+// the zones already published. The GPU zones are pairs of GL_TIMESTAMP queries read back a few frames later, moved
+// on the CPU clock with the offset measured by CalibrateGpuProfiler.
+// The zone names must be string literals (or live until the export).
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+// GL thread only: the zone covers the execution of the GL commands issued in the scope; it is also a pass of the GL
+// call accounting
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
+
+// the capture can begin before the GL context exists, to keep the startup (the GPU zones wait for the calibration)
+void BeginProfilerCapture();
+// stops the capture and writes its trace; returns false if the file cannot be written
+bool EndProfilerCapture(const std::string &path);
+bool IsProfilerCapturing();
+// name of the calling thread in the trace
+void SetProfilerThreadName(const char *name);
+// microseconds from the start of the application, on the clock of the trace
+int64_t ProfilerNow();
+// zones dropped because a buffer was full
+size_t GetProfilerDroppedCount();
+
+// GL thread, with the context current: creates the queries and measures the offset between the GPU and CPU clocks
+void CalibrateGpuProfiler();
+// GL thread, once per frame: reads the GPU zones whose queries are available
+void CollectGpuProfileZones();
+// GL thread, before the context is destroyed
+void ReleaseGpuProfiler();
+
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char *name);
+    ~ProfileScope() noexcept;
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *_name;
+    // -1 if the capture was not running when the scope began
+    int64_t _start;
+};
+
+class GpuProfileScope
+{
+public:
+    explicit GpuProfileScope(const char *name);
+    ~GpuProfileScope() noexcept;
+    GpuProfileScope(const GpuProfileScope &) = delete;
+    GpuProfileScope &operator=(const GpuProfileScope &) = delete;
+
+private:
+    // slot of the zone in the query ring (-1 if it is not recorded)
+    int _zone;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <utils/density_volumes.h>
+#include <utils/gl_state_cache.h>
+#include <utils/mesh.h>
+#include <utils/uniform_ring.h>
+#include <vector>
+
+// binding points of the uniform blocks shared by the shaders
+const GLuint PassBlockBinding = 0;
+const GLuint ObjectBlockBinding = 1;
+
+// std140 layout of the PassData block: constants shared by all the draws of a pass
+struct PassUniforms
+{
+    glm::mat4 ViewMatrix = glm::mat4(1.0f);
+    glm::mat4 ProjectionMatrix = glm::mat4(1.0f);
+    glm::mat4 InverseViewProjMatrix = glm::mat4(1.0f);
+    glm::mat4 ShadowMatrices[6] = {};
+    glm::vec3 WLightPos = glm::vec3(0.0f);
+    float G = 0.0f;
+    glm::vec3 WCameraPos = glm::vec3(0.0f);
+    float Width = 0.0f;
+    glm::vec3 AbsorptionCoeff = glm::vec3(0.0f);
+    float Height = 0.0f;
+    glm::vec3 ScatteringCoeff = glm::vec3(0.0f);
+    // adaptive ray marching of the media
+    float TransmittanceThreshold = 0.01f;
+    GLint MinSteps = 4;
+    GLint MaxSteps = 32;
+    float StepsPerOpticalDepth = 4.0f;
+    GLint StepHeatmap = 0;
+    // the in-scattering is not marched by the media shaders, it is added by the epipolar pass
+    GLint ExternalInscattering = 0;
+    // light of the shadow pass: layer of the shadow cube array and range (far plane of its cube)
+    GLint ShadowLayer = 0;
+    float ShadowFarPlane = 1.0f;
+    GLint Padding = 0;
+    // clustered lights: view-projection of the camera and size of the cluster grid
+    glm::mat4 ClusterViewProj = glm::mat4(1.0f);
+    glm::ivec4 ClusterSize = glm::ivec4(1);
+    glm::vec4 ClusterDepth = glm::vec4(0.0f);
+    // density volumes: world bounds, with the density multiplier (VolumeMin.w) and the maximum density (VolumeMax.w)
+    glm::vec4 VolumeMin[MaxDensityVolumes] = {};
+    glm::vec4 VolumeMax[MaxDensityVolumes] = {};
+    GLint VolumeCount = 0;
+    // density of the medium outside the volumes
+    float AmbientDensity = 1.0f;
+    GLint Padding2[2] = {};
+};
+static_assert(sizeof(PassUniforms) == 912, "PassUniforms must match the std140 layout of PassData");
+
+// std140 layout of the ObjectData block: constants of a single draw
+struct ObjectUniforms
+{
+    glm::mat4 ModelMatrix;
+    // a mat3 in std140 has columns of 4 floats: we use a mat4 and the shaders take its upper-left 3x3 part
+    glm::mat4 NormalMatrix;
+    GLint FaceMask;
+    GLint Padding[3];
+};
+static_assert(sizeof(ObjectUniforms) == 144, "ObjectUniforms must match the std140 layout of ObjectData");
+
+struct TextureBinding
+{
+    GLuint Unit;
+    GLenum Target;
+    GLuint Texture;
+};
+
+// textures used together by a draw; the id (unique, < 256) is part of the sort key
+struct TextureSet
+{
+    uint8_t Id = 0;
+    std::vector<TextureBinding> Bindings;
+};
+
+// A draw of a mesh with all the state it needs
+struct DrawItem
+{
+    // items of a lower layer are always drawn first (e.g. the skybox is drawn after the objects)
+    uint8_t Layer = 0;
+    GLuint Program = 0;
+    const TextureSet *Textures = nullptr;
+    GLuint VertexArray = 0;
+    GLsizei IndexCount = 0;
+    GLenum DepthFunc = GL_LESS;
+    GLuint Subroutine = GL_INVALID_INDEX;
+    // query of a conditional render (0 for unconditional draws)
+    GLuint ConditionQuery = 0;
+
+    // per draw uniforms, written in the ObjectData block of the draw
+    bool HasTransform = false;
+    glm::mat4 ModelMatrix = glm::mat4(1.0f);
+    glm::mat3 NormalMatrix = glm::mat3(1.0f);
+    GLint FaceMask = -1;
+};
+
+// Draws submitted by the passes are sorted by a key built from (layer, depth state, program, textures, vertex array),
+// so consecutive draws share as much state as possible, and the state changes go through the state cache.
+// The uniforms of the pass and of each draw are streamed through the uniform ring buffer.
+class RenderQueue
+{
+public:
+    RenderQueue(GLStateCache &state, UniformRingBuffer &uniforms);
+
+    // the constants are bound to the PassData block of the draws flushed from now on
+    void SetPassUniforms(const PassUniforms &pass);
+
+    void Submit(const DrawItem &item);
+    // an item for the mesh, with the state of the base item; the index count is given by the caller (the CPU copy of
+    // the mesh may be dropped)
+    void Submit(const DrawItem &base, const Mesh &mesh, GLsizei indexCount);
+    // sorts and draws the submitted items, then empties the queue
+    void Flush();
+
+    // draws since the last call of ResetStats
+    size_t GetDrawCount() const;
+    void ResetStats();
+
+private:
+    static uint64_t makeKey(const DrawItem &item);
+
+    GLStateCache &_state;
+    UniformRingBuffer &_uniforms;
+    std::vector<DrawItem> _items;
+    std::vector<uint64_t> _keys;
+    std::vector<uint32_t> _order, _scratch;
+    // offset in the ring of the ObjectData of each item
+    std::vector<size_t> _objectOffsets;
+    size_t _drawCount = 0;
+};
+
+// LSD radix sort of the indices of the keys, 8 bits per pass. The sort is stable, and the passes
+// on digits equal for all the keys are skipped
+void RadixSortKeys(const std::vector<uint64_t> &keys, std::vector<uint32_t> &order, std::vector<uint32_t> &scratch);
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// unit of the cube in the skybox pass (after the density volumes)
+const GLuint SkyCacheUnit = 12;
+
+struct SkyCacheSettings
+{
+    bool Enabled = true;
+    // distance the camera moves before the sky is rendered again
+    float MoveThreshold = 0.5f;
+};
+
+// Cube map of the participating media skybox.
+// The media sky depends only on the view direction, the camera position, the lights and the medium: it is rendered
+// in the 6 faces of the cube (RGBA16F) when one of them changes, and the skybox pass samples it. The parameters of the
+// last render are kept as a list of values: any change of a value, or a move of the camera over the threshold, makes
+// the cube stale. Invalidate is called when the shadow cubes are rendered again.
+class SkyCache
+{
+public:
+    explicit SkyCache(int size = 256);
+    ~SkyCache() noexcept;
+    SkyCache(const SkyCache &) = delete;
+    SkyCache &operator=(const SkyCache &) = delete;
+
+    bool IsStale(const glm::vec3 &cameraPos, const std::vector<float> &parameters, float moveThreshold) const;
+    void Invalidate();
+    // binds the framebuffer of the face, with the viewport of the face (the faces are in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i)
+    void BindFace(int face);
+    // the cube has been rendered for the given state
+    void MarkRendered(const glm::vec3 &cameraPos, const std::vector<float> &parameters);
+
+    // rotation from the world to the view of the face, and projection of the face (90 degrees field of view)
+    static glm::mat4 GetFaceView(int face);
+    static glm::mat4 GetFaceProjection();
+
+    GLuint GetTexture() const;
+    int GetSize() const;
+    // number of renders of the cube since the start
+    int GetRenderCount() const;
+
+private:
+    GLuint _texture = 0, _FBO = 0;
+    int _size;
+    bool _valid = false;
+    glm::vec3 _cameraPos = glm::vec3(0.0f);
+    std::vector<float> _parameters;
+    int _renderCount = 0;
+};
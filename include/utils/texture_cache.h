@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <utils/job_system.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Precompiled textures.
+// The first time a texture is loaded, the source images are decoded, the full mipmap chain is computed on the CPU
+// and the levels are block compressed (if the OpenGL context supports it), then everything is saved in a cache
+// file placed next to the source. The following loads memory-map the cache file and upload the levels as they are,
+// without decoding the images or generating the mipmaps at runtime.
+// The cache is rebuilt when a source image is newer, or when its format is not supported by the current context.
+
+// extension appended to the path of the source image (or of the cube map folder) to get the path of the cache
+constexpr const char *TextureCacheExtension = ".rtc";
+
+enum class TextureCacheFormat : uint32_t
+{
+    RGBA8 = 0,
+    BC1 = 1, // opaque images, with GL_EXT_texture_compression_s3tc
+    BC3 = 2, // images with alpha, with GL_EXT_texture_compression_s3tc
+    BC7 = 3, // with GL_ARB_texture_compression_bptc
+};
+
+// the best format supported by the current context
+TextureCacheFormat ChooseTextureCacheFormat(bool hasAlpha);
+bool IsTextureCacheFormatSupported(TextureCacheFormat format);
+
+// a level of a face of the texture; the offset is from the start of the file
+struct TextureCacheLevel
+{
+    uint32_t Width, Height;
+    uint64_t Offset, Size;
+};
+
+// A cache file mapped in memory
+class TextureCacheFile
+{
+public:
+    TextureCacheFile() = default;
+    ~TextureCacheFile() noexcept;
+    TextureCacheFile(const TextureCacheFile &) = delete;
+    TextureCacheFile &operator=(const TextureCacheFile &) = delete;
+
+    // decodes the sources (1 image, or the 6 faces of a cube map) and writes the cache file; with a job system the
+    // faces are decoded and the levels encoded in parallel
+    static bool Build(const std::vector<std::string> &sourcePaths, const std::string &cachePath, JobSystem *jobs = nullptr);
+
+    bool Open(const std::string &cachePath);
+    void Close();
+    bool IsOpen() const;
+
+    // uploads all the faces and levels to the texture bound to the target (GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP)
+    void Upload(GLenum target) const;
+    // uploads a single level: the pixels are read from the pointer, or from the offset in the bound unpack buffer
+    void UploadLevel(GLenum target, int face, int level, const void *pixels) const;
+
+    TextureCacheFormat GetFormat() const;
+    bool IsCompressed() const;
+    // internal format for glCompressedTexImage2D, or GL_RGBA8
+    GLenum GetInternalFormat() const;
+    int GetFaceCount() const;
+    int GetLevelCount() const;
+    const TextureCacheLevel &GetLevel(int face, int level) const;
+    const unsigned char *GetLevelData(int face, int level) const;
+    // bytes of all the faces and levels, as they are stored in the texture
+    size_t GetTotalSize() const;
+
+private:
+    void *_mapping = nullptr;
+    size_t _mappingSize = 0;
+#ifdef _WIN32
+    void *_file = nullptr;
+    void *_fileMapping = nullptr;
+#endif
+    TextureCacheFormat _format = TextureCacheFormat::RGBA8;
+    int _faceCount = 0;
+    int _levelCount = 0;
+    const TextureCacheLevel *_levels = nullptr;
+};
+
+// opens the cache of the sources, building it if it is missing, outdated or not supported
+bool LoadTextureCache(const std::vector<std::string> &sourcePaths, const std::string &cachePath, TextureCacheFile &cache,
+                      JobSystem *jobs = nullptr);
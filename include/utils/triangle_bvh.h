@@ -0,0 +1,61 @@
+#pragma once
+
+#include <utils/bounds.h>
+#include <cstdint>
+#include <vector>
+
+// closest intersection of a ray: distance along the ray, triangle (in the order given to Build) and barycentric
+// coordinates of the hit point (weights of the second and third vertex)
+struct TriangleHit
+{
+    float T;
+    uint32_t Triangle;
+    float U, V;
+};
+
+// Static bounding volume hierarchy over the triangles of a scene, for the rays of the CPU renderers.
+// The nodes are split with the surface area heuristic on bins of the centroids, and stored flattened in depth-first
+// order: the left child of an internal node follows it, the right one is at the offset stored in the node. The
+// triangles are reordered so each leaf has a contiguous range of them. The tree is read-only after Build, so any
+// number of threads can trace rays in parallel.
+class TriangleBVH
+{
+public:
+    // positions of the triangles, 3 per triangle
+    void Build(const std::vector<glm::vec3> &positions);
+
+    // returns false if the ray hits no triangle closer than tMax
+    bool Intersect(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, TriangleHit &hit) const;
+    // any hit closer than tMax (shadow rays): stops at the first triangle found
+    bool Occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const;
+
+    const AABB &GetBounds() const;
+    size_t GetTriangleCount() const;
+    size_t GetNodeCount() const;
+    int GetDepth() const;
+
+private:
+    struct Node
+    {
+        AABB Box;
+        // leaf: first triangle and number of triangles; internal node: index of the right child, and 0
+        uint32_t Offset;
+        uint32_t Count;
+    };
+
+    // the vertex and the two edges of the Moller-Trumbore test, and the index of the triangle given to Build
+    struct Triangle
+    {
+        glm::vec3 V0, Edge1, Edge2;
+        uint32_t Index;
+    };
+
+    uint32_t buildNode(std::vector<uint32_t> &order, const std::vector<AABB> &boxes, const std::vector<glm::vec3> &centroids,
+                       uint32_t first, uint32_t count, int depth);
+    template <bool AnyHit>
+    bool traverse(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, TriangleHit &hit) const;
+
+    std::vector<Node> _nodes;
+    std::vector<Triangle> _triangles;
+    int _depth = 0;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <vector>
+
+// Ring of uniform data for the frames in flight.
+// A single uniform buffer is split in a slot per frame. The data of the frame is appended to a CPU staging copy and
+// copied into the slot with a single map per flush (GL_MAP_UNSYNCHRONIZED_BIT: the GPU never reads the ranges being
+// written), then the draws bind their range with glBindBufferRange. A fence per slot guarantees that the GPU has
+// finished the frame which used the slot before it is written again.
+class UniformRingBuffer
+{
+public:
+    static constexpr size_t InvalidOffset = (size_t)-1;
+
+    UniformRingBuffer(size_t frameSize = 1024 * 1024, size_t frameCount = 3);
+    ~UniformRingBuffer() noexcept;
+    UniformRingBuffer(const UniformRingBuffer &) = delete;
+    UniformRingBuffer &operator=(const UniformRingBuffer &) = delete;
+
+    // moves to the next slot, waiting for the GPU only if it is still using it
+    void BeginFrame();
+    // the fence of the slot is inserted after the last draw of the frame
+    void EndFrame();
+
+    // appends the data to the frame and returns its offset in the buffer (InvalidOffset if the slot is full)
+    size_t Allocate(const void *data, size_t size);
+    // copies the data allocated since the last upload into the buffer, before the draws which use it
+    void Upload();
+
+    GLuint GetBuffer() const;
+    // bytes used by the current frame
+    size_t GetFrameUsage() const;
+    size_t GetFrameSize() const;
+
+private:
+    GLuint _buffer = 0;
+    size_t _frameSize;
+    size_t _alignment = 256;
+    std::vector<GLsync> _fences;
+    size_t _slot = 0;
+    std::vector<unsigned char> _staging;
+    size_t _cursor = 0;
+    size_t _uploaded = 0;
+    bool _overflowReported = false;
+};
+
+// assigns a binding point to a uniform block of the program (GLSL 4.10 has no binding qualifier for blocks)
+void BindUniformBlock(GLuint program, const char *blockName, GLuint bindingPoint);
@@ -49,6 +49,27 @@ positive Z axis points "outside" the screen
 
 // classes developed during lab lectures to manage shaders, to load models, and for FPS camera
 #include <utils/utils.h>
+#include <utils/bounds.h>
+#include <utils/bvh.h>
+#include <utils/lod.h>
+#include <utils/occlusion.h>
+#include <utils/asset_streamer.h>
+#include <utils/render_queue.h>
+#include <utils/frame_mailbox.h>
+#include <utils/dynamic_resolution.h>
+#include <utils/epipolar.h>
+#include <utils/sky_cache.h>
+#include <utils/lights.h>
+#include <utils/density_volumes.h>
+#include <utils/input_log.h>
+#include <utils/profiler.h>
+#include <utils/gl_call_accounting.h>
+#include <utils/gpu_memory.h>
+#include <utils/frame_graph.h>
+#include <utils/frame_capture.h>
+#include <utils/batch_render.h>
+#include <utils/job_system.h>
+#include <utils/path_tracer.h>
 
 // we load the GLM classes used in the application
 #include <glm/glm.hpp>
@@ -64,6 +85,12 @@ positive Z axis points "outside" the screen
 #include <string>
 #include <vector>
 #include <array>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
 using std::string;
 using std::vector;
 using std::array;
@@ -71,20 +98,68 @@ using std::array;
 #define SHADERS_DIR_PATH "shaders"
 #define TEXTURES_DIR_PATH "../textures"
 #define MODELS_DIR_PATH "../models"
+#define VOLUMES_DIR_PATH "../volumes"
 
 void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void char_callback(GLFWwindow *window, unsigned int codepoint);
+void refresh_callback(GLFWwindow *window);
+void ProcessKey(GLFWwindow *window, int key, int action);
+void ProcessMouse(double xpos, double ypos);
+bool ParseArguments(int argc, char **argv);
+void ShowGLCallCounters(const char *name, const GLCallCounters &counters);
 void apply_camera_movements();
 void SetupShader(int shader_program);
 void PrintCurrentShader(int subroutine);
-void RenderObjects(Shader &shader);
-void PerformShadowMapping(Shader &shadowShader, GLuint depthMapFBO);
-void PerformIlluminationPass(Shader &shader, glm::vec3 &absorptionCoeff, glm::vec3 &scatteringCoeff, float gCoeff);
-void PerformSkyboxPass(Shader &shader, Model &skyboxCube, glm::vec3 &absorptionCoeff, glm::vec3 &scatteringCoeff, float gCoeff);
-void RenderAxis(Shader& shader, ArrowLine& xAxis, ArrowLine& yAxis, ArrowLine& zAxis);
+struct ObjectDraw;
+struct FramePacket;
+struct MarchSettings;
+void SubmitObjects(const DrawItem &base, const vector<ObjectDraw> &draws, const glm::mat4 &viewMatrix);
+void SubmitObject(const DrawItem &base, const ObjectDraw &draw, const glm::mat4 &viewMatrix);
+void SubmitLod(const DrawItem &item, const LodModel &lodModel, int level);
+void AddSceneObject(std::unique_ptr<Object> object, Model &model, const Bounds &localBounds, LodModel *lodModel, bool occluder);
+void RenderObjectsWithOcclusion(Shader &shader, const FramePacket &packet);
+void SelectObjectsLod();
+int SelectShadowCasterLod(size_t objectIndex, const glm::vec3 &lightPos);
+void UpdateSceneBounds();
+void CullObjectsForCamera();
+struct ShadowCubeUpdate;
+int CullObjectsForLight(ShadowCubeUpdate &update);
+void ComputeShadowTransforms(const PointLight &light, glm::mat4 shadowTransforms[6]);
+void UpdateShadowQuality();
+void UpdateLights();
+void ScatterLights();
+ObjectDraw MakeObjectDraw(size_t objectIndex, int lodLevel, GLint faceMask);
+void BuildFramePacket(FramePacket &packet, const glm::vec3 &absorptionCoeff, const glm::vec3 &scatteringCoeff, float gCoeff);
+struct RenderStats;
+bool NeedsRedraw(const RenderStats &stats);
+void LoadBatch();
+void ApplyBatchJob(glm::vec3 &absorptionCoeff, glm::vec3 &scatteringCoeff, float &gCoeff);
+bool SetBatchTile(FramePacket &packet, size_t texturesPending);
+void FinishBatch();
+void CreateReferenceScene();
+ReferenceFrame MakeReferenceFrame(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix, int imageWidth, int imageHeight,
+                                  const glm::vec3 &absorptionCoeff, const glm::vec3 &scatteringCoeff, float gCoeff);
+void StartReference(const glm::vec3 &absorptionCoeff, const glm::vec3 &scatteringCoeff, float gCoeff);
+void UpdateReference();
+void RenderBatchReferences();
+void PerformShadowMapping(Shader &shadowShader, const FramePacket &packet);
+void SetMarchUniforms(PassUniforms &pass, const MarchSettings &march);
+void SetLightUniforms(PassUniforms &pass, const FramePacket &packet);
+void SetMediumUniforms(PassUniforms &pass, const MediumSettings &medium);
+void PerformEpipolarPass(const FramePacket &packet, GLuint inscatteringFramebuffer);
+void PerformIlluminationPass(Shader &shader, const FramePacket &packet);
+vector<float> GetSkyParameters(const FramePacket &packet, size_t texturesPending);
+void SetSkyboxUniforms(PassUniforms &pass, const FramePacket &packet, const glm::mat4 &viewRotation, const glm::mat4 &projection);
+void RenderSkyCache(Shader &shader, const LodModel &skyboxCube, const FramePacket &packet, const vector<float> &parameters);
+void PerformSkyboxPass(Shader &shader, Shader &cachedShader, const LodModel &skyboxCube, const FramePacket &packet, bool cached);
+void RenderAxis(Shader& shader, ArrowLine& xAxis, ArrowLine& yAxis, ArrowLine& zAxis, const FramePacket &packet);
 ArrowLine CreateArrowLine(const vector<glm::vec3>& pointsPos, const glm::vec4& color);
-void CreateSceneObjects(Model& planeModel, Model& sphereModel, Model& cubeModel);
-void PerformSkyBoxPass(Shader& shader, Model &skyboxCube);
+void CreateSceneObjects(Model& planeModel, Model& sphereModel, Model& cubeModel, MeshLodCache& lodCache);
+void CreateDensityVolumes();
+void PerformSkyBoxPass(Shader& shader, const LodModel &skyboxCube, const FramePacket &packet);
 
 
 
@@ -109,6 +184,86 @@ bool firstMouse = true;
 GLfloat deltaTime = 0.0f;
 GLfloat lastFrame = 0.0f;
 
+// INPUT RECORDING AND REPLAY
+// --record <file> logs the input and the GUI parameters of the session, --replay <file> plays it back with the
+// recorded time steps; --headless replays it in a hidden window and closes the application at the end
+InputLog inputLog;
+string recordPath, replayPath;
+bool headless = false;
+// --trace <file> captures the CPU and GPU zones from the launch to the exit, written as a Chrome trace
+string tracePath;
+
+// GPU MEMORY
+// --memory-budget <MB> flags the report over the budget, --drop-cpu-copies releases the mesh data after the scene
+// setup, --memory-report prints the report at the exit (and the triangles of the LOD chains at the start)
+MemorySettings memorySettings;
+bool memoryReport = false;
+
+// FRAME CAPTURE
+// --capture <prefix> writes every frame (without the GUI) as <prefix>_<frame>.png, or .exr with --capture-exr;
+// F12 or the GUI button write a single screenshot. The pixels are read back and encoded without stalling the frames
+FrameCapture *frameCapture = nullptr;
+string capturePrefix;
+CaptureFormat captureFormat = CaptureFormat::PNG;
+bool screenshotRequested = false;
+int capturedFrames = 0, screenshots = 0;
+
+// BATCH RENDERING
+// --batch <file> renders the jobs of the file (see batch_render.h) in a hidden window, and writes their images and
+// batch_report.csv in --batch-output <dir>. The images larger than --batch-tile <px> (or than the limits of the GPU) are
+// rendered in tiles. A tile is published per frame: the GPU renders a tile while the previous ones are read back and
+// encoded by a thread per core
+string batchPath, batchOutput = ".";
+int batchTileLimit = 4096;
+vector<BatchJob> batchJobs;
+vector<string> batchFiles;
+vector<BatchJobTiming> batchTimings;
+// job and tile published next, and tiles of the job
+size_t batchJob = 0, batchTile = 0;
+vector<BatchTile> batchTiles;
+// frames rendered before the first tile, while the textures are uploaded
+int batchWarmupFrames = 4;
+int64_t batchStartUs = -1;
+
+// REFERENCE RENDERS
+// the CPU path tracer (see path_tracer.h) renders the ground truth of a view with the workers of the job system. The
+// GUI renders the current view in background jobs while the frames go on, and captures the GPU frame of the same view:
+// when the samples are done (or the render is stopped) reference_<n>.exr, the GPU frame reference_<n>_gpu.<ext> and
+// the difference reference_<n>_error.exr are written. With --capture every frame is already written under its prefix,
+// so the GUI does not start references. In a batch, the jobs with reference=<samples> are rendered after the GPU images
+ReferenceScene *referenceScene = nullptr;
+ReferenceRenderer *referenceRenderer = nullptr;
+ReferenceSettings referenceSettings;
+int references = 0;
+string referenceName;
+// the GPU frame is captured by the next packet; the comparison waits for the reference and for the written capture
+bool referenceCaptureRequested = false;
+bool referencePending = false;
+// captures written or dropped before the request, and samples shown by the counter of the GUI
+int referenceCaptureCount = 0, referenceShownSamples = 0;
+bool referenceCompared = false;
+ImageError referenceError;
+
+// EVENT-DRIVEN REDRAW
+// the input callbacks and the animated state (held movement keys, textures streaming in, shadow cubes waiting for
+// their update) bump the revision of the scene. When the revision has not changed for SettleFrames frames (so the
+// occlusion queries, the LOD hysteresis and the resolution controller have converged) no packet is published: the
+// window keeps the last frame, and the update loop waits for the events instead of polling them. --continuous, a
+// replay, a recording, a capture or a batch render every frame
+struct IdleSettings
+{
+    bool Enabled = true;
+    int SettleFrames = 8;
+    // the GUI is updated at least this often while idle
+    double WaitTimeoutS = 0.25;
+};
+IdleSettings idleSettings;
+// the first frame is a change
+uint64_t sceneRevision = 1, renderedRevision = 0;
+int settleFrames = 0;
+bool idleFrame = false;
+int renderedFrames = 0, skippedFrames = 0;
+
 //CAMERA PARAMETERS
 // View matrix: the camera moves, so we just set to indentity now
 glm::mat4 view = glm::mat4(1.0f);
@@ -117,8 +272,31 @@ glm::mat4 projection = glm::mat4(1.0f);
 Camera camera(glm::vec3(0.0f, 0.0f, 7.0f), GL_FALSE);
 bool detachMouseFromCamera = false;
 
-// point light pos
-glm::vec3 lightPos = glm::vec3(0.0f, 30.0f, 15.0f);
+// LIGHTS
+// the first light is the point light of the GUI (the epipolar lines follow it), the others are scattered in the room
+vector<PointLight> lights;
+int extraLightCount = 0;
+const int MAX_EXTRA_LIGHTS = 64;
+float extraLightRange = 8.0f;
+// layers of the shadow cube array, and cubes rendered per frame at most
+const int SHADOW_LAYERS = 8;
+ShadowScheduler shadowScheduler(SHADOW_LAYERS);
+int maxShadowUpdates = 2;
+ShadowCubeArray *shadowCubes = nullptr;
+// resolution and depth format of the cubes: the update thread chooses them, the render thread reallocates the array
+ShadowSettings shadowSettings;
+int shadowTier = shadowSettings.Tier;
+ShadowDepthFormat shadowFormat = shadowSettings.Format;
+float shadowCoverage = 0.0f;
+// lights of each cluster of the view frustum, built by the update thread and read by the shaders from buffer textures
+LightClusters lightClusters;
+ClusterSettings clusterSettings;
+LightBuffers *lightBuffers = nullptr;
+
+// HETEROGENEOUS MEDIA
+// the density volumes multiply the coefficients of the medium inside their bounds (created once, never modified)
+vector<DensityVolume *> densityVolumes;
+MediumSettings mediumSettings;
 
 // weight for the diffusive component
 GLfloat Kd = 3.0f;
@@ -132,14 +310,206 @@ GLfloat repeat = 1.0;
 
 std::vector<std::unique_ptr<Object>> objects;
 
+// CULLING
+// local space bounds and BVH proxy of each object (same indices of the objects vector)
+vector<Bounds> objectsLocalBounds;
+vector<int> objectsProxies;
+BVH sceneBVH(0.2f);
+bool frustumCulling = true;
+// indices of the objects which survived the camera culling
+vector<size_t> cameraVisibleObjects;
+// world matrices of the objects (computed once per frame), world boxes of the objects, their new boxes (computed by
+// the jobs before the BVH update), and boxes (before and after the move) of the objects moved in this frame
+vector<glm::mat4> objectsWorldMatrices;
+vector<AABB> objectsWorldBoxes;
+vector<AABB> objectsNewBoxes;
+vector<AABB> movedBoxes;
+
+struct CullingStats
+{
+    int cameraVisible = 0;
+    int cameraNodesTested = 0;
+    // summed over the shadow cubes rendered in the frame
+    int shadowCasters = 0;
+    int shadowFaces = 0;
+    int shadowNodesTested = 0;
+};
+CullingStats cullingStats;
+
+// LEVEL OF DETAIL
+// LOD chain of each object (nullptr if the model has no chain) and level currently selected for the camera
+vector<LodModel *> objectsLods;
+vector<int> objectsLodLevels;
+LodSelectionSettings lodSelectionSettings;
+bool lodEnabled = true;
+size_t cameraTriangles = 0, shadowTriangles = 0;
+
+// OCCLUSION CULLING
+// big objects (floor, walls) are drawn first as occluders, the other objects are tested against them
+vector<bool> objectsOccluders;
+OcclusionCuller *occlusionCuller = nullptr;
+int occlusionMode = (int)OcclusionMode::PREVIOUS_FRAME;
+// draws skipped by the previous frame queries (written by the render thread)
+int occlusionSkipped = 0;
+
+// RENDER QUEUE
+// the passes submit their draws to the queue, which sorts them and drops the redundant state changes
+GLStateCache glState;
+RenderQueue *renderQueue = nullptr;
+// per pass and per draw constants of the frames in flight
+UniformRingBuffer *uniformRing = nullptr;
+// model of each object, drawn when the object has no LOD chain
+vector<Model *> objectsModels;
+// textures used by the draws of the illumination and skybox passes
+TextureSet illuminationTextures, skyboxTextures, skyCacheTextures;
+
 CubeMap *cubeMap = nullptr;
 Texture2D *debugTex;
 
-const unsigned int SHADOW_WIDTH = 2048, SHADOW_HEIGHT = 2048;
-constexpr float aspect = (float)SHADOW_WIDTH / (float)SHADOW_HEIGHT;
+// JOB SYSTEM
+// the workers load the assets (background jobs) and split the scene update of the frames; the jobs calling OpenGL
+// run on the render thread at the start of each frame. --job-benchmark measures the scheduling overhead and exits
+JobSystem *jobSystem = nullptr;
+bool jobBenchmark = false;
+// objects per job in the parallel loops over the objects
+const size_t OBJECTS_PER_JOB = 64;
+
+// ASSET STREAMING
+AssetStreamer *assetStreamer = nullptr;
+// maximum time spent each frame to upload the decoded textures
+float streamingBudgetMs = 2.0f;
+
+// DYNAMIC RESOLUTION
+// the scene is rendered in an offscreen target whose resolution follows the GPU time of the frame, then upscaled
+SceneTarget *sceneTarget = nullptr;
+GpuTimer *gpuTimer = nullptr;
+// the passes of a frame are declared on the graph, which orders them, culls the unused ones and allocates the
+// transient render targets
+FrameGraph *frameGraph = nullptr;
+ResolutionSettings resolutionSettings;
+
+// RAY MARCHING
+// the number of steps of the media march follows the optical depth of the ray, between a minimum and a maximum
+struct MarchSettings
+{
+    int MinSteps = 4;
+    int MaxSteps = 32;
+    float StepsPerOpticalDepth = 4.0f;
+    // the march stops where the transmittance from the camera falls below the threshold
+    float TransmittanceThreshold = 0.01f;
+    // the media passes output the number of steps of each pixel
+    bool StepHeatmap = false;
+};
+MarchSettings marchSettings;
+// the in-scattering is marched on a sparse set of epipolar lines and interpolated, instead of per pixel
+EpipolarScattering *epipolarScattering = nullptr;
+EpipolarSettings epipolarSettings;
+// the media skybox is rendered in a cube map when the camera, the lights or the medium change, and sampled by the frames
+SkyCache *skyCache = nullptr;
+SkyCacheSettings skyCacheSettings;
+
+// UPDATE AND RENDER THREADS
+// the main thread processes the input and updates the scene, then publishes a frame packet which is drawn by the
+// render thread, the only one using the GL context. The update of a frame overlaps the GL submission of the previous one
+
+// an object to draw, with the transform computed by the update thread
+struct ObjectDraw
+{
+    size_t Object;
+    int LodLevel;
+    glm::mat4 ModelMatrix;
+    AABB WorldBox;
+    // faces of the shadow cube touched by the object (shadow draws only)
+    GLint FaceMask;
+};
+
+// a shadow cube rendered in the frame, with its casters
+struct ShadowCubeUpdate
+{
+    int Layer;
+    glm::vec3 LightPos;
+    float Range;
+    glm::mat4 Transforms[6];
+    vector<ObjectDraw> Draws;
+};
+vector<ShadowCubeUpdate> shadowUpdates;
+
+// snapshot of everything the render thread needs to draw a frame: it is not modified after its publication
+struct FramePacket
+{
+    glm::mat4 View, Projection;
+    // position of the first light
+    glm::vec3 CameraPos, LightPos;
+    vector<ShadowCubeUpdate> ShadowUpdates;
+    // the shadow array is reallocated before the frame when they change
+    int ShadowSize;
+    GLenum ShadowFormat;
+    // content of the light buffers
+    vector<glm::vec4> LightData;
+    vector<GLuint> ClusterLights;
+    vector<uint16_t> LightIndices;
+    glm::ivec4 ClusterSize;
+    glm::vec4 ClusterDepth;
+    glm::vec3 AbsorptionCoeff, ScatteringCoeff;
+    float G;
+    int PhaseFunction, SkyboxTechnique, OcclusionMode;
+    float StreamingBudgetMs;
+    ResolutionSettings Resolution;
+    MarchSettings March;
+    EpipolarSettings Epipolar;
+    MediumSettings Medium;
+    SkyCacheSettings SkyCache;
+    // capture of this frame (empty path = no capture)
+    CaptureTarget Capture;
+    // size of the framebuffer of the window
+    int WindowWidth, WindowHeight;
+    // size of the image when it is not drawn on the window (a batch tile), or 0; job of the batch (-1 = none)
+    int OutputWidth, OutputHeight;
+    int JobIndex;
+    vector<ObjectDraw> CameraDraws;
+    // copy of the ImGui draw lists built by the update thread
+    ImDrawData GuiData;
+    vector<ImDrawList *> GuiLists;
+
+    FramePacket() = default;
+    FramePacket(const FramePacket &) = delete;
+    FramePacket &operator=(const FramePacket &) = delete;
+    ~FramePacket()
+    {
+        for (ImDrawList *list : GuiLists)
+            IM_DELETE(list);
+    }
+};
+FrameMailbox<FramePacket> frameMailbox;
+
+// statistics of the last frame drawn by the render thread, shown by the GUI
+struct RenderStats
+{
+    int QueriesIssued = 0;
+    int ObjectsOccluded = 0;
+    int OcclusionSkipped = 0;
+    size_t Draws = 0;
+    GLStateCache::Stats State;
+    size_t UniformUsage = 0;
+    size_t TexturesPending = 0;
+    float StreamingMs = 0.0f;
+    float GpuFrameMs = 0.0f;
+    float ResolutionScale = 1.0f;
+    int SceneWidth = 0;
+    int SceneHeight = 0;
+    GLuint EpipolarSamples = 0;
+    GLCallStats GLCalls;
+    FrameGraphStats Graph;
+    int CapturesPending = 0;
+    int SkyCacheRenders = 0;
+};
+RenderStats renderStats;
+std::mutex renderStatsMutex;
+
 const float near = 0.1f;
 const float far = 100.0f;
-const glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), aspect, near, far);
+// vertical FOV of the camera
+const float cameraFovY = glm::radians(45.0f);
 
 int width, height;
 
@@ -150,8 +520,22 @@ int phaseFunction = 0;
 array<GLuint, 4> illuminationShaderSubroutines;
 array<GLuint, 4> skyboxShaderSubroutines;
 
-int main()
+int main(int argc, char **argv)
 {
+    if (!ParseArguments(argc, argv))
+        return -1;
+    SetProfilerThreadName("Main");
+    if (!tracePath.empty())
+        BeginProfilerCapture();
+
+    jobSystem = new JobSystem();
+    if (jobBenchmark)
+    {
+        RunJobBenchmarks(*jobSystem);
+        delete jobSystem;
+        return 0;
+    }
+
     // initw
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -159,6 +543,7 @@ int main()
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
     glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    glfwWindowHint(GLFW_VISIBLE, headless || !batchPath.empty() ? GL_FALSE : GL_TRUE);
 
     GLFWwindow *window = glfwCreateWindow(screenWidth, screenHeight, "main", nullptr, nullptr);
     if (!window)
@@ -168,13 +553,20 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    jobSystem->SetGLThread();
 
     glfwSetKeyCallback(window, key_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
+    // installed before the ImGui backend, which calls them from its own callbacks
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+    glfwSetScrollCallback(window, scroll_callback);
+    glfwSetCharCallback(window, char_callback);
+    glfwSetWindowRefreshCallback(window, refresh_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    // in debug builds the entry points are wrapped by the GL call accounting
+    if (!gladLoadGLLoader(WrapGLLoader((GLADloadproc)glfwGetProcAddress)))
     {
         std::cout << "Failed to initialize OpenGL context" << std::endl;
         return -1;
@@ -220,55 +612,168 @@ int main()
     Shader flat_shader(SHADERS_DIR_PATH "/flat.vert", SHADERS_DIR_PATH "/flat.frag");
     Shader skybox_partmedia_shader(SHADERS_DIR_PATH "/skybox_partmedia.vert", SHADERS_DIR_PATH "/skybox_partmedia.frag");
     Shader skybox_fog_shader(SHADERS_DIR_PATH "/skybox_fog.vert", SHADERS_DIR_PATH "/skybox_fog.frag");
+    Shader skybox_cached_shader(SHADERS_DIR_PATH "/skybox_partmedia.vert", SHADERS_DIR_PATH "/skybox_cached.frag");
+
+    // the constants of the passes and of the draws are read from the uniform ring buffer
+    for (GLuint program : {shadow_shader.Program, illumination_shader.Program, skybox_partmedia_shader.Program, skybox_fog_shader.Program,
+                           skybox_cached_shader.Program})
+    {
+        BindUniformBlock(program, "PassData", PassBlockBinding);
+        BindUniformBlock(program, "ObjectData", ObjectBlockBinding);
+    }
+    uniformRing = new UniformRingBuffer();
+    renderQueue = new RenderQueue(glState, *uniformRing);
 
     SetupShader(illumination_shader.Program);
     PrintCurrentShader(current_subroutine);
 
+    // ASSET STREAMING
+    // images and models are decoded in parallel by the workers of the job system
+    assetStreamer = new AssetStreamer(*jobSystem);
+    auto planeData = assetStreamer->StreamModelData(MODELS_DIR_PATH "/plane.obj");
+    auto cubeData = assetStreamer->StreamModelData(MODELS_DIR_PATH "/cube.obj");
+    auto sphereData = assetStreamer->StreamModelData(MODELS_DIR_PATH "/sphere.obj");
+
     // TEXTURES
+    // the textures show a placeholder until they are uploaded by the streamer during the first frames
     cubeMap = new CubeMap(TEXTURES_DIR_PATH "/cube/Maskonaive2/");
-    cubeMap->Load();
+    cubeMap->LoadAsync(*assetStreamer);
 
     debugTex = new Texture2D(TEXTURES_DIR_PATH "/UV_Grid_Sm.png", Texture2DType::DIFFUSE);
-    debugTex->Load();
+    debugTex->LoadAsync(*assetStreamer);
 
     // MODELS
-    Model planeModel = Model(MODELS_DIR_PATH "/plane.obj");
-    Model cubeModel(MODELS_DIR_PATH "/cube.obj"); // used for the environment map
-    Model sphereModel(MODELS_DIR_PATH "/sphere.obj");
+    // the scene setup needs the meshes, so we wait for the import (but not for the textures)
+    vector<MeshData> planeMeshes = planeData.get();
+    vector<MeshData> cubeMeshes = cubeData.get();
+    vector<MeshData> sphereMeshes = sphereData.get();
+    Model planeModel(planeMeshes);
+    Model cubeModel(cubeMeshes); // used for the environment map
+    Model sphereModel(sphereMeshes);
+
+    // LOD chains of the models used by the objects (the chain stops at level 0 if a model cannot be simplified)
+    MeshLodCache lodCache;
+    lodCache.Build(planeModel);
+    // the skybox draws the level 0 of the chain of the cube, whose index counts are kept when the CPU copies are dropped
+    const LodModel &skyboxCube = *lodCache.Build(cubeModel);
+    lodCache.Build(sphereModel);
+    // the triangles of the levels are printed with the memory report
+    if (memoryReport)
+    {
+        for (const Model *model : {&planeModel, &cubeModel, &sphereModel})
+        {
+            const LodModel *chain = lodCache.Find(*model);
+            std::cout << "LOD chain: " << chain->GetLevelCount() << " levels (";
+            for (int level = 0; level < chain->GetLevelCount(); level++)
+                std::cout << (level ? ", " : "") << chain->GetTriangleCount(level);
+            std::cout << " triangles)" << std::endl;
+        }
+    }
 
     // SCENE SETUP
-    CreateSceneObjects(planeModel, sphereModel, cubeModel);
+    CreateSceneObjects(planeModel, sphereModel, cubeModel, lodCache);
+    CreateReferenceScene();
+    // the LOD chains and the bounds are built: the GPU has the only copy of the meshes needed by the frames
+    if (memorySettings.DropCpuCopies)
+        lodCache.DropCpuCopies();
+
+    PointLight mainLight;
+    mainLight.Position = glm::vec3(0.0f, 30.0f, 15.0f);
+    mainLight.Range = far;
+    // the extra lights never reallocate the list: the input log tracks the position of the first light
+    lights.reserve(1 + MAX_EXTRA_LIGHTS);
+    lights.push_back(mainLight);
+
+    occlusionCuller = new OcclusionCuller(SHADERS_DIR_PATH "/occlusion_box.vert", SHADERS_DIR_PATH "/occlusion_box.frag");
+    occlusionCuller->Resize(objects.size());
+
+    // in a batch the scene target holds the largest tile of the jobs, instead of the window
+    int sceneWidth = width, sceneHeight = height;
+    CaptureSettings captureSettings;
+    if (!batchPath.empty())
+    {
+        LoadBatch();
+        if (batchJobs.empty())
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        sceneWidth = sceneHeight = 1;
+        for (const BatchJob &job : batchJobs)
+        {
+            sceneWidth = std::max(sceneWidth, std::min(job.Width, batchTileLimit));
+            sceneHeight = std::max(sceneHeight, std::min(job.Height, batchTileLimit));
+        }
+        // every image is written, by all the cores but the ones of the update and render threads
+        const unsigned cores = std::thread::hardware_concurrency();
+        captureSettings.EncoderCount = cores > 2 ? cores - 2 : 1;
+        captureSettings.WaitWhenFull = true;
+        captureSettings.KeepResults = true;
+    }
+
+    sceneTarget = new SceneTarget(SHADERS_DIR_PATH "/fullscreen.vert", SHADERS_DIR_PATH "/upscale.frag", sceneWidth, sceneHeight);
+    gpuTimer = new GpuTimer();
+    epipolarScattering = new EpipolarScattering(SHADERS_DIR_PATH);
+    skyCache = new SkyCache();
+    frameGraph = new FrameGraph();
+    frameCapture = new FrameCapture(captureSettings);
 
     // DEPTH MAP CONFIGURATION
-    unsigned int depthMapFBO;
-    glGenFramebuffers(1, &depthMapFBO);
-    unsigned int depthCubemap;
-    glGenTextures(1, &depthCubemap);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-    for (unsigned int i = 0; i < 6; ++i)
-    {
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    // attach depth texture as FBO's depth buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthCubemap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // the shadow cubes of all the lights are layers of a single cube map array
+    shadowCubes = new ShadowCubeArray(ShadowTierSizes[shadowTier], SHADOW_LAYERS, GetShadowInternalFormat(shadowFormat));
+    const GLuint depthCubemaps = shadowCubes->GetTexture();
+    lightBuffers = new LightBuffers();
+
+    CreateDensityVolumes();
+
+    vector<TextureBinding> mediaBindings = {
+        {2, GL_TEXTURE_CUBE_MAP_ARRAY, depthCubemaps},
+        {LightDataUnit, GL_TEXTURE_BUFFER, lightBuffers->GetLightDataTexture()},
+        {ClusterLightsUnit, GL_TEXTURE_BUFFER, lightBuffers->GetClusterLightsTexture()},
+        {LightIndicesUnit, GL_TEXTURE_BUFFER, lightBuffers->GetLightIndicesTexture()}};
+    for (size_t i = 0; i < densityVolumes.size(); i++)
+        mediaBindings.push_back({DensityVolumeUnit + (GLuint)i, GL_TEXTURE_3D, densityVolumes[i]->GetTexture()});
+    illuminationTextures = {1, {{0, GL_TEXTURE_2D, debugTex->GetTextureId()}}};
+    illuminationTextures.Bindings.insert(illuminationTextures.Bindings.end(), mediaBindings.begin(), mediaBindings.end());
+    skyboxTextures = {2, {{3, GL_TEXTURE_CUBE_MAP, cubeMap->GetId()}}};
+    skyCacheTextures = {3, {{SkyCacheUnit, GL_TEXTURE_CUBE_MAP, skyCache->GetTexture()}}};
+    skyboxTextures.Bindings.insert(skyboxTextures.Bindings.end(), mediaBindings.begin(), mediaBindings.end());
 
     // Projection matrix of the camera: FOV angle, aspect ratio, near and far planes
-    projection = glm::perspective(glm::radians(45.0f), (float)screenWidth / (float)screenHeight, near, far);
+    projection = glm::perspective(cameraFovY, (float)screenWidth / (float)screenHeight, near, far);
 
     // PARTICIPATING MEDIA
     glm::vec3 absorptionCoeff = glm::vec3(0.05f, 0.05f, 0.05f);
     glm::vec3 scatteringCoeff = glm::vec3(0.150f, 0.150f, 0.150f);
     float gCoeff = 0.0f;
 
+    // the GUI parameters of a recorded session (in the same order when it is replayed)
+    inputLog.TrackParameter(&absorptionCoeff, sizeof(absorptionCoeff));
+    inputLog.TrackParameter(&scatteringCoeff, sizeof(scatteringCoeff));
+    inputLog.TrackParameter(&gCoeff, sizeof(gCoeff));
+    inputLog.TrackParameter(&phaseFunction, sizeof(phaseFunction));
+    inputLog.TrackParameter(&skyboxTechnique, sizeof(skyboxTechnique));
+    inputLog.TrackParameter(&lights[0].Position, sizeof(lights[0].Position));
+    inputLog.TrackParameter(&mediumSettings.AmbientDensity, sizeof(mediumSettings.AmbientDensity));
+    // the settings of the passes, lights and shadows, which change the workload of the frames
+    inputLog.TrackParameter(&marchSettings, sizeof(marchSettings));
+    inputLog.TrackParameter(&epipolarSettings, sizeof(epipolarSettings));
+    inputLog.TrackParameter(&mediumSettings.VolumesEnabled, sizeof(mediumSettings.VolumesEnabled));
+    inputLog.TrackParameter(&mediumSettings.VolumeDensity, sizeof(mediumSettings.VolumeDensity));
+    inputLog.TrackParameter(&lights[0].Update, sizeof(lights[0].Update));
+    inputLog.TrackParameter(&extraLightCount, sizeof(extraLightCount));
+    inputLog.TrackParameter(&extraLightRange, sizeof(extraLightRange));
+    inputLog.TrackParameter(&maxShadowUpdates, sizeof(maxShadowUpdates));
+    inputLog.TrackParameter(&shadowSettings, sizeof(shadowSettings));
+    inputLog.TrackParameter(&skyCacheSettings, sizeof(skyCacheSettings));
+    inputLog.TrackParameter(&frustumCulling, sizeof(frustumCulling));
+    inputLog.TrackParameter(&occlusionMode, sizeof(occlusionMode));
+    inputLog.TrackParameter(&lodEnabled, sizeof(lodEnabled));
+    inputLog.TrackParameter(&lodSelectionSettings.Hysteresis, sizeof(lodSelectionSettings.Hysteresis));
+    inputLog.TrackParameter(&resolutionSettings, sizeof(resolutionSettings));
+    inputLog.TrackParameter(&streamingBudgetMs, sizeof(streamingBudgetMs));
+    if (!recordPath.empty())
+        inputLog.StartRecording(recordPath);
+    if (!replayPath.empty() && !inputLog.StartReplay(replayPath) && headless)
+        glfwSetWindowShouldClose(window, GL_TRUE);
+
     // ImGui SETUP
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -279,22 +784,22 @@ int main()
     ImGui_ImplOpenGL3_Init("#version 410");
 
     // Constant shaders' values setup
-    shadow_shader.Use();
-    glUniform1f(glGetUniformLocation(shadow_shader.Program, "far_plane"), far);
-
     illumination_shader.Use();
-    glUniformMatrix4fv(glGetUniformLocation(illumination_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
     glUniform1f(glGetUniformLocation(illumination_shader.Program, "Kd"), Kd);
     glUniform1f(glGetUniformLocation(illumination_shader.Program, "alpha"), alpha);
     glUniform1f(glGetUniformLocation(illumination_shader.Program, "F0"), F0);
-    glUniform1f(glGetUniformLocation(illumination_shader.Program, "far_plane"), far);
     glUniform1f(glGetUniformLocation(illumination_shader.Program, "repeat"), repeat);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, debugTex->GetTextureId());
     glUniform1i(glGetUniformLocation(illumination_shader.Program, "tex"), 0);
     glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-    glUniform1i(glGetUniformLocation(illumination_shader.Program, "depthMap"), 2);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, depthCubemaps);
+    glUniform1i(glGetUniformLocation(illumination_shader.Program, "depthMaps"), 2);
+    glUniform1i(glGetUniformLocation(illumination_shader.Program, "lightData"), LightDataUnit);
+    glUniform1i(glGetUniformLocation(illumination_shader.Program, "clusterLights"), ClusterLightsUnit);
+    glUniform1i(glGetUniformLocation(illumination_shader.Program, "lightIndices"), LightIndicesUnit);
+    for (int i = 0; i < MaxDensityVolumes; i++)
+        glUniform1i(glGetUniformLocation(illumination_shader.Program, ("densityVolumes[" + std::to_string(i) + "]").c_str()), DensityVolumeUnit + i);
 
     illuminationShaderSubroutines = {
         glGetSubroutineIndex(illumination_shader.Program, GL_FRAGMENT_SHADER, "miePhaseFunc"), 
@@ -304,15 +809,20 @@ int main()
     };
 
     skybox_partmedia_shader.Use();
-    glUniform1f(glGetUniformLocation(skybox_partmedia_shader.Program, "far_plane_vert"), far);
-    glUniformMatrix4fv(glGetUniformLocation(skybox_partmedia_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform1f(glGetUniformLocation(skybox_partmedia_shader.Program, "skyDistance"), far);
+    // the sky cache pass switches it through the state cache, which must know its value
+    glState.Uniform(skybox_partmedia_shader.Program, "cacheRender", 0);
     glActiveTexture(GL_TEXTURE3);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMap->GetId());
     glUniform1i(glGetUniformLocation(skybox_partmedia_shader.Program, "skyboxTex"), 3);
-    glUniform1f(glGetUniformLocation(skybox_partmedia_shader.Program, "far_plane"), far);
     glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, depthCubemap);
-    glUniform1i(glGetUniformLocation(skybox_partmedia_shader.Program, "depthMap"), 2);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, depthCubemaps);
+    glUniform1i(glGetUniformLocation(skybox_partmedia_shader.Program, "depthMaps"), 2);
+    glUniform1i(glGetUniformLocation(skybox_partmedia_shader.Program, "lightData"), LightDataUnit);
+    glUniform1i(glGetUniformLocation(skybox_partmedia_shader.Program, "clusterLights"), ClusterLightsUnit);
+    glUniform1i(glGetUniformLocation(skybox_partmedia_shader.Program, "lightIndices"), LightIndicesUnit);
+    for (int i = 0; i < MaxDensityVolumes; i++)
+        glUniform1i(glGetUniformLocation(skybox_partmedia_shader.Program, ("densityVolumes[" + std::to_string(i) + "]").c_str()), DensityVolumeUnit + i);
 
     skyboxShaderSubroutines = {
         glGetSubroutineIndex(skybox_partmedia_shader.Program, GL_FRAGMENT_SHADER, "miePhaseFunc"), 
@@ -321,8 +831,10 @@ int main()
         glGetSubroutineIndex(skybox_partmedia_shader.Program, GL_FRAGMENT_SHADER, "uniformPhaseFunc")
     };
 
+    skybox_cached_shader.Use();
+    glUniform1i(glGetUniformLocation(skybox_cached_shader.Program, "skyCache"), SkyCacheUnit);
+
     skybox_fog_shader.Use();
-    glUniformMatrix4fv(glGetUniformLocation(skybox_fog_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
     float fogDensity = 2.0f;
     glUniform1f(glGetUniformLocation(skybox_fog_shader.Program, "fogDensity"), fogDensity);
     glm::vec3 fogColor = glm::vec3(0.5f, 0.5f, 0.5f);
@@ -336,43 +848,308 @@ int main()
     glUniformMatrix4fv(glGetUniformLocation(flat_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
     glUniformMatrix4fv(glGetUniformLocation(flat_shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(glm::mat4(1.0)));
 
-    // Rendering loop: this code is executed at each frame
+    // the device objects of ImGui (fonts texture, program) are created before the GL context leaves this thread
+    ImGui_ImplOpenGL3_NewFrame();
+
+    // RENDER THREAD
+    // the context can be current on a single thread at a time: we hand it over to the render thread
+    glfwMakeContextCurrent(nullptr);
+    std::thread renderThread([&]() {
+        glfwMakeContextCurrent(window);
+        jobSystem->SetGLThread();
+        SetProfilerThreadName("Render");
+        // the GPU zones are measured by this thread: the clocks are aligned once it owns the context
+        CalibrateGpuProfiler();
+
+        // Rendering loop: this code is executed for each frame packet published by the update loop
+        while (const FramePacket *packet = frameMailbox.Acquire())
+        {
+            PROFILE_SCOPE("Render frame");
+            BeginGLCallFrame();
+            // the GPU zones of the previous frames
+            CollectGpuProfileZones();
+            // the captures of the previous frames which are ready go to the encoder
+            frameCapture->Update();
+
+            // we upload the assets decoded by the workers since the last frame
+            {
+                PROFILE_SCOPE("Streaming upload");
+                jobSystem->ExecuteGLThreadJobs();
+                assetStreamer->Update(packet->StreamingBudgetMs);
+                lightBuffers->Upload(packet->LightData, packet->ClusterLights, packet->LightIndices);
+                // the update thread has invalidated all the cubes in the same frame
+                if (packet->ShadowSize != shadowCubes->GetSize() || packet->ShadowFormat != shadowCubes->GetInternalFormat())
+                    shadowCubes->Reallocate(packet->ShadowSize, packet->ShadowFormat);
+            }
+
+            // the streamer, the light buffers, the lines and ImGui change the GL state directly: the cache starts again from scratch
+            glState.Invalidate();
+            glState.ResetStats();
+            renderQueue->ResetStats();
+            uniformRing->BeginFrame();
+
+            // the scale of this frame follows the last GPU time available (a few frames old); a batch tile is rendered
+            // at its size, and its GPU time goes to its job
+            const bool measured = gpuTimer->CollectResults([](int job, float ms) {
+                if (job < 0)
+                    return;
+                batchTimings[job].GpuMs += ms;
+                batchTimings[job].GpuFramesMeasured++;
+            });
+            const bool offscreen = packet->OutputWidth > 0;
+            if (offscreen)
+                sceneTarget->SetSize(packet->OutputWidth, packet->OutputHeight);
+            else if (measured || !packet->Resolution.Enabled)
+                sceneTarget->SetScale(UpdateResolutionScale(sceneTarget->GetScale(), gpuTimer->GetLastMs(), packet->Resolution));
+            gpuTimer->Begin(packet->JobIndex);
+            // read by the sky cache pass when the graph is executed
+            const vector<float> skyParameters = GetSkyParameters(*packet, assetStreamer->GetPendingCount());
+
+            // FRAME GRAPH
+            // the passes are declared in the order of the pipeline; the graph runs only the ones contributing to the
+            // window, and binds their render targets. The executions of the passes refer to the values and resources
+            // of this block: the graph is executed before its end
+            {
+                PROFILE_SCOPE("Frame graph");
+                frameGraph->Reset();
+                const FrameGraphResource shadows = frameGraph->Import("Shadow cubes", shadowCubes->GetTexture(), 0,
+                                                                      shadowCubes->GetSize(), shadowCubes->GetSize());
+                const FrameGraphResource scene = frameGraph->Import("Scene", sceneTarget->GetColorTexture(), sceneTarget->GetFramebuffer(),
+                                                                    sceneTarget->GetWidth(), sceneTarget->GetHeight());
+                // a batch tile is drawn in a texture of its size instead of the window (in half floats for the EXR files)
+                const int outputWidth = offscreen ? packet->OutputWidth : packet->WindowWidth;
+                const int outputHeight = offscreen ? packet->OutputHeight : packet->WindowHeight;
+                FrameGraphResource output;
+                if (offscreen)
+                {
+                    TransientTextureDesc tileDesc;
+                    tileDesc.Width = outputWidth;
+                    tileDesc.Height = outputHeight;
+                    tileDesc.InternalFormat = packet->Capture.Format == CaptureFormat::EXR ? GL_RGBA16F : GL_RGBA8;
+                    tileDesc.Filter = GL_NEAREST;
+                    output = frameGraph->CreateTexture("Batch tile", tileDesc);
+                }
+                else
+                    output = frameGraph->Import("Backbuffer", 0, 0, packet->WindowWidth, packet->WindowHeight);
+                TransientTextureDesc inscatteringDesc;
+                inscatteringDesc.Width = sceneTarget->GetFullWidth();
+                inscatteringDesc.Height = sceneTarget->GetFullHeight();
+                inscatteringDesc.InternalFormat = GL_RGBA16F;
+                // the in-scattering is read by the upscale with bilinear filtering
+                inscatteringDesc.Filter = GL_LINEAR;
+                const FrameGraphResource inscattering = frameGraph->CreateTexture("In-scattering", inscatteringDesc);
+
+                // the cubes not updated in this frame are kept: the pass writes on the content of the array
+                FrameGraphResource shadowsDone = -1;
+                frameGraph->AddPass("Shadow pass",
+                    [&](FrameGraphBuilder &builder) { shadowsDone = builder.Write(builder.Read(shadows)); },
+                    [&](const FrameGraph &) { PerformShadowMapping(shadow_shader, *packet); });
+
+                FrameGraphResource sceneLit = -1;
+                frameGraph->AddPass("Illumination pass",
+                    [&](FrameGraphBuilder &builder) {
+                        builder.Read(shadowsDone);
+                        sceneLit = builder.RenderTo(scene);
+                    },
+                    [&](const FrameGraph &) { PerformIlluminationPass(illumination_shader, *packet); });
+
+                // the media sky is rendered in its cache only when the cache is stale (the shadow cubes rendered again
+                // make it stale, also while the fog skybox is used)
+                if (!packet->ShadowUpdates.empty())
+                    skyCache->Invalidate();
+                const bool skyCached = packet->SkyCache.Enabled && !packet->March.StepHeatmap;
+                const FrameGraphResource skyCacheImported = frameGraph->Import("Sky cache", skyCache->GetTexture(), 0,
+                                                                               skyCache->GetSize(), skyCache->GetSize());
+                FrameGraphResource skyCacheDone = skyCacheImported;
+                if (skyCached && packet->SkyboxTechnique == 1 &&
+                    skyCache->IsStale(packet->CameraPos, skyParameters, packet->SkyCache.MoveThreshold))
+                    frameGraph->AddPass("Sky cache pass",
+                        [&](FrameGraphBuilder &builder) {
+                            builder.Read(shadowsDone);
+                            skyCacheDone = builder.Write(skyCacheImported);
+                        },
+                        [&](const FrameGraph &) { RenderSkyCache(skybox_partmedia_shader, skyboxCube, *packet, skyParameters); });
+
+                // both skybox variants are declared: the graph culls the one the next pass does not read
+                FrameGraphResource fogSky = -1, mediaSky = -1;
+                frameGraph->AddPass("Fog skybox pass",
+                    [&](FrameGraphBuilder &builder) { fogSky = builder.RenderTo(builder.Read(sceneLit)); },
+                    [&](const FrameGraph &) { PerformSkyBoxPass(skybox_fog_shader, skyboxCube, *packet); });
+                frameGraph->AddPass("Media skybox pass",
+                    [&](FrameGraphBuilder &builder) {
+                        builder.Read(skyCached ? skyCacheDone : shadowsDone);
+                        mediaSky = builder.RenderTo(builder.Read(sceneLit));
+                    },
+                    [&](const FrameGraph &) {
+                        PerformSkyboxPass(skybox_partmedia_shader, skybox_cached_shader, skyboxCube, *packet, skyCached);
+                    });
+
+                FrameGraphResource sceneDone = -1;
+                frameGraph->AddPass("Axis pass",
+                    [&](FrameGraphBuilder &builder) {
+                        sceneDone = builder.RenderTo(builder.Read(packet->SkyboxTechnique == 0 ? fogSky : mediaSky));
+                    },
+                    [&](const FrameGraph &) { RenderAxis(flat_shader, xAxis, yAxis, zAxis, *packet); });
+
+                // culled when the upscale does not add the in-scattering: its texture goes back to the pool
+                FrameGraphResource inscatteringDone = -1;
+                frameGraph->AddPass("Epipolar pass",
+                    [&](FrameGraphBuilder &builder) {
+                        builder.Read(sceneDone);
+                        builder.Read(shadowsDone);
+                        inscatteringDone = builder.Write(inscattering);
+                    },
+                    [&](const FrameGraph &graph) { PerformEpipolarPass(*packet, graph.GetFramebuffer(inscatteringDone)); });
+
+                FrameGraphResource upscaled = -1;
+                frameGraph->AddPass("Upscale",
+                    [&](FrameGraphBuilder &builder) {
+                        builder.Read(sceneDone);
+                        if (packet->Epipolar.Enabled)
+                            builder.Read(inscatteringDone);
+                        upscaled = builder.RenderTo(output);
+                    },
+                    [&](const FrameGraph &graph) {
+                        {
+                            PROFILE_SCOPE("Upscale");
+                            PROFILE_GPU_SCOPE("Upscale");
+                            sceneTarget->Upscale(packet->Resolution.Sharpness,
+                                                 packet->Epipolar.Enabled ? graph.GetTexture(inscatteringDone) : 0);
+                        }
+                        // the upscale changed program, vertex array and texture bindings directly
+                        glState.Invalidate();
+                    });
+
+                // the capture reads the upscaled image: the graph runs it before the GUI draws on the same target
+                if (!packet->Capture.Path.empty())
+                    frameGraph->AddPass("Frame capture",
+                        [&](FrameGraphBuilder &builder) {
+                            builder.Read(upscaled);
+                            builder.SetSideEffect();
+                        },
+                        [&](const FrameGraph &graph) {
+                            frameCapture->Capture(graph.GetFramebuffer(upscaled), outputWidth, outputHeight, packet->Capture);
+                        });
+
+                // the backend takes a non const pointer: we draw a shallow copy of the lists of the packet
+                FrameGraphResource displayed = upscaled;
+                if (!offscreen)
+                    frameGraph->AddPass("GUI draw",
+                        [&](FrameGraphBuilder &builder) { displayed = builder.RenderTo(builder.Read(upscaled)); },
+                        [&](const FrameGraph &) {
+                            PROFILE_SCOPE("GUI draw");
+                            PROFILE_GPU_SCOPE("GUI draw");
+                            ImDrawData guiData = packet->GuiData;
+                            ImGui_ImplOpenGL3_RenderDrawData(&guiData);
+                        });
+                frameGraph->MarkOutput(displayed);
+                frameGraph->Compile();
+                frameGraph->Execute();
+            }
+            gpuTimer->End();
+            // the slot of the ring used by this frame is reused only after the GPU has completed it
+            uniformRing->EndFrame();
+
+            const GLCallStats glCalls = EndGLCallFrame();
+            {
+                std::lock_guard<std::mutex> lock(renderStatsMutex);
+                renderStats.GLCalls = glCalls;
+                renderStats.Graph = frameGraph->GetStats();
+                renderStats.CapturesPending = frameCapture->GetPendingCount();
+                renderStats.SkyCacheRenders = skyCache->GetRenderCount();
+                renderStats.QueriesIssued = occlusionCuller->GetQueriesIssued();
+                renderStats.ObjectsOccluded = occlusionCuller->GetOccludedCount();
+                renderStats.OcclusionSkipped = occlusionSkipped;
+                renderStats.Draws = renderQueue->GetDrawCount();
+                renderStats.State = glState.GetStats();
+                renderStats.UniformUsage = uniformRing->GetFrameUsage();
+                renderStats.TexturesPending = assetStreamer->GetPendingCount();
+                renderStats.StreamingMs = assetStreamer->GetLastUpdateMs();
+                renderStats.GpuFrameMs = gpuTimer->GetLastMs();
+                renderStats.ResolutionScale = sceneTarget->GetScale();
+                renderStats.SceneWidth = sceneTarget->GetWidth();
+                renderStats.SceneHeight = sceneTarget->GetHeight();
+                renderStats.EpipolarSamples = epipolarScattering->GetMarchedSamples();
+            }
+
+            // Swapping back and front buffers (the batch tiles are not shown)
+            PROFILE_SCOPE("Swap buffers");
+            if (!offscreen)
+                glfwSwapBuffers(window);
+        }
+
+        // the frames captured at the end of the session are written before the exit
+        frameCapture->Flush();
+        // the context goes back to the main thread for the cleanup
+        glfwMakeContextCurrent(nullptr);
+    });
+
+    // Update loop: GLFW processes the events only on the main thread, so the input and the scene update stay here
     while (!glfwWindowShouldClose(window))
     {
+        // while idle, the loop sleeps until an event arrives (or the timeout, to refresh the GUI); the time spent
+        // waiting is not a time step of the camera
+        if (idleFrame)
+        {
+            PROFILE_SCOPE("Idle wait");
+            glfwWaitEventsTimeout(idleSettings.WaitTimeoutS);
+            lastFrame = glfwGetTime();
+        }
+
+        PROFILE_SCOPE("Update frame");
         // we determine the time passed from the beginning
         // and we calculate time difference between current frame rendering and the previous one
         GLfloat currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        inputLog.RecordFrame(currentFrame, deltaTime);
 
         // Check is an I/O event is happening
-        glfwPollEvents();
+        {
+            PROFILE_SCOPE("Poll events");
+            glfwPollEvents();
+        }
+
+        // in replay, the time step and the input events are the recorded ones
+        if (inputLog.IsReplaying())
+        {
+            const bool replayed = inputLog.ReplayFrame(deltaTime,
+                [window](int key, int action) { ProcessKey(window, key, action); },
+                [](double xpos, double ypos) { ProcessMouse(xpos, ypos); });
+            if (!replayed && headless)
+                glfwSetWindowShouldClose(window, GL_TRUE);
+        }
 
-        ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        apply_camera_movements();
-
-        PerformShadowMapping(shadow_shader, depthMapFBO);
-
-        view = camera.GetViewMatrix();
-
-        PerformIlluminationPass(illumination_shader, absorptionCoeff, scatteringCoeff, gCoeff);
-
-        if (skyboxTechnique == 0) {
-            PerformSkyBoxPass(skybox_fog_shader, cubeModel);
-        } else  {
-            PerformSkyboxPass(skybox_partmedia_shader, cubeModel, absorptionCoeff, scatteringCoeff, gCoeff);
+        {
+            PROFILE_SCOPE("Scene update");
+            apply_camera_movements();
+            // in a batch the camera, the light and the medium are the ones of the job
+            if (!batchJobs.empty())
+                ApplyBatchJob(absorptionCoeff, scatteringCoeff, gCoeff);
+
+            UpdateSceneBounds();
+
+            view = camera.GetViewMatrix();
+            UpdateLights();
+            CullObjectsForCamera();
+            SelectObjectsLod();
         }
 
-        RenderAxis(flat_shader, xAxis, yAxis, zAxis);
+        RenderStats stats;
+        {
+            std::lock_guard<std::mutex> lock(renderStatsMutex);
+            stats = renderStats;
+        }
+        UpdateReference();
 
         // GUI RENDERING
-        ImGui::PushStyleVar(ImGuiStyleVar_WindowMinSize, {650.f,460.f });
+        ImGui::PushStyleVar(ImGuiStyleVar_WindowMinSize, {650.f,840.f });
         ImGui::Begin("Tools", &menuIsActive, ImGuiWindowFlags_MenuBar);
         ImGui::PopStyleVar();
-        ImGui::BeginChild("Participating media rendering", ImVec2(600, 270), true);
+        ImGui::BeginChild("Participating media rendering", ImVec2(600, 410), true);
         ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Participating media coefficients:");
         ImGui::Indent();
         ImGui::SliderFloat("absorptionCoefficient_R", &absorptionCoeff.x, 0.0f, 1.0f);
@@ -395,44 +1172,307 @@ int main()
         ImGui::RadioButton("Schlick", &phaseFunction, 2);
         ImGui::SameLine();
         ImGui::RadioButton("Uniform", &phaseFunction, 3);
+        ImGui::Separator();
+
+        ImGui::Text("Ray marching:");
+        ImGui::SliderInt("min steps", &marchSettings.MinSteps, 1, 16);
+        ImGui::SliderInt("max steps", &marchSettings.MaxSteps, 1, 128);
+        ImGui::SliderFloat("steps per optical depth", &marchSettings.StepsPerOpticalDepth, 0.5f, 16.0f);
+        ImGui::SliderFloat("transmittance threshold", &marchSettings.TransmittanceThreshold, 0.001f, 0.2f, "%.3f");
+        ImGui::Checkbox("Step count heatmap", &marchSettings.StepHeatmap);
+        ImGui::Checkbox("Epipolar sampling", &epipolarSettings.Enabled);
+        if (epipolarSettings.Enabled)
+        {
+            ImGui::SliderInt("epipolar lines", &epipolarSettings.LineCount, 64, 1024);
+            ImGui::SliderInt("samples per line", &epipolarSettings.SamplesPerLine, 64, 1024);
+            ImGui::SliderInt("initial sample step", &epipolarSettings.InitialSampleStep, 1, 64);
+            ImGui::SliderFloat("depth break threshold", &epipolarSettings.DepthBreakThreshold, 0.01f, 0.5f);
+            ImGui::Text("Scattering evaluations: %u on the lines (%d pixels)", stats.EpipolarSamples,
+                        stats.SceneWidth * stats.SceneHeight);
+        }
+        ImGui::EndChild();
+
+        ImGui::BeginChild("Heterogeneous media", ImVec2(600, 130), true);
+        ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "Density volumes:");
+        ImGui::Indent();
+        ImGui::SliderFloat("ambient density", &mediumSettings.AmbientDensity, 0.0f, 1.0f);
+        ImGui::Checkbox("Density volumes", &mediumSettings.VolumesEnabled);
+        for (size_t i = 0; i < densityVolumes.size(); i++)
+        {
+            ImGui::PushID((int)i);
+            ImGui::SliderFloat("density", &mediumSettings.VolumeDensity[i], 0.0f, 16.0f);
+            ImGui::SameLine();
+            ImGui::Text("volume %zu, %.0f%% occupied", i, densityVolumes[i]->GetOccupancy() * 100.0f);
+            ImGui::PopID();
+        }
         ImGui::EndChild();
 
-        ImGui::BeginChild("Point light", ImVec2(600, 100), true);
+        ImGui::BeginChild("Point light", ImVec2(600, 330), true);
         ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "Point light");
         ImGui::Indent();
-        ImGui::SliderFloat("light x", &lightPos[0], -100.0f, 100.0f);
-        ImGui::SliderFloat("light y", &lightPos[1], -100.0f, 100.0f);
-        ImGui::SliderFloat("light z", &lightPos[2], -100.0f, 100.0f);
+        ImGui::SliderFloat("light x", &lights[0].Position[0], -100.0f, 100.0f);
+        ImGui::SliderFloat("light y", &lights[0].Position[1], -100.0f, 100.0f);
+        ImGui::SliderFloat("light z", &lights[0].Position[2], -100.0f, 100.0f);
+        int mainShadowUpdate = (int)lights[0].Update;
+        ImGui::Text("Shadow update:");
+        ImGui::SameLine();
+        ImGui::RadioButton("Every frame", &mainShadowUpdate, (int)ShadowUpdate::EVERY_FRAME);
+        ImGui::SameLine();
+        ImGui::RadioButton("On change", &mainShadowUpdate, (int)ShadowUpdate::ON_CHANGE);
+        ImGui::SameLine();
+        ImGui::RadioButton("Static", &mainShadowUpdate, (int)ShadowUpdate::STATIC);
+        lights[0].Update = (ShadowUpdate)mainShadowUpdate;
+        ImGui::Separator();
+
+        ImGui::SliderInt("extra lights", &extraLightCount, 0, MAX_EXTRA_LIGHTS);
+        ImGui::SliderFloat("extra lights range", &extraLightRange, 2.0f, 30.0f);
+        ImGui::SliderInt("shadow cubes per frame", &maxShadowUpdates, 1, SHADOW_LAYERS);
+        ImGui::Text("%zu lights, %d shadow layers: %zu cubes rendered, %d waiting", lights.size(), SHADOW_LAYERS,
+                    shadowScheduler.GetUpdates().size(), shadowScheduler.GetPendingCount());
+        ImGui::Text(shadowSettings.AutoResolution ? "Max shadow resolution:" : "Shadow resolution:");
+        for (int i = 0; i < ShadowTierCount; i++)
+        {
+            ImGui::SameLine();
+            ImGui::RadioButton(std::to_string(ShadowTierSizes[i]).c_str(), &shadowSettings.Tier, i);
+        }
+        int shadowFormatOption = (int)shadowSettings.Format;
+        ImGui::Text("Shadow depth:");
+        ImGui::SameLine();
+        ImGui::RadioButton("16 bit", &shadowFormatOption, (int)ShadowDepthFormat::DEPTH16);
+        ImGui::SameLine();
+        ImGui::RadioButton("24 bit", &shadowFormatOption, (int)ShadowDepthFormat::DEPTH24);
+        ImGui::SameLine();
+        ImGui::RadioButton("32 bit float", &shadowFormatOption, (int)ShadowDepthFormat::DEPTH32F);
+        shadowSettings.Format = (ShadowDepthFormat)shadowFormatOption;
+        ImGui::Checkbox("automatic shadow resolution", &shadowSettings.AutoResolution);
+        ImGui::Text("Shadow cubes: %d x %d, %.1f MB (light coverage %.2f)", ShadowTierSizes[shadowTier], ShadowTierSizes[shadowTier],
+                    GetTextureBytes(GetShadowInternalFormat(shadowFormat), ShadowTierSizes[shadowTier], ShadowTierSizes[shadowTier],
+                                    SHADOW_LAYERS * 6) / (1024.0 * 1024.0),
+                    shadowCoverage);
+        ImGui::Text("Clusters: %d / %d with lights, max %d lights per cluster, %zu indices (%zu dropped)",
+                    lightClusters.GetNonEmptyClusters(), clusterSettings.TilesX * clusterSettings.TilesY * clusterSettings.Slices,
+                    lightClusters.GetMaxLightsPerCluster(), lightClusters.GetLightIndices().size(), lightClusters.GetDroppedCount());
 
         ImGui::EndChild();
 
-        ImGui::BeginChild("Skybox options", ImVec2(600, 80), true);
+        ImGui::BeginChild("Skybox options", ImVec2(600, 150), true);
         ImGui::TextColored(ImVec4(0.0, 1.0, 1.0, 1.0), "Skybox rendering technique");
         ImGui::Indent();
         ImGui::RadioButton("Volumetric Fog Skybox", &skyboxTechnique, 0);
         ImGui::RadioButton("Participating Media Skybox", &skyboxTechnique, 1);
+        ImGui::Checkbox("Cache the media skybox", &skyCacheSettings.Enabled);
+        ImGui::SliderFloat("camera move threshold", &skyCacheSettings.MoveThreshold, 0.0f, 5.0f);
+        ImGui::Text("Sky cache: %d x %d faces, rendered %d times", skyCache->GetSize(), skyCache->GetSize(), stats.SkyCacheRenders);
+        ImGui::EndChild();
+
+        ImGui::BeginChild("Culling", ImVec2(600, 180), true);
+        ImGui::TextColored(ImVec4(1.0, 0.5, 0.0, 1.0), "Culling");
+        ImGui::Indent();
+        ImGui::Checkbox("Frustum culling", &frustumCulling);
+        ImGui::Text("Camera: %d / %zu objects visible (%d BVH nodes tested)", cullingStats.cameraVisible, objects.size(), cullingStats.cameraNodesTested);
+        ImGui::Text("Shadow: %d / %zu casters, %d / %zu cube faces (%d BVH nodes tested)", cullingStats.shadowCasters, objects.size(),
+                    cullingStats.shadowFaces, objects.size() * 6, cullingStats.shadowNodesTested);
+        ImGui::Text("BVH height: %d", sceneBVH.GetHeight());
+        ImGui::Text("Occlusion:");
+        ImGui::SameLine();
+        ImGui::RadioButton("Disabled", &occlusionMode, (int)OcclusionMode::DISABLED);
+        ImGui::SameLine();
+        ImGui::RadioButton("Previous frame queries", &occlusionMode, (int)OcclusionMode::PREVIOUS_FRAME);
+        ImGui::SameLine();
+        ImGui::RadioButton("Conditional rendering", &occlusionMode, (int)OcclusionMode::CONDITIONAL_RENDER);
+        ImGui::Text("Occlusion queries: %d issued, %d objects occluded, %d draws skipped", stats.QueriesIssued,
+                    stats.ObjectsOccluded, stats.OcclusionSkipped);
+        ImGui::EndChild();
+
+        ImGui::BeginChild("Level of detail", ImVec2(600, 110), true);
+        ImGui::TextColored(ImVec4(1.0, 0.0, 1.0, 1.0), "Level of detail");
+        ImGui::Indent();
+        ImGui::Checkbox("LOD selection", &lodEnabled);
+        ImGui::SliderFloat("hysteresis", &lodSelectionSettings.Hysteresis, 0.0f, 0.5f);
+        ImGui::Text("Triangles: %zu (camera), %zu (shadow proxies)", cameraTriangles, shadowTriangles);
+        ImGui::EndChild();
+
+        ImGui::BeginChild("Dynamic resolution", ImVec2(600, 110), true);
+        ImGui::TextColored(ImVec4(0.5, 1.0, 0.5, 1.0), "Dynamic resolution");
+        ImGui::Indent();
+        ImGui::Checkbox("Enabled", &resolutionSettings.Enabled);
+        ImGui::SameLine();
+        ImGui::SliderFloat("target GPU time (ms)", &resolutionSettings.TargetMs, 4.0f, 33.0f);
+        ImGui::SliderFloat("minimum scale", &resolutionSettings.MinScale, 0.25f, 1.0f);
+        ImGui::SliderFloat("sharpness", &resolutionSettings.Sharpness, 0.0f, 1.0f);
+        ImGui::Text("GPU frame: %.2f ms, scene at %d x %d (scale %.2f)", stats.GpuFrameMs, stats.SceneWidth, stats.SceneHeight,
+                    stats.ResolutionScale);
+        ImGui::EndChild();
+
+        ImGui::Text("Streaming: %zu textures pending, upload %.2f ms", stats.TexturesPending, stats.StreamingMs);
+        ImGui::SliderFloat("upload budget (ms)", &streamingBudgetMs, 0.5f, 10.0f);
+        ImGui::Text("Render queue: %zu draws, %d state changes issued, %d redundant skipped", stats.Draws,
+                    stats.State.Issued, stats.State.Skipped);
+        ImGui::Text("Uniform ring: %zu / %zu KB per frame", stats.UniformUsage / 1024, uniformRing->GetFrameSize() / 1024);
+        if (ImGui::Button("Screenshot"))
+            screenshotRequested = true;
+        ImGui::SameLine();
+        ImGui::Text("Captures: %d written, %d dropped, %d pending", frameCapture->GetWrittenCount(),
+                    frameCapture->GetDroppedCount(), stats.CapturesPending);
+        ImGui::Text("Frame graph: %zu passes, %zu culled, %d transient targets in %d textures (pool %.1f MB), %d FBO binds (%d skipped)",
+                    stats.Graph.Passes.size(), stats.Graph.Culled.size(), stats.Graph.Transients, stats.Graph.PooledTextures,
+                    stats.Graph.PoolBytes / (1024.0 * 1024.0), stats.Graph.FramebufferBinds, stats.Graph.FramebufferBindsSkipped);
+
+        const MemoryReport memory = GetMemoryReport();
+        ImGui::BeginChild("Memory", ImVec2(600, 130), true);
+        ImGui::TextColored(ImVec4(0.5, 0.5, 1.0, 1.0), "GPU memory");
+        ImGui::Indent();
+        const double gpuMb = memory.GetGpuTotal() / (1024.0 * 1024.0);
+        if (memorySettings.BudgetMb > 0 && gpuMb > memorySettings.BudgetMb)
+            ImGui::TextColored(ImVec4(1.0, 0.0, 0.0, 1.0), "%.1f MB, over the budget of %zu MB", gpuMb, memorySettings.BudgetMb);
+        else
+            ImGui::Text("%.1f MB", gpuMb);
+        for (int i = 0; i < MemoryCategoryCount; i++)
+        {
+            ImGui::Text("%s %.1f", GetMemoryCategoryName((MemoryCategory)i), memory.GpuBytes[i] / (1024.0 * 1024.0));
+            ImGui::SameLine();
+        }
+        ImGui::NewLine();
+        ImGui::Text("CPU copies of %d meshes: %.1f MB", memory.CpuCopies, memory.CpuCopyBytes / (1024.0 * 1024.0));
+        ImGui::EndChild();
+
+        ImGui::BeginChild("Redraw", ImVec2(600, 80), true);
+        ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "Redraw");
+        ImGui::Indent();
+        ImGui::Checkbox("Event-driven redraw", &idleSettings.Enabled);
+        ImGui::SameLine();
+        ImGui::SliderInt("settle frames", &idleSettings.SettleFrames, 1, 60);
+        ImGui::Text("Frames: %d rendered, %d skipped (revision %llu)", renderedFrames, skippedFrames,
+                    (unsigned long long)sceneRevision);
+        ImGui::EndChild();
+
+        ImGui::BeginChild("Reference", ImVec2(600, 80), true);
+        ImGui::TextColored(ImVec4(1.0, 0.5, 0.0, 1.0), "Reference path tracer");
+        ImGui::Indent();
+        ImGui::SliderInt("samples", &referenceSettings.Samples, 1, 4096);
+        ImGui::SameLine();
+        ImGui::SliderInt("max bounces", &referenceSettings.MaxBounces, 1, 256);
+        if (referenceRenderer->IsRunning())
+        {
+            if (ImGui::Button("Stop"))
+                referenceRenderer->Cancel();
+            ImGui::SameLine();
+            ImGui::Text("%s: %d samples, %.1f s", referenceName.c_str(), referenceRenderer->GetCompletedSamples(),
+                        referenceRenderer->GetElapsedMs() / 1000.0);
+        }
+        else
+        {
+            if (!capturePrefix.empty())
+                ImGui::Text("not available with --capture");
+            else if (ImGui::Button("Render reference") && !referencePending)
+                StartReference(absorptionCoeff, scatteringCoeff, gCoeff);
+            if (referenceCompared)
+            {
+                ImGui::SameLine();
+                ImGui::Text("%s: RMSE %.4f, relMSE %.4f, mean error %.4f", referenceName.c_str(), referenceError.Rmse,
+                            referenceError.RelMse, referenceError.MeanAbsolute);
+            }
+        }
+        ImGui::EndChild();
+
+        ImGui::BeginChild("GL calls", ImVec2(600, 200), true);
+        ImGui::TextColored(ImVec4(1.0, 1.0, 0.0, 1.0), "GL calls");
+        ImGui::Indent();
+#ifdef GL_CALL_ACCOUNTING
+        ShowGLCallCounters("Frame", stats.GLCalls.Frame);
+        for (const auto &pass : stats.GLCalls.Passes)
+            ShowGLCallCounters(pass.first, pass.second);
+        for (const auto &function : stats.GLCalls.TopFunctions)
+        {
+            ImGui::Text("%s: %d", function.first, function.second);
+            ImGui::SameLine();
+        }
+        ImGui::NewLine();
+#else
+        ImGui::Text("The GL call accounting is compiled out of release builds");
+#endif
         ImGui::EndChild();
 
         ImGui::End();
 
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // the parameters changed by the GUI are logged, or overwritten by the recorded ones
+        inputLog.RecordParameters();
+        inputLog.ReplayParameters();
+        // the extra lights follow their count and range, also when they are replayed
+        if ((int)lights.size() != 1 + extraLightCount || (extraLightCount > 0 && lights[1].Range != extraLightRange))
+            ScatterLights();
 
+        ImGui::Render();
 
-        // Swapping back and front buffers
-        glfwSwapBuffers(window);
+        if (!NeedsRedraw(stats))
+        {
+            skippedFrames++;
+            idleFrame = true;
+            continue;
+        }
+        renderedFrames++;
+        idleFrame = false;
+
+        // the packet is filled in the buffer owned by this thread, then published when the render thread has taken
+        // the previous one
+        BuildFramePacket(frameMailbox.GetWriteBuffer(), absorptionCoeff, scatteringCoeff, gCoeff);
+        if (!batchJobs.empty() && !SetBatchTile(frameMailbox.GetWriteBuffer(), stats.TexturesPending))
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        PROFILE_SCOPE("Publish wait");
+        frameMailbox.Publish();
     }
 
+    inputLog.Stop();
+
+    // the render thread draws the last packet and releases the context
+    frameMailbox.Close();
+    renderThread.join();
+    glfwMakeContextCurrent(window);
+    jobSystem->SetGLThread();
+    // the replay of a session is the benchmark of the application
+    if (!replayPath.empty())
+        PrintGLCallSummary();
+    if (memoryReport)
+        PrintMemoryReport(memorySettings);
+    if (!batchJobs.empty())
+        FinishBatch();
+
     // when I exit from the graphics loop, it is because the application is closing
-    // we delete the Shader Programs
+    // we delete the Shader Programs (the state cache forgets their uniforms, the names can be reused)
+    for (Shader *shader : {&illumination_shader, &shadow_shader, &skybox_partmedia_shader, &skybox_cached_shader,
+                           &skybox_fog_shader, &flat_shader})
+        glState.ForgetProgram(shader->Program);
     illumination_shader.Delete();
     shadow_shader.Delete();
     skybox_partmedia_shader.Delete();
+    skybox_cached_shader.Delete();
+    skybox_fog_shader.Delete();
     flat_shader.Delete();
     delete cubeMap;
     delete debugTex;
+    delete occlusionCuller;
+    delete sceneTarget;
+    delete gpuTimer;
+    delete epipolarScattering;
+    delete skyCache;
+    delete frameGraph;
+    delete frameCapture;
+    delete shadowCubes;
+    delete lightBuffers;
+    for (DensityVolume *volume : densityVolumes)
+        delete volume;
+    delete renderQueue;
+    delete uniformRing;
+    delete assetStreamer;
+    delete referenceRenderer;
+    delete referenceScene;
+    delete jobSystem;
+    ReleaseGpuProfiler();
 
     glfwTerminate();
+
+    if (!tracePath.empty())
+        EndProfilerCapture(tracePath);
     return 0;
 }
 
@@ -449,12 +1489,17 @@ ArrowLine CreateArrowLine(const vector<glm::vec3>& pointsPos, const glm::vec4& c
     return ArrowLine(points, 2);
 }
 
-void CreateSceneObjects(Model& planeModel, Model& sphereModel, Model& cubeModel) {
+void CreateSceneObjects(Model& planeModel, Model& sphereModel, Model& cubeModel, MeshLodCache& lodCache) {
+    // bounds are computed once per model, and shared by all the objects which use it
+    const Bounds planeBounds = ComputeBounds(planeModel);
+    const Bounds sphereBounds = ComputeBounds(sphereModel);
+    const Bounds cubeBounds = ComputeBounds(cubeModel);
+
     auto floor = std::make_unique<Object>("Floor");
     floor->SetModel(&planeModel);
     Transform &floorTransform = floor->GetTransform();
     floorTransform.Scale(glm::vec3(2.0f));
-    objects.push_back(std::move(floor));
+    AddSceneObject(std::move(floor), planeModel, planeBounds, lodCache.Find(planeModel), true);
 
     auto negZWall = std::make_unique<Object>("NegZWall");
     negZWall->SetModel(&planeModel);
@@ -462,7 +1507,7 @@ void CreateSceneObjects(Model& planeModel, Model& sphereModel, Model& cubeModel)
     negZWallTransform.SetPosition(glm::vec3(0.0f, 0.0f, -15.0f));
     negZWallTransform.Rotate(glm::vec3(1.0f, 0.0f, 0.0f), glm::radians(-90.0f));
     negZWallTransform.Scale(glm::vec3(2.0f));
-    objects.push_back(std::move(negZWall));
+    AddSceneObject(std::move(negZWall), planeModel, planeBounds, lodCache.Find(planeModel), true);
 
     auto posXWall = std::make_unique<Object>("PosXWall");
     posXWall->SetModel(&planeModel);
@@ -470,149 +1515,1055 @@ void CreateSceneObjects(Model& planeModel, Model& sphereModel, Model& cubeModel)
     posXWallTransform.SetPosition(glm::vec3(15.0f, 0.0f, 0.0f));
     posXWallTransform.Rotate(glm::vec3(0.0f, 0.0f, 1.0f), glm::radians(90.0f));
     posXWallTransform.Scale(glm::vec3(2.0f));
-    objects.push_back(std::move(posXWall));
+    AddSceneObject(std::move(posXWall), planeModel, planeBounds, lodCache.Find(planeModel), true);
 
     auto cube1Obj = std::make_unique<Object>("Cube 1");
     cube1Obj->SetModel(&cubeModel);
     Transform &cube1Transform = cube1Obj->GetTransform();
     cube1Transform.SetPosition(glm::vec3(0.0f, 4.0f, -3.5f));
     cube1Transform.Scale(glm::vec3(0.5f));
-    objects.push_back(std::move(cube1Obj));
+    AddSceneObject(std::move(cube1Obj), cubeModel, cubeBounds, lodCache.Find(cubeModel), false);
 
     auto cube2Obj = std::make_unique<Object>("Cube 2");
     cube2Obj->SetModel(&cubeModel);
     Transform &cube2Transform = cube2Obj->GetTransform();
     cube2Transform.SetPosition(glm::vec3(-5.0f, 4.0f, -1.5f));
     cube2Transform.Scale(glm::vec3(0.2));
-    objects.push_back(std::move(cube2Obj));
+    AddSceneObject(std::move(cube2Obj), cubeModel, cubeBounds, lodCache.Find(cubeModel), false);
 
     auto sphere1Obj = std::make_unique<Object>("Sphere 1");
     sphere1Obj->SetModel(&sphereModel);
     Transform &sphere1Transform = sphere1Obj->GetTransform();
     sphere1Transform.SetPosition(glm::vec3(5.0f, 4.0f, -6.0f));
     sphere1Transform.Scale(glm::vec3(0.5));
-    objects.push_back(std::move(sphere1Obj));
+    AddSceneObject(std::move(sphere1Obj), sphereModel, sphereBounds, lodCache.Find(sphereModel), false);
+
+}
+
+//////////////////////////////////////////
+// the volumes are read from their files if present, otherwise they are generated
+void CreateDensityVolumes()
+{
+    DensityData fogBank;
+    if (!LoadDensityData(VOLUMES_DIR_PATH "/fog_bank.dvol", fogBank))
+        fogBank = GenerateFogBank(AABB(glm::vec3(-15.0f, -1.0f, -15.0f), glm::vec3(15.0f, 5.0f, 15.0f)), glm::ivec3(96, 24, 96), 1);
+    densityVolumes.push_back(new DensityVolume(fogBank));
+    referenceScene->AddVolume(fogBank);
+
+    DensityData smoke;
+    if (!LoadDensityData(VOLUMES_DIR_PATH "/smoke.dvol", smoke))
+        smoke = GenerateSmokeColumn(AABB(glm::vec3(-10.0f, -1.0f, 1.0f), glm::vec3(-4.0f, 15.0f, 7.0f)), glm::ivec3(32, 80, 32), 2);
+    densityVolumes.push_back(new DensityVolume(smoke));
+    referenceScene->AddVolume(smoke);
+}
+
+void AddSceneObject(std::unique_ptr<Object> object, Model &model, const Bounds &localBounds, LodModel *lodModel, bool occluder)
+{
+    const AABB worldBox = localBounds.Box.Transformed(object->GetTransform().GetTransformMatrix());
+    objectsProxies.push_back(sceneBVH.Insert(worldBox, (void *)objects.size()));
+    objectsWorldMatrices.push_back(object->GetTransform().GetTransformMatrix());
+    objectsWorldBoxes.push_back(worldBox);
+    objectsLocalBounds.push_back(localBounds);
+    objectsLods.push_back(lodModel);
+    objectsLodLevels.push_back(0);
+    objectsOccluders.push_back(occluder);
+    objectsModels.push_back(&model);
+    objects.push_back(std::move(object));
+}
+
+//////////////////////////////////////////
+// we update the world matrices and bounds of the objects (in parallel), then the BVH. Objects which moved inside their
+// fat AABB are not reinserted. The boxes of the moved objects are kept, to find the shadow cubes they change
+void UpdateSceneBounds()
+{
+    objectsNewBoxes.resize(objects.size());
+    jobSystem->ParallelFor(objects.size(), OBJECTS_PER_JOB, [](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            objectsWorldMatrices[i] = objects[i]->GetTransform().GetTransformMatrix();
+            objectsNewBoxes[i] = objectsLocalBounds[i].Box.Transformed(objectsWorldMatrices[i]);
+        }
+    });
 
+    movedBoxes.clear();
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        const AABB &worldBox = objectsNewBoxes[i];
+        if (worldBox.Min != objectsWorldBoxes[i].Min || worldBox.Max != objectsWorldBoxes[i].Max)
+        {
+            movedBoxes.push_back(objectsWorldBoxes[i]);
+            movedBoxes.push_back(worldBox);
+            objectsWorldBoxes[i] = worldBox;
+        }
+        sceneBVH.Move(objectsProxies[i], worldBox);
+    }
 }
-void PerformShadowMapping(Shader &shadowShader, GLuint depthMapFBO)
+
+//////////////////////////////////////////
+// we collect the objects inside the camera frustum
+void CullObjectsForCamera()
 {
-    glm::mat4 shadowTransforms[6] = {};
+    cameraVisibleObjects.clear();
+    if (!frustumCulling)
+    {
+        for (size_t i = 0; i < objects.size(); i++)
+            cameraVisibleObjects.push_back(i);
+        cullingStats.cameraVisible = (int)objects.size();
+        cullingStats.cameraNodesTested = 0;
+        return;
+    }
+
+    const Frustum frustum(projection * view);
+    cullingStats.cameraNodesTested = sceneBVH.Query(
+        [&](const AABB &box) { return frustum.Intersects(box); },
+        [&](int proxyId) { cameraVisibleObjects.push_back((size_t)sceneBVH.GetUserData(proxyId)); });
+    cullingStats.cameraVisible = (int)cameraVisibleObjects.size();
+}
+
+//////////////////////////////////////////
+// we select the LOD level of the visible objects, using their projected size on the screen
+void SelectObjectsLod()
+{
+    jobSystem->ParallelFor(cameraVisibleObjects.size(), OBJECTS_PER_JOB, [](size_t begin, size_t end) {
+        for (size_t visible = begin; visible < end; visible++)
+        {
+            const size_t i = cameraVisibleObjects[visible];
+            LodModel *lodModel = objectsLods[i];
+            if (lodModel == nullptr)
+                continue;
+
+            if (lodEnabled)
+            {
+                const BoundingSphere sphere = objectsLocalBounds[i].Sphere.Transformed(objectsWorldMatrices[i]);
+                const float screenSize = ProjectedScreenSize(sphere, camera.Position, cameraFovY);
+                objectsLodLevels[i] = SelectLod(objectsLodLevels[i], screenSize, lodModel->GetLevelCount(), lodSelectionSettings);
+            }
+            else
+            {
+                objectsLodLevels[i] = 0;
+            }
+        }
+    });
+
+    cameraTriangles = 0;
+    for (size_t i : cameraVisibleObjects)
+    {
+        if (objectsLods[i] != nullptr)
+            cameraTriangles += objectsLods[i]->GetTriangleCount(objectsLodLevels[i]);
+    }
+}
+
+//////////////////////////////////////////
+// we choose the resolution of the shadow cubes: in automatic mode it follows the largest screen coverage of the regions
+// lit by the shadowed lights (the part of their range inside the scene), since all the cubes share the array
+void UpdateShadowQuality()
+{
+    shadowCoverage = 0.0f;
+    if (shadowSettings.AutoResolution)
+    {
+        AABB sceneBox;
+        for (const AABB &box : objectsWorldBoxes)
+            sceneBox.Expand(box);
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            if (shadowScheduler.GetLayer(i) < 0)
+                continue;
+            const glm::vec3 range(lights[i].Range);
+            const AABB litBox(glm::max(lights[i].Position - range, sceneBox.Min), glm::min(lights[i].Position + range, sceneBox.Max));
+            if (!litBox.IsValid())
+                continue;
+            BoundingSphere sphere;
+            sphere.Center = litBox.Center();
+            sphere.Radius = glm::length(litBox.Extents());
+            shadowCoverage = std::max(shadowCoverage, ProjectedScreenSize(sphere, camera.Position, cameraFovY));
+        }
+    }
+
+    const int tier = SelectShadowTier(shadowTier, shadowCoverage, shadowSettings);
+    if (tier == shadowTier && shadowSettings.Format == shadowFormat)
+        return;
+    // the render thread reallocates the array before this frame: its content is lost
+    shadowTier = tier;
+    shadowFormat = shadowSettings.Format;
+    shadowScheduler.InvalidateAll();
+}
+
+//////////////////////////////////////////
+// we schedule the shadow cubes to render in this frame, collect their casters, and build the clusters of the lights
+void UpdateLights()
+{
+    UpdateShadowQuality();
+    shadowScheduler.Update(lights, movedBoxes, maxShadowUpdates);
+
+    // the cubes are culled in parallel, each job writing only its updates
+    const vector<size_t> &updates = shadowScheduler.GetUpdates();
+    shadowUpdates.resize(updates.size());
+    static vector<int> nodesTested;
+    nodesTested.assign(updates.size(), 0);
+    jobSystem->ParallelFor(updates.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            const PointLight &light = lights[updates[i]];
+            ShadowCubeUpdate &update = shadowUpdates[i];
+            update.Layer = shadowScheduler.GetLayer(updates[i]);
+            update.LightPos = light.Position;
+            update.Range = light.Range;
+            ComputeShadowTransforms(light, update.Transforms);
+            nodesTested[i] = CullObjectsForLight(update);
+        }
+    });
+
+    cullingStats.shadowCasters = 0;
+    cullingStats.shadowFaces = 0;
+    cullingStats.shadowNodesTested = 0;
+    shadowTriangles = 0;
+    for (size_t i = 0; i < shadowUpdates.size(); i++)
+    {
+        cullingStats.shadowNodesTested += nodesTested[i];
+        cullingStats.shadowCasters += (int)shadowUpdates[i].Draws.size();
+        for (const ObjectDraw &draw : shadowUpdates[i].Draws)
+        {
+            for (int face = 0; face < 6; face++)
+                cullingStats.shadowFaces += (draw.FaceMask >> face) & 1;
+            if (objectsLods[draw.Object] != nullptr)
+                shadowTriangles += objectsLods[draw.Object]->GetTriangleCount(draw.LodLevel);
+        }
+    }
+
+    lightClusters.Build(lights, view, projection, near, far, clusterSettings);
+}
+
+//////////////////////////////////////////
+// the extra lights are scattered in the room with a fixed sequence, so the same count always gives the same lights
+void ScatterLights()
+{
+    lights.resize(1);
+    for (int i = 0; i < extraLightCount; i++)
+    {
+        // additive recurrences with irrational steps spread the positions evenly
+        const float ux = glm::fract(0.5f + i * 0.6180340f);
+        const float uy = glm::fract(0.5f + i * 0.7548777f);
+        const float uz = glm::fract(0.5f + i * 0.5698403f);
+        PointLight light;
+        light.Position = glm::vec3(-14.0f + 28.0f * ux, 1.0f + 9.0f * uy, -14.0f + 28.0f * uz);
+        // saturated color with the hue from the index
+        const float hue = glm::fract(i * 0.6180340f) * 6.0f;
+        const glm::vec3 rgb(glm::clamp(std::abs(hue - 3.0f) - 1.0f, 0.0f, 1.0f),
+                            glm::clamp(2.0f - std::abs(hue - 2.0f), 0.0f, 1.0f),
+                            glm::clamp(2.0f - std::abs(hue - 4.0f), 0.0f, 1.0f));
+        light.Color = 0.2f * rgb;
+        light.Range = extraLightRange;
+        // the scene is static: the cubes of the extra lights are rendered once
+        light.Update = ShadowUpdate::STATIC;
+        lights.push_back(light);
+    }
+}
+
+//////////////////////////////////////////
+// we collect the objects inside the light range, and for each of them the faces of the shadow cube they touch; returns
+// the number of BVH nodes tested. Only the update is written, so the cubes can be culled in parallel
+int CullObjectsForLight(ShadowCubeUpdate &update)
+{
+    update.Draws.clear();
+    if (!frustumCulling)
+    {
+        for (size_t i = 0; i < objects.size(); i++)
+            update.Draws.push_back(MakeObjectDraw(i, SelectShadowCasterLod(i, update.LightPos), 0x3F));
+        return 0;
+    }
+
+    // the light range is given by the far plane of the shadow projection
+    const AABB lightRange(update.LightPos - glm::vec3(update.Range), update.LightPos + glm::vec3(update.Range));
+    Frustum faceFrustums[6];
+    for (int i = 0; i < 6; i++)
+        faceFrustums[i] = Frustum(update.Transforms[i]);
+
+    return sceneBVH.Query(
+        [&](const AABB &box) { return lightRange.Overlaps(box); },
+        [&](int proxyId) {
+            const AABB &box = sceneBVH.GetFatAABB(proxyId);
+            GLint faceMask = 0;
+            for (int i = 0; i < 6; i++)
+            {
+                if (faceFrustums[i].Intersects(box))
+                    faceMask |= 1 << i;
+            }
+            if (faceMask == 0)
+                return;
+            const size_t objectIndex = (size_t)sceneBVH.GetUserData(proxyId);
+            update.Draws.push_back(MakeObjectDraw(objectIndex, SelectShadowCasterLod(objectIndex, update.LightPos), faceMask));
+        });
+}
+
+//////////////////////////////////////////
+// shadow proxies: the LOD level of the shadow casters is chosen by their distance from the light
+int SelectShadowCasterLod(size_t objectIndex, const glm::vec3 &lightPos)
+{
+    LodModel *lodModel = objectsLods[objectIndex];
+    if (lodModel == nullptr || !lodEnabled)
+        return 0;
+
+    const BoundingSphere sphere = objectsLocalBounds[objectIndex].Sphere.Transformed(objectsWorldMatrices[objectIndex]);
+    return SelectShadowLod(sphere, lightPos, lodModel->GetLevelCount(), lodSelectionSettings);
+}
+
+//////////////////////////////////////////
+// view-projection matrices of the faces of the shadow cube (the far plane is the range of the light)
+void ComputeShadowTransforms(const PointLight &light, glm::mat4 shadowTransforms[6])
+{
+    const glm::vec3 &lightPos = light.Position;
+    const glm::mat4 shadowProj = glm::perspective(glm::radians(90.0f), 1.0f, near, light.Range);
     shadowTransforms[0] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
     shadowTransforms[1] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(-1.0, 0.0, 0.0), glm::vec3(0.0, -1.0, 0.0));
     shadowTransforms[2] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 1.0, 0.0), glm::vec3(0.0, 0.0, 1.0));
     shadowTransforms[3] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, -1.0, 0.0), glm::vec3(0.0, 0.0, -1.0));
     shadowTransforms[4] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, 1.0), glm::vec3(0.0, -1.0, 0.0));
     shadowTransforms[5] = shadowProj * glm::lookAt(lightPos, lightPos + glm::vec3(0.0, 0.0, -1.0), glm::vec3(0.0, -1.0, 0.0));
+}
 
-    shadowShader.Use();
+//////////////////////////////////////////
+ObjectDraw MakeObjectDraw(size_t objectIndex, int lodLevel, GLint faceMask)
+{
+    ObjectDraw draw;
+    draw.Object = objectIndex;
+    draw.LodLevel = lodLevel;
+    draw.ModelMatrix = objectsWorldMatrices[objectIndex];
+    draw.WorldBox = objectsLocalBounds[objectIndex].Box.Transformed(draw.ModelMatrix);
+    draw.FaceMask = faceMask;
+    return draw;
+}
 
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-    // we activate the FBO for the depth map rendering
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
+//////////////////////////////////////////
+// we decide if the frame is published: the state which changes by itself bumps the revision like the input, then the
+// frames keep being rendered until the temporal state has settled
+bool NeedsRedraw(const RenderStats &stats)
+{
+    const bool moving = keys[GLFW_KEY_W] || keys[GLFW_KEY_S] || keys[GLFW_KEY_A] || keys[GLFW_KEY_D];
+    // the updates of the cubes of the lights rendered every frame do not change a still scene
+    const bool shadowsChanged = shadowScheduler.GetPendingCount() > 0 ||
+        std::any_of(shadowScheduler.GetUpdates().begin(), shadowScheduler.GetUpdates().end(),
+                    [](size_t light) { return lights[light].Update != ShadowUpdate::EVERY_FRAME; });
+    if (moving || shadowsChanged || !movedBoxes.empty() || stats.TexturesPending > 0 || ImGui::IsAnyItemActive())
+        sceneRevision++;
+
+    if (sceneRevision != renderedRevision)
+    {
+        renderedRevision = sceneRevision;
+        settleFrames = idleSettings.SettleFrames;
+    }
+    else if (settleFrames > 0)
+    {
+        settleFrames--;
+    }
 
-    for (unsigned int i = 0; i < 6; ++i)
+    // the sessions and the captures need every frame, and the readbacks complete only when frames are rendered
+    const bool continuous = !idleSettings.Enabled || inputLog.IsReplaying() || inputLog.IsRecording() ||
+        !capturePrefix.empty() || !batchJobs.empty() || screenshotRequested || referenceCaptureRequested || stats.CapturesPending > 0;
+    return continuous || settleFrames > 0;
+}
+
+//////////////////////////////////////////
+// we copy in the packet the state of the frame produced by the update: the render thread does not read the globals
+// changed by the input, the GUI or the culling
+void BuildFramePacket(FramePacket &packet, const glm::vec3 &absorptionCoeff, const glm::vec3 &scatteringCoeff, float gCoeff)
+{
+    packet.View = view;
+    packet.Projection = projection;
+    packet.CameraPos = camera.Position;
+    packet.LightPos = lights[0].Position;
+    packet.ShadowUpdates = shadowUpdates;
+    packet.ShadowSize = ShadowTierSizes[shadowTier];
+    packet.ShadowFormat = GetShadowInternalFormat(shadowFormat);
+    PackLights(lights, shadowScheduler, packet.LightData);
+    packet.ClusterLights = lightClusters.GetClusterLights();
+    packet.LightIndices = lightClusters.GetLightIndices();
+    packet.ClusterSize = lightClusters.GetGridSize();
+    packet.ClusterDepth = lightClusters.GetDepthParams();
+    packet.AbsorptionCoeff = absorptionCoeff;
+    packet.ScatteringCoeff = scatteringCoeff;
+    packet.G = gCoeff;
+    packet.PhaseFunction = phaseFunction;
+    packet.SkyboxTechnique = skyboxTechnique;
+    packet.OcclusionMode = occlusionMode;
+    packet.StreamingBudgetMs = streamingBudgetMs;
+    packet.Resolution = resolutionSettings;
+    packet.March = marchSettings;
+    packet.Epipolar = epipolarSettings;
+    packet.Medium = mediumSettings;
+    packet.SkyCache = skyCacheSettings;
+    packet.Capture = CaptureTarget();
+    packet.Capture.Format = captureFormat;
+    const string extension = captureFormat == CaptureFormat::EXR ? ".exr" : ".png";
+    char number[16];
+    if (!capturePrefix.empty())
+    {
+        snprintf(number, sizeof(number), "_%05d", capturedFrames++);
+        packet.Capture.Path = capturePrefix + number + extension;
+    }
+    else if (referenceCaptureRequested)
     {
-        string name = "shadowMatrices[" + std::to_string(i) + "]";
-        glUniformMatrix4fv(glGetUniformLocation(shadowShader.Program, name.c_str()), 1, GL_FALSE, glm::value_ptr(shadowTransforms[i]));
+        packet.Capture.Path = referenceName + "_gpu" + extension;
+        referenceCaptureRequested = false;
     }
-    glUniform3fv(glGetUniformLocation(shadowShader.Program, "lightPos"), 1, glm::value_ptr(lightPos));
+    else if (screenshotRequested)
+    {
+        snprintf(number, sizeof(number), "_%03d", screenshots++);
+        packet.Capture.Path = "screenshot" + string(number) + extension;
+    }
+    screenshotRequested = false;
+    packet.WindowWidth = width;
+    packet.WindowHeight = height;
+    packet.OutputWidth = packet.OutputHeight = 0;
+    packet.JobIndex = -1;
+
+    packet.CameraDraws.clear();
+    for (size_t i : cameraVisibleObjects)
+        packet.CameraDraws.push_back(MakeObjectDraw(i, objectsLodLevels[i], -1));
+
+    // ImGui rebuilds its draw lists at the next NewFrame: the packet keeps a copy of them
+    for (ImDrawList *list : packet.GuiLists)
+        IM_DELETE(list);
+    packet.GuiLists.clear();
+    ImDrawData *guiData = ImGui::GetDrawData();
+    for (int i = 0; i < guiData->CmdListsCount; i++)
+        packet.GuiLists.push_back(guiData->CmdLists[i]->CloneOutput());
+    packet.GuiData = *guiData;
+    packet.GuiData.CmdLists = packet.GuiLists.data();
+}
 
-    RenderObjects(shadowShader);
+//////////////////////////////////////////
+// BATCH RENDERING
+// the jobs start from the parameters of the application. The tiles are limited by the size of the textures, of the
+// renderbuffers and of the viewport
+void LoadBatch()
+{
+    BatchJob defaults;
+    defaults.CameraPos = camera.Position;
+    defaults.Yaw = camera.Yaw;
+    defaults.Pitch = camera.Pitch;
+    defaults.LightPos = lights[0].Position;
+    defaults.PhaseFunction = phaseFunction;
+    defaults.SkyboxTechnique = skyboxTechnique;
+    if (!LoadBatchJobs(batchPath, defaults, batchJobs))
+        return;
+
+    GLint maxTextureSize = 0, maxRenderbufferSize = 0, maxViewport[2] = {};
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxRenderbufferSize);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    batchTileLimit = std::min({batchTileLimit, (int)maxTextureSize, (int)maxRenderbufferSize, (int)maxViewport[0], (int)maxViewport[1]});
+
+    const string extension = captureFormat == CaptureFormat::EXR ? ".exr" : ".png";
+    for (const BatchJob &job : batchJobs)
+        batchFiles.push_back(batchOutput + "/" + job.Name + extension);
+    batchTimings.assign(batchJobs.size(), BatchJobTiming());
+
+    // the frames of a batch are not related: the queries of the previous frame, the LOD and the time budgets of the
+    // shadows would change the images, and the sharpening is not needed by a tile rendered at its size
+    lodEnabled = false;
+    occlusionMode = (int)OcclusionMode::DISABLED;
+    maxShadowUpdates = SHADOW_LAYERS;
+    resolutionSettings.Enabled = false;
+    resolutionSettings.Sharpness = 0.0f;
+    std::cout << "Batch: " << batchJobs.size() << " jobs, tiles of at most " << batchTileLimit << " pixels" << std::endl;
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// the camera, the light and the medium of the current job, with the projection of its current tile
+void ApplyBatchJob(glm::vec3 &absorptionCoeff, glm::vec3 &scatteringCoeff, float &gCoeff)
+{
+    const BatchJob &job = batchJobs[batchJob];
+    if (batchTile == 0)
+        batchTiles = SplitIntoTiles(job.Width, job.Height, batchTileLimit);
+
+    camera.Position = job.CameraPos;
+    camera.Yaw = job.Yaw;
+    camera.Pitch = job.Pitch;
+    // a null movement updates the vectors of the camera
+    camera.ProcessMouseMovement(0.0f, 0.0f, GL_FALSE);
+    lights[0].Position = job.LightPos;
+    absorptionCoeff = job.AbsorptionCoeff;
+    scatteringCoeff = job.ScatteringCoeff;
+    gCoeff = job.G;
+    phaseFunction = job.PhaseFunction;
+    skyboxTechnique = job.SkyboxTechnique;
+    projection = GetTileProjection(cameraFovY, near, far, job.Width, job.Height, batchTiles[batchTile]);
 }
 
-void PerformIlluminationPass(Shader &shader, glm::vec3 &absorptionCoeff, glm::vec3 &scatteringCoeff, float gCoeff)
+// the packet draws the current tile at its size, and captures it at its place in the image of the job. The first frames
+// only wait for the textures: returns false once the last tile is published
+bool SetBatchTile(FramePacket &packet, size_t texturesPending)
 {
+    const BatchTile &tile = batchTiles[batchTile];
+    packet.OutputWidth = tile.Width;
+    packet.OutputHeight = tile.Height;
+    if (batchWarmupFrames > 0 || texturesPending > 0)
+    {
+        batchWarmupFrames = std::max(batchWarmupFrames - 1, 0);
+        return true;
+    }
 
-    // we "clear" the frame and z buffer
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    const int64_t now = ProfilerNow();
+    if (batchStartUs < 0)
+        batchStartUs = now;
+    if (batchTile == 0)
+    {
+        batchTimings[batchJob].SubmittedMs = (now - batchStartUs) / 1000.0;
+        batchTimings[batchJob].Tiles = (int)batchTiles.size();
+    }
+    const BatchJob &job = batchJobs[batchJob];
+    packet.JobIndex = (int)batchJob;
+    packet.Capture.Path = batchFiles[batchJob];
+    packet.Capture.ImageWidth = job.Width;
+    packet.Capture.ImageHeight = job.Height;
+    packet.Capture.X = tile.X;
+    packet.Capture.Y = tile.Y;
+
+    if (++batchTile == batchTiles.size())
+    {
+        batchTile = 0;
+        batchJob++;
+    }
+    return batchJob < batchJobs.size();
+}
 
-    // we set the viewport for the final rendering step
-    glViewport(0, 0, width, height);
+// the render thread has flushed the captures: the results of the encoders complete the timings of the jobs
+void FinishBatch()
+{
+    for (const CaptureResult &result : frameCapture->TakeResults())
+    {
+        auto file = std::find(batchFiles.begin(), batchFiles.end(), result.Path);
+        if (file == batchFiles.end())
+            continue;
+        BatchJobTiming &timing = batchTimings[file - batchFiles.begin()];
+        timing.Written = result.Written;
+        timing.WrittenMs = (result.CompletedUs - batchStartUs) / 1000.0;
+        timing.EncodeMs = result.EncodeUs / 1000.0;
+    }
+    RenderBatchReferences();
+    WriteBatchReport(batchOutput + "/batch_report.csv", batchJobs, batchFiles, batchTimings);
 
-    // illumination pass
-    shader.Use();
+    int written = 0;
+    double totalMs = 0.0;
+    for (const BatchJobTiming &timing : batchTimings)
+    {
+        written += timing.Written ? 1 : 0;
+        totalMs = std::max(totalMs, timing.WrittenMs);
+    }
+    std::cout << "Batch: " << written << " of " << batchJobs.size() << " images written in " << totalMs / 1000.0 << " s"
+              << std::endl;
+}
 
-    const GLuint selectedPhaseFunc = (GLuint) phaseFunction;
-    glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &selectedPhaseFunc);
+//////////////////////////////////////////
+// REFERENCE RENDERS
+// the meshes of the objects are copied in world space (the objects do not move), before the CPU copies are dropped;
+// the volumes are added by CreateDensityVolumes
+void CreateReferenceScene()
+{
+    referenceScene = new ReferenceScene();
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        for (auto &mesh : objectsModels[i]->meshes)
+            referenceScene->AddMesh(mesh->vertices, mesh->indices, objectsWorldMatrices[i]);
+    }
+    ReferenceMaterial material;
+    material.Kd = Kd;
+    material.Alpha = alpha;
+    material.F0 = F0;
+    material.Repeat = repeat;
+    material.AlbedoPath = TEXTURES_DIR_PATH "/UV_Grid_Sm.png";
+    referenceScene->SetMaterial(material);
+    const string cubePath = TEXTURES_DIR_PATH "/cube/Maskonaive2/";
+    referenceScene->SetEnvironment({cubePath + "posx.jpg", cubePath + "negx.jpg", cubePath + "posy.jpg",
+                                    cubePath + "negy.jpg", cubePath + "posz.jpg", cubePath + "negz.jpg"});
+    referenceScene->Build();
+    referenceRenderer = new ReferenceRenderer(*referenceScene, *jobSystem);
+}
 
-    // VERTEX SHADER'S UNIFORMS
-    // model matrix is set by object.cpp when render call is fired
-    glUniformMatrix4fv(glGetUniformLocation(shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+// the lights and the medium of the frame; the medium reaches the far plane, where the GPU draws the sky
+ReferenceFrame MakeReferenceFrame(const glm::mat4 &viewMatrix, const glm::mat4 &projectionMatrix, int imageWidth, int imageHeight,
+                                  const glm::vec3 &absorptionCoeff, const glm::vec3 &scatteringCoeff, float gCoeff)
+{
+    ReferenceFrame frame;
+    frame.View = viewMatrix;
+    frame.Projection = projectionMatrix;
+    frame.CameraPos = camera.Position;
+    frame.Width = imageWidth;
+    frame.Height = imageHeight;
+    frame.Lights = lights;
+    frame.AbsorptionCoeff = absorptionCoeff;
+    frame.ScatteringCoeff = scatteringCoeff;
+    frame.G = gCoeff;
+    frame.PhaseFunction = phaseFunction;
+    frame.Medium = mediumSettings;
+    frame.MediumRadius = far;
+    return frame;
+}
 
-    // FRAGMENT SHADER'S UNIFORMS
-    glUniform3fv(glGetUniformLocation(shader.Program, "wLightPos"), 1, glm::value_ptr(lightPos));
-    glUniform3fv(glGetUniformLocation(shader.Program, "wCameraPos"), 1, glm::value_ptr(camera.Position));
+// the reference of the current view, at the size of the window; the next packet captures the GPU frame
+void StartReference(const glm::vec3 &absorptionCoeff, const glm::vec3 &scatteringCoeff, float gCoeff)
+{
+    // the capture of every frame would take the place of the GPU frame of the reference
+    if (!capturePrefix.empty())
+    {
+        std::cout << "ERROR::REFERENCE::CAPTURE_RUNNING" << std::endl;
+        return;
+    }
+    char number[16];
+    snprintf(number, sizeof(number), "_%03d", references++);
+    referenceName = "reference" + string(number);
+    referenceRenderer->Start(MakeReferenceFrame(view, projection, width, height, absorptionCoeff, scatteringCoeff, gCoeff),
+                             referenceSettings);
+    referenceCaptureRequested = true;
+    referenceCaptureCount = frameCapture->GetWrittenCount() + frameCapture->GetDroppedCount();
+    referencePending = true;
+    referenceCompared = false;
+    referenceShownSamples = 0;
+}
 
-    // Participating media
-    glUniform3fv(glGetUniformLocation(shader.Program, "absorptionCoeff"), 1, glm::value_ptr(absorptionCoeff));
-    glUniform3fv(glGetUniformLocation(shader.Program, "scatteringCoeff"), 1, glm::value_ptr(scatteringCoeff));
-    glUniform1f(glGetUniformLocation(shader.Program, "g"), gCoeff);
+// while the render runs, a new pass only redraws the GUI to update its sample count (the image is not shown); once the
+// reference and the capture are done, the images are written and compared (the window is 8 bit: the reference is clamped)
+void UpdateReference()
+{
+    if (!referencePending)
+        return;
+    if (referenceRenderer->IsRunning())
+    {
+        if (referenceRenderer->GetCompletedSamples() != referenceShownSamples)
+        {
+            referenceShownSamples = referenceRenderer->GetCompletedSamples();
+            sceneRevision++;
+        }
+        return;
+    }
+    if (referenceCaptureRequested || frameCapture->GetWrittenCount() + frameCapture->GetDroppedCount() <= referenceCaptureCount)
+        return;
+
+    referencePending = false;
+    sceneRevision++;
+    const int imageWidth = referenceRenderer->GetWidth(), imageHeight = referenceRenderer->GetHeight();
+    const vector<float> reference = referenceRenderer->GetImage();
+    WriteExr(referenceName + ".exr", imageWidth, imageHeight, reference.data());
+
+    const string extension = captureFormat == CaptureFormat::EXR ? ".exr" : ".png";
+    int gpuWidth = 0, gpuHeight = 0;
+    vector<float> gpu, errorImage;
+    if (!LoadCapturedImage(referenceName + "_gpu" + extension, gpuWidth, gpuHeight, gpu))
+        return;
+    if (gpuWidth != imageWidth || gpuHeight != imageHeight)
+    {
+        std::cout << "ERROR::REFERENCE::SIZE_MISMATCH: " << referenceName << " GPU " << gpuWidth << "x" << gpuHeight
+                  << ", reference " << imageWidth << "x" << imageHeight << std::endl;
+        return;
+    }
+    referenceError = CompareImages(gpu, reference, true, &errorImage);
+    referenceCompared = true;
+    WriteExr(referenceName + "_error.exr", imageWidth, imageHeight, errorImage.data());
+    std::cout << "Reference " << referenceName << ": " << referenceRenderer->GetCompletedSamples() << " samples in "
+              << referenceRenderer->GetElapsedMs() / 1000.0 << " s, RMSE " << referenceError.Rmse << ", relMSE "
+              << referenceError.RelMse << std::endl;
+}
 
-    RenderObjects(shader);
+// the jobs with reference samples, once their GPU images are written: the references are rendered one at a time with
+// all the workers and the main thread, at the size of the images (the PNG images are compared with the reference clamped)
+void RenderBatchReferences()
+{
+    for (size_t i = 0; i < batchJobs.size(); i++)
+    {
+        const BatchJob &job = batchJobs[i];
+        if (job.ReferenceSamples <= 0)
+            continue;
+        camera.Position = job.CameraPos;
+        camera.Yaw = job.Yaw;
+        camera.Pitch = job.Pitch;
+        camera.ProcessMouseMovement(0.0f, 0.0f, GL_FALSE);
+        lights[0].Position = job.LightPos;
+        phaseFunction = job.PhaseFunction;
+        const glm::mat4 jobProjection = GetTileProjection(cameraFovY, near, far, job.Width, job.Height, {0, 0, job.Width, job.Height});
+        ReferenceSettings settings = referenceSettings;
+        settings.Samples = job.ReferenceSamples;
+        referenceRenderer->Render(MakeReferenceFrame(camera.GetViewMatrix(), jobProjection, job.Width, job.Height,
+                                                     job.AbsorptionCoeff, job.ScatteringCoeff, job.G),
+                                  settings);
+
+        BatchJobTiming &timing = batchTimings[i];
+        timing.ReferenceMs = referenceRenderer->GetElapsedMs();
+        const vector<float> reference = referenceRenderer->GetImage();
+        const string path = batchOutput + "/" + job.Name;
+        WriteExr(path + "_reference.exr", job.Width, job.Height, reference.data());
+
+        int gpuWidth = 0, gpuHeight = 0;
+        vector<float> gpu, errorImage;
+        const bool loaded = timing.Written && LoadCapturedImage(batchFiles[i], gpuWidth, gpuHeight, gpu);
+        if (loaded && (gpuWidth != job.Width || gpuHeight != job.Height))
+            std::cout << "ERROR::REFERENCE::SIZE_MISMATCH: " << job.Name << " GPU " << gpuWidth << "x" << gpuHeight
+                      << ", reference " << job.Width << "x" << job.Height << std::endl;
+        else if (loaded)
+        {
+            const ImageError error = CompareImages(gpu, reference, captureFormat == CaptureFormat::PNG, &errorImage);
+            timing.ReferenceRmse = error.Rmse;
+            timing.ReferenceRelMse = error.RelMse;
+            WriteExr(path + "_error.exr", job.Width, job.Height, errorImage.data());
+        }
+        std::cout << "Reference " << job.Name << ": " << job.ReferenceSamples << " samples in " << timing.ReferenceMs / 1000.0
+                  << " s, RMSE " << timing.ReferenceRmse << ", relMSE " << timing.ReferenceRelMse << std::endl;
+    }
 }
 
-void PerformSkyBoxPass(Shader& shader, Model &skyboxCube) {
-    shader.Use();
-    glDepthFunc(GL_LEQUAL);
+//////////////////////////////////////////
+// only the cubes scheduled for this frame are rendered: the other layers of the array keep their content
+void PerformShadowMapping(Shader &shadowShader, const FramePacket &packet)
+{
+    PROFILE_SCOPE("Shadow pass");
+    PROFILE_GPU_SCOPE("Shadow pass");
+    if (packet.ShadowUpdates.empty())
+        return;
 
-    glUniformMatrix4fv(glGetUniformLocation(shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(glm::mat4(glm::mat3(view))));
+    for (const ShadowCubeUpdate &update : packet.ShadowUpdates)
+        shadowCubes->ClearLayer(update.Layer);
+    // we activate the FBO for the depth map rendering
+    shadowCubes->Bind();
 
-    skyboxCube.Draw();
+    for (const ShadowCubeUpdate &update : packet.ShadowUpdates)
+    {
+        PassUniforms pass;
+        for (unsigned int i = 0; i < 6; ++i)
+            pass.ShadowMatrices[i] = update.Transforms[i];
+        pass.WLightPos = update.LightPos;
+        pass.ShadowLayer = update.Layer;
+        pass.ShadowFarPlane = update.Range;
+        renderQueue->SetPassUniforms(pass);
+
+        // the geometry shader emits each triangle only on the cube faces enabled by the mask
+        DrawItem item;
+        item.Program = shadowShader.Program;
+        for (const ObjectDraw &draw : update.Draws)
+        {
+            item.FaceMask = draw.FaceMask;
+            SubmitObject(item, draw, packet.View);
+        }
+        renderQueue->Flush();
+    }
+    // the frame graph binds the target of the next pass
+}
 
-    glDepthFunc(GL_LESS);
+//////////////////////////////////////////
+void SetMarchUniforms(PassUniforms &pass, const MarchSettings &march)
+{
+    pass.MinSteps = march.MinSteps;
+    // the step count is clamped in the shader: the maximum cannot be lower than the minimum
+    pass.MaxSteps = std::max(march.MinSteps, march.MaxSteps);
+    pass.StepsPerOpticalDepth = march.StepsPerOpticalDepth;
+    pass.TransmittanceThreshold = march.TransmittanceThreshold;
+    pass.StepHeatmap = march.StepHeatmap ? 1 : 0;
 }
 
-void PerformSkyboxPass(Shader &shader, Model &skyboxCube, glm::vec3 &absorptionCoeff, glm::vec3 &scatteringCoeff, float gCoeff)
+void SetLightUniforms(PassUniforms &pass, const FramePacket &packet)
 {
-    // skybox
-    shader.Use();
-    const GLuint selectedPhaseFunc = (GLuint) phaseFunction;
-    glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &selectedPhaseFunc);
-    glDepthFunc(GL_LEQUAL);
+    // the full view of the camera, also in the skybox pass: a point is assigned to the cluster it is seen in
+    pass.ClusterViewProj = packet.Projection * packet.View;
+    pass.ClusterSize = packet.ClusterSize;
+    pass.ClusterDepth = packet.ClusterDepth;
+}
+
+void SetMediumUniforms(PassUniforms &pass, const MediumSettings &medium)
+{
+    pass.AmbientDensity = medium.AmbientDensity;
+    pass.VolumeCount = 0;
+    if (!medium.VolumesEnabled)
+        return;
+    for (size_t i = 0; i < densityVolumes.size(); i++)
+    {
+        const AABB &bounds = densityVolumes[i]->GetBounds();
+        const float density = medium.VolumeDensity[i];
+        pass.VolumeMin[i] = glm::vec4(bounds.Min, density);
+        pass.VolumeMax[i] = glm::vec4(bounds.Max, densityVolumes[i]->GetMaxDensity() * density);
+    }
+    pass.VolumeCount = (GLint)densityVolumes.size();
+}
+
+void PerformIlluminationPass(Shader &shader, const FramePacket &packet)
+{
+    PROFILE_SCOPE("Illumination pass");
+    PROFILE_GPU_SCOPE("Illumination pass");
+
+    // we "clear" the frame and z buffer
+    // (the frame graph has bound the scene target, with the viewport at the scaled resolution)
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // illumination pass: the program and the phase function subroutine are set by the render queue
+
+    // VERTEX SHADER'S UNIFORMS
+    // model matrix is written by the render queue in the constants of each draw
+    PassUniforms pass;
+    pass.ViewMatrix = packet.View;
+    pass.ProjectionMatrix = packet.Projection;
+
+    // FRAGMENT SHADER'S UNIFORMS
+    pass.WLightPos = packet.LightPos;
+    pass.WCameraPos = packet.CameraPos;
+
+    // Participating media
+    pass.AbsorptionCoeff = packet.AbsorptionCoeff;
+    pass.ScatteringCoeff = packet.ScatteringCoeff;
+    pass.G = packet.G;
+    SetMarchUniforms(pass, packet.March);
+    SetLightUniforms(pass, packet);
+    SetMediumUniforms(pass, packet.Medium);
+    pass.ExternalInscattering = packet.Epipolar.Enabled ? 1 : 0;
+    renderQueue->SetPassUniforms(pass);
+
+    RenderObjectsWithOcclusion(shader, packet);
+}
 
-    glUniformMatrix4fv(glGetUniformLocation(shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(glm::mat4(glm::mat3(view))));
-    glm::mat4 inverseViewProjection = glm::inverse((projection * glm::mat4(glm::mat3(view))));
-    glUniformMatrix4fv(glGetUniformLocation(shader.Program, "inverseViewProjMatrix"), 1, GL_FALSE, glm::value_ptr(inverseViewProjection));
-    glUniform1f(glGetUniformLocation(shader.Program, "width"), width);
-    glUniform1f(glGetUniformLocation(shader.Program, "height"), height);
+void PerformSkyBoxPass(Shader& shader, const LodModel &skyboxCube, const FramePacket &packet) {
+    PROFILE_SCOPE("Fog skybox pass");
+    PROFILE_GPU_SCOPE("Fog skybox pass");
+    PassUniforms pass;
+    pass.ViewMatrix = glm::mat4(glm::mat3(packet.View));
+    pass.ProjectionMatrix = packet.Projection;
+    renderQueue->SetPassUniforms(pass);
+
+    DrawItem item;
+    item.Program = shader.Program;
+    item.Textures = &skyboxTextures;
+    item.DepthFunc = GL_LEQUAL;
+    SubmitLod(item, skyboxCube, 0);
+    renderQueue->Flush();
+}
+
+// values the media sky depends on, besides the view direction and the camera position: a change renders the cache
+// again. The sky texture is streamed, so the cache is rendered again once the textures are uploaded
+vector<float> GetSkyParameters(const FramePacket &packet, size_t texturesPending)
+{
+    vector<float> parameters;
+    for (const glm::vec4 &texel : packet.LightData)
+        parameters.insert(parameters.end(), {texel.x, texel.y, texel.z, texel.w});
+    parameters.insert(parameters.end(), {packet.AbsorptionCoeff.x, packet.AbsorptionCoeff.y, packet.AbsorptionCoeff.z,
+                                         packet.ScatteringCoeff.x, packet.ScatteringCoeff.y, packet.ScatteringCoeff.z, packet.G,
+                                         (float)packet.PhaseFunction, (float)packet.March.MinSteps, (float)packet.March.MaxSteps,
+                                         packet.March.StepsPerOpticalDepth, packet.March.TransmittanceThreshold,
+                                         packet.Epipolar.Enabled ? 1.0f : 0.0f, packet.Medium.AmbientDensity,
+                                         packet.Medium.VolumesEnabled ? 1.0f : 0.0f, (float)texturesPending});
+    parameters.insert(parameters.end(), packet.Medium.VolumeDensity, packet.Medium.VolumeDensity + MaxDensityVolumes);
+    return parameters;
+}
 
+// constants of the media skybox seen with the given rotation of the camera and projection
+void SetSkyboxUniforms(PassUniforms &pass, const FramePacket &packet, const glm::mat4 &viewRotation, const glm::mat4 &projection)
+{
+    pass.ViewMatrix = viewRotation;
+    pass.ProjectionMatrix = projection;
+    pass.InverseViewProjMatrix = glm::inverse(projection * viewRotation);
 
     // FOR PARTMEDIA SKYBOX
-    glUniform3fv(glGetUniformLocation(shader.Program, "wLightPos"), 1, glm::value_ptr(lightPos));
-    glUniform3fv(glGetUniformLocation(shader.Program, "wCameraPos"), 1, glm::value_ptr(camera.Position));
+    pass.WLightPos = packet.LightPos;
+    pass.WCameraPos = packet.CameraPos;
 
     // Participating media
-    glUniform3fv(glGetUniformLocation(shader.Program, "absorptionCoeff"), 1, glm::value_ptr(absorptionCoeff));
-    glUniform3fv(glGetUniformLocation(shader.Program, "scatteringCoeff"), 1, glm::value_ptr(scatteringCoeff));
-    glUniform1f(glGetUniformLocation(shader.Program, "g"), gCoeff);
+    pass.AbsorptionCoeff = packet.AbsorptionCoeff;
+    pass.ScatteringCoeff = packet.ScatteringCoeff;
+    pass.G = packet.G;
+    SetMarchUniforms(pass, packet.March);
+    SetLightUniforms(pass, packet);
+    SetMediumUniforms(pass, packet.Medium);
+    pass.ExternalInscattering = packet.Epipolar.Enabled ? 1 : 0;
+}
 
-    skyboxCube.Draw();
+// the media sky is rendered in the 6 faces of the cache, from the position of the camera
+void RenderSkyCache(Shader &shader, const LodModel &skyboxCube, const FramePacket &packet, const vector<float> &parameters)
+{
+    PROFILE_SCOPE("Sky cache pass");
+    PROFILE_GPU_SCOPE("Sky cache pass");
+    glState.Uniform(shader.Program, "cacheRender", 1);
+    for (int face = 0; face < 6; face++)
+    {
+        skyCache->BindFace(face);
+        PassUniforms pass;
+        SetSkyboxUniforms(pass, packet, SkyCache::GetFaceView(face), SkyCache::GetFaceProjection());
+        renderQueue->SetPassUniforms(pass);
+
+        // the faces have no depth buffer: the whole cube is drawn
+        DrawItem item;
+        item.Program = shader.Program;
+        item.Textures = &skyboxTextures;
+        item.DepthFunc = GL_LEQUAL;
+        item.Subroutine = (GLuint) packet.PhaseFunction;
+        SubmitLod(item, skyboxCube, 0);
+        renderQueue->Flush();
+    }
+    glState.Uniform(shader.Program, "cacheRender", 0);
+    skyCache->MarkRendered(packet.CameraPos, parameters);
+}
+
+void PerformSkyboxPass(Shader &shader, Shader &cachedShader, const LodModel &skyboxCube, const FramePacket &packet, bool cached)
+{
+    PROFILE_SCOPE("Media skybox pass");
+    PROFILE_GPU_SCOPE("Media skybox pass");
+    // skybox
+    PassUniforms pass;
+    SetSkyboxUniforms(pass, packet, glm::mat4(glm::mat3(packet.View)), packet.Projection);
+    renderQueue->SetPassUniforms(pass);
+
+    // the skybox is drawn where the depth is still at the far plane; with the cache, the sky is a fetch of its cube
+    DrawItem item;
+    item.DepthFunc = GL_LEQUAL;
+    if (cached)
+    {
+        item.Program = cachedShader.Program;
+        item.Textures = &skyCacheTextures;
+    }
+    else
+    {
+        item.Program = shader.Program;
+        item.Textures = &skyboxTextures;
+        item.Subroutine = (GLuint) packet.PhaseFunction;
+    }
+    SubmitLod(item, skyboxCube, 0);
+    renderQueue->Flush();
+}
 
-    glDepthFunc(GL_LESS);
+//////////////////////////////////////////
+// in-scattering of the media with epipolar sampling, on the depth of the scene target
+void PerformEpipolarPass(const FramePacket &packet, GLuint inscatteringFramebuffer)
+{
+    PROFILE_SCOPE("Epipolar pass");
+    PROFILE_GPU_SCOPE("Epipolar pass");
+    PassUniforms pass;
+    pass.ViewMatrix = packet.View;
+    pass.ProjectionMatrix = packet.Projection;
+    pass.InverseViewProjMatrix = glm::inverse(packet.Projection * packet.View);
+    pass.WLightPos = packet.LightPos;
+    pass.WCameraPos = packet.CameraPos;
+    pass.AbsorptionCoeff = packet.AbsorptionCoeff;
+    pass.ScatteringCoeff = packet.ScatteringCoeff;
+    pass.G = packet.G;
+    SetMarchUniforms(pass, packet.March);
+    SetLightUniforms(pass, packet);
+    SetMediumUniforms(pass, packet.Medium);
+    renderQueue->SetPassUniforms(pass);
+    // the passes draw with direct GL calls, without a flush of the queue: we upload the constants now
+    uniformRing->Upload();
+    // the lights are read from the same buffer textures of the media passes
+    glState.BindTexture(LightDataUnit, GL_TEXTURE_BUFFER, lightBuffers->GetLightDataTexture());
+    glState.BindTexture(ClusterLightsUnit, GL_TEXTURE_BUFFER, lightBuffers->GetClusterLightsTexture());
+    glState.BindTexture(LightIndicesUnit, GL_TEXTURE_BUFFER, lightBuffers->GetLightIndicesTexture());
+    for (size_t i = 0; i < densityVolumes.size(); i++)
+        glState.BindTexture(DensityVolumeUnit + (GLuint)i, GL_TEXTURE_3D, densityVolumes[i]->GetTexture());
+
+    const glm::vec4 lightClipPos = packet.Projection * packet.View * glm::vec4(packet.LightPos, 1.0f);
+    epipolarScattering->Render(packet.Epipolar, lightClipPos, sceneTarget->GetDepthTexture(), shadowCubes->GetTexture(),
+                               inscatteringFramebuffer, sceneTarget->GetWidth(), sceneTarget->GetHeight(), sceneTarget->GetUvScale(),
+                               (GLuint)packet.PhaseFunction, packet.SkyboxTechnique == 1);
+    // the passes changed program, framebuffer, vertex array and texture bindings
+    glState.Invalidate();
 }
 
-void RenderAxis(Shader& shader, ArrowLine& xAxis, ArrowLine& yAxis, ArrowLine& zAxis) {
+void RenderAxis(Shader& shader, ArrowLine& xAxis, ArrowLine& yAxis, ArrowLine& zAxis, const FramePacket &packet) {
     // AXIS RENDERING
-        shader.Use();
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+        glState.UseProgram(shader.Program);
+        glState.DepthFunc(GL_LESS);
+        glState.Uniform(shader.Program, "projectionMatrix", packet.Projection);
+        glState.Uniform(shader.Program, "viewMatrix", packet.View);
 
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
         xAxis.Draw();
         yAxis.Draw();
         zAxis.Draw();
+        // the lines bind their own vertex arrays
+        glState.Invalidate();
 }
 
 //////////////////////////////////////////
-// we render the objects. We pass also the current rendering step, and the depth map generated in the first step, which is used by the shaders of the second step
-void RenderObjects(Shader &shader)
+// we submit the objects to the render queue, each one with the LOD level selected for the camera
+void SubmitObjects(const DrawItem &base, const vector<ObjectDraw> &draws, const glm::mat4 &viewMatrix)
 {
-    for (size_t i = 0; i < objects.size(); i++)
+    for (const ObjectDraw &draw : draws)
+    {
+        SubmitObject(base, draw, viewMatrix);
+    }
+}
+
+//////////////////////////////////////////
+// we render the occluders, then the bounding boxes of the other visible objects are tested against their depth
+void RenderObjectsWithOcclusion(Shader &shader, const FramePacket &packet)
+{
+    DrawItem item;
+    item.Program = shader.Program;
+    item.Textures = &illuminationTextures;
+    item.Subroutine = (GLuint) packet.PhaseFunction;
+
+    occlusionSkipped = 0;
+    if (packet.OcclusionMode == (int)OcclusionMode::DISABLED)
+    {
+        SubmitObjects(item, packet.CameraDraws, packet.View);
+        renderQueue->Flush();
+        return;
+    }
+
+    vector<ObjectDraw> occluders, occludees;
+    for (const ObjectDraw &draw : packet.CameraDraws)
+        (objectsOccluders[draw.Object] ? occluders : occludees).push_back(draw);
+
+    SubmitObjects(item, occluders, packet.View);
+    renderQueue->Flush();
+
+    occlusionCuller->CollectResults();
+    occlusionCuller->BeginQueries(packet.Projection * packet.View);
+    for (const ObjectDraw &draw : occludees)
+        occlusionCuller->QueryBox(draw.Object, draw.WorldBox, packet.CameraPos, near);
+    occlusionCuller->EndQueries();
+
+    // the occlusion culler replaced program, vertex array and depth state with direct GL calls
+    glState.Invalidate();
+
+    for (const ObjectDraw &draw : occludees)
     {
-        objects[i]->Render(shader, view);
+        if (packet.OcclusionMode == (int)OcclusionMode::PREVIOUS_FRAME)
+        {
+            if (occlusionCuller->IsOccluded(draw.Object))
+            {
+                occlusionSkipped++;
+                continue;
+            }
+            SubmitObject(item, draw, packet.View);
+        }
+        else
+        {
+            // objects without a query in this frame are drawn unconditionally
+            DrawItem conditional = item;
+            conditional.ConditionQuery = occlusionCuller->GetConditionQuery(draw.Object);
+            SubmitObject(conditional, draw, packet.View);
+        }
     }
+    renderQueue->Flush();
+}
+
+//////////////////////////////////////////
+// we submit a draw for each mesh of the given level of the LOD chain of the object
+void SubmitObject(const DrawItem &base, const ObjectDraw &draw, const glm::mat4 &viewMatrix)
+{
+    // same uniforms set by Object::Render
+    DrawItem item = base;
+    item.HasTransform = true;
+    item.ModelMatrix = draw.ModelMatrix;
+    item.NormalMatrix = glm::inverseTranspose(glm::mat3(viewMatrix * item.ModelMatrix));
+
+    LodModel *lodModel = objectsLods[draw.Object];
+    if (lodModel == nullptr)
+    {
+        // the models without a chain keep their CPU copy
+        for (auto &mesh : objectsModels[draw.Object]->meshes)
+            renderQueue->Submit(item, *mesh, (GLsizei)mesh->indices.size());
+        return;
+    }
+    SubmitLod(item, *lodModel, draw.LodLevel);
+}
+
+// the index counts come from the chain, so the draws do not look up the memory registry
+void SubmitLod(const DrawItem &item, const LodModel &lodModel, int level)
+{
+    for (size_t m = 0; m < lodModel.GetMeshCount(level); m++)
+        renderQueue->Submit(item, lodModel.GetMesh(level, m), lodModel.GetIndexCount(level, m));
 }
 
 ///////////////////////////////////////////
@@ -686,8 +2637,17 @@ void apply_camera_movements()
 }
 
 //////////////////////////////////////////
-// callback for keyboard events
-void key_callback(GLFWwindow *window, int key, int scancode, int action, int mode)
+// callback for keyboard events: in replay, the live keys are ignored (except ESC)
+void key_callback(GLFWwindow *window, int key, int /*scancode*/, int action, int /*mode*/)
+{
+    sceneRevision++;
+    if (inputLog.IsReplaying() && key != GLFW_KEY_ESCAPE)
+        return;
+    inputLog.RecordKey(key, action);
+    ProcessKey(window, key, action);
+}
+
+void ProcessKey(GLFWwindow *window, int key, int action)
 {
     GLuint new_subroutine;
 
@@ -715,6 +2675,9 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
         }
     }
 
+    if (key == GLFW_KEY_F12 && action == GLFW_PRESS)
+        screenshotRequested = true;
+
     if (key == GLFW_KEY_SPACE && action == GLFW_PRESS)
     {
         detachMouseFromCamera = !detachMouseFromCamera;
@@ -733,8 +2696,17 @@ void key_callback(GLFWwindow *window, int key, int scancode, int action, int mod
 }
 
 //////////////////////////////////////////
-// callback for mouse events
-void mouse_callback(GLFWwindow *window, double xpos, double ypos)
+// callback for mouse events: in replay, the live mouse is ignored
+void mouse_callback(GLFWwindow * /*window*/, double xpos, double ypos)
+{
+    sceneRevision++;
+    if (inputLog.IsReplaying())
+        return;
+    inputLog.RecordMouse(xpos, ypos);
+    ProcessMouse(xpos, ypos);
+}
+
+void ProcessMouse(double xpos, double ypos)
 {
     // we move the camera view following the mouse cursor
     // we calculate the offset of the mouse cursor from the position in the last frame
@@ -761,3 +2733,104 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos)
         camera.ProcessMouseMovement(xoffset, yoffset);
     }
 }
+
+//////////////////////////////////////////
+// the other events are handled by ImGui: they only ask for a new frame, which shows their effect on the GUI
+void mouse_button_callback(GLFWwindow * /*window*/, int /*button*/, int /*action*/, int /*mods*/)
+{
+    sceneRevision++;
+}
+
+void scroll_callback(GLFWwindow * /*window*/, double /*xoffset*/, double /*yoffset*/)
+{
+    sceneRevision++;
+}
+
+void char_callback(GLFWwindow * /*window*/, unsigned int /*codepoint*/)
+{
+    sceneRevision++;
+}
+
+// the window has been exposed: the content of the back buffer may be lost
+void refresh_callback(GLFWwindow * /*window*/)
+{
+    sceneRevision++;
+}
+
+//////////////////////////////////////////
+// a line of the GL calls panel: the calls of a pass (or of the frame) by category
+void ShowGLCallCounters(const char *name, const GLCallCounters &counters)
+{
+    ImGui::Text("%s: %d calls, %d redundant", name, counters.Total(), counters.Redundant);
+    ImGui::Indent();
+    for (int i = 0; i < GLCallCategoryCount; i++)
+    {
+        if (counters.Calls[i] == 0)
+            continue;
+        ImGui::Text("%s %d", GetGLCallCategoryName((GLCallCategory)i), counters.Calls[i]);
+        ImGui::SameLine();
+    }
+    ImGui::NewLine();
+    ImGui::Unindent();
+}
+
+//////////////////////////////////////////
+// command line options of the input recording and replay, of the trace capture and of the memory report
+bool ParseArguments(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const string option = argv[i];
+        if (option == "--record" && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (option == "--replay" && i + 1 < argc)
+            replayPath = argv[++i];
+        else if (option == "--headless")
+            headless = true;
+        else if (option == "--trace" && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (option == "--memory-budget" && i + 1 < argc)
+            memorySettings.BudgetMb = (size_t)std::max(std::atoi(argv[++i]), 0);
+        else if (option == "--drop-cpu-copies")
+            memorySettings.DropCpuCopies = true;
+        else if (option == "--memory-report")
+            memoryReport = true;
+        else if (option == "--capture" && i + 1 < argc)
+            capturePrefix = argv[++i];
+        else if (option == "--capture-exr")
+            captureFormat = CaptureFormat::EXR;
+        else if (option == "--batch" && i + 1 < argc)
+            batchPath = argv[++i];
+        else if (option == "--batch-output" && i + 1 < argc)
+            batchOutput = argv[++i];
+        else if (option == "--batch-tile" && i + 1 < argc)
+            batchTileLimit = std::max(std::atoi(argv[++i]), 64);
+        else if (option == "--continuous")
+            idleSettings.Enabled = false;
+        else if (option == "--job-benchmark")
+            jobBenchmark = true;
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--record <file>] [--replay <file> [--headless]] [--trace <file>]"
+                      << " [--memory-budget <MB>] [--drop-cpu-copies] [--memory-report] [--capture <prefix> [--capture-exr]]"
+                      << " [--batch <file> [--batch-output <dir>] [--batch-tile <px>]] [--continuous] [--job-benchmark]" << std::endl;
+            return false;
+        }
+    }
+    if (!batchPath.empty() && (!replayPath.empty() || !recordPath.empty() || !capturePrefix.empty()))
+    {
+        std::cout << "ERROR::ARGUMENTS::BATCH_WITH_SESSION" << std::endl;
+        return false;
+    }
+    if (headless && replayPath.empty())
+    {
+        std::cout << "ERROR::ARGUMENTS::HEADLESS_WITHOUT_REPLAY" << std::endl;
+        return false;
+    }
+    if (!recordPath.empty() && !replayPath.empty())
+    {
+        std::cout << "ERROR::ARGUMENTS::RECORD_DURING_REPLAY" << std::endl;
+        return false;
+    }
+    return true;
+}
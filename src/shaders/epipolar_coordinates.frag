@@ -0,0 +1,104 @@
+#version 410 core
+
+// EPIPOLAR SAMPLING - pass 1
+// each texel of the target is a sample of the epipolar lines: the x coordinate is the sample along the line, the y
+// coordinate is the line. The lines go from the light (or from the screen border, if the light is outside the screen)
+// to a point of the screen border; the end points are evenly distributed on the border.
+// Output: screen UV of the sample, camera distance of the scene at the sample, validity of the line
+out vec4 coordinates;
+
+// constants of the pass, streamed by the uniform ring buffer (same std140 layout of PassUniforms)
+layout (std140) uniform PassData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 inverseViewProjMatrix;
+    mat4 shadowMatrices[6];
+    vec3 wLightPos;
+    float g; //parameter used by Mie phase function to represent backward (g<0), isotropic (g=0) and forward (g > 0) scattering
+    vec3 wCameraPos;
+    float width;
+    vec3 absorptionCoeff;
+    float height;
+    vec3 scatteringCoeff;
+    float transmittanceThreshold; // the march ends where the transmittance from the camera falls below it
+    int minSteps;
+    int maxSteps;
+    float stepsPerOpticalDepth;
+    int stepHeatmap; // 1: the color is the number of steps of the march
+    int externalInscattering; // 1: the in-scattering is computed by the epipolar pass, the surfaces only attenuate
+    int shadowLayer; // layer of the shadow cube array written by the shadow pass
+    float shadowFarPlane; // range of the light of the shadow pass
+    mat4 clusterViewProj; // view-projection of the camera, which finds the light cluster of a point
+    ivec4 clusterSize; // tiles along x and y, depth slices
+    vec4 clusterDepth; // slice of a point = log(view depth) * x + y
+    vec4 volumeMin[4]; // world bounds of the density volumes, w = density multiplier
+    vec4 volumeMax[4]; // w = maximum density of the volume (with the multiplier)
+    int volumeCount;
+    float ambientDensity; // density of the medium outside the volumes
+};
+
+// depth of the scene target
+uniform sampler2D sceneDepth;
+// fraction of the scene textures covered by the scaled viewport
+uniform vec2 uvScale;
+// position of the light in NDC (it can be outside the screen)
+uniform vec2 lightNdc;
+// the number of lines is a multiple of 4
+uniform int lineCount;
+uniform int samplesPerLine;
+
+// end point on the screen border of the line: the lines of each border are evenly spaced, and the border is visited
+// counterclockwise starting from the bottom-left corner
+vec2 lineExitPoint(int line, int lineCount) {
+    int linesPerEdge = lineCount / 4;
+    int edge = line / linesPerEdge;
+    float t = (float(line % linesPerEdge) + 0.5) / float(linesPerEdge);
+    if (edge == 0)
+        return vec2(-1.0 + 2.0*t, -1.0);
+    if (edge == 1)
+        return vec2(1.0, -1.0 + 2.0*t);
+    if (edge == 2)
+        return vec2(1.0 - 2.0*t, 1.0);
+    return vec2(-1.0, 1.0 - 2.0*t);
+}
+
+// intersection of the ray with the screen [-1, 1]^2 (slab method)
+vec2 intersectScreen(vec2 origin, vec2 dir) {
+    // the components equal to 0 are replaced by a small value, to keep the divisions finite
+    vec2 safeDir = mix(dir, vec2(1e-6), lessThan(abs(dir), vec2(1e-6)));
+    vec2 invDir = 1.0 / safeDir;
+    vec2 t0 = (vec2(-1.0) - origin) * invDir;
+    vec2 t1 = (vec2(1.0) - origin) * invDir;
+    vec2 tMin = min(t0, t1);
+    vec2 tMax = max(t0, t1);
+    return vec2(max(tMin.x, tMin.y), min(tMax.x, tMax.y));
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    coordinates = vec4(0.0);
+
+    vec2 exitPoint = lineExitPoint(texel.y, lineCount);
+    vec2 entryPoint = lightNdc;
+    bool lightOnScreen = all(lessThanEqual(abs(lightNdc), vec2(1.0)));
+    if (!lightOnScreen) {
+        // the line enters the screen where the ray from the light to the exit point crosses the border. If the exit
+        // point is the first crossing, the part of the line on the screen is covered by another line
+        vec2 toExit = exitPoint - lightNdc;
+        float exitDistance = length(toExit);
+        vec2 range = intersectScreen(lightNdc, toExit / exitDistance);
+        if (range.x >= range.y || abs(range.y - exitDistance) > 1e-3)
+            return;
+        entryPoint = lightNdc + toExit / exitDistance * max(range.x, 0.0);
+    }
+
+    vec2 ndc = mix(entryPoint, exitPoint, float(texel.x) / float(samplesPerLine - 1));
+    vec2 uv = ndc * 0.5 + 0.5;
+
+    // camera distance of the scene: the depth is brought back to world space
+    float depth = texture(sceneDepth, uv * uvScale).r;
+    vec4 wPos = inverseViewProjMatrix * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    float distanceFromCamera = length(wPos.xyz / wPos.w - wCameraPos);
+
+    coordinates = vec4(uv, distanceFromCamera, 1.0);
+}
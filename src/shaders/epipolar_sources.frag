@@ -0,0 +1,81 @@
+#version 410 core
+
+// EPIPOLAR SAMPLING - pass 2
+// the in-scattering is marched only on some samples of each line, and interpolated on the others. The marched samples
+// are placed every initialSampleStep samples, and on both sides of each depth discontinuity along the line, so the
+// interpolation never crosses a silhouette.
+// Output: indices of the samples (along the same line) the sample is interpolated from. A sample whose left or
+// right source is itself is marched
+out vec2 sources;
+
+// constants of the pass, streamed by the uniform ring buffer (same std140 layout of PassUniforms)
+layout (std140) uniform PassData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 inverseViewProjMatrix;
+    mat4 shadowMatrices[6];
+    vec3 wLightPos;
+    float g; //parameter used by Mie phase function to represent backward (g<0), isotropic (g=0) and forward (g > 0) scattering
+    vec3 wCameraPos;
+    float width;
+    vec3 absorptionCoeff;
+    float height;
+    vec3 scatteringCoeff;
+    float transmittanceThreshold; // the march ends where the transmittance from the camera falls below it
+    int minSteps;
+    int maxSteps;
+    float stepsPerOpticalDepth;
+    int stepHeatmap; // 1: the color is the number of steps of the march
+    int externalInscattering; // 1: the in-scattering is computed by the epipolar pass, the surfaces only attenuate
+    int shadowLayer; // layer of the shadow cube array written by the shadow pass
+    float shadowFarPlane; // range of the light of the shadow pass
+    mat4 clusterViewProj; // view-projection of the camera, which finds the light cluster of a point
+    ivec4 clusterSize; // tiles along x and y, depth slices
+    vec4 clusterDepth; // slice of a point = log(view depth) * x + y
+    vec4 volumeMin[4]; // world bounds of the density volumes, w = density multiplier
+    vec4 volumeMax[4]; // w = maximum density of the volume (with the multiplier)
+    int volumeCount;
+    float ambientDensity; // density of the medium outside the volumes
+};
+
+// output of pass 1
+uniform sampler2D coordinatesTex;
+uniform int samplesPerLine;
+uniform int initialSampleStep;
+// relative difference of the camera distance between two samples which breaks the interpolation
+uniform float depthBreakThreshold;
+
+bool isDepthBreak(int line, int first, int second) {
+    float firstDistance = texelFetch(coordinatesTex, ivec2(first, line), 0).z;
+    float secondDistance = texelFetch(coordinatesTex, ivec2(second, line), 0).z;
+    return abs(firstDistance - secondDistance) > depthBreakThreshold * min(firstDistance, secondDistance);
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    int line = texel.y;
+    int index = texel.x;
+    if (texelFetch(coordinatesTex, texel, 0).w == 0.0)
+        discard;
+
+    // the segment between two initial samples which contains the sample
+    int segmentStart = (index / initialSampleStep) * initialSampleStep;
+    int segmentEnd = min(segmentStart + initialSampleStep, samplesPerLine - 1);
+
+    // we look for the closest depth discontinuity on each side, inside the segment
+    int left = segmentStart;
+    for (int i = index; i > segmentStart; i--) {
+        if (isDepthBreak(line, i - 1, i)) {
+            left = i;
+            break;
+        }
+    }
+    int right = segmentEnd;
+    for (int i = index; i < segmentEnd; i++) {
+        if (isDepthBreak(line, i, i + 1)) {
+            right = i;
+            break;
+        }
+    }
+    sources = vec2(left, right);
+}
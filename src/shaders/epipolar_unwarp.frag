@@ -0,0 +1,466 @@
+#version 410 core
+
+const float PI = 3.14159265359;
+// effective radius of the light (ro in lightRadiance): the in-scattered radiance changes over this distance
+const float LIGHT_RADIUS = 30.0;
+
+// EPIPOLAR SAMPLING - pass 4
+// the in-scattering of each pixel is interpolated from the samples of the two closest epipolar lines. The samples
+// whose camera distance differs from the one of the pixel are rejected (bilateral weights): if no sample is left,
+// the pixel is on a silhouette not covered by the lines, and the in-scattering is marched for the pixel itself
+out vec4 inscattering;
+
+// constants of the pass, streamed by the uniform ring buffer (same std140 layout of PassUniforms)
+layout (std140) uniform PassData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 inverseViewProjMatrix;
+    mat4 shadowMatrices[6];
+    vec3 wLightPos;
+    float g; //parameter used by Mie phase function to represent backward (g<0), isotropic (g=0) and forward (g > 0) scattering
+    vec3 wCameraPos;
+    float width;
+    vec3 absorptionCoeff;
+    float height;
+    vec3 scatteringCoeff;
+    float transmittanceThreshold; // the march ends where the transmittance from the camera falls below it
+    int minSteps;
+    int maxSteps;
+    float stepsPerOpticalDepth;
+    int stepHeatmap; // 1: the color is the number of steps of the march
+    int externalInscattering; // 1: the in-scattering is computed by the epipolar pass, the surfaces only attenuate
+    int shadowLayer; // layer of the shadow cube array written by the shadow pass
+    float shadowFarPlane; // range of the light of the shadow pass
+    mat4 clusterViewProj; // view-projection of the camera, which finds the light cluster of a point
+    ivec4 clusterSize; // tiles along x and y, depth slices
+    vec4 clusterDepth; // slice of a point = log(view depth) * x + y
+    vec4 volumeMin[4]; // world bounds of the density volumes, w = density multiplier
+    vec4 volumeMax[4]; // w = maximum density of the volume (with the multiplier)
+    int volumeCount;
+    float ambientDensity; // density of the medium outside the volumes
+};
+
+// outputs of the passes 1, 2 and 3
+uniform sampler2D coordinatesTex;
+uniform sampler2D sourcesTex;
+uniform sampler2D scatteringTex;
+// depth of the scene target
+uniform sampler2D sceneDepth;
+// LIGHTS
+// light i is in the texels 2i (position, range) and 2i+1 (color, layer of its shadow cube or -1)
+uniform samplerBuffer lightData;
+// (offset, count) in lightIndices of the lights of each cluster
+uniform usamplerBuffer clusterLights;
+uniform usamplerBuffer lightIndices;
+// shadow cubes of the lights (the depth is the distance from the light over its range)
+uniform samplerCubeArray depthMaps;
+// DENSITY VOLUMES
+// density of the voxels at the level 0, minimum and maximum density of blocks of 8^3 voxels at OCCUPANCY_LEVEL
+const int MAX_DENSITY_VOLUMES = 4;
+const int OCCUPANCY_LEVEL = 3;
+uniform sampler3D densityVolumes[MAX_DENSITY_VOLUMES];
+
+// fraction of the scene textures covered by the scaled viewport
+uniform vec2 uvScale;
+// size of the scaled viewport
+uniform vec2 viewportSize;
+// position of the light in NDC (it can be outside the screen)
+uniform vec2 lightNdc;
+uniform int lineCount;
+uniform int samplesPerLine;
+uniform float depthBreakThreshold;
+// the fog skybox has no in-scattering
+uniform bool skyInscattering;
+
+vec3 extinctionCoeff;
+
+vec3 sampleOffsetDirections[20] = vec3[]
+(
+   vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1), 
+   vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+   vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+   vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+   vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
+); 
+
+subroutine float phase_function(float cosTheta);
+subroutine uniform phase_function PhaseFunction;
+
+//////////////////////////////////////////
+// CLUSTERED LIGHTS
+struct Light {
+    vec3 position;
+    float range;
+    vec3 color;
+    float shadowLayer;
+};
+
+Light fetchLight(int index) {
+    vec4 positionRange = texelFetch(lightData, index * 2);
+    vec4 colorLayer = texelFetch(lightData, index * 2 + 1);
+    return Light(positionRange.xyz, positionRange.w, colorLayer.rgb, colorLayer.w);
+}
+
+// all the points of a view ray are in the clusters of the same tile, given by the projection of the ray direction;
+// their view depth grows linearly with the distance from the camera (w of the projected direction)
+vec4 clusterRay(vec3 wRayDir) {
+    return clusterViewProj * vec4(wRayDir, 0.0);
+}
+
+int clusterIndex(vec4 clipRayDir, float t) {
+    vec2 ndc = clipRayDir.xy / max(clipRayDir.w, 1e-6);
+    ivec2 tile = clamp(ivec2(floor((ndc * 0.5 + 0.5) * vec2(clusterSize.xy))), ivec2(0), clusterSize.xy - 1);
+    float viewDepth = max(t * clipRayDir.w, 1e-6);
+    int slice = clamp(int(floor(log(viewDepth) * clusterDepth.x + clusterDepth.y)), 0, clusterSize.z - 1);
+    return (slice * clusterSize.y + tile.y) * clusterSize.x + tile.x;
+}
+
+// the contribution of a light fades to 0 at its range, where the clusters stop listing it
+float rangeWindow(Light light, float dist) {
+    float x = clamp(1.0 - pow(dist / light.range, 4.0), 0.0, 1.0);
+    return x * x;
+}
+
+vec3 lightRadiance(Light light, float dist) {
+    float ro = LIGHT_RADIUS;
+    float epsilon = 0.1;
+    return light.color * ((ro*ro) / (dist*dist + epsilon)) * rangeWindow(light, dist);
+}
+
+float calculateShadow(Light light, vec3 wFragPos)
+{
+    // lights without a layer of the shadow array cast no shadows
+    if (light.shadowLayer < 0.0)
+        return 0.0;
+
+    float shadow = 0.0;
+    float bias   = 0.70;
+    int samples  = 20;
+
+    float diskRadius = 0.10; 
+
+    vec3 lightToFrag = wFragPos - light.position;
+    // now get current linear depth as the length between the fragment and light position
+    float currentDepth = length(lightToFrag);
+    
+    for(int i = 0; i < samples; ++i)
+    {
+        float closestDepth = texture(depthMaps, vec4(lightToFrag + sampleOffsetDirections[i] * diskRadius, light.shadowLayer)).r;
+        closestDepth *= light.range;   // undo mapping [0;1]
+        if(currentDepth - bias > closestDepth)
+            shadow += 1.0;
+    }
+    shadow /= float(samples);
+    return shadow;
+}
+
+
+// in-scattered radiance at a sample of the march, from the lights of its cluster
+// (view dir is the direction from the point to the camera)
+vec3 calculateScattering(vec3 wSamplePos, vec3 wViewDir, int cluster) {
+    uvec2 lights = texelFetch(clusterLights, cluster).xy;
+    vec3 scattering = vec3(0.0);
+    for (uint i = 0u; i < lights.y; i++) {
+        Light light = fetchLight(int(texelFetch(lightIndices, int(lights.x + i)).r));
+        //light dir is direction of light from light to point
+        vec3 wLightToSample = wSamplePos - light.position;
+        float dist = length(wLightToSample);
+        if (dist >= light.range)
+            continue;
+
+        scattering += PI * PhaseFunction(dot(wViewDir, wLightToSample / dist))
+                    *(1.0-calculateShadow(light, wSamplePos))
+                    *lightRadiance(light, dist);
+    }
+    return scattering;
+}
+
+
+subroutine(phase_function)
+float uniformPhaseFunc(float cosTheta) {
+    return 1.0 / (4.0*PI);
+}
+
+subroutine(phase_function)
+float rayleighPhaseFunc(float cosTheta) {
+    return (3.0/(16.0*PI))*(1.0 + cosTheta*cosTheta);
+}
+
+subroutine(phase_function)
+float miePhaseFunc(float cosTheta) {
+    float num = 1.0 - g*g;
+    float denom = (4.0*PI)*pow((1.0 + g*g - 2.0*g*cosTheta), 1.5);
+    return num/denom;
+}
+
+subroutine(phase_function) 
+float schlickPhaseFunc(float cosTheta) {
+    float k = 1.55*g - 0.55*g*g*g;
+    float num = 1 - k*k;
+    float denom = (4*PI)*pow((1+k*cosTheta), 2.0);
+    return num/denom;
+}
+
+vec3 calculateTransmittance(vec3 opticalDepth) {
+    return exp(-opticalDepth);
+}
+
+//////////////////////////////////////////
+// HETEROGENEOUS MEDIUM
+// the density multiplies the absorption and scattering coefficients: it is the ambient density everywhere, plus the
+// density of the volumes containing the point
+vec3 marchRayDir;
+vec3 marchRayInvDir;
+// distances from the camera where the view ray enters and exits each volume (x > y if it misses the volume)
+vec2 volumeIntervals[MAX_DENSITY_VOLUMES];
+// upper bound of the density along the view ray
+float maxRayDensity;
+
+vec2 intersectBox(vec3 boxMin, vec3 boxMax) {
+    vec3 t0 = (boxMin - wCameraPos) * marchRayInvDir;
+    vec3 t1 = (boxMax - wCameraPos) * marchRayInvDir;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    return vec2(max(max(tMin.x, tMin.y), tMin.z), min(min(tMax.x, tMax.y), tMax.z));
+}
+
+// the view ray is intersected with the bounds of the volumes once, before the march
+void intersectVolumes(vec3 wRayDir) {
+    marchRayDir = wRayDir;
+    // the components equal to 0 are replaced by a small value, to keep the divisions finite
+    marchRayInvDir = 1.0 / mix(wRayDir, vec3(1e-6), lessThan(abs(wRayDir), vec3(1e-6)));
+    maxRayDensity = ambientDensity;
+    for (int i = 0; i < volumeCount; i++) {
+        volumeIntervals[i] = intersectBox(volumeMin[i].xyz, volumeMax[i].xyz);
+        if (volumeIntervals[i].x <= volumeIntervals[i].y)
+            maxRayDensity += volumeMax[i].w;
+    }
+}
+
+vec3 volumeUvw(int volume, vec3 wPos) {
+    return (wPos - volumeMin[volume].xyz) / (volumeMax[volume].xyz - volumeMin[volume].xyz);
+}
+
+// density at the point of the view ray at distance t from the camera
+float mediumDensity(vec3 wPos, float t) {
+    float density = ambientDensity;
+    for (int i = 0; i < volumeCount; i++) {
+        if (t >= volumeIntervals[i].x && t <= volumeIntervals[i].y)
+            density += textureLod(densityVolumes[i], volumeUvw(i, wPos), 0.0).r * volumeMin[i].w;
+    }
+    return density;
+}
+
+// first distance from t where the medium can be non empty (t itself if the medium at t is not empty). Inside a
+// volume, the occupancy level gives the maximum density of the block of voxels of the point: an empty block is
+// skipped up to the point where the ray exits it
+float skipEmptySpace(float t, float tEnd) {
+    if (ambientDensity > 0.0)
+        return t;
+
+    float next = tEnd;
+    for (int i = 0; i < volumeCount; i++) {
+        vec2 interval = volumeIntervals[i];
+        if (interval.x > interval.y || interval.y < t)
+            continue;
+        if (interval.x > t) {
+            next = min(next, interval.x);
+            continue;
+        }
+        ivec3 bricks = textureSize(densityVolumes[i], OCCUPANCY_LEVEL);
+        vec3 uvw = volumeUvw(i, wCameraPos + marchRayDir * t);
+        ivec3 brick = clamp(ivec3(floor(uvw * vec3(bricks))), ivec3(0), bricks - 1);
+        if (texelFetch(densityVolumes[i], brick, OCCUPANCY_LEVEL).g * volumeMin[i].w > 0.0)
+            return t;
+        vec3 brickSize = (volumeMax[i].xyz - volumeMin[i].xyz) / vec3(bricks);
+        vec3 brickMin = volumeMin[i].xyz + vec3(brick) * brickSize;
+        next = min(next, intersectBox(brickMin, brickMin + brickSize).y);
+    }
+    return next;
+}
+
+//////////////////////////////////////////
+// ADAPTIVE RAY MARCHING
+float maxComponent(vec3 v) {
+    return max(max(v.x, v.y), v.z);
+}
+
+// we clip the segment [0, marchLength] of the view ray to the distance where the transmittance from the camera falls
+// below the threshold: the samples beyond it are hidden by the medium in front of them. The volumes only add density,
+// so the distance of the ambient medium is an upper bound. Without an ambient medium, only the part of the ray
+// through the volumes is marched. The ranges of the lights are left to the clusters, which list no light where there
+// is nothing to scatter. Returns false if nothing is left to march
+bool clipMarch(float marchLength, out float tStart, out float tEnd) {
+    tStart = 0.0;
+    tEnd = marchLength;
+
+    float minExtinction = min(min(extinctionCoeff.x, extinctionCoeff.y), extinctionCoeff.z) * ambientDensity;
+    if (minExtinction > 0.0)
+        tEnd = min(tEnd, -log(transmittanceThreshold) / minExtinction);
+    if (ambientDensity <= 0.0) {
+        float volumesStart = tEnd, volumesEnd = tStart;
+        for (int i = 0; i < volumeCount; i++) {
+            if (volumeIntervals[i].x > volumeIntervals[i].y)
+                continue;
+            volumesStart = min(volumesStart, volumeIntervals[i].x);
+            volumesEnd = max(volumesEnd, volumeIntervals[i].y);
+        }
+        tStart = max(tStart, volumesStart);
+        tEnd = min(tEnd, volumesEnd);
+    }
+    return tEnd > tStart;
+}
+
+// the steps follow the variation of the transmittance (optical depth of the segment, with the maximum density along
+// the ray) and of the light radiance (segment length in light radii), whichever is faster
+int marchStepCount(float marchLength) {
+    float opticalDepth = maxComponent(extinctionCoeff) * maxRayDensity * marchLength;
+    float lightVariation = marchLength / LIGHT_RADIUS;
+    return clamp(int(ceil(stepsPerOpticalDepth * max(opticalDepth, lightVariation))), minSteps, maxSteps);
+}
+
+// in-scattered radiance along the view ray between tStart and tEnd (intersectVolumes must be called first). The first
+// sample is at the fraction offset of the first step. The transmittance from the camera is the running integral of the
+// optical depth of the samples; the steps in empty space are skipped, and the march stops where the transmittance
+// falls below the threshold. steps is the number of samples evaluated, opticalDepth the one up to the last of them
+vec3 marchRay(vec4 clipRayDir, float tStart, float tEnd, float offset, out int steps, out vec3 opticalDepth) {
+    int stepCount = marchStepCount(tEnd - tStart);
+    float differential = (tEnd - tStart) / float(stepCount);
+
+    vec3 result = vec3(0.0);
+    opticalDepth = vec3(0.0);
+    steps = 0;
+    for (int k = 0; k < stepCount; k++) {
+        float t = tStart + differential * (float(k) + offset);
+        float tNext = skipEmptySpace(t, tEnd);
+        if (tNext > t) {
+            // the next sample is the first one after the empty space
+            k = max(k, int(ceil((tNext - tStart) / differential - offset)) - 1);
+            continue;
+        }
+
+        vec3 wSamplePos = wCameraPos + marchRayDir * t;
+        float density = mediumDensity(wSamplePos, t);
+        steps++;
+        if (density <= 0.0)
+            continue;
+        vec3 sampleExtinction = extinctionCoeff * density;
+        // transmittance from the camera to the middle of the step
+        vec3 cameraSampleTransmittance = calculateTransmittance(opticalDepth + sampleExtinction * differential * 0.5);
+        vec3 wSampleToCamera = -marchRayDir;
+
+        vec3 scattering = calculateScattering(wSamplePos, wSampleToCamera, clusterIndex(clipRayDir, t));
+
+        //transmittance x scattering x scatteringCoeff x density x differential of integral
+        result += cameraSampleTransmittance*scattering*scatteringCoeff*density*differential;
+        opticalDepth += sampleExtinction * differential;
+        if (maxComponent(calculateTransmittance(opticalDepth)) < transmittanceThreshold)
+            break;
+    }
+    return result;
+}
+
+// in-scattered radiance along the view ray through the screen point, up to the given camera distance
+vec3 marchInscattering(vec2 ndc, float distanceFromCamera) {
+    vec4 wFar = inverseViewProjMatrix * vec4(ndc, 1.0, 1.0);
+    vec3 wRayDir = normalize(wFar.xyz / wFar.w - wCameraPos);
+    vec4 clipRayDir = clusterRay(wRayDir);
+    intersectVolumes(wRayDir);
+
+    float tStart, tEnd;
+    if (!clipMarch(distanceFromCamera, tStart, tEnd))
+        return vec3(0.0);
+
+    // no random offset: the noise would be spread by the interpolation
+    int steps;
+    vec3 opticalDepth;
+    return marchRay(clipRayDir, tStart, tEnd, 0.5, steps, opticalDepth);
+}
+
+// intersection of the ray with the screen [-1, 1]^2 (slab method)
+vec2 intersectScreen(vec2 origin, vec2 dir) {
+    // the components equal to 0 are replaced by a small value, to keep the divisions finite
+    vec2 safeDir = mix(dir, vec2(1e-6), lessThan(abs(dir), vec2(1e-6)));
+    vec2 invDir = 1.0 / safeDir;
+    vec2 t0 = (vec2(-1.0) - origin) * invDir;
+    vec2 t1 = (vec2(1.0) - origin) * invDir;
+    vec2 tMin = min(t0, t1);
+    vec2 tMax = max(t0, t1);
+    return vec2(max(tMin.x, tMin.y), min(tMax.x, tMax.y));
+}
+
+// inverse of lineExitPoint of pass 1: continuous line coordinate of a point of the screen border
+float lineCoordinate(vec2 exitPoint) {
+    float linesPerEdge = float(lineCount / 4);
+    float edge, t;
+    if (abs(exitPoint.y) >= abs(exitPoint.x)) {
+        edge = exitPoint.y < 0.0 ? 0.0 : 2.0;
+        t = exitPoint.y < 0.0 ? (exitPoint.x + 1.0) * 0.5 : (1.0 - exitPoint.x) * 0.5;
+    } else {
+        edge = exitPoint.x > 0.0 ? 1.0 : 3.0;
+        t = exitPoint.x > 0.0 ? (exitPoint.y + 1.0) * 0.5 : (1.0 - exitPoint.y) * 0.5;
+    }
+    return edge * linesPerEdge + t * linesPerEdge - 0.5;
+}
+
+// in-scattering of a sample, interpolated between its sources
+vec3 interpolatedInscattering(int line, int index) {
+    vec2 sources = texelFetch(sourcesTex, ivec2(index, line), 0).xy;
+    vec3 left = texelFetch(scatteringTex, ivec2(int(sources.x), line), 0).rgb;
+    vec3 right = texelFetch(scatteringTex, ivec2(int(sources.y), line), 0).rgb;
+    float weight = sources.y > sources.x ? (float(index) - sources.x) / (sources.y - sources.x) : 0.0;
+    return mix(left, right, weight);
+}
+
+void main() {
+    extinctionCoeff = absorptionCoeff + scatteringCoeff;
+
+    vec2 uv = gl_FragCoord.xy / viewportSize;
+    vec2 ndc = uv * 2.0 - 1.0;
+    float depth = texture(sceneDepth, uv * uvScale).r;
+    if (!skyInscattering && depth == 1.0) {
+        inscattering = vec4(0.0);
+        return;
+    }
+    vec4 wPos = inverseViewProjMatrix * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+    float distanceFromCamera = length(wPos.xyz / wPos.w - wCameraPos);
+
+    // the epipolar line through the pixel
+    vec2 toPixel = ndc - lightNdc;
+    float pixelDistance = length(toPixel);
+    vec3 result = vec3(0.0);
+    float totalWeight = 0.0;
+    if (pixelDistance > 1e-4) {
+        vec2 dir = toPixel / pixelDistance;
+        vec2 range = intersectScreen(lightNdc, dir);
+        vec2 entryPoint = lightNdc + dir * max(range.x, 0.0);
+        vec2 exitPoint = lightNdc + dir * range.y;
+
+        float linePos = lineCoordinate(exitPoint);
+        float samplePos = length(ndc - entryPoint) / max(length(exitPoint - entryPoint), 1e-6) * float(samplesPerLine - 1);
+        int firstLine = int(floor(linePos));
+        int firstSample = min(int(floor(samplePos)), samplesPerLine - 2);
+        vec2 fraction = vec2(linePos - float(firstLine), samplePos - float(firstSample));
+
+        for (int l = 0; l < 2; l++) {
+            // the border is closed: the last line is next to the first one
+            int line = (firstLine + l + lineCount) % lineCount;
+            float lineWeight = l == 0 ? 1.0 - fraction.x : fraction.x;
+            for (int s = 0; s < 2; s++) {
+                int index = clamp(firstSample + s, 0, samplesPerLine - 1);
+                vec4 coordinates = texelFetch(coordinatesTex, ivec2(index, line), 0);
+                if (coordinates.w == 0.0 || abs(coordinates.z - distanceFromCamera) > depthBreakThreshold * distanceFromCamera)
+                    continue;
+                float weight = lineWeight * (s == 0 ? 1.0 - fraction.y : fraction.y);
+                result += weight * interpolatedInscattering(line, index);
+                totalWeight += weight;
+            }
+        }
+    }
+
+    if (totalWeight > 1e-3)
+        result /= totalWeight;
+    else
+        result = marchInscattering(ndc, distanceFromCamera);
+    inscattering = vec4(result, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 410 core
+
+// fullscreen triangle generated from the vertex index: no vertex buffer is needed
+out vec2 interp_UV;
+
+void main() {
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    interp_UV = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 410 core
+
+// color writes are disabled during the occlusion queries: only the depth test matters
+out vec4 colorFrag;
+
+void main()
+{
+    colorFrag = vec4(1.0);
+}
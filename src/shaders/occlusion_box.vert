@@ -0,0 +1,11 @@
+#version 410 core
+layout (location = 0) in vec3 position;
+
+// transformation of the unit cube on the world AABB of the object
+uniform mat4 modelMatrix;
+uniform mat4 viewProjectionMatrix;
+
+void main()
+{
+    gl_Position = viewProjectionMatrix * modelMatrix * vec4(position, 1.0);
+}
@@ -1,6 +1,12 @@
 #version 410 core
 layout (location = 0) in vec3 position;
-uniform mat4 modelMatrix;
+// constants of the draw, streamed by the uniform ring buffer (same std140 layout of ObjectUniforms)
+layout (std140) uniform ObjectData {
+    mat4 modelMatrix;
+    mat4 normalMatrix;
+    // bit i is set if the object is inside the frustum of the i-th face of the shadow cube
+    int faceMask;
+};
 
 void main()
 {
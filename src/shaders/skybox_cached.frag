@@ -0,0 +1,12 @@
+#version 410 core
+
+out vec4 colorFrag;
+
+in vec3 interp_UVW;
+
+// participating media skybox rendered in every direction by skybox_partmedia.frag
+uniform samplerCube skyCache;
+
+void main() {
+    colorFrag = vec4(texture(skyCache, interp_UVW).rgb, 1.0);
+}
@@ -1,30 +1,66 @@
 #version 410 core
 
 const float PI = 3.14159265359;
-const int NSAMPLES = 25;
+// effective radius of the light (ro in lightRadiance): the in-scattered radiance changes over this distance
+const float LIGHT_RADIUS = 30.0;
 const float E = 0.5772156649;
 
 out vec4 colorFrag;
 
-uniform vec3 wLightPos;
-uniform vec3 wCameraPos;
+// constants of the pass, streamed by the uniform ring buffer (same std140 layout of PassUniforms)
+layout (std140) uniform PassData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 inverseViewProjMatrix;
+    mat4 shadowMatrices[6];
+    vec3 wLightPos;
+    float g; //parameter used by Mie phase function to represent backward (g<0), isotropic (g=0) and forward (g > 0) scattering
+    vec3 wCameraPos;
+    float width;
+    vec3 absorptionCoeff;
+    float height;
+    vec3 scatteringCoeff;
+    float transmittanceThreshold; // the march ends where the transmittance from the camera falls below it
+    int minSteps;
+    int maxSteps;
+    float stepsPerOpticalDepth;
+    int stepHeatmap; // 1: the color is the number of steps of the march
+    int externalInscattering; // 1: the in-scattering is computed by the epipolar pass, the surfaces only attenuate
+    int shadowLayer; // layer of the shadow cube array written by the shadow pass
+    float shadowFarPlane; // range of the light of the shadow pass
+    mat4 clusterViewProj; // view-projection of the camera, which finds the light cluster of a point
+    ivec4 clusterSize; // tiles along x and y, depth slices
+    vec4 clusterDepth; // slice of a point = log(view depth) * x + y
+    vec4 volumeMin[4]; // world bounds of the density volumes, w = density multiplier
+    vec4 volumeMax[4]; // w = maximum density of the volume (with the multiplier)
+    int volumeCount;
+    float ambientDensity; // density of the medium outside the volumes
+};
 
 in vec2 interp_UV;
 in vec3 interp_UVW;
 
-uniform mat4 inverseViewProjMatrix;
-uniform float width;
-uniform float height;
-
 uniform samplerCube skyboxTex;
-// texture sampler for the depth map
-uniform samplerCube depthMap;
+// distance of the sky from the camera, the same in every direction: the sky depends only on the view direction, so
+// it can be rendered in the faces of the sky cache
+uniform float skyDistance;
+// 1: the sky is rendered in the cache, in every direction (also outside the clusters of the camera)
+uniform int cacheRender;
+// LIGHTS
+// light i is in the texels 2i (position, range) and 2i+1 (color, layer of its shadow cube or -1)
+uniform samplerBuffer lightData;
+// (offset, count) in lightIndices of the lights of each cluster
+uniform usamplerBuffer clusterLights;
+uniform usamplerBuffer lightIndices;
+// shadow cubes of the lights (the depth is the distance from the light over its range)
+uniform samplerCubeArray depthMaps;
+// DENSITY VOLUMES
+// density of the voxels at the level 0, minimum and maximum density of blocks of 8^3 voxels at OCCUPANCY_LEVEL
+const int MAX_DENSITY_VOLUMES = 4;
+const int OCCUPANCY_LEVEL = 3;
+uniform sampler3D densityVolumes[MAX_DENSITY_VOLUMES];
 
-uniform float far_plane;
 
-uniform vec3 absorptionCoeff;
-uniform vec3 scatteringCoeff;
-uniform float g; //parameter used by Mie phase function to represent backward (g<0), isotropic (g=0) and forward (g > 0) scattering
 
 vec3 extinctionCoeff;
 
@@ -40,29 +76,67 @@ vec3 sampleOffsetDirections[20] = vec3[]
 subroutine float phase_function(float cosTheta);
 subroutine uniform phase_function PhaseFunction;
 
-vec3 lightRadiance(float dist) {
-    vec3 cLight0 = vec3(1.0, 1.0, 1.0);
-    float ro = 30.0;
+//////////////////////////////////////////
+// CLUSTERED LIGHTS
+struct Light {
+    vec3 position;
+    float range;
+    vec3 color;
+    float shadowLayer;
+};
+
+Light fetchLight(int index) {
+    vec4 positionRange = texelFetch(lightData, index * 2);
+    vec4 colorLayer = texelFetch(lightData, index * 2 + 1);
+    return Light(positionRange.xyz, positionRange.w, colorLayer.rgb, colorLayer.w);
+}
+
+// all the points of a view ray are in the clusters of the same tile, given by the projection of the ray direction;
+// their view depth grows linearly with the distance from the camera (w of the projected direction)
+vec4 clusterRay(vec3 wRayDir) {
+    return clusterViewProj * vec4(wRayDir, 0.0);
+}
+
+int clusterIndex(vec4 clipRayDir, float t) {
+    vec2 ndc = clipRayDir.xy / max(clipRayDir.w, 1e-6);
+    ivec2 tile = clamp(ivec2(floor((ndc * 0.5 + 0.5) * vec2(clusterSize.xy))), ivec2(0), clusterSize.xy - 1);
+    float viewDepth = max(t * clipRayDir.w, 1e-6);
+    int slice = clamp(int(floor(log(viewDepth) * clusterDepth.x + clusterDepth.y)), 0, clusterSize.z - 1);
+    return (slice * clusterSize.y + tile.y) * clusterSize.x + tile.x;
+}
+
+// the contribution of a light fades to 0 at its range, where the clusters stop listing it
+float rangeWindow(Light light, float dist) {
+    float x = clamp(1.0 - pow(dist / light.range, 4.0), 0.0, 1.0);
+    return x * x;
+}
+
+vec3 lightRadiance(Light light, float dist) {
+    float ro = LIGHT_RADIUS;
     float epsilon = 0.1;
-    return cLight0 * ((ro*ro) / (dist*dist + epsilon));
+    return light.color * ((ro*ro) / (dist*dist + epsilon)) * rangeWindow(light, dist);
 }
 
-float calculateShadow(vec3 wFragPos)
+float calculateShadow(Light light, vec3 wFragPos)
 {
+    // lights without a layer of the shadow array cast no shadows
+    if (light.shadowLayer < 0.0)
+        return 0.0;
+
     float shadow = 0.0;
     float bias   = 0.70;
     int samples  = 20;
 
     float diskRadius = 0.10; 
 
-    vec3 lightToFrag = wFragPos - wLightPos;
+    vec3 lightToFrag = wFragPos - light.position;
     // now get current linear depth as the length between the fragment and light position
     float currentDepth = length(lightToFrag);
     
     for(int i = 0; i < samples; ++i)
     {
-        float closestDepth = texture(depthMap, lightToFrag + sampleOffsetDirections[i] * diskRadius).r;
-        closestDepth *= far_plane;   // undo mapping [0;1]
+        float closestDepth = texture(depthMaps, vec4(lightToFrag + sampleOffsetDirections[i] * diskRadius, light.shadowLayer)).r;
+        closestDepth *= light.range;   // undo mapping [0;1]
         if(currentDepth - bias > closestDepth)
             shadow += 1.0;
     }
@@ -71,13 +145,25 @@ float calculateShadow(vec3 wFragPos)
 }
 
 
-//light dir is direction of light from light to point
-vec3 calculateScattering(vec3 wSamplePos, vec3 wLightDir, vec3 wViewDir) {
-    float xShadowVal = calculateShadow(wSamplePos);
-
-    return PI * PhaseFunction(dot(wViewDir, wLightDir))
-                *(1.0-xShadowVal)
-                *lightRadiance(length(wSamplePos-wLightPos));
+// in-scattered radiance at a sample of the march, from the lights of its cluster
+// (view dir is the direction from the point to the camera)
+vec3 calculateScattering(vec3 wSamplePos, vec3 wViewDir, int cluster) {
+    // the render of the cache reads all the lights (2 texels each)
+    uvec2 lights = cacheRender != 0 ? uvec2(0u, uint(textureSize(lightData) / 2)) : texelFetch(clusterLights, cluster).xy;
+    vec3 scattering = vec3(0.0);
+    for (uint i = 0u; i < lights.y; i++) {
+        Light light = fetchLight(cacheRender != 0 ? int(i) : int(texelFetch(lightIndices, int(lights.x + i)).r));
+        //light dir is direction of light from light to point
+        vec3 wLightToSample = wSamplePos - light.position;
+        float dist = length(wLightToSample);
+        if (dist >= light.range)
+            continue;
+
+        scattering += PI * PhaseFunction(dot(wViewDir, wLightToSample / dist))
+                    *(1.0-calculateShadow(light, wSamplePos))
+                    *lightRadiance(light, dist);
+    }
+    return scattering;
 }
 
 
@@ -106,65 +192,223 @@ float schlickPhaseFunc(float cosTheta) {
     return num/denom;
 }
 
-vec3 calculateTransmittance(float dist) {
-    return exp(-dist*extinctionCoeff.xyz);
+vec3 calculateTransmittance(vec3 opticalDepth) {
+    return exp(-opticalDepth);
 }
 
-vec3 computeFragmentWorldPosition() {
-    vec4 ndc = vec4(0.0, 0.0, 0.0, 0.0);
+//////////////////////////////////////////
+// HETEROGENEOUS MEDIUM
+// the density multiplies the absorption and scattering coefficients: it is the ambient density everywhere, plus the
+// density of the volumes containing the point
+vec3 marchRayDir;
+vec3 marchRayInvDir;
+// distances from the camera where the view ray enters and exits each volume (x > y if it misses the volume)
+vec2 volumeIntervals[MAX_DENSITY_VOLUMES];
+// upper bound of the density along the view ray
+float maxRayDensity;
+
+vec2 intersectBox(vec3 boxMin, vec3 boxMax) {
+    vec3 t0 = (boxMin - wCameraPos) * marchRayInvDir;
+    vec3 t1 = (boxMax - wCameraPos) * marchRayInvDir;
+    vec3 tMin = min(t0, t1);
+    vec3 tMax = max(t0, t1);
+    return vec2(max(max(tMin.x, tMin.y), tMin.z), min(min(tMax.x, tMax.y), tMax.z));
+}
 
-    //from screen coordinates to NDC
-    ndc.x = (2.0 * gl_FragCoord.x) / width - 1.0;
-    ndc.y = 1.0 - (2.0 * gl_FragCoord.y) / height;
-    ndc.z = 1.0; //it is a skybox
-    ndc.w = 1.0;
+// the view ray is intersected with the bounds of the volumes once, before the march
+void intersectVolumes(vec3 wRayDir) {
+    marchRayDir = wRayDir;
+    // the components equal to 0 are replaced by a small value, to keep the divisions finite
+    marchRayInvDir = 1.0 / mix(wRayDir, vec3(1e-6), lessThan(abs(wRayDir), vec3(1e-6)));
+    maxRayDensity = ambientDensity;
+    for (int i = 0; i < volumeCount; i++) {
+        volumeIntervals[i] = intersectBox(volumeMin[i].xyz, volumeMax[i].xyz);
+        if (volumeIntervals[i].x <= volumeIntervals[i].y)
+            maxRayDensity += volumeMax[i].w;
+    }
+}
 
-    //invert view projection
-    vec4 wCoord = inverseViewProjMatrix * ndc;
+vec3 volumeUvw(int volume, vec3 wPos) {
+    return (wPos - volumeMin[volume].xyz) / (volumeMax[volume].xyz - volumeMin[volume].xyz);
+}
 
-    // invert perspective divide
-    wCoord.x *= wCoord.w;
-    wCoord.y *= wCoord.w;
-    wCoord.z *= wCoord.w;
+// density at the point of the view ray at distance t from the camera
+float mediumDensity(vec3 wPos, float t) {
+    float density = ambientDensity;
+    for (int i = 0; i < volumeCount; i++) {
+        if (t >= volumeIntervals[i].x && t <= volumeIntervals[i].y)
+            density += textureLod(densityVolumes[i], volumeUvw(i, wPos), 0.0).r * volumeMin[i].w;
+    }
+    return density;
+}
 
-    return wCoord.xyz;
+// first distance from t where the medium can be non empty (t itself if the medium at t is not empty). Inside a
+// volume, the occupancy level gives the maximum density of the block of voxels of the point: an empty block is
+// skipped up to the point where the ray exits it
+float skipEmptySpace(float t, float tEnd) {
+    if (ambientDensity > 0.0)
+        return t;
+
+    float next = tEnd;
+    for (int i = 0; i < volumeCount; i++) {
+        vec2 interval = volumeIntervals[i];
+        if (interval.x > interval.y || interval.y < t)
+            continue;
+        if (interval.x > t) {
+            next = min(next, interval.x);
+            continue;
+        }
+        ivec3 bricks = textureSize(densityVolumes[i], OCCUPANCY_LEVEL);
+        vec3 uvw = volumeUvw(i, wCameraPos + marchRayDir * t);
+        ivec3 brick = clamp(ivec3(floor(uvw * vec3(bricks))), ivec3(0), bricks - 1);
+        if (texelFetch(densityVolumes[i], brick, OCCUPANCY_LEVEL).g * volumeMin[i].w > 0.0)
+            return t;
+        vec3 brickSize = (volumeMax[i].xyz - volumeMin[i].xyz) / vec3(bricks);
+        vec3 brickMin = volumeMin[i].xyz + vec3(brick) * brickSize;
+        next = min(next, intersectBox(brickMin, brickMin + brickSize).y);
+    }
+    return next;
 }
 
-void main() {
-    extinctionCoeff = absorptionCoeff + scatteringCoeff;
+// optical depth of the view ray up to the distance dist, without marching it (for the surfaces when the in-scattering
+// is computed by another pass): the ambient medium is integrated exactly, the volumes with a few samples
+vec3 calculateOpticalDepth(float dist) {
+    const int samples = 8;
+    float depth = ambientDensity * dist;
+    for (int i = 0; i < volumeCount; i++) {
+        float t0 = max(volumeIntervals[i].x, 0.0);
+        float t1 = min(volumeIntervals[i].y, dist);
+        if (t0 >= t1)
+            continue;
+        float differential = (t1 - t0) / float(samples);
+        for (int s = 0; s < samples; s++) {
+            vec3 wSamplePos = wCameraPos + marchRayDir * (t0 + differential * (float(s) + 0.5));
+            depth += textureLod(densityVolumes[i], volumeUvw(i, wSamplePos), 0.0).r * volumeMin[i].w * differential;
+        }
+    }
+    return extinctionCoeff * depth;
+}
 
-    vec3 fragRadiance = vec3(texture(skyboxTex, interp_UVW));
-    vec3 wPos = computeFragmentWorldPosition(); 
-    vec3 wCamToFrag = wPos - wCameraPos;
-    float distanceFromCamera = length(wCamToFrag);
-    vec3 fragCameraTransmittance = calculateTransmittance(distanceFromCamera);
-    
-    //1st term
-    vec3 transmittedSurfaceRadiance = fragCameraTransmittance*fragRadiance;
+//////////////////////////////////////////
+// ADAPTIVE RAY MARCHING
+float maxComponent(vec3 v) {
+    return max(max(v.x, v.y), v.z);
+}
 
-    //Ray marching init
-    // NSAMPLES + 1 because we want to esclude samples at camera pos and at fragment pos
-    vec3 wStep = wCamToFrag / (NSAMPLES+1);
-    float differential = length(wStep);
+// we clip the segment [0, marchLength] of the view ray to the distance where the transmittance from the camera falls
+// below the threshold: the samples beyond it are hidden by the medium in front of them. The volumes only add density,
+// so the distance of the ambient medium is an upper bound. Without an ambient medium, only the part of the ray
+// through the volumes is marched. The ranges of the lights are left to the clusters, which list no light where there
+// is nothing to scatter. Returns false if nothing is left to march
+bool clipMarch(float marchLength, out float tStart, out float tEnd) {
+    tStart = 0.0;
+    tEnd = marchLength;
+
+    float minExtinction = min(min(extinctionCoeff.x, extinctionCoeff.y), extinctionCoeff.z) * ambientDensity;
+    if (minExtinction > 0.0)
+        tEnd = min(tEnd, -log(transmittanceThreshold) / minExtinction);
+    if (ambientDensity <= 0.0) {
+        float volumesStart = tEnd, volumesEnd = tStart;
+        for (int i = 0; i < volumeCount; i++) {
+            if (volumeIntervals[i].x > volumeIntervals[i].y)
+                continue;
+            volumesStart = min(volumesStart, volumeIntervals[i].x);
+            volumesEnd = max(volumesEnd, volumeIntervals[i].y);
+        }
+        tStart = max(tStart, volumesStart);
+        tEnd = min(tEnd, volumesEnd);
+    }
+    return tEnd > tStart;
+}
 
-    // Not using random on skybox to avoid visual artifacts
-    vec3 wSamplePos = wCameraPos + wStep;
+// the steps follow the variation of the transmittance (optical depth of the segment, with the maximum density along
+// the ray) and of the light radiance (segment length in light radii), whichever is faster
+int marchStepCount(float marchLength) {
+    float opticalDepth = maxComponent(extinctionCoeff) * maxRayDensity * marchLength;
+    float lightVariation = marchLength / LIGHT_RADIUS;
+    return clamp(int(ceil(stepsPerOpticalDepth * max(opticalDepth, lightVariation))), minSteps, maxSteps);
+}
 
-    vec3 result = transmittedSurfaceRadiance;
+// in-scattered radiance along the view ray between tStart and tEnd (intersectVolumes must be called first). The first
+// sample is at the fraction offset of the first step. The transmittance from the camera is the running integral of the
+// optical depth of the samples; the steps in empty space are skipped, and the march stops where the transmittance
+// falls below the threshold. steps is the number of samples evaluated, opticalDepth the one up to the last of them
+vec3 marchRay(vec4 clipRayDir, float tStart, float tEnd, float offset, out int steps, out vec3 opticalDepth) {
+    int stepCount = marchStepCount(tEnd - tStart);
+    float differential = (tEnd - tStart) / float(stepCount);
+
+    vec3 result = vec3(0.0);
+    opticalDepth = vec3(0.0);
+    steps = 0;
+    for (int k = 0; k < stepCount; k++) {
+        float t = tStart + differential * (float(k) + offset);
+        float tNext = skipEmptySpace(t, tEnd);
+        if (tNext > t) {
+            // the next sample is the first one after the empty space
+            k = max(k, int(ceil((tNext - tStart) / differential - offset)) - 1);
+            continue;
+        }
+
+        vec3 wSamplePos = wCameraPos + marchRayDir * t;
+        float density = mediumDensity(wSamplePos, t);
+        steps++;
+        if (density <= 0.0)
+            continue;
+        vec3 sampleExtinction = extinctionCoeff * density;
+        // transmittance from the camera to the middle of the step
+        vec3 cameraSampleTransmittance = calculateTransmittance(opticalDepth + sampleExtinction * differential * 0.5);
+        vec3 wSampleToCamera = -marchRayDir;
+
+        vec3 scattering = calculateScattering(wSamplePos, wSampleToCamera, clusterIndex(clipRayDir, t));
+
+        //transmittance x scattering x scatteringCoeff x density x differential of integral
+        result += cameraSampleTransmittance*scattering*scatteringCoeff*density*differential;
+        opticalDepth += sampleExtinction * differential;
+        if (maxComponent(calculateTransmittance(opticalDepth)) < transmittanceThreshold)
+            break;
+    }
+    return result;
+}
 
-    //Ray marching
-    for(int i = 0; i < NSAMPLES; i++) {
-        vec3 cameraSampleTransmittance = calculateTransmittance(length(wSamplePos));
-        //for the scattering we need the direction of the light towards the fragment
-        vec3 wLightToSample = normalize(wSamplePos - wLightPos);
-        vec3 wSampleToCamera = normalize(wCameraPos - wSamplePos);
+// blue (minimum steps) -> green -> red (maximum steps); black if the march has been skipped
+vec3 stepHeatmapColor(int steps) {
+    if (steps == 0)
+        return vec3(0.0);
+    float t = clamp(float(steps - minSteps) / float(max(maxSteps - minSteps, 1)), 0.0, 1.0);
+    return t < 0.5 ? mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), t*2.0) : mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), t*2.0 - 1.0);
+}
+
+void main() {
+    extinctionCoeff = absorptionCoeff + scatteringCoeff;
+
+    vec3 fragRadiance = vec3(texture(skyboxTex, interp_UVW));
+    // the view ray is the direction of the skybox texel
+    float distanceFromCamera = skyDistance;
+    vec3 wRayDir = normalize(interp_UVW);
+    vec4 clipRayDir = clusterRay(wRayDir);
+    intersectVolumes(wRayDir);
 
-        vec3 scattering = calculateScattering(wSamplePos, wLightToSample, wSampleToCamera);
+    vec3 result = vec3(0.0);
+    vec3 fragOpticalDepth;
 
-        //transmittance x scattering x scatteringCoeff x differential of integral
-        result += cameraSampleTransmittance*scattering*scatteringCoeff*differential;
-        wSamplePos += wStep;
+    //Ray marching init
+    float tStart, tEnd;
+    int steps = 0;
+    if (externalInscattering == 0 && clipMarch(distanceFromCamera, tStart, tEnd)) {
+        // Not using random on skybox to avoid visual artifacts: the samples are at the middle of the steps
+        result = marchRay(clipRayDir, tStart, tEnd, 0.5, steps, fragOpticalDepth);
+        // after the end of the march there is only the ambient medium (or the transmittance is under the threshold)
+        fragOpticalDepth += extinctionCoeff * ambientDensity * (distanceFromCamera - tEnd);
+    } else {
+        fragOpticalDepth = calculateOpticalDepth(distanceFromCamera);
     }
+
+    //1st term
+    vec3 transmittedSurfaceRadiance = calculateTransmittance(fragOpticalDepth)*fragRadiance;
+    result += transmittedSurfaceRadiance;
+
+    if (stepHeatmap != 0)
+        result = stepHeatmapColor(steps);
     colorFrag = vec4(result, 1.0);
 }
 
@@ -0,0 +1,44 @@
+#version 410 core
+
+// upscale of the scene target on the full framebuffer. The bilinear upscale is followed by a sharpening filter,
+// which recovers part of the detail lost by the lower resolution
+out vec4 colorFrag;
+
+in vec2 interp_UV;
+
+uniform sampler2D sceneTex;
+// in-scattering of the media computed by the epipolar pass, added to the scene
+uniform sampler2D inscatteringTex;
+uniform bool addInscattering;
+// fraction of the texture covered by the scaled viewport
+uniform vec2 uvScale;
+uniform float sharpness;
+
+vec3 sampleScene(vec2 uv, vec2 texel) {
+    // the samples are kept inside the rendered area of the texture
+    vec2 clampedUv = clamp(uv, 0.5 * texel, uvScale - 0.5 * texel);
+    vec3 color = texture(sceneTex, clampedUv).rgb;
+    if (addInscattering)
+        color += texture(inscatteringTex, clampedUv).rgb;
+    return color;
+}
+
+void main() {
+    vec2 texel = 1.0 / vec2(textureSize(sceneTex, 0));
+    vec2 uv = interp_UV * uvScale;
+
+    vec3 center = sampleScene(uv, texel);
+    vec3 north = sampleScene(uv + vec2(0.0, texel.y), texel);
+    vec3 south = sampleScene(uv - vec2(0.0, texel.y), texel);
+    vec3 east = sampleScene(uv + vec2(texel.x, 0.0), texel);
+    vec3 west = sampleScene(uv - vec2(texel.x, 0.0), texel);
+
+    // unsharp mask: the difference with the average of the neighbours is added back. The result is limited to the
+    // range of the neighbourhood, to avoid halos around the edges
+    vec3 blurred = 0.25 * (north + south + east + west);
+    vec3 minColor = min(center, min(min(north, south), min(east, west)));
+    vec3 maxColor = max(center, max(max(north, south), max(east, west)));
+    vec3 sharpened = clamp(center + 2.0 * sharpness * (center - blurred), minColor, maxColor);
+
+    colorFrag = vec4(sharpened, 1.0);
+}
@@ -1,4 +1,5 @@
 #include <utils/arrow_line.h>
+#include <utils/gpu_memory.h>
 
 ArrowLine::~ArrowLine() noexcept {
 }
@@ -20,6 +21,7 @@ ArrowLine::ArrowLine(vector<Point>& _points, int _linePointsNum) : points(_point
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
 
         glBufferData(GL_ARRAY_BUFFER, points.size() * sizeof(Point), &this->points[0], GL_STATIC_DRAW);
+        TrackGpuMemory(MemoryCategory::GEOMETRY, VAO, points.size() * sizeof(Point));
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(
             0,        // attribute 0. No particular reason for 0, but must match the layout in the shader.
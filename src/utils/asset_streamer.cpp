@@ -0,0 +1,221 @@
+#include <utils/asset_streamer.h>
+#include <utils/gpu_memory.h>
+#include <utils/profiler.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+AssetStreamer::AssetStreamer(JobSystem &jobs, size_t ringSize, size_t slotSize) : _jobs(jobs), _slotSize(slotSize)
+{
+    _pbos.resize(ringSize);
+    _fences.resize(ringSize, nullptr);
+    glGenBuffers((GLsizei)ringSize, _pbos.data());
+    for (GLuint pbo : _pbos)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, _slotSize, nullptr, GL_STREAM_DRAW);
+        TrackGpuMemory(MemoryCategory::BUFFER, pbo, _slotSize);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+AssetStreamer::~AssetStreamer() noexcept
+{
+    _quit = true;
+    _jobs.Wait(_outstanding);
+
+    for (GLsync fence : _fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    for (GLuint pbo : _pbos)
+        UntrackGpuMemory(MemoryCategory::BUFFER, pbo);
+    glDeleteBuffers((GLsizei)_pbos.size(), _pbos.data());
+}
+
+// the loads are background jobs: the frames never wait for them
+void AssetStreamer::enqueueWork(std::function<void()> work, std::function<void()> cancelled)
+{
+    _jobs.Run([this, work, cancelled] {
+        if (_quit)
+        {
+            if (cancelled)
+                cancelled();
+            return;
+        }
+        PROFILE_SCOPE("Asset job");
+        work();
+    }, &_outstanding, JobPriority::BACKGROUND);
+}
+
+void AssetStreamer::setPlaceholder(GLuint texture, GLenum target)
+{
+    // 1x1 grey texel: a single level is a complete mipmap chain, so the texture is usable with any filter
+    const GLubyte grey[3] = {128, 128, 128};
+    glActiveTexture(GL_TEXTURE0 + StreamingTextureUnit);
+    glBindTexture(target, texture);
+    if (target == GL_TEXTURE_CUBE_MAP)
+    {
+        for (GLenum face = 0; face < 6; face++)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+    }
+    else
+    {
+        glTexImage2D(target, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+    }
+    glBindTexture(target, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void AssetStreamer::StreamTexture2D(GLuint texture, const string &path)
+{
+    setPlaceholder(texture, GL_TEXTURE_2D);
+
+    auto job = std::make_shared<UploadJob>();
+    job->Texture = texture;
+    job->Target = GL_TEXTURE_2D;
+    job->Paths = {path};
+    job->CachePath = path + TextureCacheExtension;
+    enqueueTexture(job);
+}
+
+void AssetStreamer::StreamCubeMap(GLuint texture, const std::array<string, 6> &facePaths, const string &cachePath)
+{
+    setPlaceholder(texture, GL_TEXTURE_CUBE_MAP);
+
+    auto job = std::make_shared<UploadJob>();
+    job->Texture = texture;
+    job->Target = GL_TEXTURE_CUBE_MAP;
+    job->Paths.assign(facePaths.begin(), facePaths.end());
+    job->CachePath = cachePath;
+    enqueueTexture(job);
+}
+
+void AssetStreamer::enqueueTexture(const std::shared_ptr<UploadJob> &job)
+{
+    _pending++;
+    // the worker only maps the cache file, unless it must be built: then it decodes the images and compresses the levels
+    enqueueWork([this, job] {
+        LoadTextureCache(job->Paths, job->CachePath, job->Cache, &_jobs);
+        std::lock_guard<std::mutex> lock(_readyMutex);
+        _ready.push_back(job);
+    });
+}
+
+std::future<vector<MeshData>> AssetStreamer::StreamModelData(const string &path)
+{
+    auto promise = std::make_shared<std::promise<vector<MeshData>>>();
+    std::future<vector<MeshData>> result = promise->get_future();
+    enqueueWork([this, promise, path] {
+        vector<MeshData> meshes;
+        ImportModel(path, meshes, &_jobs);
+        promise->set_value(std::move(meshes));
+    }, [promise] { promise->set_value(vector<MeshData>()); });
+    return result;
+}
+
+void AssetStreamer::Update(double budgetMs)
+{
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    auto elapsedMs = [&] { return std::chrono::duration<double, std::milli>(clock::now() - start).count(); };
+
+    // a texture is uploaded as a whole, so a cube map never shows a mix of placeholder and real faces
+    while (elapsedMs() < budgetMs)
+    {
+        std::shared_ptr<UploadJob> job;
+        {
+            std::lock_guard<std::mutex> lock(_readyMutex);
+            if (_ready.empty())
+                break;
+            job = _ready.front();
+            _ready.pop_front();
+        }
+        upload(*job);
+        _pending--;
+    }
+    _lastUpdateMs = elapsedMs();
+}
+
+void AssetStreamer::upload(UploadJob &job)
+{
+    // if the texture could not be loaded we keep the placeholder
+    if (!job.Cache.IsOpen())
+        return;
+
+    // the textures used by the frame are bound once to their units: we work on a unit reserved to the streaming
+    glActiveTexture(GL_TEXTURE0 + StreamingTextureUnit);
+    glBindTexture(job.Target, job.Texture);
+
+    for (int face = 0; face < job.Cache.GetFaceCount(); face++)
+    {
+        for (int level = 0; level < job.Cache.GetLevelCount(); level++)
+            uploadLevel(job, face, level);
+    }
+    TrackGpuMemory(job.Target == GL_TEXTURE_CUBE_MAP ? MemoryCategory::CUBE_MAP : MemoryCategory::TEXTURE, job.Texture,
+                   job.Cache.GetTotalSize());
+    // the levels are in the GL memory now, we can release the mapping of the file
+    job.Cache.Close();
+
+    glBindTexture(job.Target, 0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void AssetStreamer::uploadLevel(const UploadJob &job, int face, int level)
+{
+    const size_t size = job.Cache.GetLevel(face, level).Size;
+    const unsigned char *data = job.Cache.GetLevelData(face, level);
+
+    // levels bigger than a slot of the ring are uploaded directly from the mapped file
+    if (size > _slotSize)
+    {
+        job.Cache.UploadLevel(job.Target, face, level, data);
+        return;
+    }
+
+    const size_t slot = _nextSlot;
+    _nextSlot = (_nextSlot + 1) % _pbos.size();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _pbos[slot]);
+
+    // if the GPU has finished reading the slot we can write it without synchronization,
+    // otherwise we orphan the buffer storage instead of waiting
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+    if (_fences[slot] && glClientWaitSync(_fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, _slotSize, nullptr, GL_STREAM_DRAW);
+    else
+        access |= GL_MAP_UNSYNCHRONIZED_BIT;
+
+    void *ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, access);
+    if (ptr)
+    {
+        memcpy(ptr, data, size);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        // the data pointer is an offset in the bound unpack buffer
+        job.Cache.UploadLevel(job.Target, face, level, (GLvoid *)0);
+    }
+    else
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        job.Cache.UploadLevel(job.Target, face, level, data);
+    }
+
+    if (_fences[slot])
+        glDeleteSync(_fences[slot]);
+    _fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+size_t AssetStreamer::GetPendingCount() const
+{
+    return _pending;
+}
+
+double AssetStreamer::GetLastUpdateMs() const
+{
+    return _lastUpdateMs;
+}
@@ -0,0 +1,163 @@
+#include <utils/batch_render.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+using std::string;
+using std::vector;
+
+namespace
+{
+    bool parseVec3(const string &text, glm::vec3 &value)
+    {
+        char comma1 = 0, comma2 = 0;
+        std::istringstream stream(text);
+        stream >> value.x >> comma1 >> value.y >> comma2 >> value.z;
+        return !stream.fail() && comma1 == ',' && comma2 == ',';
+    }
+
+    template <typename T>
+    bool parseNumber(const string &text, T &value)
+    {
+        std::istringstream stream(text);
+        stream >> value;
+        return !stream.fail() && stream.eof();
+    }
+
+    bool parseChoice(const string &text, const vector<string> &names, int &value)
+    {
+        auto name = std::find(names.begin(), names.end(), text);
+        if (name != names.end())
+        {
+            value = (int)(name - names.begin());
+            return true;
+        }
+        return parseNumber(text, value) && value >= 0 && value < (int)names.size();
+    }
+
+    bool parseKey(BatchJob &job, const string &key, const string &value)
+    {
+        if (key == "name")
+        {
+            job.Name = value;
+            return !value.empty();
+        }
+        if (key == "camera")
+            return parseVec3(value, job.CameraPos);
+        if (key == "yaw")
+            return parseNumber(value, job.Yaw);
+        if (key == "pitch")
+            return parseNumber(value, job.Pitch);
+        if (key == "light")
+            return parseVec3(value, job.LightPos);
+        if (key == "absorption")
+            return parseVec3(value, job.AbsorptionCoeff);
+        if (key == "scattering")
+            return parseVec3(value, job.ScatteringCoeff);
+        if (key == "g")
+            return parseNumber(value, job.G) && job.G > -1.0f && job.G < 1.0f;
+        if (key == "phase")
+            return parseChoice(value, {"mie", "rayleigh", "schlick", "uniform"}, job.PhaseFunction);
+        if (key == "skybox")
+            return parseChoice(value, {"fog", "media"}, job.SkyboxTechnique);
+        if (key == "width")
+            return parseNumber(value, job.Width) && job.Width > 0;
+        if (key == "height")
+            return parseNumber(value, job.Height) && job.Height > 0;
+        if (key == "reference")
+            return parseNumber(value, job.ReferenceSamples) && job.ReferenceSamples >= 0;
+        return false;
+    }
+}
+
+bool LoadBatchJobs(const string &path, const BatchJob &defaults, vector<BatchJob> &jobs)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::BATCH::FILE_NOT_READ: " << path << std::endl;
+        return false;
+    }
+
+    jobs.clear();
+    BatchJob job = defaults;
+    string line;
+    for (int lineNumber = 1; std::getline(file, line); lineNumber++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream tokens(line);
+        string token;
+        bool empty = true;
+        job.Name.clear();
+        while (tokens >> token)
+        {
+            empty = false;
+            const size_t equal = token.find('=');
+            if (equal == string::npos || !parseKey(job, token.substr(0, equal), token.substr(equal + 1)))
+            {
+                std::cout << "ERROR::BATCH::INVALID_PARAMETER at line " << lineNumber << ": " << token << std::endl;
+                return false;
+            }
+        }
+        if (empty)
+            continue;
+        // the names are not inherited: each image has its own file
+        if (job.Name.empty())
+            job.Name = "job_" + std::to_string(lineNumber);
+        jobs.push_back(job);
+    }
+    if (jobs.empty())
+        std::cout << "ERROR::BATCH::NO_JOBS: " << path << std::endl;
+    return !jobs.empty();
+}
+
+vector<BatchTile> SplitIntoTiles(int width, int height, int maxTileSize)
+{
+    // tiles of the same size (but the last ones), as large as allowed
+    const int columns = (width + maxTileSize - 1) / maxTileSize;
+    const int rows = (height + maxTileSize - 1) / maxTileSize;
+    const int tileWidth = (width + columns - 1) / columns;
+    const int tileHeight = (height + rows - 1) / rows;
+    vector<BatchTile> tiles;
+    for (int y = 0; y < height; y += tileHeight)
+    {
+        for (int x = 0; x < width; x += tileWidth)
+            tiles.push_back({x, y, std::min(tileWidth, width - x), std::min(tileHeight, height - y)});
+    }
+    return tiles;
+}
+
+glm::mat4 GetTileProjection(float fovY, float near, float far, int imageWidth, int imageHeight, const BatchTile &tile)
+{
+    // the near plane window of the whole image, cut at the borders of the tile
+    const float top = near * std::tan(fovY * 0.5f);
+    const float right = top * (float)imageWidth / (float)imageHeight;
+    const float left = -right + 2.0f * right * tile.X / imageWidth;
+    const float bottom = -top + 2.0f * top * tile.Y / imageHeight;
+    return glm::frustum(left, left + 2.0f * right * tile.Width / imageWidth, bottom,
+                        bottom + 2.0f * top * tile.Height / imageHeight, near, far);
+}
+
+bool WriteBatchReport(const string &path, const vector<BatchJob> &jobs, const vector<string> &files,
+                      const vector<BatchJobTiming> &timings)
+{
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::BATCH::FILE_NOT_WRITTEN: " << path << std::endl;
+        return false;
+    }
+    file << "name,file,width,height,tiles,submitted_ms,written_ms,encode_ms,gpu_ms,gpu_frames_measured,written,"
+            "reference_samples,reference_ms,reference_rmse,reference_rel_mse\n";
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const BatchJobTiming &timing = timings[i];
+        file << jobs[i].Name << "," << files[i] << "," << jobs[i].Width << "," << jobs[i].Height << "," << timing.Tiles << "," << timing.SubmittedMs
+             << "," << timing.WrittenMs << "," << timing.EncodeMs << "," << timing.GpuMs << "," << timing.GpuFramesMeasured
+             << "," << (timing.Written ? 1 : 0) << "," << jobs[i].ReferenceSamples << "," << timing.ReferenceMs << ","
+             << timing.ReferenceRmse << "," << timing.ReferenceRelMse << "\n";
+    }
+    return (bool)file;
+}
@@ -0,0 +1,303 @@
+#include <utils/block_compression.h>
+#include <algorithm>
+#include <cstring>
+using std::vector;
+
+namespace
+{
+    // 4x4 block of pixels read from the image, with clamping on the borders
+    void fetchBlock(const uint8_t *rgba, int width, int height, int bx, int by, uint8_t block[16][4])
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int sy = std::min(by * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int sx = std::min(bx * 4 + x, width - 1);
+                memcpy(block[y * 4 + x], rgba + ((size_t)sy * width + sx) * 4, 4);
+            }
+        }
+    }
+
+    // bounding box of the colors, with the diagonal oriented following the covariance of the channels
+    void boundingDiagonal(const uint8_t block[16][4], int channels, int minColor[4], int maxColor[4])
+    {
+        float mean[4] = {};
+        for (int c = 0; c < channels; c++)
+        {
+            minColor[c] = 255;
+            maxColor[c] = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                minColor[c] = std::min(minColor[c], (int)block[i][c]);
+                maxColor[c] = std::max(maxColor[c], (int)block[i][c]);
+                mean[c] += block[i][c] / 16.0f;
+            }
+        }
+        // if a channel decreases when the first one increases, its endpoints are swapped
+        for (int c = 1; c < channels; c++)
+        {
+            float covariance = 0.0f;
+            for (int i = 0; i < 16; i++)
+                covariance += (block[i][0] - mean[0]) * (block[i][c] - mean[c]);
+            if (covariance < 0.0f)
+                std::swap(minColor[c], maxColor[c]);
+        }
+    }
+
+    int colorDistance(const int a[3], const int b[3])
+    {
+        int dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+        return dr * dr + dg * dg + db * db;
+    }
+
+    uint16_t to565(const int c[3])
+    {
+        int r = std::min(31, (c[0] * 31 + 127) / 255);
+        int g = std::min(63, (c[1] * 63 + 127) / 255);
+        int b = std::min(31, (c[2] * 31 + 127) / 255);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void from565(uint16_t v, int c[3])
+    {
+        int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+        c[0] = (r << 3) | (r >> 2);
+        c[1] = (g << 2) | (g >> 4);
+        c[2] = (b << 3) | (b >> 2);
+    }
+
+    // BC1 color block, always in 4 colors mode (as required by BC3)
+    void encodeColorBlock(const uint8_t block[16][4], uint8_t out[8])
+    {
+        int minColor[4], maxColor[4];
+        boundingDiagonal(block, 3, minColor, maxColor);
+
+        // the endpoints are moved slightly inside the box, to reduce the error on the interpolated colors
+        for (int c = 0; c < 3; c++)
+        {
+            int inset = (maxColor[c] - minColor[c]) / 16;
+            maxColor[c] -= inset;
+            minColor[c] += inset;
+        }
+
+        uint16_t c0 = to565(maxColor);
+        uint16_t c1 = to565(minColor);
+        if (c0 < c1)
+            std::swap(c0, c1);
+
+        uint32_t indices = 0;
+        if (c0 != c1)
+        {
+            int palette[4][3];
+            from565(c0, palette[0]);
+            from565(c1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                int pixel[3] = {block[i][0], block[i][1], block[i][2]};
+                int best = 0, bestDistance = colorDistance(pixel, palette[0]);
+                for (int p = 1; p < 4; p++)
+                {
+                    int d = colorDistance(pixel, palette[p]);
+                    if (d < bestDistance)
+                    {
+                        best = p;
+                        bestDistance = d;
+                    }
+                }
+                indices |= (uint32_t)best << (i * 2);
+            }
+        }
+
+        out[0] = c0 & 0xFF;
+        out[1] = c0 >> 8;
+        out[2] = c1 & 0xFF;
+        out[3] = c1 >> 8;
+        for (int i = 0; i < 4; i++)
+            out[4 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+
+    // BC3 alpha block, in 8 values mode
+    void encodeAlphaBlock(const uint8_t block[16][4], uint8_t out[8])
+    {
+        int a0 = 0, a1 = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            a0 = std::max(a0, (int)block[i][3]);
+            a1 = std::min(a1, (int)block[i][3]);
+        }
+
+        uint64_t indices = 0;
+        if (a0 != a1)
+        {
+            int palette[8];
+            palette[0] = a0;
+            palette[1] = a1;
+            for (int i = 1; i < 7; i++)
+                palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0;
+                for (int p = 1; p < 8; p++)
+                {
+                    if (std::abs(block[i][3] - palette[p]) < std::abs(block[i][3] - palette[best]))
+                        best = p;
+                }
+                indices |= (uint64_t)best << (i * 3);
+            }
+        }
+
+        out[0] = (uint8_t)a0;
+        out[1] = (uint8_t)a1;
+        for (int i = 0; i < 6; i++)
+            out[2 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+
+    // writes the bits of a BC7 block, starting from the least significant bit
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(uint8_t *out) : _out(out) { memset(_out, 0, 16); }
+        void Write(uint32_t value, int bits)
+        {
+            for (int i = 0; i < bits; i++, _position++)
+            {
+                if (value & (1u << i))
+                    _out[_position / 8] |= (uint8_t)(1u << (_position % 8));
+            }
+        }
+
+    private:
+        uint8_t *_out;
+        int _position = 0;
+    };
+
+    void encodeBC7Mode6Block(const uint8_t block[16][4], uint8_t out[16])
+    {
+        static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+        int minColor[4], maxColor[4];
+        boundingDiagonal(block, 4, minColor, maxColor);
+
+        // endpoints are 7 bits per channel plus a p-bit shared by the 4 channels: we pick the p-bit with the lowest error
+        int endpoints[2][4], quantized[2][4], pbits[2];
+        const int *source[2] = {minColor, maxColor};
+        for (int e = 0; e < 2; e++)
+        {
+            int bestError = -1;
+            for (int p = 0; p < 2; p++)
+            {
+                int error = 0, q[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    q[c] = std::min(127, std::max(0, (source[e][c] - p + 1) / 2));
+                    int value = (q[c] << 1) | p;
+                    error += (value - source[e][c]) * (value - source[e][c]);
+                }
+                if (bestError < 0 || error < bestError)
+                {
+                    bestError = error;
+                    pbits[e] = p;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        quantized[e][c] = q[c];
+                        endpoints[e][c] = (q[c] << 1) | p;
+                    }
+                }
+            }
+        }
+
+        int palette[16][4];
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++)
+                palette[i][c] = ((64 - weights[i]) * endpoints[0][c] + weights[i] * endpoints[1][c] + 32) >> 6;
+        }
+
+        int indices[16];
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestDistance = -1;
+            for (int p = 0; p < 16; p++)
+            {
+                int d = 0;
+                for (int c = 0; c < 4; c++)
+                    d += (block[i][c] - palette[p][c]) * (block[i][c] - palette[p][c]);
+                if (bestDistance < 0 || d < bestDistance)
+                {
+                    best = p;
+                    bestDistance = d;
+                }
+            }
+            indices[i] = best;
+        }
+
+        // the most significant bit of the first index is implicitly 0: if it is set, we swap the endpoints
+        if (indices[0] & 8)
+        {
+            std::swap(quantized[0], quantized[1]);
+            std::swap(pbits[0], pbits[1]);
+            for (int &index : indices)
+                index = 15 - index;
+        }
+
+        BitWriter writer(out);
+        writer.Write(1u << 6, 7); // mode 6
+        for (int c = 0; c < 4; c++)
+        {
+            writer.Write(quantized[0][c], 7);
+            writer.Write(quantized[1][c], 7);
+        }
+        writer.Write(pbits[0], 1);
+        writer.Write(pbits[1], 1);
+        writer.Write(indices[0], 3);
+        for (int i = 1; i < 16; i++)
+            writer.Write(indices[i], 4);
+    }
+
+    template <typename Encoder>
+    void compressBlocks(const uint8_t *rgba, int width, int height, size_t blockSize, vector<uint8_t> &out, Encoder encode)
+    {
+        int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+        out.resize((size_t)blocksX * blocksY * blockSize);
+        uint8_t *dst = out.data();
+        uint8_t block[16][4];
+        for (int by = 0; by < blocksY; by++)
+        {
+            for (int bx = 0; bx < blocksX; bx++)
+            {
+                fetchBlock(rgba, width, height, bx, by, block);
+                encode(block, dst);
+                dst += blockSize;
+            }
+        }
+    }
+}
+
+size_t CompressedSize(int width, int height, size_t blockSize)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+void CompressBC1(const uint8_t *rgba, int width, int height, vector<uint8_t> &out)
+{
+    compressBlocks(rgba, width, height, 8, out, [](const uint8_t block[16][4], uint8_t *dst) { encodeColorBlock(block, dst); });
+}
+
+void CompressBC3(const uint8_t *rgba, int width, int height, vector<uint8_t> &out)
+{
+    compressBlocks(rgba, width, height, 16, out, [](const uint8_t block[16][4], uint8_t *dst) {
+        encodeAlphaBlock(block, dst);
+        encodeColorBlock(block, dst + 8);
+    });
+}
+
+void CompressBC7(const uint8_t *rgba, int width, int height, vector<uint8_t> &out)
+{
+    compressBlocks(rgba, width, height, 16, out, [](const uint8_t block[16][4], uint8_t *dst) { encodeBC7Mode6Block(block, dst); });
+}
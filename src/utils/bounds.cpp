@@ -0,0 +1,142 @@
+#include <utils/bounds.h>
+
+AABB::AABB(const glm::vec3 &min, const glm::vec3 &max) : Min(min), Max(max) {}
+
+bool AABB::IsValid() const
+{
+    return Min.x <= Max.x && Min.y <= Max.y && Min.z <= Max.z;
+}
+
+glm::vec3 AABB::Center() const
+{
+    return (Min + Max) * 0.5f;
+}
+
+glm::vec3 AABB::Extents() const
+{
+    return (Max - Min) * 0.5f;
+}
+
+float AABB::SurfaceArea() const
+{
+    glm::vec3 d = Max - Min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+void AABB::Expand(const glm::vec3 &point)
+{
+    Min = glm::min(Min, point);
+    Max = glm::max(Max, point);
+}
+
+void AABB::Expand(const AABB &other)
+{
+    Min = glm::min(Min, other.Min);
+    Max = glm::max(Max, other.Max);
+}
+
+AABB AABB::Fattened(float margin) const
+{
+    return AABB(Min - glm::vec3(margin), Max + glm::vec3(margin));
+}
+
+bool AABB::Contains(const AABB &other) const
+{
+    return glm::all(glm::lessThanEqual(Min, other.Min)) && glm::all(glm::greaterThanEqual(Max, other.Max));
+}
+
+bool AABB::Overlaps(const AABB &other) const
+{
+    return glm::all(glm::lessThanEqual(Min, other.Max)) && glm::all(glm::greaterThanEqual(Max, other.Min));
+}
+
+AABB AABB::Transformed(const glm::mat4 &matrix) const
+{
+    // we start from the translation and we add, for each axis, the min and max contribution of every matrix column
+    glm::vec3 newMin = glm::vec3(matrix[3]);
+    glm::vec3 newMax = newMin;
+    for (int i = 0; i < 3; i++)
+    {
+        glm::vec3 a = glm::vec3(matrix[i]) * Min[i];
+        glm::vec3 b = glm::vec3(matrix[i]) * Max[i];
+        newMin += glm::min(a, b);
+        newMax += glm::max(a, b);
+    }
+    return AABB(newMin, newMax);
+}
+
+BoundingSphere BoundingSphere::Transformed(const glm::mat4 &matrix) const
+{
+    BoundingSphere result;
+    result.Center = glm::vec3(matrix * glm::vec4(Center, 1.0f));
+    // the radius is scaled by the largest axis scaling of the matrix
+    float maxScale = glm::max(glm::length(glm::vec3(matrix[0])), glm::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+    result.Radius = Radius * maxScale;
+    return result;
+}
+
+Frustum::Frustum(const glm::mat4 &viewProjection)
+{
+    // Gribb-Hartmann extraction: GLM matrices are column major, so we work on the rows of the transposed matrix
+    glm::mat4 m = glm::transpose(viewProjection);
+    _planes[0] = m[3] + m[0]; // left
+    _planes[1] = m[3] - m[0]; // right
+    _planes[2] = m[3] + m[1]; // bottom
+    _planes[3] = m[3] - m[1]; // top
+    _planes[4] = m[3] + m[2]; // near
+    _planes[5] = m[3] - m[2]; // far
+    for (auto &plane : _planes)
+        plane /= glm::length(glm::vec3(plane));
+}
+
+bool Frustum::Intersects(const AABB &box) const
+{
+    glm::vec3 center = box.Center();
+    glm::vec3 extents = box.Extents();
+    for (const auto &plane : _planes)
+    {
+        // projected radius of the box on the plane normal
+        float r = glm::dot(extents, glm::abs(glm::vec3(plane)));
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -r)
+            return false;
+    }
+    return true;
+}
+
+bool Frustum::Intersects(const BoundingSphere &sphere) const
+{
+    for (const auto &plane : _planes)
+    {
+        if (glm::dot(glm::vec3(plane), sphere.Center) + plane.w < -sphere.Radius)
+            return false;
+    }
+    return true;
+}
+
+Bounds ComputeBounds(const Mesh &mesh)
+{
+    Bounds bounds;
+    for (const auto &vertex : mesh.vertices)
+        bounds.Box.Expand(vertex.Position);
+
+    // the sphere is centered in the box, and its radius is the farthest vertex
+    bounds.Sphere.Center = bounds.Box.Center();
+    for (const auto &vertex : mesh.vertices)
+        bounds.Sphere.Radius = glm::max(bounds.Sphere.Radius, glm::length(vertex.Position - bounds.Sphere.Center));
+    return bounds;
+}
+
+Bounds ComputeBounds(const Model &model)
+{
+    Bounds bounds;
+    for (const auto &mesh : model.meshes)
+        bounds.Box.Expand(ComputeBounds(*mesh).Box);
+
+    bounds.Sphere.Center = bounds.Box.Center();
+    for (const auto &mesh : model.meshes)
+    {
+        for (const auto &vertex : mesh->vertices)
+            bounds.Sphere.Radius = glm::max(bounds.Sphere.Radius, glm::length(vertex.Position - bounds.Sphere.Center));
+    }
+    return bounds;
+}
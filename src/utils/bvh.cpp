@@ -0,0 +1,290 @@
+#include <utils/bvh.h>
+
+BVH::BVH(float margin) : _margin(margin) {}
+
+int BVH::allocateNode()
+{
+    if (_freeList == NullNode)
+    {
+        _nodes.emplace_back();
+        return (int)_nodes.size() - 1;
+    }
+    int nodeId = _freeList;
+    _freeList = _nodes[nodeId].Parent;
+    _nodes[nodeId] = Node();
+    return nodeId;
+}
+
+void BVH::freeNode(int nodeId)
+{
+    _nodes[nodeId].Parent = _freeList;
+    _nodes[nodeId].Height = -1;
+    _freeList = nodeId;
+}
+
+int BVH::Insert(const AABB &box, void *userData)
+{
+    int proxyId = allocateNode();
+    _nodes[proxyId].Box = box.Fattened(_margin);
+    _nodes[proxyId].UserData = userData;
+    _nodes[proxyId].Height = 0;
+    insertLeaf(proxyId);
+    _proxyCount++;
+    return proxyId;
+}
+
+void BVH::Remove(int proxyId)
+{
+    removeLeaf(proxyId);
+    freeNode(proxyId);
+    _proxyCount--;
+}
+
+bool BVH::Move(int proxyId, const AABB &box)
+{
+    // the fat AABB still contains the object: nothing to do
+    if (_nodes[proxyId].Box.Contains(box))
+        return false;
+
+    removeLeaf(proxyId);
+    _nodes[proxyId].Box = box.Fattened(_margin);
+    insertLeaf(proxyId);
+    return true;
+}
+
+void *BVH::GetUserData(int proxyId) const
+{
+    return _nodes[proxyId].UserData;
+}
+
+const AABB &BVH::GetFatAABB(int proxyId) const
+{
+    return _nodes[proxyId].Box;
+}
+
+int BVH::GetHeight() const
+{
+    return _root == NullNode ? 0 : _nodes[_root].Height;
+}
+
+int BVH::GetProxyCount() const
+{
+    return _proxyCount;
+}
+
+int BVH::Query(const std::function<bool(const AABB &)> &test, const std::function<void(int)> &callback) const
+{
+    int tested = 0;
+    if (_root == NullNode)
+        return tested;
+
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(_root);
+    while (!stack.empty())
+    {
+        int nodeId = stack.back();
+        stack.pop_back();
+        const Node &node = _nodes[nodeId];
+        tested++;
+        if (!test(node.Box))
+            continue;
+
+        if (node.IsLeaf())
+        {
+            callback(nodeId);
+        }
+        else
+        {
+            stack.push_back(node.Left);
+            stack.push_back(node.Right);
+        }
+    }
+    return tested;
+}
+
+void BVH::insertLeaf(int leaf)
+{
+    if (_root == NullNode)
+    {
+        _root = leaf;
+        _nodes[_root].Parent = NullNode;
+        return;
+    }
+
+    // we descend the tree looking for the best sibling, using the surface area heuristic
+    AABB leafBox = _nodes[leaf].Box;
+    int index = _root;
+    while (!_nodes[index].IsLeaf())
+    {
+        int left = _nodes[index].Left;
+        int right = _nodes[index].Right;
+
+        float area = _nodes[index].Box.SurfaceArea();
+        AABB combined = _nodes[index].Box;
+        combined.Expand(leafBox);
+        float combinedArea = combined.SurfaceArea();
+
+        // cost of creating a new parent for this node and the new leaf
+        float cost = 2.0f * combinedArea;
+        // minimum cost of pushing the leaf further down the tree
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        auto descendCost = [&](int child) {
+            AABB box = leafBox;
+            box.Expand(_nodes[child].Box);
+            if (_nodes[child].IsLeaf())
+                return box.SurfaceArea() + inheritanceCost;
+            return (box.SurfaceArea() - _nodes[child].Box.SurfaceArea()) + inheritanceCost;
+        };
+        float costLeft = descendCost(left);
+        float costRight = descendCost(right);
+
+        if (cost < costLeft && cost < costRight)
+            break;
+
+        index = costLeft < costRight ? left : right;
+    }
+
+    int sibling = index;
+    int oldParent = _nodes[sibling].Parent;
+    int newParent = allocateNode();
+    _nodes[newParent].Parent = oldParent;
+    _nodes[newParent].Box = leafBox;
+    _nodes[newParent].Box.Expand(_nodes[sibling].Box);
+    _nodes[newParent].Height = _nodes[sibling].Height + 1;
+    _nodes[newParent].Left = sibling;
+    _nodes[newParent].Right = leaf;
+    _nodes[sibling].Parent = newParent;
+    _nodes[leaf].Parent = newParent;
+
+    if (oldParent != NullNode)
+    {
+        if (_nodes[oldParent].Left == sibling)
+            _nodes[oldParent].Left = newParent;
+        else
+            _nodes[oldParent].Right = newParent;
+    }
+    else
+    {
+        _root = newParent;
+    }
+
+    // we walk back up the tree fixing heights and boxes
+    index = _nodes[leaf].Parent;
+    while (index != NullNode)
+    {
+        index = balance(index);
+        int left = _nodes[index].Left;
+        int right = _nodes[index].Right;
+        _nodes[index].Height = 1 + glm::max(_nodes[left].Height, _nodes[right].Height);
+        _nodes[index].Box = _nodes[left].Box;
+        _nodes[index].Box.Expand(_nodes[right].Box);
+        index = _nodes[index].Parent;
+    }
+}
+
+void BVH::removeLeaf(int leaf)
+{
+    if (leaf == _root)
+    {
+        _root = NullNode;
+        return;
+    }
+
+    int parent = _nodes[leaf].Parent;
+    int grandParent = _nodes[parent].Parent;
+    int sibling = _nodes[parent].Left == leaf ? _nodes[parent].Right : _nodes[parent].Left;
+
+    if (grandParent != NullNode)
+    {
+        // the sibling takes the place of the parent
+        if (_nodes[grandParent].Left == parent)
+            _nodes[grandParent].Left = sibling;
+        else
+            _nodes[grandParent].Right = sibling;
+        _nodes[sibling].Parent = grandParent;
+        freeNode(parent);
+
+        int index = grandParent;
+        while (index != NullNode)
+        {
+            index = balance(index);
+            int left = _nodes[index].Left;
+            int right = _nodes[index].Right;
+            _nodes[index].Box = _nodes[left].Box;
+            _nodes[index].Box.Expand(_nodes[right].Box);
+            _nodes[index].Height = 1 + glm::max(_nodes[left].Height, _nodes[right].Height);
+            index = _nodes[index].Parent;
+        }
+    }
+    else
+    {
+        _root = sibling;
+        _nodes[sibling].Parent = NullNode;
+        freeNode(parent);
+    }
+}
+
+// Performs a left or right rotation if the node A is imbalanced, and returns the new root of the subtree
+int BVH::balance(int iA)
+{
+    Node &A = _nodes[iA];
+    if (A.IsLeaf() || A.Height < 2)
+        return iA;
+
+    int iB = A.Left;
+    int iC = A.Right;
+    int balanceFactor = _nodes[iC].Height - _nodes[iB].Height;
+
+    // the rotation promotes the highest child (C or B), and it is symmetric for the two cases
+    auto rotate = [&](int iUp, int iOther, bool upIsRight) {
+        Node &up = _nodes[iUp];
+        int iF = up.Left;
+        int iG = up.Right;
+
+        // "up" becomes the parent of A
+        up.Left = iA;
+        up.Parent = _nodes[iA].Parent;
+        _nodes[iA].Parent = iUp;
+
+        if (up.Parent != NullNode)
+        {
+            if (_nodes[up.Parent].Left == iA)
+                _nodes[up.Parent].Left = iUp;
+            else
+                _nodes[up.Parent].Right = iUp;
+        }
+        else
+        {
+            _root = iUp;
+        }
+
+        // the highest grandchild stays with "up", the other one goes under A
+        int iKeep = _nodes[iF].Height > _nodes[iG].Height ? iF : iG;
+        int iMove = iKeep == iF ? iG : iF;
+        up.Right = iKeep;
+        if (upIsRight)
+            _nodes[iA].Right = iMove;
+        else
+            _nodes[iA].Left = iMove;
+        _nodes[iMove].Parent = iA;
+
+        _nodes[iA].Box = _nodes[iOther].Box;
+        _nodes[iA].Box.Expand(_nodes[iMove].Box);
+        _nodes[iA].Height = 1 + glm::max(_nodes[iOther].Height, _nodes[iMove].Height);
+        up.Box = _nodes[iA].Box;
+        up.Box.Expand(_nodes[iKeep].Box);
+        up.Height = 1 + glm::max(_nodes[iA].Height, _nodes[iKeep].Height);
+        return iUp;
+    };
+
+    // C is higher: we rotate C up
+    if (balanceFactor > 1)
+        return rotate(iC, iB, true);
+    // B is higher: we rotate B up
+    if (balanceFactor < -1)
+        return rotate(iB, iC, false);
+
+    return iA;
+}
@@ -1,14 +1,26 @@
 #include <utils/cubemap.h>
+#include <utils/asset_streamer.h>
+#include <utils/gpu_memory.h>
+#include <utils/profiler.h>
+#include <utils/texture_cache.h>
 #include <stb_image/stb_image.h>
+#include <array>
 #include <iostream>
 
 using std::string;
 using std::cout;
 using std::endl;
 
+// paths of the 6 images, in the order of the faces of the cube map
+static std::array<string, 6> facePaths(const string& path) {
+    return {path + "posx.jpg", path + "negx.jpg", path + "posy.jpg",
+            path + "negy.jpg", path + "posz.jpg", path + "negz.jpg"};
+}
+
 CubeMap::CubeMap(string path) : _path(path) {}
 
 void CubeMap::Load() {
+    PROFILE_SCOPE("CubeMap::Load");
 
     // we create and activate the OpenGL cubemap texture
     glGenTextures(1, &_id);
@@ -17,17 +29,29 @@ void CubeMap::Load() {
 
     // we load and set the 6 images corresponding to the 6 views of the cubemap
     // we use as convention that the names of the 6 images are "posx, negx, posy, negy, posz, negz", placed at the path passed as parameter
-    // we load the images individually and we assign them to the correct sides of the cube map
-    loadSide(std::string("posx.jpg"), GL_TEXTURE_CUBE_MAP_POSITIVE_X);
-    loadSide(std::string("negx.jpg"), GL_TEXTURE_CUBE_MAP_NEGATIVE_X);
-    loadSide(std::string("posy.jpg"), GL_TEXTURE_CUBE_MAP_POSITIVE_Y);
-    loadSide(std::string("negy.jpg"), GL_TEXTURE_CUBE_MAP_NEGATIVE_Y);
-    loadSide(std::string("posz.jpg"), GL_TEXTURE_CUBE_MAP_POSITIVE_Z);
-    loadSide(std::string("negz.jpg"), GL_TEXTURE_CUBE_MAP_NEGATIVE_Z);
-
-    // we set the filtering for minification and magnification
+    // the faces and their mipmaps are read from the cache, built from the images the first time
+    const std::array<string, 6> faces = facePaths(_path);
+    TextureCacheFile cache;
+    if (LoadTextureCache({faces.begin(), faces.end()}, _path + "cubemap" + TextureCacheExtension, cache))
+    {
+        cache.Upload(GL_TEXTURE_CUBE_MAP);
+        TrackGpuMemory(MemoryCategory::CUBE_MAP, _id, cache.GetTotalSize());
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    }
+    else
+    {
+        // if the cache cannot be built we load the images individually and we assign them to the correct sides of the cube map
+        loadSide(std::string("posx.jpg"), GL_TEXTURE_CUBE_MAP_POSITIVE_X);
+        loadSide(std::string("negx.jpg"), GL_TEXTURE_CUBE_MAP_NEGATIVE_X);
+        loadSide(std::string("posy.jpg"), GL_TEXTURE_CUBE_MAP_POSITIVE_Y);
+        loadSide(std::string("negy.jpg"), GL_TEXTURE_CUBE_MAP_NEGATIVE_Y);
+        loadSide(std::string("posz.jpg"), GL_TEXTURE_CUBE_MAP_POSITIVE_Z);
+        loadSide(std::string("negz.jpg"), GL_TEXTURE_CUBE_MAP_NEGATIVE_Z);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    }
+
+    // we set the filtering for magnification
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     // we set how to consider the texture coordinates outside [0,1] range
     // in this case we have a cube map, so
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -38,6 +62,24 @@ void CubeMap::Load() {
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
+void CubeMap::LoadAsync(AssetStreamer &streamer) {
+
+    glGenTextures(1, &_id);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _id);
+
+    // same filtering and wrapping of the synchronous loading: the streamed cube map always has its mipmaps
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    // the cube map shows a placeholder until all the faces are uploaded
+    streamer.StreamCubeMap(_id, facePaths(_path), _path + "cubemap" + TextureCacheExtension);
+}
+
 void CubeMap::loadSide(const string& _name, GLenum _side) {
     int w, h;
     unsigned char* image;
@@ -51,11 +93,15 @@ void CubeMap::loadSide(const string& _name, GLenum _side) {
         cout << "Failed to load texture!" << endl;
     // we set the image file as one of the side of the cubemap (passed as a parameter)
     glTexImage2D(_side, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+    // the faces are added to the size of the cube map as they are loaded
+    const size_t loadedFaces = (size_t)(_side - GL_TEXTURE_CUBE_MAP_POSITIVE_X) + 1;
+    TrackGpuMemory(MemoryCategory::CUBE_MAP, _id, GetTextureBytes(GL_RGB, w, h) * loadedFaces);
     // we free the memory once we have created an OpenGL texture
     stbi_image_free(image);
 }
 
 void CubeMap::releaseGpuResources() {
+    UntrackGpuMemory(MemoryCategory::CUBE_MAP, _id);
     glDeleteTextures(1, &_id);
 }
 
@@ -0,0 +1,257 @@
+#include <utils/density_volumes.h>
+#include <utils/gpu_memory.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+using std::string;
+using std::vector;
+
+static const char DensityMagic[4] = {'D', 'V', 'O', 'L'};
+// larger grids are rejected as corrupted files
+static const int MaxGridSize = 1024;
+
+bool LoadDensityData(const string &path, DensityData &data)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+
+    char magic[4];
+    int32_t size[3];
+    float bounds[6];
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char *>(size), sizeof(size));
+    file.read(reinterpret_cast<char *>(bounds), sizeof(bounds));
+    if (!file || std::memcmp(magic, DensityMagic, sizeof(magic)) != 0)
+    {
+        std::cout << "ERROR::DENSITY_VOLUME::INVALID_HEADER: " << path << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        if (size[i] <= 0 || size[i] > MaxGridSize || bounds[i + 3] <= bounds[i])
+        {
+            std::cout << "ERROR::DENSITY_VOLUME::INVALID_GRID: " << path << std::endl;
+            return false;
+        }
+    }
+
+    data.Size = glm::ivec3(size[0], size[1], size[2]);
+    data.Bounds = AABB(glm::vec3(bounds[0], bounds[1], bounds[2]), glm::vec3(bounds[3], bounds[4], bounds[5]));
+    data.Voxels.resize((size_t)size[0] * size[1] * size[2]);
+    file.read(reinterpret_cast<char *>(data.Voxels.data()), data.Voxels.size() * sizeof(float));
+    if (!file)
+    {
+        std::cout << "ERROR::DENSITY_VOLUME::TRUNCATED_FILE: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SaveDensityData(const string &path, const DensityData &data)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::DENSITY_VOLUME::FILE_NOT_WRITTEN: " << path << std::endl;
+        return false;
+    }
+    const int32_t size[3] = {data.Size.x, data.Size.y, data.Size.z};
+    const float bounds[6] = {data.Bounds.Min.x, data.Bounds.Min.y, data.Bounds.Min.z,
+                             data.Bounds.Max.x, data.Bounds.Max.y, data.Bounds.Max.z};
+    file.write(DensityMagic, sizeof(DensityMagic));
+    file.write(reinterpret_cast<const char *>(size), sizeof(size));
+    file.write(reinterpret_cast<const char *>(bounds), sizeof(bounds));
+    file.write(reinterpret_cast<const char *>(data.Voxels.data()), data.Voxels.size() * sizeof(float));
+    return (bool)file;
+}
+
+//////////////////////////////////////////
+// PROCEDURAL VOLUMES
+// value noise on the integer lattice, with a hash of the lattice points
+static float latticeValue(int x, int y, int z, unsigned int seed)
+{
+    uint32_t h = (uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u ^ (uint32_t)z * 83492791u ^ seed * 2654435761u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return (h & 0xFFFFFF) / float(0xFFFFFF);
+}
+
+static float valueNoise(const glm::vec3 &p, unsigned int seed)
+{
+    const glm::vec3 cell = glm::floor(p);
+    const glm::vec3 f = p - cell;
+    // smoothstep weights, so the noise has no visible lattice
+    const glm::vec3 w = f * f * (3.0f - 2.0f * f);
+    const int x = (int)cell.x, y = (int)cell.y, z = (int)cell.z;
+
+    float result = 0.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        const int dx = i & 1, dy = (i >> 1) & 1, dz = (i >> 2) & 1;
+        const float weight = (dx ? w.x : 1.0f - w.x) * (dy ? w.y : 1.0f - w.y) * (dz ? w.z : 1.0f - w.z);
+        result += weight * latticeValue(x + dx, y + dy, z + dz, seed);
+    }
+    return result;
+}
+
+// fractal sum of 4 octaves, in [0, 1]
+static float fractalNoise(const glm::vec3 &p, unsigned int seed)
+{
+    float result = 0.0f, amplitude = 0.5f, frequency = 1.0f;
+    for (int octave = 0; octave < 4; octave++)
+    {
+        result += amplitude * valueNoise(p * frequency, seed + octave);
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return result / 0.9375f;
+}
+
+template <typename F>
+static DensityData generateVolume(const AABB &bounds, const glm::ivec3 &size, F density)
+{
+    DensityData data;
+    data.Size = size;
+    data.Bounds = bounds;
+    data.Voxels.resize((size_t)size.x * size.y * size.z);
+    const glm::vec3 voxelSize = (bounds.Max - bounds.Min) / glm::vec3(size);
+    size_t index = 0;
+    for (int z = 0; z < size.z; z++)
+        for (int y = 0; y < size.y; y++)
+            for (int x = 0; x < size.x; x++)
+            {
+                const glm::vec3 p = bounds.Min + (glm::vec3(x, y, z) + 0.5f) * voxelSize;
+                // the coordinates relative to the grid are in [0, 1]
+                const glm::vec3 uvw = (glm::vec3(x, y, z) + 0.5f) / glm::vec3(size);
+                data.Voxels[index++] = std::max(density(p, uvw), 0.0f);
+            }
+    return data;
+}
+
+DensityData GenerateFogBank(const AABB &bounds, const glm::ivec3 &size, unsigned int seed)
+{
+    return generateVolume(bounds, size, [seed](const glm::vec3 &p, const glm::vec3 &uvw) {
+        // the top of the bank is a noisy surface, under which the density fades in
+        const float top = 0.35f + 0.6f * fractalNoise(glm::vec3(p.x, 0.0f, p.z) * 0.12f, seed);
+        const float inside = glm::clamp((top - uvw.y) * 4.0f, 0.0f, 1.0f);
+        // the borders of the box fade out, so the bank has no straight edges
+        const glm::vec2 border = glm::min(glm::vec2(uvw.x, uvw.z), 1.0f - glm::vec2(uvw.x, uvw.z));
+        const float edge = glm::clamp(std::min(border.x, border.y) * 8.0f, 0.0f, 1.0f);
+        const float detail = fractalNoise(p * 0.3f, seed + 17);
+        return inside * edge * glm::clamp(detail * 1.6f - 0.4f, 0.0f, 1.0f);
+    });
+}
+
+DensityData GenerateSmokeColumn(const AABB &bounds, const glm::ivec3 &size, unsigned int seed)
+{
+    return generateVolume(bounds, size, [seed](const glm::vec3 &p, const glm::vec3 &uvw) {
+        // the column widens and thins out while rising, and wanders around the center of the box
+        const glm::vec2 center = glm::vec2(0.5f) + 0.12f * glm::vec2(std::sin(uvw.y * 5.0f), std::cos(uvw.y * 3.7f)) * uvw.y;
+        const float radius = 0.12f + 0.3f * uvw.y;
+        const float distance = glm::length(glm::vec2(uvw.x, uvw.z) - center) / radius;
+        const float turbulence = fractalNoise(p * 0.6f + glm::vec3(0.0f, -p.y * 0.3f, 0.0f), seed);
+        const float profile = 1.0f - distance * (0.7f + 0.6f * turbulence);
+        return glm::clamp(profile * 2.0f, 0.0f, 1.0f) * (1.0f - uvw.y * 0.7f) * turbulence * 1.5f;
+    });
+}
+
+//////////////////////////////////////////
+
+DensityVolume::DensityVolume(const DensityData &data)
+{
+    // the grid is padded with empty voxels to a multiple of the brick size, so each texel of the occupancy level covers
+    // whole voxels; the bounds grow with the padding, so the voxels keep their world positions
+    const glm::ivec3 size = ((data.Size + OccupancyBrickSize - 1) / OccupancyBrickSize) * OccupancyBrickSize;
+    const glm::vec3 voxelSize = (data.Bounds.Max - data.Bounds.Min) / glm::vec3(data.Size);
+    _bounds = AABB(data.Bounds.Min, data.Bounds.Min + voxelSize * glm::vec3(size));
+
+    // level 0: min = max = density of the voxel
+    vector<glm::vec2> level((size_t)size.x * size.y * size.z, glm::vec2(0.0f));
+    for (int z = 0; z < data.Size.z; z++)
+        for (int y = 0; y < data.Size.y; y++)
+            for (int x = 0; x < data.Size.x; x++)
+            {
+                const float density = data.Voxels[((size_t)z * data.Size.y + y) * data.Size.x + x];
+                level[((size_t)z * size.y + y) * size.x + x] = glm::vec2(density);
+                _maxDensity = std::max(_maxDensity, density);
+            }
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_3D, _texture);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RG16F, size.x, size.y, size.z, 0, GL_RG, GL_FLOAT, level.data());
+    TrackGpuMemory(MemoryCategory::VOLUME, _texture, GetTextureBytes(GL_RG16F, size.x, size.y, size.z, OccupancyLevel + 1));
+
+    // the coarser levels keep the min and max of their 2x2x2 children (not their average, as a mipmap would)
+    glm::ivec3 levelSize = size;
+    vector<glm::vec2> coarse;
+    for (int l = 1; l <= OccupancyLevel; l++)
+    {
+        const glm::ivec3 coarseSize = levelSize / 2;
+        coarse.assign((size_t)coarseSize.x * coarseSize.y * coarseSize.z, glm::vec2(0.0f));
+        for (int z = 0; z < coarseSize.z; z++)
+            for (int y = 0; y < coarseSize.y; y++)
+                for (int x = 0; x < coarseSize.x; x++)
+                {
+                    glm::vec2 range(std::numeric_limits<float>::max(), 0.0f);
+                    for (int i = 0; i < 8; i++)
+                    {
+                        const glm::ivec3 child = glm::ivec3(x, y, z) * 2 + glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+                        const glm::vec2 &value = level[((size_t)child.z * levelSize.y + child.y) * levelSize.x + child.x];
+                        range.x = std::min(range.x, value.x);
+                        range.y = std::max(range.y, value.y);
+                    }
+                    coarse[((size_t)z * coarseSize.y + y) * coarseSize.x + x] = range;
+                }
+        glTexImage3D(GL_TEXTURE_3D, l, GL_RG16F, coarseSize.x, coarseSize.y, coarseSize.z, 0, GL_RG, GL_FLOAT, coarse.data());
+        level.swap(coarse);
+        levelSize = coarseSize;
+    }
+
+    size_t occupied = 0;
+    for (const glm::vec2 &brick : level)
+        occupied += brick.y > 0.0f ? 1 : 0;
+    _occupancy = level.empty() ? 0.0f : (float)occupied / level.size();
+
+    // the density is sampled with textureLod on the level 0, the occupancy with texelFetch on its level: the mipmap
+    // filter only makes the levels part of the texture
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, OccupancyLevel);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+DensityVolume::~DensityVolume() noexcept
+{
+    UntrackGpuMemory(MemoryCategory::VOLUME, _texture);
+    glDeleteTextures(1, &_texture);
+}
+
+GLuint DensityVolume::GetTexture() const
+{
+    return _texture;
+}
+
+const AABB &DensityVolume::GetBounds() const
+{
+    return _bounds;
+}
+
+float DensityVolume::GetMaxDensity() const
+{
+    return _maxDensity;
+}
+
+float DensityVolume::GetOccupancy() const
+{
+    return _occupancy;
+}
@@ -1,7 +1,9 @@
 #include <utils/drawable_object.h>
+#include <utils/gpu_memory.h>
 
 DrawableObject::~DrawableObject() noexcept {
     if (VAO) {
+        UntrackGpuMemory(MemoryCategory::GEOMETRY, this->VAO);
         glDeleteVertexArrays(1, &this->VAO);
         glDeleteBuffers(1, &this->VBO);
     }
@@ -19,6 +21,7 @@ DrawableObject::DrawableObject(DrawableObject&& move) noexcept : VAO(move.VAO),
 DrawableObject& DrawableObject::operator=(DrawableObject&& move) noexcept {
     if (VAO)
     {        
+        UntrackGpuMemory(MemoryCategory::GEOMETRY, this->VAO);
         glDeleteVertexArrays(1, &this->VAO);
         glDeleteBuffers(1, &this->VBO);
     }
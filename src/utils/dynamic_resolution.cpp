@@ -0,0 +1,217 @@
+#include <utils/dynamic_resolution.h>
+#include <utils/gpu_memory.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+GpuTimer::GpuTimer()
+{
+    glGenQueries(QueryCount, _queries);
+}
+
+GpuTimer::~GpuTimer() noexcept
+{
+    glDeleteQueries(QueryCount, _queries);
+}
+
+void GpuTimer::Begin(int tag)
+{
+    _active = -1;
+    if (_pending[_next])
+        return;
+    _active = _next;
+    _tags[_active] = tag;
+    glBeginQuery(GL_TIME_ELAPSED, _queries[_active]);
+}
+
+void GpuTimer::End()
+{
+    if (_active < 0)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    _pending[_active] = true;
+    _next = (_next + 1) % QueryCount;
+    _active = -1;
+}
+
+bool GpuTimer::CollectResults(const std::function<void(int, float)> &onResult)
+{
+    // the queries are read in the order they have been issued, starting from the oldest one
+    bool measured = false;
+    for (int i = 0; i < QueryCount; i++)
+    {
+        const int index = (_next + i) % QueryCount;
+        if (!_pending[index])
+            continue;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(_queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(_queries[index], GL_QUERY_RESULT, &elapsed);
+        _lastMs = (float)((double)elapsed / 1.0e6);
+        _pending[index] = false;
+        measured = true;
+        if (onResult)
+            onResult(_tags[index], _lastMs);
+    }
+    return measured;
+}
+
+float GpuTimer::GetLastMs() const
+{
+    return _lastMs;
+}
+
+//////////////////////////////////////////
+
+float UpdateResolutionScale(float scale, float gpuMs, const ResolutionSettings &settings)
+{
+    if (!settings.Enabled)
+        return settings.MaxScale;
+    if (gpuMs <= 0.0f)
+        return scale;
+
+    const float ratio = settings.TargetMs / gpuMs;
+    if (std::abs(ratio - 1.0f) < settings.Deadband)
+        return glm::clamp(scale, settings.MinScale, settings.MaxScale);
+
+    // the correction is damped by the gain: the measures arrive a few frames late, and a full correction would overshoot
+    const float area = scale * scale * (1.0f + settings.Gain * (ratio - 1.0f));
+    return glm::clamp(std::sqrt(std::max(area, 0.0f)), settings.MinScale, settings.MaxScale);
+}
+
+//////////////////////////////////////////
+
+SceneTarget::SceneTarget(const GLchar *vertexPath, const GLchar *fragmentPath, int width, int height)
+    : _shader(vertexPath, fragmentPath), _fullWidth(width), _fullHeight(height), _width(width), _height(height)
+{
+    glGenTextures(1, &_colorTexture);
+    glBindTexture(GL_TEXTURE_2D, _colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    TrackGpuMemory(MemoryCategory::RENDER_TARGET, _colorTexture, GetTextureBytes(GL_RGBA8, width, height));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenTextures(1, &_depthTexture);
+    glBindTexture(GL_TEXTURE_2D, _depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    TrackGpuMemory(MemoryCategory::RENDER_TARGET, _depthTexture, GetTextureBytes(GL_DEPTH_COMPONENT24, width, height));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &_FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, _FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, _depthTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::SCENE_TARGET::Framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // the fullscreen triangle is generated from gl_VertexID, but the core profile needs a vertex array to draw
+    glGenVertexArrays(1, &_VAO);
+
+    _shader.Use();
+    glUniform1i(glGetUniformLocation(_shader.Program, "sceneTex"), 0);
+    glUniform1i(glGetUniformLocation(_shader.Program, "inscatteringTex"), 1);
+}
+
+SceneTarget::~SceneTarget() noexcept
+{
+    glDeleteFramebuffers(1, &_FBO);
+    UntrackGpuMemory(MemoryCategory::RENDER_TARGET, _colorTexture);
+    UntrackGpuMemory(MemoryCategory::RENDER_TARGET, _depthTexture);
+    glDeleteTextures(1, &_colorTexture);
+    glDeleteTextures(1, &_depthTexture);
+    glDeleteVertexArrays(1, &_VAO);
+    _shader.Delete();
+}
+
+void SceneTarget::SetScale(float scale)
+{
+    _scale = glm::clamp(scale, 0.1f, 1.0f);
+    _width = std::max(1, (int)std::lround(_fullWidth * _scale));
+    _height = std::max(1, (int)std::lround(_fullHeight * _scale));
+}
+
+void SceneTarget::SetSize(int width, int height)
+{
+    _width = glm::clamp(width, 1, _fullWidth);
+    _height = glm::clamp(height, 1, _fullHeight);
+    _scale = std::max((float)_width / _fullWidth, (float)_height / _fullHeight);
+}
+
+float SceneTarget::GetScale() const
+{
+    return _scale;
+}
+
+int SceneTarget::GetWidth() const
+{
+    return _width;
+}
+
+int SceneTarget::GetHeight() const
+{
+    return _height;
+}
+
+int SceneTarget::GetFullWidth() const
+{
+    return _fullWidth;
+}
+
+int SceneTarget::GetFullHeight() const
+{
+    return _fullHeight;
+}
+
+glm::vec2 SceneTarget::GetUvScale() const
+{
+    return glm::vec2((float)_width / _fullWidth, (float)_height / _fullHeight);
+}
+
+GLuint SceneTarget::GetColorTexture() const
+{
+    return _colorTexture;
+}
+
+GLuint SceneTarget::GetDepthTexture() const
+{
+    return _depthTexture;
+}
+
+GLuint SceneTarget::GetFramebuffer() const
+{
+    return _FBO;
+}
+
+void SceneTarget::Upscale(float sharpness, GLuint inscatteringTexture)
+{
+    glDisable(GL_DEPTH_TEST);
+
+    _shader.Use();
+    // the texture is sampled only inside the scaled viewport: outside there are the pixels of older (larger) frames
+    const glm::vec2 uvScale = GetUvScale();
+    glUniform2f(glGetUniformLocation(_shader.Program, "uvScale"), uvScale.x, uvScale.y);
+    glUniform1f(glGetUniformLocation(_shader.Program, "sharpness"), sharpness);
+    glUniform1i(glGetUniformLocation(_shader.Program, "addInscattering"), inscatteringTexture != 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, inscatteringTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _colorTexture);
+    glBindVertexArray(_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glEnable(GL_DEPTH_TEST);
+}
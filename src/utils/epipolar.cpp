@@ -0,0 +1,239 @@
+#include <utils/density_volumes.h>
+#include <utils/epipolar.h>
+#include <utils/gpu_memory.h>
+#include <utils/lights.h>
+#include <utils/render_queue.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+using std::string;
+
+// texture units of the inputs of the passes (the shadow cube array stays on unit 2, and the light buffers on their
+// units, as in the media shaders)
+static const GLuint CoordinatesUnit = 0;
+static const GLuint SourcesUnit = 1;
+static const GLuint ShadowUnit = 2;
+static const GLuint ScatteringUnit = 3;
+static const GLuint SceneDepthUnit = 4;
+
+static void getPhaseSubroutines(GLuint program, GLuint subroutines[4])
+{
+    const char *names[4] = {"miePhaseFunc", "rayleighPhaseFunc", "schlickPhaseFunc", "uniformPhaseFunc"};
+    for (int i = 0; i < 4; i++)
+        subroutines[i] = glGetSubroutineIndex(program, GL_FRAGMENT_SHADER, names[i]);
+}
+
+static void setSampler(Shader &shader, const char *name, GLuint unit)
+{
+    glUniform1i(glGetUniformLocation(shader.Program, name), unit);
+}
+
+// the density volumes are on their units, as in the media shaders
+static void setVolumeSamplers(Shader &shader)
+{
+    for (int i = 0; i < MaxDensityVolumes; i++)
+        setSampler(shader, ("densityVolumes[" + std::to_string(i) + "]").c_str(), DensityVolumeUnit + i);
+}
+
+EpipolarScattering::EpipolarScattering(const string &shadersPath)
+    : _coordinatesShader((shadersPath + "/fullscreen.vert").c_str(), (shadersPath + "/epipolar_coordinates.frag").c_str()),
+      _sourcesShader((shadersPath + "/fullscreen.vert").c_str(), (shadersPath + "/epipolar_sources.frag").c_str()),
+      _marchShader((shadersPath + "/fullscreen.vert").c_str(), (shadersPath + "/epipolar_march.frag").c_str()),
+      _unwarpShader((shadersPath + "/fullscreen.vert").c_str(), (shadersPath + "/epipolar_unwarp.frag").c_str())
+{
+    for (Shader *shader : {&_coordinatesShader, &_sourcesShader, &_marchShader, &_unwarpShader})
+        BindUniformBlock(shader->Program, "PassData", PassBlockBinding);
+
+    _coordinatesShader.Use();
+    setSampler(_coordinatesShader, "sceneDepth", SceneDepthUnit);
+    _sourcesShader.Use();
+    setSampler(_sourcesShader, "coordinatesTex", CoordinatesUnit);
+    _marchShader.Use();
+    setSampler(_marchShader, "coordinatesTex", CoordinatesUnit);
+    setSampler(_marchShader, "sourcesTex", SourcesUnit);
+    setSampler(_marchShader, "depthMaps", ShadowUnit);
+    setSampler(_marchShader, "lightData", LightDataUnit);
+    setSampler(_marchShader, "clusterLights", ClusterLightsUnit);
+    setSampler(_marchShader, "lightIndices", LightIndicesUnit);
+    setVolumeSamplers(_marchShader);
+    _unwarpShader.Use();
+    setSampler(_unwarpShader, "coordinatesTex", CoordinatesUnit);
+    setSampler(_unwarpShader, "sourcesTex", SourcesUnit);
+    setSampler(_unwarpShader, "depthMaps", ShadowUnit);
+    setSampler(_unwarpShader, "lightData", LightDataUnit);
+    setSampler(_unwarpShader, "clusterLights", ClusterLightsUnit);
+    setSampler(_unwarpShader, "lightIndices", LightIndicesUnit);
+    setVolumeSamplers(_unwarpShader);
+    setSampler(_unwarpShader, "scatteringTex", ScatteringUnit);
+    setSampler(_unwarpShader, "sceneDepth", SceneDepthUnit);
+
+    getPhaseSubroutines(_marchShader.Program, _marchSubroutines);
+    getPhaseSubroutines(_unwarpShader.Program, _unwarpSubroutines);
+
+    glGenVertexArrays(1, &_VAO);
+    glGenQueries(1, &_marchQuery);
+}
+
+EpipolarScattering::~EpipolarScattering() noexcept
+{
+    deleteTarget(_coordinates);
+    deleteTarget(_sources);
+    deleteTarget(_scattering);
+    glDeleteVertexArrays(1, &_VAO);
+    glDeleteQueries(1, &_marchQuery);
+    _coordinatesShader.Delete();
+    _sourcesShader.Delete();
+    _marchShader.Delete();
+    _unwarpShader.Delete();
+}
+
+void EpipolarScattering::createTarget(EpipolarTarget &target, GLint internalFormat, GLenum format, GLint filter, int width, int height)
+{
+    glGenTextures(1, &target.Texture);
+    glBindTexture(GL_TEXTURE_2D, target.Texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_FLOAT, NULL);
+    TrackGpuMemory(MemoryCategory::RENDER_TARGET, target.Texture, GetTextureBytes(internalFormat, width, height));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &target.FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.Texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::EPIPOLAR::Framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void EpipolarScattering::deleteTarget(EpipolarTarget &target)
+{
+    glDeleteFramebuffers(1, &target.FBO);
+    UntrackGpuMemory(MemoryCategory::RENDER_TARGET, target.Texture);
+    glDeleteTextures(1, &target.Texture);
+    target = EpipolarTarget();
+}
+
+void EpipolarScattering::resizeLines(int lineCount, int samplesPerLine)
+{
+    if (lineCount == _lineCount && samplesPerLine == _samplesPerLine)
+        return;
+    deleteTarget(_coordinates);
+    deleteTarget(_sources);
+    deleteTarget(_scattering);
+    // the samples of the lines are read with texelFetch
+    createTarget(_coordinates, GL_RGBA32F, GL_RGBA, GL_NEAREST, samplesPerLine, lineCount);
+    createTarget(_sources, GL_RG32F, GL_RG, GL_NEAREST, samplesPerLine, lineCount);
+    createTarget(_scattering, GL_RGBA16F, GL_RGBA, GL_NEAREST, samplesPerLine, lineCount);
+    _lineCount = lineCount;
+    _samplesPerLine = samplesPerLine;
+}
+
+void EpipolarScattering::drawFullscreen()
+{
+    glBindVertexArray(_VAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
+
+void EpipolarScattering::Render(const EpipolarSettings &settings, const glm::vec4 &lightClipPos, GLuint sceneDepthTexture,
+                                GLuint shadowCubes, GLuint inscatteringFramebuffer, int viewportWidth, int viewportHeight,
+                                const glm::vec2 &uvScale, GLuint phaseFunction, bool skyInscattering)
+{
+    const int lineCount = std::max(4, settings.LineCount / 4 * 4);
+    const int samplesPerLine = std::max(2, settings.SamplesPerLine);
+    const int initialSampleStep = std::max(1, settings.InitialSampleStep);
+    resizeLines(lineCount, samplesPerLine);
+
+    // position of the light in NDC. Close to the plane of the camera the projection goes to infinity: the lines
+    // become parallel, and a far point gives the same lines
+    float w = lightClipPos.w;
+    if (std::abs(w) < 1e-4f)
+        w = w < 0.0f ? -1e-4f : 1e-4f;
+    glm::vec2 lightNdc = glm::vec2(lightClipPos.x, lightClipPos.y) / w;
+    const float maxNdc = 1e4f;
+    if (glm::length(lightNdc) > maxNdc)
+        lightNdc = glm::normalize(lightNdc) * maxNdc;
+
+    glDisable(GL_DEPTH_TEST);
+    glDepthMask(GL_FALSE);
+
+    glActiveTexture(GL_TEXTURE0 + SceneDepthUnit);
+    glBindTexture(GL_TEXTURE_2D, sceneDepthTexture);
+    glActiveTexture(GL_TEXTURE0 + ShadowUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, shadowCubes);
+
+    // PASS 1: coordinates of the samples
+    glBindFramebuffer(GL_FRAMEBUFFER, _coordinates.FBO);
+    glViewport(0, 0, samplesPerLine, lineCount);
+    glClear(GL_COLOR_BUFFER_BIT);
+    _coordinatesShader.Use();
+    glUniform2f(glGetUniformLocation(_coordinatesShader.Program, "uvScale"), uvScale.x, uvScale.y);
+    glUniform2f(glGetUniformLocation(_coordinatesShader.Program, "lightNdc"), lightNdc.x, lightNdc.y);
+    glUniform1i(glGetUniformLocation(_coordinatesShader.Program, "lineCount"), lineCount);
+    glUniform1i(glGetUniformLocation(_coordinatesShader.Program, "samplesPerLine"), samplesPerLine);
+    drawFullscreen();
+
+    glActiveTexture(GL_TEXTURE0 + CoordinatesUnit);
+    glBindTexture(GL_TEXTURE_2D, _coordinates.Texture);
+
+    // PASS 2: interpolation sources
+    glBindFramebuffer(GL_FRAMEBUFFER, _sources.FBO);
+    _sourcesShader.Use();
+    glUniform1i(glGetUniformLocation(_sourcesShader.Program, "samplesPerLine"), samplesPerLine);
+    glUniform1i(glGetUniformLocation(_sourcesShader.Program, "initialSampleStep"), initialSampleStep);
+    glUniform1f(glGetUniformLocation(_sourcesShader.Program, "depthBreakThreshold"), settings.DepthBreakThreshold);
+    drawFullscreen();
+
+    glActiveTexture(GL_TEXTURE0 + SourcesUnit);
+    glBindTexture(GL_TEXTURE_2D, _sources.Texture);
+
+    // PASS 3: march of the sources. The result of the query is read only when available
+    if (_marchQueryPending)
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(_marchQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            glGetQueryObjectuiv(_marchQuery, GL_QUERY_RESULT, &_marchedSamples);
+            _marchQueryPending = false;
+        }
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, _scattering.FBO);
+    _marchShader.Use();
+    glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &_marchSubroutines[phaseFunction % 4]);
+    if (!_marchQueryPending)
+        glBeginQuery(GL_SAMPLES_PASSED, _marchQuery);
+    drawFullscreen();
+    if (!_marchQueryPending)
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+        _marchQueryPending = true;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + ScatteringUnit);
+    glBindTexture(GL_TEXTURE_2D, _scattering.Texture);
+
+    // PASS 4: interpolation on the pixels of the scaled viewport
+    glBindFramebuffer(GL_FRAMEBUFFER, inscatteringFramebuffer);
+    glViewport(0, 0, viewportWidth, viewportHeight);
+    _unwarpShader.Use();
+    glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &_unwarpSubroutines[phaseFunction % 4]);
+    glUniform2f(glGetUniformLocation(_unwarpShader.Program, "uvScale"), uvScale.x, uvScale.y);
+    glUniform2f(glGetUniformLocation(_unwarpShader.Program, "viewportSize"), (float)viewportWidth, (float)viewportHeight);
+    glUniform2f(glGetUniformLocation(_unwarpShader.Program, "lightNdc"), lightNdc.x, lightNdc.y);
+    glUniform1i(glGetUniformLocation(_unwarpShader.Program, "lineCount"), lineCount);
+    glUniform1i(glGetUniformLocation(_unwarpShader.Program, "samplesPerLine"), samplesPerLine);
+    glUniform1f(glGetUniformLocation(_unwarpShader.Program, "depthBreakThreshold"), settings.DepthBreakThreshold);
+    glUniform1i(glGetUniformLocation(_unwarpShader.Program, "skyInscattering"), skyInscattering);
+    drawFullscreen();
+
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glEnable(GL_DEPTH_TEST);
+}
+
+GLuint EpipolarScattering::GetMarchedSamples() const
+{
+    return _marchedSamples;
+}
@@ -0,0 +1,529 @@
+#include <utils/frame_capture.h>
+#include <utils/gpu_memory.h>
+#include <utils/profiler.h>
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+using std::string;
+using std::vector;
+
+namespace
+{
+    // the file formats are little endian (EXR) or big endian (PNG), whatever the CPU
+    void putLittle(vector<unsigned char> &out, uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+            out.push_back((unsigned char)(value >> (8 * i)));
+    }
+
+    void putBig(vector<unsigned char> &out, uint32_t value)
+    {
+        for (int i = 3; i >= 0; i--)
+            out.push_back((unsigned char)(value >> (8 * i)));
+    }
+
+    void putString(vector<unsigned char> &out, const char *text)
+    {
+        out.insert(out.end(), text, text + strlen(text) + 1);
+    }
+
+    uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0)
+    {
+        // the encoders run in parallel: the table is built once by the thread-safe initialization of the static
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> values;
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                values[i] = c;
+            }
+            return values;
+        }();
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void putChunk(vector<unsigned char> &out, const char *type, const vector<unsigned char> &data)
+    {
+        putBig(out, (uint32_t)data.size());
+        const size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        putBig(out, crc32(out.data() + start, out.size() - start));
+    }
+
+    uint64_t getLittle(const vector<unsigned char> &in, size_t offset, int bytes)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+            value |= (uint64_t)in[offset + i] << (8 * i);
+        return value;
+    }
+
+    bool writeFile(const string &path, const vector<unsigned char> &data)
+    {
+        std::ofstream file(path, std::ios::binary);
+        file.write((const char *)data.data(), data.size());
+        if (!file)
+        {
+            std::cout << "ERROR::FRAME_CAPTURE::FILE_NOT_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+// the image data is stored in deflate blocks without compression: the encoder keeps up with a capture per frame, and
+// the files are read by any decoder
+bool WritePng(const string &path, int width, int height, const unsigned char *rgba)
+{
+    const size_t rowSize = (size_t)width * 4;
+    // each row starts with its filter type (0 = none)
+    vector<unsigned char> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (int y = height - 1; y >= 0; y--)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+    }
+
+    vector<unsigned char> zlib = {0x78, 0x01};
+    const size_t maxBlock = 65535;
+    for (size_t offset = 0; offset < raw.size(); offset += maxBlock)
+    {
+        // the last block has the final bit set
+        const size_t size = std::min(maxBlock, raw.size() - offset);
+        zlib.push_back(offset + size == raw.size() ? 1 : 0);
+        putLittle(zlib, size, 2);
+        putLittle(zlib, ~size & 0xFFFF, 2);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+    }
+    uint32_t a = 1, b = 0;
+    for (unsigned char byte : raw)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    putBig(zlib, (b << 16) | a);
+
+    vector<unsigned char> header;
+    putBig(header, (uint32_t)width);
+    putBig(header, (uint32_t)height);
+    // 8 bits per channel, RGBA, deflate, adaptive filters, no interlace
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+
+    vector<unsigned char> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    putChunk(png, "IHDR", header);
+    putChunk(png, "IDAT", zlib);
+    putChunk(png, "IEND", {});
+    return writeFile(path, png);
+}
+
+// scanline image without compression, with a half float channel per component
+bool WriteExr(const string &path, int width, int height, const float *rgba)
+{
+    vector<unsigned char> exr;
+    putLittle(exr, 20000630, 4);
+    putLittle(exr, 2, 4);
+
+    auto putAttribute = [&](const char *name, const char *type, uint32_t size) {
+        putString(exr, name);
+        putString(exr, type);
+        putLittle(exr, size, 4);
+    };
+    // the channels are stored in alphabetical order
+    const char *channels[4] = {"A", "B", "G", "R"};
+    const int components[4] = {3, 2, 1, 0};
+    putAttribute("channels", "chlist", 4 * 18 + 1);
+    for (const char *channel : channels)
+    {
+        putString(exr, channel);
+        // half, not linear, x and y sampling 1
+        putLittle(exr, 1, 4);
+        putLittle(exr, 0, 4);
+        putLittle(exr, 1, 4);
+        putLittle(exr, 1, 4);
+    }
+    exr.push_back(0);
+    putAttribute("compression", "compression", 1);
+    exr.push_back(0);
+    for (const char *window : {"dataWindow", "displayWindow"})
+    {
+        putAttribute(window, "box2i", 16);
+        putLittle(exr, 0, 4);
+        putLittle(exr, 0, 4);
+        putLittle(exr, (uint32_t)(width - 1), 4);
+        putLittle(exr, (uint32_t)(height - 1), 4);
+    }
+    putAttribute("lineOrder", "lineOrder", 1);
+    exr.push_back(0);
+    const float one = 1.0f, zero = 0.0f;
+    uint32_t oneBits, zeroBits;
+    memcpy(&oneBits, &one, 4);
+    memcpy(&zeroBits, &zero, 4);
+    putAttribute("pixelAspectRatio", "float", 4);
+    putLittle(exr, oneBits, 4);
+    putAttribute("screenWindowCenter", "v2f", 8);
+    putLittle(exr, zeroBits, 4);
+    putLittle(exr, zeroBits, 4);
+    putAttribute("screenWindowWidth", "float", 4);
+    putLittle(exr, oneBits, 4);
+    exr.push_back(0);
+
+    // offsets of the lines (one line per block), from the top
+    const size_t lineSize = 8 + (size_t)width * 4 * 2;
+    const size_t firstLine = exr.size() + (size_t)height * 8;
+    for (int y = 0; y < height; y++)
+        putLittle(exr, firstLine + y * lineSize, 8);
+    for (int y = 0; y < height; y++)
+    {
+        putLittle(exr, (uint32_t)y, 4);
+        putLittle(exr, (uint32_t)(lineSize - 8), 4);
+        const float *row = rgba + (size_t)(height - 1 - y) * width * 4;
+        for (int component : components)
+        {
+            for (int x = 0; x < width; x++)
+                putLittle(exr, glm::packHalf1x16(row[x * 4 + component]), 2);
+        }
+    }
+    return writeFile(path, exr);
+}
+
+// only the layout of WriteExr: 4 half channels (A, B, G, R), no compression, a line per block
+bool ReadExr(const string &path, int &width, int &height, vector<float> &rgba)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::FRAME_CAPTURE::FILE_NOT_READ: " << path << std::endl;
+        return false;
+    }
+    const vector<unsigned char> exr((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    auto invalid = [&path](const char *reason) {
+        std::cout << "ERROR::FRAME_CAPTURE::UNSUPPORTED_EXR (" << reason << "): " << path << std::endl;
+        return false;
+    };
+    if (exr.size() < 8 || getLittle(exr, 0, 4) != 20000630)
+        return invalid("magic");
+
+    // the attributes: name, type, size and value, up to an empty name
+    auto readString = [&exr](size_t &offset) {
+        string text;
+        while (offset < exr.size() && exr[offset] != 0)
+            text.push_back((char)exr[offset++]);
+        offset++;
+        return text;
+    };
+    size_t offset = 8;
+    bool channelsValid = false, uncompressed = false;
+    int32_t window[4] = {0, 0, -1, -1};
+    while (true)
+    {
+        const string name = readString(offset);
+        if (name.empty())
+            break;
+        readString(offset);
+        if (offset + 4 > exr.size())
+            return invalid("header");
+        const size_t size = getLittle(exr, offset, 4);
+        offset += 4;
+        if (offset + size > exr.size())
+            return invalid("header");
+        if (name == "channels")
+        {
+            // 4 channels of 18 bytes (a name of 1 letter and 16 bytes of type and sampling), then the end of the list
+            channelsValid = size == 4 * 18 + 1;
+            const char names[4] = {'A', 'B', 'G', 'R'};
+            for (int i = 0; i < 4 && channelsValid; i++)
+                channelsValid = exr[offset + i * 18] == names[i] && getLittle(exr, offset + i * 18 + 2, 4) == 1;
+        }
+        else if (name == "compression")
+            uncompressed = size == 1 && exr[offset] == 0;
+        else if (name == "dataWindow" && size == 16)
+        {
+            for (int i = 0; i < 4; i++)
+                window[i] = (int32_t)getLittle(exr, offset + i * 4, 4);
+        }
+        offset += size;
+    }
+    if (!channelsValid)
+        return invalid("channels");
+    if (!uncompressed)
+        return invalid("compression");
+    width = window[2] - window[0] + 1;
+    height = window[3] - window[1] + 1;
+    if (width <= 0 || height <= 0)
+        return invalid("data window");
+
+    // the lines are read at their offsets, from the top; the rows of the result are from the bottom
+    const size_t lineSize = 8 + (size_t)width * 4 * 2;
+    const int components[4] = {3, 2, 1, 0};
+    rgba.assign((size_t)width * height * 4, 0.0f);
+    for (int y = 0; y < height; y++)
+    {
+        const size_t table = offset + (size_t)y * 8;
+        if (table + 8 > exr.size())
+            return invalid("line offsets");
+        const size_t line = getLittle(exr, table, 8);
+        if (line + lineSize > exr.size() || getLittle(exr, line + 4, 4) != lineSize - 8)
+            return invalid("line");
+        const int row = (int32_t)getLittle(exr, line, 4) - window[1];
+        if (row < 0 || row >= height)
+            return invalid("line");
+        float *pixels = rgba.data() + (size_t)(height - 1 - row) * width * 4;
+        for (int c = 0; c < 4; c++)
+        {
+            for (int x = 0; x < width; x++)
+                pixels[x * 4 + components[c]] = glm::unpackHalf1x16((uint16_t)getLittle(exr, line + 8 + ((size_t)c * width + x) * 2, 2));
+        }
+    }
+    return true;
+}
+
+//////////////////////////////////////////
+
+FrameCapture::FrameCapture(const CaptureSettings &settings) : _settings(settings), _ring(settings.RingSize)
+{
+    for (Readback &readback : _ring)
+        glGenBuffers(1, &readback.Buffer);
+    for (unsigned i = 0; i < std::max(1u, settings.EncoderCount); i++)
+        _encoders.emplace_back(&FrameCapture::encoderLoop, this);
+}
+
+FrameCapture::~FrameCapture() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(_jobsMutex);
+        _quit = true;
+    }
+    _jobsCondition.notify_all();
+    for (std::thread &encoder : _encoders)
+        encoder.join();
+
+    for (Readback &readback : _ring)
+    {
+        if (readback.Fence)
+            glDeleteSync(readback.Fence);
+        UntrackGpuMemory(MemoryCategory::BUFFER, readback.Buffer);
+        glDeleteBuffers(1, &readback.Buffer);
+    }
+}
+
+bool FrameCapture::Capture(GLuint framebuffer, int width, int height, const CaptureTarget &target)
+{
+    PROFILE_SCOPE("Frame capture");
+    if (_inFlight == _ring.size())
+    {
+        if (!_settings.WaitWhenFull)
+        {
+            _dropped++;
+            return false;
+        }
+        while (!completeReadback(1000000000))
+            ;
+    }
+
+    Readback &readback = _ring[(_oldest + _inFlight) % _ring.size()];
+    const bool exr = target.Format == CaptureFormat::EXR;
+    const size_t size = (size_t)width * height * 4 * (exr ? sizeof(float) : 1);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.Buffer);
+    if (size != readback.Size)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        TrackGpuMemory(MemoryCategory::BUFFER, readback.Buffer, size);
+        readback.Size = size;
+    }
+    // the copy goes to the buffer: glReadPixels returns without waiting for the frame
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RGBA, exr ? GL_FLOAT : GL_UNSIGNED_BYTE, nullptr);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.Width = width;
+    readback.Height = height;
+    readback.Target = target;
+    if (readback.Target.ImageWidth <= 0 || readback.Target.ImageHeight <= 0)
+    {
+        readback.Target.ImageWidth = width;
+        readback.Target.ImageHeight = height;
+    }
+    _inFlight++;
+    return true;
+}
+
+bool FrameCapture::completeReadback(GLuint64 timeout)
+{
+    Readback &readback = _ring[_oldest];
+    const GLenum status = glClientWaitSync(readback.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+    if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED)
+        return false;
+    glDeleteSync(readback.Fence);
+    readback.Fence = nullptr;
+    _oldest = (_oldest + 1) % _ring.size();
+    _inFlight--;
+
+    const CaptureTarget &target = readback.Target;
+    const bool whole = target.ImageWidth == readback.Width && target.ImageHeight == readback.Height;
+    if (whole && !_settings.WaitWhenFull)
+    {
+        std::lock_guard<std::mutex> lock(_jobsMutex);
+        if (_jobs.size() >= MaxQueuedFrames)
+        {
+            _dropped++;
+            return true;
+        }
+    }
+
+    // the pixels are copied straight to the image, at their position
+    auto assembly = _assemblies.find(target.Path);
+    if (assembly == _assemblies.end())
+    {
+        EncodeJob job;
+        job.Width = target.ImageWidth;
+        job.Height = target.ImageHeight;
+        job.Format = target.Format;
+        job.Path = target.Path;
+        job.Pixels.resize(readback.Size / ((size_t)readback.Width * readback.Height) * job.Width * job.Height);
+        job.Missing = (size_t)job.Width * job.Height;
+        assembly = _assemblies.emplace(target.Path, std::move(job)).first;
+    }
+    EncodeJob &job = assembly->second;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.Buffer);
+    const unsigned char *pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback.Size, GL_MAP_READ_BIT);
+    if (pixels)
+    {
+        const size_t pixelSize = readback.Size / ((size_t)readback.Width * readback.Height);
+        const size_t rowSize = pixelSize * readback.Width;
+        const int rows = std::min(readback.Height, job.Height - target.Y);
+        const size_t copied = pixelSize * std::min(readback.Width, job.Width - target.X);
+        for (int y = 0; y < rows; y++)
+            memcpy(job.Pixels.data() + ((size_t)(target.Y + y) * job.Width + target.X) * pixelSize, pixels + y * rowSize, copied);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        job.Missing -= std::min(job.Missing, copied / pixelSize * rows);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!pixels)
+    {
+        _assemblies.erase(assembly);
+        _dropped++;
+        return true;
+    }
+
+    if (job.Missing == 0)
+    {
+        EncodeJob complete = std::move(job);
+        _assemblies.erase(assembly);
+        if (!queueJob(complete))
+            _dropped++;
+    }
+    return true;
+}
+
+bool FrameCapture::queueJob(EncodeJob &job)
+{
+    {
+        std::unique_lock<std::mutex> lock(_jobsMutex);
+        if (_settings.WaitWhenFull)
+            _jobsCondition.wait(lock, [this] { return _jobs.size() < MaxQueuedFrames; });
+        else if (_jobs.size() >= MaxQueuedFrames)
+            return false;
+        _jobs.push_back(std::move(job));
+    }
+    _jobsCondition.notify_all();
+    return true;
+}
+
+void FrameCapture::Update()
+{
+    while (_inFlight > 0 && completeReadback(0))
+        ;
+}
+
+void FrameCapture::Flush()
+{
+    while (_inFlight > 0)
+        completeReadback(1000000000);
+    // the images whose tiles were not all captured are lost
+    _dropped += (int)_assemblies.size();
+    _assemblies.clear();
+    std::unique_lock<std::mutex> lock(_jobsMutex);
+    _jobsCondition.wait(lock, [this] { return _jobs.empty() && _encoding == 0; });
+}
+
+void FrameCapture::encoderLoop()
+{
+    SetProfilerThreadName("Capture encoder");
+    for (;;)
+    {
+        EncodeJob job;
+        {
+            std::unique_lock<std::mutex> lock(_jobsMutex);
+            _jobsCondition.wait(lock, [this] { return _quit || !_jobs.empty(); });
+            if (_jobs.empty())
+                return;
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+            _encoding++;
+        }
+        // a place is free in the queue
+        _jobsCondition.notify_all();
+
+        bool written;
+        const int64_t start = ProfilerNow();
+        {
+            PROFILE_SCOPE("Encode capture");
+            if (job.Format == CaptureFormat::EXR)
+                written = WriteExr(job.Path, job.Width, job.Height, (const float *)job.Pixels.data());
+            else
+                written = WritePng(job.Path, job.Width, job.Height, job.Pixels.data());
+        }
+        const int64_t end = ProfilerNow();
+        if (written)
+            _written++;
+
+        {
+            std::lock_guard<std::mutex> lock(_jobsMutex);
+            _encoding--;
+            if (_settings.KeepResults)
+                _results.push_back({job.Path, written, end - start, end});
+        }
+        // Flush waits for the queue to be empty
+        _jobsCondition.notify_all();
+    }
+}
+
+int FrameCapture::GetWrittenCount() const
+{
+    return _written;
+}
+
+int FrameCapture::GetDroppedCount() const
+{
+    return _dropped;
+}
+
+int FrameCapture::GetPendingCount() const
+{
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+    return (int)(_inFlight + _assemblies.size() + _jobs.size() + _encoding);
+}
+
+vector<CaptureResult> FrameCapture::TakeResults()
+{
+    std::lock_guard<std::mutex> lock(_jobsMutex);
+    vector<CaptureResult> results;
+    results.swap(_results);
+    return results;
+}
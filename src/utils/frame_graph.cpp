@@ -0,0 +1,443 @@
+#include <utils/frame_graph.h>
+#include <utils/gpu_memory.h>
+#include <iostream>
+
+static const GLuint UnknownFramebuffer = 0xFFFFFFFF;
+
+static bool isDepthFormat(GLenum internalFormat)
+{
+    return internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 ||
+           internalFormat == GL_DEPTH_COMPONENT32F;
+}
+
+bool TransientTextureDesc::operator==(const TransientTextureDesc &other) const
+{
+    return Width == other.Width && Height == other.Height && InternalFormat == other.InternalFormat && Filter == other.Filter;
+}
+
+//////////////////////////////////////////
+
+FrameGraphBuilder::FrameGraphBuilder(FrameGraph &graph, int pass) : _graph(graph), _pass(pass)
+{
+}
+
+FrameGraphResource FrameGraphBuilder::Read(FrameGraphResource resource)
+{
+    if (resource < 0 || resource >= (int)_graph._versions.size())
+    {
+        std::cout << "ERROR::FRAME_GRAPH::INVALID_RESOURCE read by " << _graph._passes[_pass].Name << std::endl;
+        return -1;
+    }
+    _graph._passes[_pass].Reads.push_back(resource);
+    _graph._versions[resource].Readers.push_back(_pass);
+    return resource;
+}
+
+FrameGraphResource FrameGraphBuilder::Write(FrameGraphResource resource)
+{
+    if (resource < 0 || resource >= (int)_graph._versions.size())
+    {
+        std::cout << "ERROR::FRAME_GRAPH::INVALID_RESOURCE written by " << _graph._passes[_pass].Name << std::endl;
+        return -1;
+    }
+    const int version = _graph.addVersion(_graph._versions[resource].Resource, resource, _pass);
+    _graph._passes[_pass].Writes.push_back(version);
+    return version;
+}
+
+FrameGraphResource FrameGraphBuilder::RenderTo(FrameGraphResource resource)
+{
+    FrameGraph::PassNode &pass = _graph._passes[_pass];
+    if (pass.RenderTarget >= 0)
+    {
+        std::cout << "ERROR::FRAME_GRAPH::MULTIPLE_RENDER_TARGETS in " << pass.Name << std::endl;
+        return -1;
+    }
+    // Write adds a version, not a pass: the reference is still valid
+    const int version = Write(resource);
+    pass.RenderTarget = version;
+    return version;
+}
+
+void FrameGraphBuilder::SetSideEffect()
+{
+    _graph._passes[_pass].SideEffect = true;
+}
+
+//////////////////////////////////////////
+
+FrameGraph::~FrameGraph() noexcept
+{
+    ReleasePool();
+}
+
+void FrameGraph::Reset()
+{
+    _resources.clear();
+    _versions.clear();
+    _passes.clear();
+    _order.clear();
+    for (PooledTexture &texture : _pool)
+        texture.InUse = false;
+}
+
+int FrameGraph::addVersion(int resource, int parent, int writer)
+{
+    VersionNode version;
+    version.Resource = resource;
+    version.Parent = parent;
+    version.Writer = writer;
+    _versions.push_back(version);
+    return (int)_versions.size() - 1;
+}
+
+FrameGraphResource FrameGraph::Import(const char *name, GLuint texture, GLuint framebuffer, int width, int height)
+{
+    ResourceNode resource;
+    resource.Name = name;
+    resource.Imported = true;
+    resource.Texture = texture;
+    resource.Framebuffer = framebuffer;
+    resource.Width = width;
+    resource.Height = height;
+    _resources.push_back(resource);
+    return addVersion((int)_resources.size() - 1, -1, -1);
+}
+
+FrameGraphResource FrameGraph::CreateTexture(const char *name, const TransientTextureDesc &desc)
+{
+    ResourceNode resource;
+    resource.Name = name;
+    resource.Imported = false;
+    resource.Texture = 0;
+    resource.Framebuffer = 0;
+    resource.Width = desc.Width;
+    resource.Height = desc.Height;
+    resource.Desc = desc;
+    _resources.push_back(resource);
+    return addVersion((int)_resources.size() - 1, -1, -1);
+}
+
+void FrameGraph::AddPass(const char *name, const std::function<void(FrameGraphBuilder &)> &setup,
+                         const std::function<void(const FrameGraph &)> &execute)
+{
+    PassNode pass;
+    pass.Name = name;
+    pass.Execute = execute;
+    _passes.push_back(pass);
+    FrameGraphBuilder builder(*this, (int)_passes.size() - 1);
+    setup(builder);
+}
+
+void FrameGraph::MarkOutput(FrameGraphResource resource)
+{
+    if (resource >= 0 && resource < (int)_versions.size())
+        _versions[resource].Output = true;
+}
+
+//////////////////////////////////////////
+
+void FrameGraph::Compile()
+{
+    cullPasses();
+    sortPasses();
+    allocateTransients();
+
+    _stats.Passes.clear();
+    _stats.Culled.clear();
+    for (int pass : _order)
+        _stats.Passes.push_back(_passes[pass].Name);
+    for (const PassNode &pass : _passes)
+    {
+        if (!pass.Live)
+            _stats.Culled.push_back(pass.Name);
+    }
+}
+
+// we walk back from the outputs and the passes with side effects, through the writers of the versions they read
+void FrameGraph::cullPasses()
+{
+    std::vector<int> stack;
+    for (size_t i = 0; i < _passes.size(); i++)
+    {
+        if (_passes[i].SideEffect)
+            stack.push_back((int)i);
+    }
+    for (const VersionNode &version : _versions)
+    {
+        if (version.Output && version.Writer >= 0)
+            stack.push_back(version.Writer);
+    }
+
+    while (!stack.empty())
+    {
+        PassNode &pass = _passes[stack.back()];
+        stack.pop_back();
+        if (pass.Live)
+            continue;
+        pass.Live = true;
+        for (int read : pass.Reads)
+        {
+            if (_versions[read].Writer >= 0)
+                stack.push_back(_versions[read].Writer);
+        }
+    }
+}
+
+// topological order of the live passes: a pass runs after the writers of the versions it reads, and after the
+// readers of the versions it writes on (they share the same texture). Among the ready passes, the first declared
+// one runs first
+void FrameGraph::sortPasses()
+{
+    const int passCount = (int)_passes.size();
+    std::vector<std::vector<int>> successors(passCount);
+    std::vector<int> predecessors(passCount, 0);
+    auto addEdge = [&](int from, int to) {
+        if (from < 0 || from == to || !_passes[from].Live)
+            return;
+        successors[from].push_back(to);
+        predecessors[to]++;
+    };
+
+    // live writer of each version written on
+    std::vector<int> overwrittenBy(_versions.size(), -1);
+    for (int i = 0; i < passCount; i++)
+    {
+        const PassNode &pass = _passes[i];
+        if (!pass.Live)
+            continue;
+        for (int read : pass.Reads)
+            addEdge(_versions[read].Writer, i);
+        for (int write : pass.Writes)
+        {
+            const int parent = _versions[write].Parent;
+            if (overwrittenBy[parent] >= 0 && overwrittenBy[parent] != i)
+                std::cout << "ERROR::FRAME_GRAPH::RESOURCE_WRITTEN_TWICE: " << _resources[_versions[write].Resource].Name
+                          << " by " << _passes[overwrittenBy[parent]].Name << " and " << pass.Name << std::endl;
+            overwrittenBy[parent] = i;
+            addEdge(_versions[parent].Writer, i);
+            for (int reader : _versions[parent].Readers)
+                addEdge(reader, i);
+        }
+    }
+
+    _order.clear();
+    std::vector<bool> scheduled(passCount, false);
+    bool progress = true;
+    while (progress)
+    {
+        progress = false;
+        for (int i = 0; i < passCount; i++)
+        {
+            if (!_passes[i].Live || scheduled[i] || predecessors[i] > 0)
+                continue;
+            scheduled[i] = true;
+            _order.push_back(i);
+            for (int successor : successors[i])
+                predecessors[successor]--;
+            progress = true;
+            break;
+        }
+    }
+
+    // a cycle can only come from wrong declarations: the remaining passes run in the declaration order
+    for (int i = 0; i < passCount; i++)
+    {
+        if (_passes[i].Live && !scheduled[i])
+        {
+            std::cout << "ERROR::FRAME_GRAPH::CYCLE at " << _passes[i].Name << std::endl;
+            _order.push_back(i);
+        }
+    }
+}
+
+// the transient textures are taken from the pool at their first use and given back after their last one, so a later
+// texture with the same description can alias them
+void FrameGraph::allocateTransients()
+{
+    for (int position = 0; position < (int)_order.size(); position++)
+    {
+        const PassNode &pass = _passes[_order[position]];
+        for (const std::vector<int> *versions : {&pass.Reads, &pass.Writes})
+        {
+            for (int version : *versions)
+            {
+                ResourceNode &resource = _resources[_versions[version].Resource];
+                if (resource.FirstUse < 0)
+                    resource.FirstUse = position;
+                resource.LastUse = position;
+            }
+        }
+    }
+
+    for (PooledTexture &texture : _pool)
+        texture.UnusedFrames++;
+    _stats.Transients = 0;
+    for (int position = 0; position < (int)_order.size(); position++)
+    {
+        for (ResourceNode &resource : _resources)
+        {
+            if (!resource.Imported && resource.FirstUse == position)
+            {
+                resource.Pooled = acquireTexture(resource.Desc);
+                _stats.Transients++;
+            }
+        }
+        for (ResourceNode &resource : _resources)
+        {
+            if (!resource.Imported && resource.LastUse == position)
+                _pool[resource.Pooled].InUse = false;
+        }
+    }
+
+    _stats.PooledTextures = 0;
+    _stats.PoolBytes = 0;
+    for (const PooledTexture &texture : _pool)
+    {
+        if (texture.UnusedFrames == 0)
+            _stats.PooledTextures++;
+        _stats.PoolBytes += GetTextureBytes(texture.Desc.InternalFormat, texture.Desc.Width, texture.Desc.Height);
+    }
+}
+
+int FrameGraph::acquireTexture(const TransientTextureDesc &desc)
+{
+    for (size_t i = 0; i < _pool.size(); i++)
+    {
+        if (!_pool[i].InUse && _pool[i].Desc == desc)
+        {
+            _pool[i].InUse = true;
+            _pool[i].UnusedFrames = 0;
+            return (int)i;
+        }
+    }
+
+    PooledTexture texture;
+    texture.Desc = desc;
+    texture.InUse = true;
+    const bool depth = isDepthFormat(desc.InternalFormat);
+    glGenTextures(1, &texture.Texture);
+    glBindTexture(GL_TEXTURE_2D, texture.Texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, desc.InternalFormat, desc.Width, desc.Height, 0, depth ? GL_DEPTH_COMPONENT : GL_RGBA,
+                 GL_FLOAT, NULL);
+    TrackGpuMemory(MemoryCategory::RENDER_TARGET, texture.Texture, GetTextureBytes(desc.InternalFormat, desc.Width, desc.Height));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.Filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.Filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &texture.Framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, texture.Framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, depth ? GL_DEPTH_ATTACHMENT : GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture.Texture, 0);
+    if (depth)
+    {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAME_GRAPH::Framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    _pool.push_back(texture);
+    return (int)_pool.size() - 1;
+}
+
+void FrameGraph::deletePooledTexture(PooledTexture &texture)
+{
+    glDeleteFramebuffers(1, &texture.Framebuffer);
+    UntrackGpuMemory(MemoryCategory::RENDER_TARGET, texture.Texture);
+    glDeleteTextures(1, &texture.Texture);
+    texture = PooledTexture();
+}
+
+//////////////////////////////////////////
+
+void FrameGraph::Execute()
+{
+    // the state left by the code before the graph is unknown
+    GLuint boundFramebuffer = UnknownFramebuffer;
+    int viewportWidth = -1, viewportHeight = -1;
+    _stats.FramebufferBinds = 0;
+    _stats.FramebufferBindsSkipped = 0;
+
+    for (int index : _order)
+    {
+        const PassNode &pass = _passes[index];
+        if (pass.RenderTarget >= 0)
+        {
+            const ResourceNode &target = _resources[_versions[pass.RenderTarget].Resource];
+            const GLuint framebuffer = GetFramebuffer(pass.RenderTarget);
+            if (framebuffer != boundFramebuffer)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                boundFramebuffer = framebuffer;
+                _stats.FramebufferBinds++;
+            }
+            else
+            {
+                _stats.FramebufferBindsSkipped++;
+            }
+            if (target.Width != viewportWidth || target.Height != viewportHeight)
+            {
+                glViewport(0, 0, target.Width, target.Height);
+                viewportWidth = target.Width;
+                viewportHeight = target.Height;
+            }
+        }
+
+        pass.Execute(*this);
+
+        // the passes without a render target bind their own framebuffers
+        if (pass.RenderTarget < 0)
+        {
+            boundFramebuffer = UnknownFramebuffer;
+            viewportWidth = viewportHeight = -1;
+        }
+    }
+
+    // the textures unused for a while leave the pool (the indices of this frame are no longer used)
+    std::vector<PooledTexture> kept;
+    for (PooledTexture &texture : _pool)
+    {
+        if (texture.UnusedFrames > MaxUnusedFrames)
+            deletePooledTexture(texture);
+        else
+            kept.push_back(texture);
+    }
+    _pool.swap(kept);
+}
+
+GLuint FrameGraph::GetTexture(FrameGraphResource resource) const
+{
+    if (resource < 0 || resource >= (int)_versions.size())
+        return 0;
+    const ResourceNode &node = _resources[_versions[resource].Resource];
+    if (node.Imported)
+        return node.Texture;
+    return node.Pooled >= 0 ? _pool[node.Pooled].Texture : 0;
+}
+
+GLuint FrameGraph::GetFramebuffer(FrameGraphResource resource) const
+{
+    if (resource < 0 || resource >= (int)_versions.size())
+        return 0;
+    const ResourceNode &node = _resources[_versions[resource].Resource];
+    if (node.Imported)
+        return node.Framebuffer;
+    return node.Pooled >= 0 ? _pool[node.Pooled].Framebuffer : 0;
+}
+
+void FrameGraph::ReleasePool()
+{
+    for (PooledTexture &texture : _pool)
+        deletePooledTexture(texture);
+    _pool.clear();
+    for (ResourceNode &resource : _resources)
+        resource.Pooled = -1;
+}
+
+const FrameGraphStats &FrameGraph::GetStats() const
+{
+    return _stats;
+}
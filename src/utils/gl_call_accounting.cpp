@@ -0,0 +1,356 @@
+#include <utils/gl_call_accounting.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+using std::vector;
+
+int GLCallCounters::Total() const
+{
+    int total = 0;
+    for (int calls : Calls)
+        total += calls;
+    return total;
+}
+
+const char *GetGLCallCategoryName(GLCallCategory category)
+{
+    static const char *names[GLCallCategoryCount] = {"draw", "program", "uniform", "lookup", "state", "resource", "sync", "query"};
+    return names[(int)category];
+}
+
+#ifdef GL_CALL_ACCOUNTING
+
+namespace
+{
+    // groups of entry points which set the same state: a set is redundant if the state already has its value
+    enum StateGroup
+    {
+        NO_STATE,
+        PROGRAM_STATE,
+        VERTEX_ARRAY_STATE,
+        ACTIVE_TEXTURE_STATE,
+        // one per texture unit
+        TEXTURE_STATE,
+        BUFFER_STATE,
+        BUFFER_RANGE_STATE,
+        FRAMEBUFFER_STATE,
+        CAPABILITY_STATE,
+        DEPTH_FUNC_STATE,
+        DEPTH_MASK_STATE,
+        COLOR_MASK_STATE,
+        POLYGON_MODE_STATE,
+        VIEWPORT_STATE,
+        CLEAR_COLOR_STATE,
+        DRAW_BUFFER_STATE,
+        READ_BUFFER_STATE
+    };
+
+    // entry points used in the application: name, category, state group, number of leading arguments which select the
+    // state (e.g. the target of a bind) rather than set its value
+#define GL_COUNTED_FUNCTIONS(X)                                   \
+    X(glDrawArrays, DRAW, NO_STATE, 0)                            \
+    X(glDrawElements, DRAW, NO_STATE, 0)                          \
+    X(glClear, DRAW, NO_STATE, 0)                                 \
+    X(glUseProgram, PROGRAM, PROGRAM_STATE, 0)                    \
+    X(glUniformSubroutinesuiv, PROGRAM, NO_STATE, 0)              \
+    X(glUniform1i, UNIFORM, NO_STATE, 0)                          \
+    X(glUniform1f, UNIFORM, NO_STATE, 0)                          \
+    X(glUniform2f, UNIFORM, NO_STATE, 0)                          \
+    X(glUniform3fv, UNIFORM, NO_STATE, 0)                         \
+    X(glUniformMatrix3fv, UNIFORM, NO_STATE, 0)                   \
+    X(glUniformMatrix4fv, UNIFORM, NO_STATE, 0)                   \
+    X(glProgramUniform1i, UNIFORM, NO_STATE, 0)                   \
+    X(glProgramUniform1f, UNIFORM, NO_STATE, 0)                   \
+    X(glProgramUniform3fv, UNIFORM, NO_STATE, 0)                  \
+    X(glProgramUniformMatrix3fv, UNIFORM, NO_STATE, 0)            \
+    X(glProgramUniformMatrix4fv, UNIFORM, NO_STATE, 0)            \
+    X(glUniformBlockBinding, UNIFORM, NO_STATE, 0)                \
+    X(glGetUniformLocation, LOOKUP, NO_STATE, 0)                  \
+    X(glGetUniformBlockIndex, LOOKUP, NO_STATE, 0)                \
+    X(glGetSubroutineIndex, LOOKUP, NO_STATE, 0)                  \
+    X(glBindVertexArray, STATE, VERTEX_ARRAY_STATE, 0)            \
+    X(glActiveTexture, STATE, ACTIVE_TEXTURE_STATE, 0)            \
+    X(glBindTexture, STATE, TEXTURE_STATE, 1)                     \
+    X(glBindBuffer, STATE, BUFFER_STATE, 1)                       \
+    X(glBindBufferRange, STATE, BUFFER_RANGE_STATE, 2)            \
+    X(glBindFramebuffer, STATE, FRAMEBUFFER_STATE, 1)             \
+    X(glEnable, STATE, CAPABILITY_STATE, 1)                       \
+    X(glDisable, STATE, CAPABILITY_STATE, 1)                      \
+    X(glDepthFunc, STATE, DEPTH_FUNC_STATE, 0)                    \
+    X(glDepthMask, STATE, DEPTH_MASK_STATE, 0)                    \
+    X(glColorMask, STATE, COLOR_MASK_STATE, 0)                    \
+    X(glPolygonMode, STATE, POLYGON_MODE_STATE, 1)                \
+    X(glViewport, STATE, VIEWPORT_STATE, 0)                       \
+    X(glClearColor, STATE, CLEAR_COLOR_STATE, 0)                  \
+    X(glDrawBuffer, STATE, DRAW_BUFFER_STATE, 0)                  \
+    X(glReadBuffer, STATE, READ_BUFFER_STATE, 0)                  \
+    X(glGenTextures, RESOURCE, NO_STATE, 0)                       \
+    X(glDeleteTextures, RESOURCE, NO_STATE, 0)                    \
+    X(glTexImage2D, RESOURCE, NO_STATE, 0)                        \
+    X(glTexImage3D, RESOURCE, NO_STATE, 0)                        \
+    X(glCompressedTexImage2D, RESOURCE, NO_STATE, 0)              \
+    X(glTexParameteri, RESOURCE, NO_STATE, 0)                     \
+    X(glTexBuffer, RESOURCE, NO_STATE, 0)                         \
+    X(glGenBuffers, RESOURCE, NO_STATE, 0)                        \
+    X(glDeleteBuffers, RESOURCE, NO_STATE, 0)                     \
+    X(glBufferData, RESOURCE, NO_STATE, 0)                        \
+    X(glBufferSubData, RESOURCE, NO_STATE, 0)                     \
+    X(glMapBufferRange, RESOURCE, NO_STATE, 0)                    \
+    X(glUnmapBuffer, RESOURCE, NO_STATE, 0)                       \
+    X(glGenVertexArrays, RESOURCE, NO_STATE, 0)                   \
+    X(glDeleteVertexArrays, RESOURCE, NO_STATE, 0)                \
+    X(glVertexAttribPointer, RESOURCE, NO_STATE, 0)               \
+    X(glEnableVertexAttribArray, RESOURCE, NO_STATE, 0)           \
+    X(glGenFramebuffers, RESOURCE, NO_STATE, 0)                   \
+    X(glDeleteFramebuffers, RESOURCE, NO_STATE, 0)                \
+    X(glFramebufferTexture, RESOURCE, NO_STATE, 0)                \
+    X(glFramebufferTexture2D, RESOURCE, NO_STATE, 0)              \
+    X(glFramebufferTextureLayer, RESOURCE, NO_STATE, 0)           \
+    X(glCreateShader, RESOURCE, NO_STATE, 0)                      \
+    X(glShaderSource, RESOURCE, NO_STATE, 0)                      \
+    X(glCompileShader, RESOURCE, NO_STATE, 0)                     \
+    X(glAttachShader, RESOURCE, NO_STATE, 0)                      \
+    X(glDeleteShader, RESOURCE, NO_STATE, 0)                      \
+    X(glCreateProgram, RESOURCE, NO_STATE, 0)                     \
+    X(glLinkProgram, RESOURCE, NO_STATE, 0)                       \
+    X(glDeleteProgram, RESOURCE, NO_STATE, 0)                     \
+    X(glGenQueries, RESOURCE, NO_STATE, 0)                        \
+    X(glDeleteQueries, RESOURCE, NO_STATE, 0)                     \
+    X(glFenceSync, RESOURCE, NO_STATE, 0)                         \
+    X(glDeleteSync, RESOURCE, NO_STATE, 0)                        \
+    X(glGetIntegerv, SYNC, NO_STATE, 0)                           \
+    X(glGetInteger64v, SYNC, NO_STATE, 0)                         \
+    X(glGetQueryObjectiv, SYNC, NO_STATE, 0)                      \
+    X(glGetQueryObjectuiv, SYNC, NO_STATE, 0)                     \
+    X(glGetQueryObjectui64v, SYNC, NO_STATE, 0)                   \
+    X(glGetShaderiv, SYNC, NO_STATE, 0)                           \
+    X(glGetShaderInfoLog, SYNC, NO_STATE, 0)                      \
+    X(glGetProgramiv, SYNC, NO_STATE, 0)                          \
+    X(glGetProgramInfoLog, SYNC, NO_STATE, 0)                     \
+    X(glGetProgramStageiv, SYNC, NO_STATE, 0)                     \
+    X(glGetActiveSubroutineUniformiv, SYNC, NO_STATE, 0)          \
+    X(glGetActiveSubroutineUniformName, SYNC, NO_STATE, 0)        \
+    X(glGetActiveSubroutineName, SYNC, NO_STATE, 0)               \
+    X(glCheckFramebufferStatus, SYNC, NO_STATE, 0)                \
+    X(glClientWaitSync, SYNC, NO_STATE, 0)                        \
+    X(glFinish, SYNC, NO_STATE, 0)                                \
+    X(glReadPixels, SYNC, NO_STATE, 0)                            \
+    X(glGetTexImage, SYNC, NO_STATE, 0)                           \
+    X(glGetBufferSubData, SYNC, NO_STATE, 0)                      \
+    X(glBeginQuery, QUERY, NO_STATE, 0)                           \
+    X(glEndQuery, QUERY, NO_STATE, 0)                             \
+    X(glQueryCounter, QUERY, NO_STATE, 0)                         \
+    X(glBeginConditionalRender, QUERY, NO_STATE, 0)               \
+    X(glEndConditionalRender, QUERY, NO_STATE, 0)
+
+    enum FunctionId
+    {
+#define FUNCTION_ID(name, category, group, keyArgs) ID_##name,
+        GL_COUNTED_FUNCTIONS(FUNCTION_ID)
+#undef FUNCTION_ID
+        FUNCTION_COUNT
+    };
+
+    GLADloadproc innerLoader = nullptr;
+    // entry points of the driver, called by the wrappers
+    void *driverProcs[FUNCTION_COUNT] = {};
+
+    // counters of the current frame
+    GLCallCounters frameCounters;
+    vector<std::pair<const char *, GLCallCounters>> framePasses;
+    vector<int> passStack;
+    int functionCalls[FUNCTION_COUNT] = {};
+    // shadow state: hash of the group and of the selecting arguments -> hash of the entry point and of the value
+    std::unordered_map<uint64_t, uint64_t> stateValues;
+    GLenum activeTexture = GL_TEXTURE0;
+
+    // totals of the session
+    GLCallCounters sessionCounters;
+    vector<std::pair<const char *, GLCallCounters>> sessionPasses;
+    int sessionFrames = 0;
+
+    int findPass(vector<std::pair<const char *, GLCallCounters>> &passes, const char *name)
+    {
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            if (std::strcmp(passes[i].first, name) == 0)
+                return (int)i;
+        }
+        passes.push_back({name, GLCallCounters()});
+        return (int)passes.size() - 1;
+    }
+
+    void addCounters(GLCallCounters &total, const GLCallCounters &counters)
+    {
+        for (int i = 0; i < GLCallCategoryCount; i++)
+            total.Calls[i] += counters.Calls[i];
+        total.Redundant += counters.Redundant;
+    }
+
+    void countCall(int id, int category, bool redundant)
+    {
+        const int pass = passStack.empty() ? findPass(framePasses, "Other") : passStack.back();
+        GLCallCounters &passCounters = framePasses[pass].second;
+        frameCounters.Calls[category]++;
+        passCounters.Calls[category]++;
+        if (redundant)
+        {
+            frameCounters.Redundant++;
+            passCounters.Redundant++;
+        }
+        functionCalls[id]++;
+    }
+
+    uint64_t hashBytes(const unsigned char *bytes, size_t size, uint64_t seed)
+    {
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull ^ seed;
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return hash;
+    }
+
+    // records the value set by the call; returns true if the state already had it
+    template <int Group, int KeyArgs, typename... A>
+    bool stateUnchanged(int id, const A &...args)
+    {
+        constexpr size_t argsSize = (sizeof(A) + ... + 0);
+        static_assert(argsSize <= 64, "the arguments of a state set are packed in 64 bytes");
+        constexpr size_t sizes[] = {sizeof(A)..., 0};
+        unsigned char bytes[64];
+        size_t size = 0;
+        ((std::memcpy(bytes + size, &args, sizeof(A)), size += sizeof(A)), ...);
+        size_t keySize = 0;
+        for (int i = 0; i < KeyArgs; i++)
+            keySize += sizes[i];
+
+        if (Group == ACTIVE_TEXTURE_STATE)
+            std::memcpy(&activeTexture, bytes, sizeof(GLenum));
+        const uint64_t key = hashBytes(bytes, keySize, ((uint64_t)Group << 32) | (Group == TEXTURE_STATE ? activeTexture : 0));
+        const uint64_t value = hashBytes(bytes + keySize, size - keySize, (uint64_t)id);
+
+        auto inserted = stateValues.emplace(key, value);
+        if (inserted.second)
+            return false;
+        if (inserted.first->second == value)
+            return true;
+        inserted.first->second = value;
+        return false;
+    }
+
+    template <int Id, int Category, int Group, int KeyArgs, typename Function>
+    struct CountedCall;
+
+    template <int Id, int Category, int Group, int KeyArgs, typename R, typename... A>
+    struct CountedCall<Id, Category, Group, KeyArgs, R(APIENTRYP)(A...)>
+    {
+        static R APIENTRY Call(A... args)
+        {
+            bool redundant = false;
+            if constexpr (Group != NO_STATE)
+                redundant = stateUnchanged<Group, KeyArgs>(Id, args...);
+            countCall(Id, Category, redundant);
+            return reinterpret_cast<R(APIENTRYP)(A...)>(driverProcs[Id])(args...);
+        }
+    };
+
+    struct CountedFunction
+    {
+        const char *Name;
+        void *Wrapper;
+    };
+
+    const CountedFunction countedFunctions[FUNCTION_COUNT] = {
+#define COUNTED_FUNCTION(name, category, group, keyArgs) \
+    {#name, reinterpret_cast<void *>(&CountedCall<ID_##name, (int)GLCallCategory::category, group, keyArgs, decltype(glad_##name)>::Call)},
+        GL_COUNTED_FUNCTIONS(COUNTED_FUNCTION)
+#undef COUNTED_FUNCTION
+    };
+
+    void *countedLoader(const char *name)
+    {
+        void *proc = innerLoader(name);
+        for (int i = 0; i < FUNCTION_COUNT; i++)
+        {
+            if (std::strcmp(name, countedFunctions[i].Name) == 0)
+            {
+                driverProcs[i] = proc;
+                // glad checks the missing entry points: they stay missing
+                return proc ? countedFunctions[i].Wrapper : nullptr;
+            }
+        }
+        return proc;
+    }
+
+    void printCounters(const char *name, const GLCallCounters &counters, int frames)
+    {
+        std::cout << "  " << name << ": " << (float)counters.Total() / frames << " calls (";
+        for (int i = 0; i < GLCallCategoryCount; i++)
+            std::cout << (i > 0 ? ", " : "") << GetGLCallCategoryName((GLCallCategory)i) << " " << (float)counters.Calls[i] / frames;
+        std::cout << "), " << (float)counters.Redundant / frames << " redundant" << std::endl;
+    }
+}
+
+GLADloadproc WrapGLLoader(GLADloadproc loader)
+{
+    innerLoader = loader;
+    return countedLoader;
+}
+
+void BeginGLCallFrame()
+{
+    frameCounters = GLCallCounters();
+    framePasses.clear();
+    passStack.clear();
+    std::fill(std::begin(functionCalls), std::end(functionCalls), 0);
+    stateValues.clear();
+    activeTexture = GL_TEXTURE0;
+}
+
+GLCallStats EndGLCallFrame()
+{
+    GLCallStats stats;
+    stats.Frame = frameCounters;
+    stats.Passes = framePasses;
+
+    vector<int> ids;
+    for (int i = 0; i < FUNCTION_COUNT; i++)
+    {
+        if (functionCalls[i] > 0)
+            ids.push_back(i);
+    }
+    std::sort(ids.begin(), ids.end(), [](int a, int b) { return functionCalls[a] > functionCalls[b]; });
+    ids.resize(std::min<size_t>(ids.size(), 6));
+    for (int id : ids)
+        stats.TopFunctions.push_back({countedFunctions[id].Name, functionCalls[id]});
+
+    addCounters(sessionCounters, frameCounters);
+    for (const auto &pass : framePasses)
+        addCounters(sessionPasses[findPass(sessionPasses, pass.first)].second, pass.second);
+    sessionFrames++;
+    return stats;
+}
+
+void BeginGLCallPass(const char *name)
+{
+    passStack.push_back(findPass(framePasses, name));
+}
+
+void EndGLCallPass()
+{
+    if (!passStack.empty())
+        passStack.pop_back();
+}
+
+void PrintGLCallSummary()
+{
+    if (sessionFrames == 0)
+        return;
+    std::cout << "GL calls per frame (" << sessionFrames << " frames):" << std::endl;
+    printCounters("Frame", sessionCounters, sessionFrames);
+    for (const auto &pass : sessionPasses)
+        printCounters(pass.first, pass.second, sessionFrames);
+}
+
+#endif
@@ -0,0 +1,177 @@
+#include <utils/gl_state_cache.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <cstring>
+#include <iterator>
+using std::string;
+
+GLStateCache::GLStateCache()
+{
+    Invalidate();
+}
+
+void GLStateCache::Invalidate()
+{
+    _program = Unknown;
+    _vertexArray = Unknown;
+    _activeUnit = Unknown;
+    _depthFunc = Unknown;
+    _textures.fill(Unknown);
+    _textureTargets.fill(GL_NONE);
+    _uniformBuffers.fill({Unknown, 0, 0});
+    _subroutines.clear();
+}
+
+void GLStateCache::ForgetProgram(GLuint program)
+{
+    if (_program == program)
+        _program = Unknown;
+    for (auto it = _uniforms.begin(); it != _uniforms.end();)
+        it = (GLuint)(it->first >> 32) == program ? _uniforms.erase(it) : std::next(it);
+    for (auto it = _locations.begin(); it != _locations.end();)
+        it = it->first.first == program ? _locations.erase(it) : std::next(it);
+}
+
+bool GLStateCache::changed(GLuint &cached, GLuint value)
+{
+    if (cached == value)
+    {
+        _stats.Skipped++;
+        return false;
+    }
+    cached = value;
+    _stats.Issued++;
+    return true;
+}
+
+void GLStateCache::UseProgram(GLuint program)
+{
+    if (changed(_program, program))
+    {
+        glUseProgram(program);
+        // the subroutine selection is lost at each glUseProgram
+        _subroutines.clear();
+    }
+}
+
+void GLStateCache::BindVertexArray(GLuint vertexArray)
+{
+    if (changed(_vertexArray, vertexArray))
+        glBindVertexArray(vertexArray);
+}
+
+void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    // a unit has a binding for each target: we track only the last target used on it
+    if (_textureTargets[unit] == target && _textures[unit] == texture)
+    {
+        _stats.Skipped++;
+        return;
+    }
+    if (changed(_activeUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, texture);
+    _textures[unit] = texture;
+    _textureTargets[unit] = target;
+    _stats.Issued++;
+}
+
+void GLStateCache::DepthFunc(GLenum func)
+{
+    if (changed(_depthFunc, func))
+        glDepthFunc(func);
+}
+
+void GLStateCache::BindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    BufferRange &range = _uniformBuffers[index];
+    if (range.Buffer == buffer && range.Offset == offset && range.Size == size)
+    {
+        _stats.Skipped++;
+        return;
+    }
+    glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size);
+    range = {buffer, offset, size};
+    _stats.Issued++;
+}
+
+void GLStateCache::UniformSubroutine(GLenum shaderType, GLuint index)
+{
+    auto it = _subroutines.find(shaderType);
+    if (it != _subroutines.end() && it->second == index)
+    {
+        _stats.Skipped++;
+        return;
+    }
+    glUniformSubroutinesuiv(shaderType, 1, &index);
+    _subroutines[shaderType] = index;
+    _stats.Issued++;
+}
+
+GLint GLStateCache::GetUniformLocation(GLuint program, const string &name)
+{
+    auto key = std::make_pair(program, name);
+    auto it = _locations.find(key);
+    if (it != _locations.end())
+        return it->second;
+    GLint location = glGetUniformLocation(program, name.c_str());
+    _locations.emplace(key, location);
+    return location;
+}
+
+bool GLStateCache::uniformChanged(GLuint program, GLint location, const void *data, size_t size)
+{
+    // uniforms not used by the program are never written
+    if (location < 0)
+        return false;
+
+    const uint64_t key = ((uint64_t)program << 32) | (uint32_t)location;
+    auto it = _uniforms.find(key);
+    if (it != _uniforms.end() && memcmp(it->second.data(), data, size) == 0)
+    {
+        _stats.Skipped++;
+        return false;
+    }
+    memcpy(_uniforms[key].data(), data, size);
+    _stats.Issued++;
+    return true;
+}
+
+void GLStateCache::Uniform(GLuint program, GLint location, GLint value)
+{
+    if (uniformChanged(program, location, &value, sizeof(value)))
+        glProgramUniform1i(program, location, value);
+}
+
+void GLStateCache::Uniform(GLuint program, GLint location, GLfloat value)
+{
+    if (uniformChanged(program, location, &value, sizeof(value)))
+        glProgramUniform1f(program, location, value);
+}
+
+void GLStateCache::Uniform(GLuint program, GLint location, const glm::vec3 &value)
+{
+    if (uniformChanged(program, location, glm::value_ptr(value), sizeof(value)))
+        glProgramUniform3fv(program, location, 1, glm::value_ptr(value));
+}
+
+void GLStateCache::Uniform(GLuint program, GLint location, const glm::mat3 &value)
+{
+    if (uniformChanged(program, location, glm::value_ptr(value), sizeof(value)))
+        glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void GLStateCache::Uniform(GLuint program, GLint location, const glm::mat4 &value)
+{
+    if (uniformChanged(program, location, glm::value_ptr(value), sizeof(value)))
+        glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+const GLStateCache::Stats &GLStateCache::GetStats() const
+{
+    return _stats;
+}
+
+void GLStateCache::ResetStats()
+{
+    _stats = Stats();
+}
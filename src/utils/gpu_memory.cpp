@@ -0,0 +1,165 @@
+#include <utils/gpu_memory.h>
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    std::mutex registryMutex;
+    // size of each object, by category and GL name
+    std::map<std::pair<int, GLuint>, size_t> gpuAllocations;
+    std::map<std::pair<int, GLuint>, size_t> cpuCopies;
+    MemoryReport totals;
+    // index count of the meshes without their CPU copy, by vertex array
+    std::unordered_map<GLuint, GLsizei> droppedIndexCounts;
+
+    void track(std::map<std::pair<int, GLuint>, size_t> &allocations, MemoryCategory category, GLuint object, size_t bytes,
+               size_t &totalBytes, int &totalObjects)
+    {
+        auto inserted = allocations.emplace(std::make_pair((int)category, object), bytes);
+        if (inserted.second)
+        {
+            totalObjects++;
+        }
+        else
+        {
+            totalBytes -= inserted.first->second;
+            inserted.first->second = bytes;
+        }
+        totalBytes += bytes;
+    }
+
+    void untrack(std::map<std::pair<int, GLuint>, size_t> &allocations, MemoryCategory category, GLuint object,
+                 size_t &totalBytes, int &totalObjects)
+    {
+        auto allocation = allocations.find(std::make_pair((int)category, object));
+        if (allocation == allocations.end())
+            return;
+        totalBytes -= allocation->second;
+        totalObjects--;
+        allocations.erase(allocation);
+    }
+
+    double toMb(size_t bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+}
+
+size_t MemoryReport::GetGpuTotal() const
+{
+    size_t total = 0;
+    for (size_t bytes : GpuBytes)
+        total += bytes;
+    return total;
+}
+
+const char *GetMemoryCategoryName(MemoryCategory category)
+{
+    static const char *names[MemoryCategoryCount] = {"geometry", "textures", "cube maps", "shadows", "render targets",
+                                                     "volumes", "buffers"};
+    return names[(int)category];
+}
+
+void TrackGpuMemory(MemoryCategory category, GLuint object, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    track(gpuAllocations, category, object, bytes, totals.GpuBytes[(int)category], totals.Objects[(int)category]);
+}
+
+void UntrackGpuMemory(MemoryCategory category, GLuint object)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    untrack(gpuAllocations, category, object, totals.GpuBytes[(int)category], totals.Objects[(int)category]);
+    // the name of a deleted vertex array can be reused by a new mesh
+    if (category == MemoryCategory::GEOMETRY)
+        droppedIndexCounts.erase(object);
+}
+
+void TrackCpuCopy(MemoryCategory category, GLuint object, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    track(cpuCopies, category, object, bytes, totals.CpuCopyBytes, totals.CpuCopies);
+}
+
+void UntrackCpuCopy(MemoryCategory category, GLuint object)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    untrack(cpuCopies, category, object, totals.CpuCopyBytes, totals.CpuCopies);
+}
+
+MemoryReport GetMemoryReport()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    return totals;
+}
+
+void PrintMemoryReport(const MemorySettings &settings)
+{
+    const MemoryReport report = GetMemoryReport();
+    std::cout << "GPU memory: " << toMb(report.GetGpuTotal()) << " MB";
+    if (settings.BudgetMb > 0)
+        std::cout << " of " << settings.BudgetMb << " MB budget";
+    std::cout << std::endl;
+    for (int i = 0; i < MemoryCategoryCount; i++)
+        std::cout << "  " << GetMemoryCategoryName((MemoryCategory)i) << ": " << toMb(report.GpuBytes[i]) << " MB ("
+                  << report.Objects[i] << " objects)" << std::endl;
+    std::cout << "CPU copies: " << toMb(report.CpuCopyBytes) << " MB (" << report.CpuCopies << " meshes)" << std::endl;
+    if (settings.BudgetMb > 0 && report.GetGpuTotal() > settings.BudgetMb * 1024 * 1024)
+        std::cout << "ERROR::GPU_MEMORY::OVER_BUDGET" << std::endl;
+}
+
+size_t GetTextureBytes(GLenum internalFormat, int width, int height, int depth, int levels)
+{
+    size_t texelSize = 4;
+    switch (internalFormat)
+    {
+    case GL_R16UI:
+    case GL_DEPTH_COMPONENT16:
+        texelSize = 2;
+        break;
+    case GL_RGBA16F:
+    case GL_RG32F:
+    case GL_RG32UI:
+        texelSize = 8;
+        break;
+    case GL_RGBA32F:
+        texelSize = 16;
+        break;
+    default:
+        // RGB8 is padded to 4 bytes, like RGBA8, RG16F, R32F and the 24 and 32 bit depth formats
+        break;
+    }
+
+    size_t bytes = 0;
+    for (int level = 0; level < levels; level++)
+    {
+        bytes += texelSize * std::max(width >> level, 1) * std::max(height >> level, 1) * std::max(depth >> level, 1);
+    }
+    return bytes;
+}
+
+void DropCpuCopy(Mesh &mesh)
+{
+    if (!mesh.VAO || mesh.indices.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        droppedIndexCounts[mesh.VAO] = (GLsizei)mesh.indices.size();
+    }
+    UntrackCpuCopy(MemoryCategory::GEOMETRY, mesh.VAO);
+    std::vector<Vertex>().swap(mesh.vertices);
+    std::vector<GLuint>().swap(mesh.indices);
+}
+
+GLsizei GetIndexCount(const Mesh &mesh)
+{
+    if (!mesh.indices.empty())
+        return (GLsizei)mesh.indices.size();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto count = droppedIndexCounts.find(mesh.VAO);
+    return count != droppedIndexCounts.end() ? count->second : 0;
+}
@@ -0,0 +1,237 @@
+#include <utils/input_log.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+using std::string;
+using std::vector;
+
+static const char InputLogMagic[4] = {'I', 'R', 'E', 'C'};
+static const uint32_t InputLogVersion = 1;
+
+template <typename T>
+void InputLog::write(const T &value)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&value);
+    _data.insert(_data.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+bool InputLog::read(T &value)
+{
+    if (_cursor + sizeof(T) > _data.size())
+        return false;
+    std::memcpy(&value, _data.data() + _cursor, sizeof(T));
+    _cursor += sizeof(T);
+    return true;
+}
+
+void InputLog::TrackParameter(void *data, size_t size)
+{
+    Parameter parameter;
+    parameter.Data = static_cast<uint8_t *>(data);
+    parameter.Size = size;
+    _parameters.push_back(parameter);
+}
+
+bool InputLog::StartRecording(const string &path)
+{
+    _mode = Mode::RECORD;
+    _path = path;
+    _data.clear();
+    _frames = 0;
+
+    // header: the parameters of the session, checked by the replay
+    _data.insert(_data.end(), InputLogMagic, InputLogMagic + sizeof(InputLogMagic));
+    write(InputLogVersion);
+    write((uint32_t)_parameters.size());
+    for (Parameter &parameter : _parameters)
+    {
+        write((uint32_t)parameter.Size);
+        // the initial values are the first change of the session
+        parameter.Last.clear();
+    }
+    return true;
+}
+
+bool InputLog::StartReplay(const string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::INPUT_LOG::FILE_NOT_FOUND: " << path << std::endl;
+        return false;
+    }
+    _data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    _cursor = 0;
+
+    char magic[4];
+    uint32_t version = 0, parameterCount = 0;
+    bool valid = _data.size() >= sizeof(magic) && std::memcmp(_data.data(), InputLogMagic, sizeof(magic)) == 0;
+    _cursor = sizeof(magic);
+    valid = valid && read(version) && version == InputLogVersion && read(parameterCount) && parameterCount == _parameters.size();
+    for (size_t i = 0; valid && i < _parameters.size(); i++)
+    {
+        uint32_t size = 0;
+        valid = read(size) && size == _parameters[i].Size;
+    }
+    if (!valid)
+    {
+        std::cout << "ERROR::INPUT_LOG::INCOMPATIBLE_SESSION: " << path << std::endl;
+        _data.clear();
+        return false;
+    }
+
+    _mode = Mode::REPLAY;
+    _path = path;
+    _frames = 0;
+    _pendingParameters.clear();
+    return true;
+}
+
+void InputLog::Stop()
+{
+    if (_mode == Mode::RECORD)
+    {
+        std::ofstream file(_path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(_data.data()), _data.size());
+        if (!file)
+            std::cout << "ERROR::INPUT_LOG::FILE_NOT_WRITTEN: " << _path << std::endl;
+        else
+            std::cout << "Input session recorded: " << _frames << " frames, " << _data.size() << " bytes" << std::endl;
+    }
+    _mode = Mode::OFF;
+    _data.clear();
+    _pendingParameters.clear();
+}
+
+bool InputLog::IsRecording() const
+{
+    return _mode == Mode::RECORD;
+}
+
+bool InputLog::IsReplaying() const
+{
+    return _mode == Mode::REPLAY;
+}
+
+//////////////////////////////////////////
+// RECORDING
+
+void InputLog::RecordFrame(double time, float deltaTime)
+{
+    if (_mode != Mode::RECORD)
+        return;
+    write(EventType::FRAME);
+    write(time);
+    write(deltaTime);
+    _frames++;
+}
+
+void InputLog::RecordKey(int key, int action)
+{
+    if (_mode != Mode::RECORD)
+        return;
+    write(EventType::KEY);
+    write((int16_t)key);
+    write((uint8_t)action);
+}
+
+void InputLog::RecordMouse(double x, double y)
+{
+    if (_mode != Mode::RECORD)
+        return;
+    write(EventType::MOUSE);
+    write(x);
+    write(y);
+}
+
+void InputLog::RecordParameters()
+{
+    if (_mode != Mode::RECORD)
+        return;
+    for (size_t i = 0; i < _parameters.size(); i++)
+    {
+        Parameter &parameter = _parameters[i];
+        if (!parameter.Last.empty() && std::memcmp(parameter.Last.data(), parameter.Data, parameter.Size) == 0)
+            continue;
+        parameter.Last.assign(parameter.Data, parameter.Data + parameter.Size);
+        write(EventType::PARAMETER);
+        write((uint8_t)i);
+        _data.insert(_data.end(), parameter.Data, parameter.Data + parameter.Size);
+    }
+}
+
+//////////////////////////////////////////
+// REPLAY
+
+bool InputLog::ReplayFrame(float &deltaTime, const std::function<void(int, int)> &onKey,
+                           const std::function<void(double, double)> &onMouse)
+{
+    if (_mode != Mode::REPLAY)
+        return false;
+
+    _pendingParameters.clear();
+    EventType type;
+    double time;
+    if (!read(type) || type != EventType::FRAME || !read(time) || !read(deltaTime))
+    {
+        std::cout << "Input session replayed: " << _frames << " frames" << std::endl;
+        Stop();
+        return false;
+    }
+    _frames++;
+
+    // the events of the frame, up to the next frame
+    while (_cursor < _data.size() && (EventType)_data[_cursor] != EventType::FRAME)
+    {
+        read(type);
+        if (type == EventType::KEY)
+        {
+            int16_t key;
+            uint8_t action;
+            if (!read(key) || !read(action))
+                break;
+            onKey(key, action);
+        }
+        else if (type == EventType::MOUSE)
+        {
+            double x, y;
+            if (!read(x) || !read(y))
+                break;
+            onMouse(x, y);
+        }
+        else if (type == EventType::PARAMETER)
+        {
+            uint8_t index;
+            if (!read(index) || index >= _parameters.size() || _cursor + _parameters[index].Size > _data.size())
+                break;
+            _pendingParameters.push_back({index, _cursor});
+            _cursor += _parameters[index].Size;
+        }
+        else
+        {
+            std::cout << "ERROR::INPUT_LOG::INVALID_EVENT" << std::endl;
+            // the rest of the session cannot be parsed
+            _cursor = _data.size();
+        }
+    }
+    return true;
+}
+
+void InputLog::ReplayParameters()
+{
+    if (_mode != Mode::REPLAY)
+        return;
+    for (const auto &change : _pendingParameters)
+    {
+        const Parameter &parameter = _parameters[change.first];
+        std::memcpy(parameter.Data, _data.data() + change.second, parameter.Size);
+    }
+    _pendingParameters.clear();
+}
+
+size_t InputLog::GetFrameCount() const
+{
+    return _frames;
+}
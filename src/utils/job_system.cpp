@@ -0,0 +1,370 @@
+#include <utils/job_system.h>
+#include <utils/profiler.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <numeric>
+using std::vector;
+
+struct JobCounter::JobEntry
+{
+    Job Function;
+    JobCounter *Counter;
+    JobPriority Priority;
+};
+
+namespace
+{
+    // worker of the calling thread (-1 for the other threads), and priority of the job it is executing
+    thread_local const JobSystem *localSystem = nullptr;
+    thread_local int localWorker = -1;
+    thread_local bool localBackground = false;
+
+    double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+bool JobCounter::IsDone() const
+{
+    return _count.load(std::memory_order_acquire) == 0;
+}
+
+//////////////////////////////////////////
+
+JobSystem::JobSystem(unsigned workerCount)
+{
+    if (workerCount == 0)
+    {
+        unsigned cores = std::thread::hardware_concurrency();
+        workerCount = cores > 2 ? cores - 2 : 1;
+    }
+    for (unsigned i = 0; i < workerCount; i++)
+        _deques.push_back(std::make_unique<WorkStealingDeque<JobEntry>>());
+    // the deques exist before the first worker can steal
+    for (unsigned i = 0; i < workerCount; i++)
+        _workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+JobSystem::~JobSystem() noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _quit = true;
+    }
+    _sleepCondition.notify_all();
+    for (auto &worker : _workers)
+        worker.join();
+
+    // the jobs never executed (their owners did not wait for them)
+    for (auto &deque : _deques)
+    {
+        while (JobEntry *entry = deque->Steal())
+            delete entry;
+    }
+    for (JobEntry *entry : _shared)
+        delete entry;
+    for (JobEntry *entry : _background)
+        delete entry;
+    for (JobEntry *entry : _glJobs)
+        delete entry;
+}
+
+void JobSystem::Run(Job job, JobCounter *counter, JobPriority priority)
+{
+    // the jobs submitted by a background job (its parallel loops) are background jobs too
+    if (localBackground)
+        priority = JobPriority::BACKGROUND;
+    if (counter)
+        counter->_count.fetch_add(1, std::memory_order_relaxed);
+    submit(new JobEntry{std::move(job), counter, priority});
+}
+
+void JobSystem::RunAfter(JobCounter &dependency, Job job, JobCounter *counter, JobPriority priority)
+{
+    if (counter)
+        counter->_count.fetch_add(1, std::memory_order_relaxed);
+    JobEntry *entry = new JobEntry{std::move(job), counter, priority};
+    {
+        // the last job of the dependency decrements it under the same lock, so the continuation is never lost
+        std::lock_guard<std::mutex> lock(dependency._mutex);
+        if (dependency._count.load(std::memory_order_acquire) > 0)
+        {
+            dependency._continuations.push_back(entry);
+            return;
+        }
+    }
+    submit(entry);
+}
+
+void JobSystem::Wait(JobCounter &counter)
+{
+    const bool glThread = _glThread.load() == std::this_thread::get_id();
+    while (!counter.IsDone())
+    {
+        // the GL thread runs its own jobs too: a job may wait for them
+        if (glThread && executeGLThreadJob())
+            continue;
+        if (JobEntry *entry = findJob(localBackground))
+            execute(entry);
+        else
+            std::this_thread::yield();
+    }
+    // the last decrement may still hold the lock: after it, the counter can be destroyed
+    std::lock_guard<std::mutex> lock(counter._mutex);
+}
+
+void JobSystem::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &body)
+{
+    grain = std::max(grain, (size_t)1);
+    if (count <= grain)
+    {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    for (size_t begin = grain; begin < count; begin += grain)
+    {
+        const size_t end = std::min(begin + grain, count);
+        Run([&body, begin, end] { body(begin, end); }, &counter);
+    }
+    body(0, grain);
+    Wait(counter);
+}
+
+void JobSystem::SetGLThread()
+{
+    _glThread = std::this_thread::get_id();
+}
+
+void JobSystem::RunOnGLThread(Job job, JobCounter *counter)
+{
+    if (counter)
+        counter->_count.fetch_add(1, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(_glMutex);
+    _glJobs.push_back(new JobEntry{std::move(job), counter, JobPriority::NORMAL});
+}
+
+void JobSystem::ExecuteGLThreadJobs()
+{
+    // only the jobs queued before the call: a job queueing another one does not keep the frame here
+    std::deque<JobEntry *> jobs;
+    {
+        std::lock_guard<std::mutex> lock(_glMutex);
+        jobs.swap(_glJobs);
+    }
+    for (JobEntry *entry : jobs)
+        execute(entry);
+}
+
+unsigned JobSystem::GetWorkerCount() const
+{
+    return (unsigned)_workers.size();
+}
+
+uint64_t JobSystem::GetStealCount() const
+{
+    return _steals.load(std::memory_order_relaxed);
+}
+
+//////////////////////////////////////////
+
+void JobSystem::workerLoop(unsigned index)
+{
+    localSystem = this;
+    localWorker = (int)index;
+    SetProfilerThreadName("Job worker");
+    while (!_quit)
+    {
+        if (JobEntry *entry = findJob(true))
+        {
+            execute(entry);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleeping++;
+        _sleepCondition.wait(lock, [this] { return _quit || _queued.load() > 0; });
+        _sleeping--;
+    }
+}
+
+void JobSystem::submit(JobEntry *entry)
+{
+    if (entry->Priority == JobPriority::BACKGROUND)
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _background.push_back(entry);
+    }
+    else if (localSystem != this || localWorker < 0 || !_deques[localWorker]->Push(entry))
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        _shared.push_back(entry);
+    }
+
+    // a worker going to sleep increments _sleeping before it checks _queued, so it sees the job or it is notified
+    _queued.fetch_add(1);
+    if (_sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _sleepCondition.notify_one();
+    }
+}
+
+JobSystem::JobEntry *JobSystem::findJob(bool background)
+{
+    JobEntry *entry = nullptr;
+    const int own = localSystem == this ? localWorker : -1;
+    if (own >= 0)
+        entry = _deques[own]->Pop();
+
+    if (!entry)
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        if (!_shared.empty())
+        {
+            entry = _shared.front();
+            _shared.pop_front();
+        }
+    }
+
+    // the other deques, starting from the next worker so the thieves spread over them
+    const size_t dequeCount = _deques.size();
+    for (size_t i = 0; i < dequeCount && !entry; i++)
+    {
+        const size_t victim = (own + 1 + i) % dequeCount;
+        if ((int)victim == own)
+            continue;
+        entry = _deques[victim]->Steal();
+        if (entry)
+            _steals.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (!entry && background)
+    {
+        std::lock_guard<std::mutex> lock(_queueMutex);
+        if (!_background.empty())
+        {
+            entry = _background.front();
+            _background.pop_front();
+        }
+    }
+
+    if (entry)
+        _queued.fetch_sub(1);
+    return entry;
+}
+
+void JobSystem::execute(JobEntry *entry)
+{
+    const bool wasBackground = localBackground;
+    localBackground = entry->Priority == JobPriority::BACKGROUND;
+    {
+        PROFILE_SCOPE(localBackground ? "Background job" : "Job");
+        entry->Function();
+    }
+    localBackground = wasBackground;
+    complete(entry->Counter);
+    delete entry;
+}
+
+void JobSystem::complete(JobCounter *counter)
+{
+    if (!counter)
+        return;
+    vector<JobEntry *> continuations;
+    {
+        std::lock_guard<std::mutex> lock(counter->_mutex);
+        if (counter->_count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            continuations.swap(counter->_continuations);
+    }
+    for (JobEntry *entry : continuations)
+        submit(entry);
+}
+
+bool JobSystem::executeGLThreadJob()
+{
+    JobEntry *entry = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_glMutex);
+        if (_glJobs.empty())
+            return false;
+        entry = _glJobs.front();
+        _glJobs.pop_front();
+    }
+    execute(entry);
+    return true;
+}
+
+//////////////////////////////////////////
+
+void RunJobBenchmarks(JobSystem &jobs)
+{
+    using Clock = std::chrono::steady_clock;
+    std::cout << "Job system: " << jobs.GetWorkerCount() << " workers" << std::endl;
+
+    // empty jobs submitted by the main thread (shared queue)
+    const int jobCount = 200000;
+    {
+        JobCounter counter;
+        const auto start = Clock::now();
+        for (int i = 0; i < jobCount; i++)
+            jobs.Run([] {}, &counter);
+        jobs.Wait(counter);
+        std::cout << "  empty jobs from the main thread: " << elapsedMs(start) * 1e6 / jobCount << " ns per job" << std::endl;
+    }
+
+    // empty jobs submitted by a worker (its own deque, stolen by the others)
+    {
+        JobCounter counter;
+        const uint64_t steals = jobs.GetStealCount();
+        const auto start = Clock::now();
+        jobs.Run([&jobs] {
+            JobCounter children;
+            for (int i = 0; i < jobCount; i++)
+                jobs.Run([] {}, &children);
+            jobs.Wait(children);
+        }, &counter);
+        jobs.Wait(counter);
+        std::cout << "  empty jobs from a worker: " << elapsedMs(start) * 1e6 / jobCount << " ns per job, "
+                  << jobs.GetStealCount() - steals << " stolen" << std::endl;
+    }
+
+    // chain of dependent jobs: the latency of a continuation
+    {
+        const int chainLength = 20000;
+        std::unique_ptr<JobCounter[]> counters(new JobCounter[chainLength]);
+        const auto start = Clock::now();
+        jobs.Run([] {}, &counters[0]);
+        for (int i = 1; i < chainLength; i++)
+            jobs.RunAfter(counters[i - 1], [] {}, &counters[i]);
+        jobs.Wait(counters[chainLength - 1]);
+        // the counters are destroyed only when all their continuations are submitted
+        for (int i = 0; i < chainLength - 1; i++)
+            jobs.Wait(counters[i]);
+        std::cout << "  dependency chain: " << elapsedMs(start) * 1e6 / chainLength << " ns per link" << std::endl;
+    }
+
+    // parallel-for over a large array, against the serial loop
+    {
+        vector<float> values(1 << 24);
+        std::iota(values.begin(), values.end(), 0.0f);
+        auto work = [&values](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                values[i] = values[i] * 0.5f + 1.0f;
+        };
+        auto start = Clock::now();
+        work(0, values.size());
+        const double serialMs = elapsedMs(start);
+        std::cout << "  parallel-for over " << values.size() << " items: serial " << serialMs << " ms" << std::endl;
+        for (size_t grain : {1024, 16384, 262144, 1048576})
+        {
+            start = Clock::now();
+            jobs.ParallelFor(values.size(), grain, work);
+            const double parallelMs = elapsedMs(start);
+            std::cout << "    grain " << grain << ": " << parallelMs << " ms (x" << serialMs / parallelMs << ")" << std::endl;
+        }
+    }
+}
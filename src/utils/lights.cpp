@@ -0,0 +1,443 @@
+#include <utils/lights.h>
+#include <utils/gpu_memory.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+using std::vector;
+
+ShadowScheduler::ShadowScheduler(int layerCount) : _layerCount(layerCount) {}
+
+void ShadowScheduler::Update(const vector<PointLight> &lights, const vector<AABB> &movedBoxes, int maxUpdates)
+{
+    // the states follow the indices of the lights: when lights are added or removed, they may belong to other lights
+    if (lights.size() != _states.size())
+    {
+        _states.resize(lights.size());
+        InvalidateAll();
+    }
+
+    int nextLayer = 0;
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        const PointLight &light = lights[i];
+        LightState &state = _states[i];
+
+        const int layer = (light.CastShadows && nextLayer < _layerCount) ? nextLayer++ : -1;
+        if (layer != state.Layer)
+        {
+            state.Layer = layer;
+            state.Dirty = true;
+        }
+
+        const bool moved = state.Position != light.Position || state.Range != light.Range;
+        state.Position = light.Position;
+        state.Range = light.Range;
+        if (layer < 0)
+        {
+            state.Dirty = false;
+            continue;
+        }
+
+        if (light.Update == ShadowUpdate::EVERY_FRAME)
+        {
+            state.Dirty = true;
+        }
+        else if (light.Update == ShadowUpdate::ON_CHANGE && !state.Dirty)
+        {
+            const AABB lightRange(light.Position - glm::vec3(light.Range), light.Position + glm::vec3(light.Range));
+            state.Dirty = moved || std::any_of(movedBoxes.begin(), movedBoxes.end(),
+                                               [&](const AABB &box) { return lightRange.Overlaps(box); });
+        }
+    }
+
+    // the cubes waiting for longer are rendered first; the others wait for the next frames
+    _updates.clear();
+    for (size_t i = 0; i < _states.size(); i++)
+    {
+        if (_states[i].Dirty)
+            _updates.push_back(i);
+    }
+    std::stable_sort(_updates.begin(), _updates.end(),
+                     [&](size_t a, size_t b) { return _states[a].Waiting > _states[b].Waiting; });
+    if ((int)_updates.size() > maxUpdates)
+        _updates.resize(std::max(maxUpdates, 0));
+
+    for (size_t i : _updates)
+        _states[i].Dirty = false;
+    _pending = 0;
+    for (LightState &state : _states)
+    {
+        if (state.Dirty)
+            _pending++;
+        state.Waiting = state.Dirty ? state.Waiting + 1 : 0;
+    }
+}
+
+void ShadowScheduler::InvalidateAll()
+{
+    for (LightState &state : _states)
+        state.Dirty = true;
+}
+
+int ShadowScheduler::GetLayer(size_t light) const
+{
+    return light < _states.size() ? _states[light].Layer : -1;
+}
+
+const vector<size_t> &ShadowScheduler::GetUpdates() const
+{
+    return _updates;
+}
+
+int ShadowScheduler::GetPendingCount() const
+{
+    return _pending;
+}
+
+//////////////////////////////////////////
+
+void LightClusters::Build(const vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &projection, float nearPlane,
+                          float farPlane, const ClusterSettings &settings)
+{
+    const int tilesX = std::max(1, settings.TilesX);
+    const int tilesY = std::max(1, settings.TilesY);
+    const int slices = std::max(1, settings.Slices);
+    const size_t clusterCount = (size_t)tilesX * tilesY * slices;
+    _gridSize = glm::ivec4(tilesX, tilesY, slices, 0);
+
+    // slice = log(depth / near) / log(far / near) * slices
+    const float logRatio = std::log(farPlane / nearPlane);
+    _depthParams = glm::vec4(slices / logRatio, -slices * std::log(nearPlane) / logRatio, 0.0f, 0.0f);
+    auto sliceOf = [&](float depth) {
+        return glm::clamp((int)std::floor(std::log(depth) * _depthParams.x + _depthParams.y), 0, slices - 1);
+    };
+    auto sliceDepth = [&](int slice) { return nearPlane * std::pow(farPlane / nearPlane, (float)slice / slices); };
+    auto tileNdc = [](int tile, int tiles) { return 2.0f * tile / tiles - 1.0f; };
+
+    _pairs.clear();
+    _dropped = 0;
+    const size_t lightCount = std::min(lights.size(), (size_t)UINT16_MAX);
+    for (size_t i = 0; i < lightCount; i++)
+    {
+        const glm::vec3 center = glm::vec3(view * glm::vec4(lights[i].Position, 1.0f));
+        const float radius = lights[i].Range;
+        const float depth = -center.z;
+        if (depth + radius < nearPlane || depth - radius > farPlane)
+            continue;
+        const int firstSlice = sliceOf(std::max(depth - radius, nearPlane));
+        const int lastSlice = sliceOf(std::min(depth + radius, farPlane));
+
+        // tiles covered by the projection of the view space box of the sphere. If the sphere crosses the near plane
+        // the projection is unbounded, and all the tiles are tested
+        glm::ivec2 firstTile(0), lastTile(tilesX - 1, tilesY - 1);
+        if (depth - radius > nearPlane)
+        {
+            glm::vec2 ndcMin(std::numeric_limits<float>::max()), ndcMax(-std::numeric_limits<float>::max());
+            for (int corner = 0; corner < 8; corner++)
+            {
+                const glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+                const glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+                const glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+                ndcMin = glm::min(ndcMin, ndc);
+                ndcMax = glm::max(ndcMax, ndc);
+            }
+            if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+                continue;
+            firstTile = glm::clamp(glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * glm::vec2(tilesX, tilesY))), glm::ivec2(0),
+                                   glm::ivec2(tilesX - 1, tilesY - 1));
+            lastTile = glm::clamp(glm::ivec2(glm::floor((ndcMax * 0.5f + 0.5f) * glm::vec2(tilesX, tilesY))), glm::ivec2(0),
+                                  glm::ivec2(tilesX - 1, tilesY - 1));
+        }
+
+        // the sphere is tested against the view space box of each cluster of the range. A point at the given NDC and
+        // view depth has x = (ndc.x + P[2][0]) * depth / P[0][0] (P[2][0] is not 0 for the off-center tiles of a batch)
+        for (int slice = firstSlice; slice <= lastSlice; slice++)
+        {
+            const float nearDepth = sliceDepth(slice), farDepth = sliceDepth(slice + 1);
+            for (int y = firstTile.y; y <= lastTile.y; y++)
+            {
+                const float y0 = (tileNdc(y, tilesY) + projection[2][1]) / projection[1][1];
+                const float y1 = (tileNdc(y + 1, tilesY) + projection[2][1]) / projection[1][1];
+                for (int x = firstTile.x; x <= lastTile.x; x++)
+                {
+                    const float x0 = (tileNdc(x, tilesX) + projection[2][0]) / projection[0][0];
+                    const float x1 = (tileNdc(x + 1, tilesX) + projection[2][0]) / projection[0][0];
+                    const glm::vec3 boxMin(std::min(x0 * nearDepth, x0 * farDepth), std::min(y0 * nearDepth, y0 * farDepth), -farDepth);
+                    const glm::vec3 boxMax(std::max(x1 * nearDepth, x1 * farDepth), std::max(y1 * nearDepth, y1 * farDepth), -nearDepth);
+                    const glm::vec3 closest = glm::clamp(center, boxMin, boxMax);
+                    const glm::vec3 delta = closest - center;
+                    if (glm::dot(delta, delta) > radius * radius)
+                        continue;
+
+                    if (_pairs.size() >= MaxLightIndices)
+                    {
+                        _dropped++;
+                        continue;
+                    }
+                    _pairs.push_back({(GLuint)((slice * tilesY + y) * tilesX + x), (uint16_t)i});
+                }
+            }
+        }
+    }
+
+    // counting sort of the pairs by cluster: the lights of a cluster are contiguous, in the order of the list
+    _counts.assign(clusterCount, 0);
+    for (const auto &pair : _pairs)
+        _counts[pair.first]++;
+    _clusterLights.resize(clusterCount * 2);
+    _nonEmpty = 0;
+    _maxPerCluster = 0;
+    GLuint offset = 0;
+    for (size_t c = 0; c < clusterCount; c++)
+    {
+        _clusterLights[c * 2] = offset;
+        _clusterLights[c * 2 + 1] = _counts[c];
+        _nonEmpty += _counts[c] > 0;
+        _maxPerCluster = std::max(_maxPerCluster, (int)_counts[c]);
+        // the counts become the write positions of the clusters
+        _counts[c] = offset;
+        offset += _clusterLights[c * 2 + 1];
+    }
+    _lightIndices.resize(_pairs.size());
+    for (const auto &pair : _pairs)
+        _lightIndices[_counts[pair.first]++] = pair.second;
+}
+
+const vector<GLuint> &LightClusters::GetClusterLights() const
+{
+    return _clusterLights;
+}
+
+const vector<uint16_t> &LightClusters::GetLightIndices() const
+{
+    return _lightIndices;
+}
+
+glm::ivec4 LightClusters::GetGridSize() const
+{
+    return _gridSize;
+}
+
+glm::vec4 LightClusters::GetDepthParams() const
+{
+    return _depthParams;
+}
+
+int LightClusters::GetNonEmptyClusters() const
+{
+    return _nonEmpty;
+}
+
+int LightClusters::GetMaxLightsPerCluster() const
+{
+    return _maxPerCluster;
+}
+
+size_t LightClusters::GetDroppedCount() const
+{
+    return _dropped;
+}
+
+//////////////////////////////////////////
+
+void PackLights(const vector<PointLight> &lights, const ShadowScheduler &shadows, vector<glm::vec4> &data)
+{
+    data.clear();
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        data.push_back(glm::vec4(lights[i].Position, lights[i].Range));
+        data.push_back(glm::vec4(lights[i].Color, (float)shadows.GetLayer(i)));
+    }
+}
+
+//////////////////////////////////////////
+
+LightBuffers::LightBuffers()
+{
+    createBufferTexture(_lightData, GL_RGBA32F);
+    createBufferTexture(_clusterLights, GL_RG32UI);
+    createBufferTexture(_lightIndices, GL_R16UI);
+}
+
+LightBuffers::~LightBuffers() noexcept
+{
+    for (BufferTexture *target : {&_lightData, &_clusterLights, &_lightIndices})
+    {
+        UntrackGpuMemory(MemoryCategory::BUFFER, target->Buffer);
+        glDeleteTextures(1, &target->Texture);
+        glDeleteBuffers(1, &target->Buffer);
+    }
+}
+
+void LightBuffers::createBufferTexture(BufferTexture &target, GLenum format)
+{
+    glGenBuffers(1, &target.Buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, target.Buffer);
+    // a buffer texture cannot be empty: the buffers always have at least a few bytes
+    glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+    TrackGpuMemory(MemoryCategory::BUFFER, target.Buffer, 16);
+    glGenTextures(1, &target.Texture);
+    glBindTexture(GL_TEXTURE_BUFFER, target.Texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, target.Buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightBuffers::upload(BufferTexture &target, const void *data, size_t size)
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, target.Buffer);
+    // the storage is orphaned, so the upload does not wait for the draws of the previous frame
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), NULL, GL_STREAM_DRAW);
+    TrackGpuMemory(MemoryCategory::BUFFER, target.Buffer, std::max(size, (size_t)16));
+    if (size > 0)
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LightBuffers::Upload(const vector<glm::vec4> &lightData, const vector<GLuint> &clusterLights, const vector<uint16_t> &lightIndices)
+{
+    upload(_lightData, lightData.data(), lightData.size() * sizeof(glm::vec4));
+    upload(_clusterLights, clusterLights.data(), clusterLights.size() * sizeof(GLuint));
+    upload(_lightIndices, lightIndices.data(), lightIndices.size() * sizeof(uint16_t));
+}
+
+GLuint LightBuffers::GetLightDataTexture() const
+{
+    return _lightData.Texture;
+}
+
+GLuint LightBuffers::GetClusterLightsTexture() const
+{
+    return _clusterLights.Texture;
+}
+
+GLuint LightBuffers::GetLightIndicesTexture() const
+{
+    return _lightIndices.Texture;
+}
+
+//////////////////////////////////////////
+
+GLenum GetShadowInternalFormat(ShadowDepthFormat format)
+{
+    switch (format)
+    {
+    case ShadowDepthFormat::DEPTH16:
+        return GL_DEPTH_COMPONENT16;
+    case ShadowDepthFormat::DEPTH32F:
+        return GL_DEPTH_COMPONENT32F;
+    default:
+        return GL_DEPTH_COMPONENT24;
+    }
+}
+
+int SelectShadowTier(int currentTier, float coverage, const ShadowSettings &settings)
+{
+    if (!settings.AutoResolution)
+        return settings.Tier;
+    int tier = glm::clamp(currentTier, 0, settings.Tier);
+    while (tier < settings.Tier && coverage > settings.CoverageThresholds[tier] * (1.0f + settings.Hysteresis))
+        tier++;
+    while (tier > 0 && coverage < settings.CoverageThresholds[tier - 1] * (1.0f - settings.Hysteresis))
+        tier--;
+    return tier;
+}
+
+//////////////////////////////////////////
+
+ShadowCubeArray::ShadowCubeArray(int size, int layerCount, GLenum internalFormat)
+    : _size(size), _layerCount(layerCount), _internalFormat(internalFormat)
+{
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, _texture);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+    glGenFramebuffers(1, &_FBO);
+    glGenFramebuffers(1, &_clearFBO);
+    allocate();
+}
+
+void ShadowCubeArray::Reallocate(int size, GLenum internalFormat)
+{
+    _size = size;
+    _internalFormat = internalFormat;
+    allocate();
+}
+
+void ShadowCubeArray::allocate()
+{
+    // the storage is specified again on the same texture: the samplers and the attachments keep pointing to it
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, _texture);
+    glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, _internalFormat, _size, _size, _layerCount * 6, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    TrackGpuMemory(MemoryCategory::SHADOW, _texture, GetTextureBytes(_internalFormat, _size, _size, _layerCount * 6));
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+    // the attachments are checked again, since the format of the texture changed
+    glBindFramebuffer(GL_FRAMEBUFFER, _FBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _texture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::SHADOW_CUBE_ARRAY::Framebuffer is not complete" << std::endl;
+    // a new storage has undefined content: the layered framebuffer clears all the layers at once (no shadows until
+    // the cubes are rendered again)
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _clearFBO);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _texture, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowCubeArray::~ShadowCubeArray() noexcept
+{
+    glDeleteFramebuffers(1, &_FBO);
+    glDeleteFramebuffers(1, &_clearFBO);
+    UntrackGpuMemory(MemoryCategory::SHADOW, _texture);
+    glDeleteTextures(1, &_texture);
+}
+
+void ShadowCubeArray::ClearLayer(int layer)
+{
+    // glClear on the layered framebuffer would clear all the layers: the faces are attached one at a time
+    glBindFramebuffer(GL_FRAMEBUFFER, _clearFBO);
+    for (int face = 0; face < 6; face++)
+    {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, _texture, 0, layer * 6 + face);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowCubeArray::Bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, _FBO);
+    glViewport(0, 0, _size, _size);
+}
+
+GLuint ShadowCubeArray::GetTexture() const
+{
+    return _texture;
+}
+
+int ShadowCubeArray::GetSize() const
+{
+    return _size;
+}
+
+int ShadowCubeArray::GetLayerCount() const
+{
+    return _layerCount;
+}
+
+GLenum ShadowCubeArray::GetInternalFormat() const
+{
+    return _internalFormat;
+}
@@ -0,0 +1,150 @@
+#include <utils/lod.h>
+#include <utils/gpu_memory.h>
+#include <utils/mesh_simplifier.h>
+#include <algorithm>
+using std::vector;
+
+LodModel::LodModel(Model &model, const LodSettings &settings) : _model(model)
+{
+    size_t triangles = 0;
+    _indexCounts.emplace_back();
+    for (auto &mesh : _model.meshes)
+    {
+        triangles += mesh->indices.size() / 3;
+        _indexCounts.back().push_back((GLsizei)mesh->indices.size());
+    }
+    _triangleCounts.push_back(triangles);
+
+    for (int level = 1; level < settings.MaxLevels; level++)
+    {
+        vector<std::unique_ptr<Mesh>> meshes;
+        vector<GLsizei> indexCounts;
+        size_t levelTriangles = 0;
+        for (size_t m = 0; m < _model.meshes.size(); m++)
+        {
+            // each level is simplified from the previous one, so the error accumulates smoothly along the chain
+            const Mesh &source = level == 1 ? *_model.meshes[m] : *_levels[level - 2][m];
+            vector<GLuint> indices;
+            size_t target = (size_t)(source.indices.size() * settings.Reduction) / 3 * 3;
+            SimplifyMesh(source.vertices, source.indices, target, settings.MaxError, indices);
+            // a mesh cannot disappear from the chain
+            if (indices.empty())
+                indices = source.indices;
+
+            vector<Vertex> vertices;
+            CompactVertices(source.vertices, indices, vertices);
+            levelTriangles += indices.size() / 3;
+            indexCounts.push_back((GLsizei)indices.size());
+            meshes.emplace_back(new Mesh(vertices, indices));
+        }
+
+        // the simplification is stuck (e.g. everything is locked): there is no point in adding other levels
+        if (levelTriangles > _triangleCounts.back() * 0.9f)
+            break;
+
+        _levels.push_back(std::move(meshes));
+        _triangleCounts.push_back(levelTriangles);
+        _indexCounts.push_back(std::move(indexCounts));
+    }
+
+}
+
+int LodModel::GetLevelCount() const
+{
+    return (int)_triangleCounts.size();
+}
+
+size_t LodModel::GetTriangleCount(int level) const
+{
+    return _triangleCounts[level];
+}
+
+void LodModel::Draw(int level)
+{
+    if (level <= 0)
+    {
+        _model.Draw();
+        return;
+    }
+    for (auto &mesh : _levels[level - 1])
+        mesh->Draw();
+}
+
+size_t LodModel::GetMeshCount(int level) const
+{
+    return level <= 0 ? _model.meshes.size() : _levels[level - 1].size();
+}
+
+const Mesh &LodModel::GetMesh(int level, size_t index) const
+{
+    return level <= 0 ? *_model.meshes[index] : *_levels[level - 1][index];
+}
+
+GLsizei LodModel::GetIndexCount(int level, size_t index) const
+{
+    return _indexCounts[std::max(level, 0)][index];
+}
+
+void LodModel::DropCpuCopies()
+{
+    for (auto &mesh : _model.meshes)
+        DropCpuCopy(*mesh);
+    for (auto &level : _levels)
+    {
+        for (auto &mesh : level)
+            DropCpuCopy(*mesh);
+    }
+}
+
+LodModel *MeshLodCache::Build(Model &model, const LodSettings &settings)
+{
+    auto &chain = _chains[&model];
+    if (!chain)
+        chain.reset(new LodModel(model, settings));
+    return chain.get();
+}
+
+LodModel *MeshLodCache::Find(const Model &model) const
+{
+    auto it = _chains.find(&model);
+    return it == _chains.end() ? nullptr : it->second.get();
+}
+
+void MeshLodCache::DropCpuCopies()
+{
+    for (auto &chain : _chains)
+        chain.second->DropCpuCopies();
+}
+
+float ProjectedScreenSize(const BoundingSphere &worldSphere, const glm::vec3 &cameraPos, float fovY)
+{
+    float distance = glm::length(worldSphere.Center - cameraPos);
+    // the camera is inside the sphere: it covers the whole screen
+    if (distance <= worldSphere.Radius)
+        return 1.0f;
+    return worldSphere.Radius / (distance * glm::tan(fovY * 0.5f));
+}
+
+int SelectLod(int currentLevel, float screenSize, int levelCount, const LodSelectionSettings &settings)
+{
+    const int maxLevel = glm::min(levelCount - 1, (int)settings.ScreenSizeThresholds.size());
+    int level = glm::min(currentLevel, maxLevel);
+    // the object must be clearly smaller than the threshold to switch to a coarser level, and clearly bigger to go back
+    while (level < maxLevel && screenSize < settings.ScreenSizeThresholds[level] * (1.0f - settings.Hysteresis))
+        level++;
+    while (level > 0 && screenSize > settings.ScreenSizeThresholds[level - 1] * (1.0f + settings.Hysteresis))
+        level--;
+    return level;
+}
+
+int SelectShadowLod(const BoundingSphere &worldSphere, const glm::vec3 &lightPos, int levelCount, const LodSelectionSettings &settings)
+{
+    float distance = glm::length(worldSphere.Center - lightPos) / glm::max(worldSphere.Radius, 1e-4f);
+    int level = settings.ShadowMinLevel;
+    for (size_t i = 0; i < settings.ShadowDistanceThresholds.size(); i++)
+    {
+        if (distance > settings.ShadowDistanceThresholds[i])
+            level = glm::max(level, (int)i + 1);
+    }
+    return glm::min(level, levelCount - 1);
+}
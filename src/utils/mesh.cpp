@@ -1,4 +1,5 @@
 #include <utils/mesh.h>
+#include <utils/gpu_memory.h>
 using glm::vec2;
 using glm::vec3;
 using std::vector;
@@ -53,7 +54,7 @@ void Mesh::Draw()
     // VAO is made "active"
     glBindVertexArray(this->VAO);
     // rendering of data in the VAO
-    glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, GetIndexCount(*this), GL_UNSIGNED_INT, 0);
     // VAO is "detached"
     glBindVertexArray(0);
 }
@@ -73,6 +74,9 @@ void Mesh::setupMesh()
     // we copy data in the EBO - we must set the data dimension, and the pointer to the structure cointaining the data
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+    // the vertices and indices stay in memory after the upload, until DropCpuCopy
+    TrackGpuMemory(MemoryCategory::GEOMETRY, this->VAO, this->vertices.size() * sizeof(Vertex) + this->indices.size() * sizeof(GLuint));
+    TrackCpuCopy(MemoryCategory::GEOMETRY, this->VAO, this->vertices.capacity() * sizeof(Vertex) + this->indices.capacity() * sizeof(GLuint));
 
     // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
     // vertex positions
@@ -101,6 +105,8 @@ void Mesh::freeGPUresources()
     // so there's no need for deleting.
     if (VAO)
     {
+        UntrackGpuMemory(MemoryCategory::GEOMETRY, this->VAO);
+        UntrackCpuCopy(MemoryCategory::GEOMETRY, this->VAO);
         glDeleteVertexArrays(1, &this->VAO);
         glDeleteBuffers(1, &this->VBO);
         glDeleteBuffers(1, &this->EBO);
@@ -0,0 +1,237 @@
+#include <utils/mesh_simplifier.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <tuple>
+using std::vector;
+
+namespace
+{
+    // symmetric 4x4 matrix, stored as the 10 coefficients of the upper triangle
+    struct Quadric
+    {
+        double a[10] = {};
+
+        static Quadric FromPlane(const glm::dvec3 &n, double d, double weight)
+        {
+            Quadric q;
+            q.a[0] = n.x * n.x; q.a[1] = n.x * n.y; q.a[2] = n.x * n.z; q.a[3] = n.x * d;
+            q.a[4] = n.y * n.y; q.a[5] = n.y * n.z; q.a[6] = n.y * d;
+            q.a[7] = n.z * n.z; q.a[8] = n.z * d;
+            q.a[9] = d * d;
+            for (double &v : q.a)
+                v *= weight;
+            return q;
+        }
+
+        void Add(const Quadric &other)
+        {
+            for (int i = 0; i < 10; i++)
+                a[i] += other.a[i];
+        }
+
+        // v^T * Q * v, with v = (p, 1)
+        double Evaluate(const glm::vec3 &p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+                 + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+                 + a[7] * z * z + 2.0 * a[8] * z
+                 + a[9];
+        }
+    };
+
+    struct Collapse
+    {
+        float Cost;
+        GLuint From;
+        GLuint To;
+        unsigned FromVersion;
+        unsigned ToVersion;
+
+        bool operator>(const Collapse &other) const { return Cost > other.Cost; }
+    };
+}
+
+float SimplifyMesh(const vector<Vertex> &vertices, const vector<GLuint> &indices,
+                   size_t targetIndexCount, float maxError, vector<GLuint> &outIndices)
+{
+    const size_t vertexCount = vertices.size();
+    vector<GLuint> triangles(indices);
+    const size_t triangleCount = triangles.size() / 3;
+    vector<bool> triangleRemoved(triangleCount, false);
+    size_t aliveTriangles = triangleCount;
+
+    // vertices sharing the same position (attribute seams) are locked
+    vector<bool> locked(vertexCount, false);
+    std::map<std::tuple<float, float, float>, GLuint> positions;
+    for (GLuint i = 0; i < vertexCount; i++)
+    {
+        const glm::vec3 &p = vertices[i].Position;
+        auto result = positions.emplace(std::make_tuple(p.x, p.y, p.z), i);
+        if (!result.second)
+        {
+            locked[i] = true;
+            locked[result.first->second] = true;
+        }
+    }
+
+    // vertices on borders (edges used by a single triangle) are locked too
+    std::map<std::pair<GLuint, GLuint>, int> edgeUse;
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        for (int e = 0; e < 3; e++)
+        {
+            GLuint a = triangles[t * 3 + e];
+            GLuint b = triangles[t * 3 + (e + 1) % 3];
+            edgeUse[std::minmax(a, b)]++;
+        }
+    }
+    for (const auto &edge : edgeUse)
+    {
+        if (edge.second == 1)
+        {
+            locked[edge.first.first] = true;
+            locked[edge.first.second] = true;
+        }
+    }
+
+    // plane quadrics of the triangles, weighted by area, accumulated on the vertices
+    vector<Quadric> quadrics(vertexCount);
+    vector<vector<GLuint>> vertexTriangles(vertexCount);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        const glm::dvec3 p0(vertices[triangles[t * 3]].Position);
+        const glm::dvec3 p1(vertices[triangles[t * 3 + 1]].Position);
+        const glm::dvec3 p2(vertices[triangles[t * 3 + 2]].Position);
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(n);
+        if (area > 0.0)
+            n /= area;
+        Quadric q = Quadric::FromPlane(n, -glm::dot(n, p0), area * 0.5);
+        for (int k = 0; k < 3; k++)
+        {
+            quadrics[triangles[t * 3 + k]].Add(q);
+            vertexTriangles[triangles[t * 3 + k]].push_back((GLuint)t);
+        }
+    }
+
+    vector<unsigned> versions(vertexCount, 0);
+    vector<bool> removed(vertexCount, false);
+    std::priority_queue<Collapse, vector<Collapse>, std::greater<Collapse>> queue;
+
+    // we evaluate the collapse in the cheapest of the two directions allowed by the locks
+    auto pushEdge = [&](GLuint a, GLuint b) {
+        Quadric q = quadrics[a];
+        q.Add(quadrics[b]);
+        if (!locked[a])
+            queue.push({(float)q.Evaluate(vertices[b].Position), a, b, versions[a], versions[b]});
+        if (!locked[b])
+            queue.push({(float)q.Evaluate(vertices[a].Position), b, a, versions[b], versions[a]});
+    };
+    for (const auto &edge : edgeUse)
+        pushEdge(edge.first.first, edge.first.second);
+
+    // moving "from" onto "to" must not flip any of the remaining triangles around "from"
+    auto flips = [&](GLuint from, GLuint to) {
+        for (GLuint t : vertexTriangles[from])
+        {
+            if (triangleRemoved[t])
+                continue;
+            GLuint *tri = &triangles[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to)
+                continue;
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = vertices[tri[k]].Position;
+                q[k] = tri[k] == from ? vertices[to].Position : p[k];
+            }
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    };
+
+    float lastError = 0.0f;
+    while (aliveTriangles * 3 > targetIndexCount && !queue.empty())
+    {
+        Collapse c = queue.top();
+        queue.pop();
+
+        // stale entry: one of the vertices has been removed or modified after the entry has been pushed
+        if (removed[c.From] || removed[c.To] || versions[c.From] != c.FromVersion || versions[c.To] != c.ToVersion)
+            continue;
+        if (c.Cost > maxError)
+            break;
+        if (flips(c.From, c.To))
+            continue;
+
+        lastError = c.Cost;
+        removed[c.From] = true;
+        quadrics[c.To].Add(quadrics[c.From]);
+        versions[c.To]++;
+
+        for (GLuint t : vertexTriangles[c.From])
+        {
+            if (triangleRemoved[t])
+                continue;
+            GLuint *tri = &triangles[t * 3];
+            for (int k = 0; k < 3; k++)
+            {
+                if (tri[k] == c.From)
+                    tri[k] = c.To;
+            }
+            if (tri[0] == tri[1] || tri[1] == tri[2] || tri[2] == tri[0])
+            {
+                triangleRemoved[t] = true;
+                aliveTriangles--;
+            }
+            else
+            {
+                vertexTriangles[c.To].push_back(t);
+            }
+        }
+        vertexTriangles[c.From].clear();
+
+        // the edges around the surviving vertex have new costs (the old entries are stale, since its version changed)
+        for (GLuint t : vertexTriangles[c.To])
+        {
+            if (triangleRemoved[t])
+                continue;
+            for (int k = 0; k < 3; k++)
+            {
+                GLuint other = triangles[t * 3 + k];
+                if (other != c.To)
+                    pushEdge(c.To, other);
+            }
+        }
+    }
+
+    outIndices.clear();
+    outIndices.reserve(aliveTriangles * 3);
+    for (size_t t = 0; t < triangleCount; t++)
+    {
+        if (!triangleRemoved[t])
+            outIndices.insert(outIndices.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+    }
+    return lastError;
+}
+
+void CompactVertices(const vector<Vertex> &vertices, vector<GLuint> &indices, vector<Vertex> &outVertices)
+{
+    const GLuint unused = (GLuint)-1;
+    vector<GLuint> remap(vertices.size(), unused);
+    outVertices.clear();
+    for (GLuint &index : indices)
+    {
+        if (remap[index] == unused)
+        {
+            remap[index] = (GLuint)outVertices.size();
+            outVertices.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+}
@@ -0,0 +1,130 @@
+#include <utils/model_import.h>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <iostream>
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+//////////////////////////////////////////
+
+// Conversion of the Assimp mesh in the vertices and indices used to allocate the OpenGL buffers
+static MeshData processMesh(aiMesh *mesh)
+{
+    MeshData data;
+
+    for (GLuint i = 0; i < mesh->mNumVertices; i++)
+    {
+        Vertex vertex;
+        // the vector data type used by Assimp is different than the GLM vector needed to allocate the OpenGL buffers
+        // I need to convert the data structures (from Assimp to GLM, which are fully compatible to the OpenGL)
+        glm::vec3 vector;
+        // vertices coordinates
+        vector.x = mesh->mVertices[i].x;
+        vector.y = mesh->mVertices[i].y;
+        vector.z = mesh->mVertices[i].z;
+        vertex.Position = vector;
+        // Normals
+        vector.x = mesh->mNormals[i].x;
+        vector.y = mesh->mNormals[i].y;
+        vector.z = mesh->mNormals[i].z;
+        vertex.Normal = vector;
+        // Texture Coordinates
+        // if the model has texture coordinates, than we assign them to a GLM data structure, otherwise we set them at 0
+        // if texture coordinates are present, than Assimp can calculate tangents and bitangents, otherwise we set them at 0 too
+
+        if (mesh->HasTextureCoords(0))
+        {
+            glm::vec2 vec;
+            // in this example we assume the model has only one set of texture coordinates. Actually, a vertex can have up to 8 different texture coordinates. For other models and formats, this code needs to be adapted and modified.
+            vec.x = mesh->mTextureCoords[0][i].x;
+            vec.y = mesh->mTextureCoords[0][i].y;
+            vertex.TexCoords = vec;
+        }
+        else
+        {
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            cout << "WARNING::ASSIMP:: MODEL WITHOUT UV COORDINATES -> TANGENT AND BITANGENT ARE = 0" << endl;
+        }
+        if (mesh->HasTangentsAndBitangents())
+        {
+            // Tangents
+            vector.x = mesh->mTangents[i].x;
+            vector.y = mesh->mTangents[i].y;
+            vector.z = mesh->mTangents[i].z;
+            vertex.Tangent = vector;
+            // Bitangents
+            vector.x = mesh->mBitangents[i].x;
+            vector.y = mesh->mBitangents[i].y;
+            vector.z = mesh->mBitangents[i].z;
+            vertex.Bitangent = vector;
+
+            // we add the vertex to the list
+            data.Vertices.emplace_back(vertex);
+        }
+    }
+
+    // for each face of the mesh, we retrieve the indices of its vertices , and we store them in a vector data structure
+    for (GLuint i = 0; i < mesh->mNumFaces; i++)
+    {
+        aiFace face = mesh->mFaces[i];
+        for (GLuint j = 0; j < face.mNumIndices; j++)
+            data.Indices.emplace_back(face.mIndices[j]);
+    }
+
+    return data;
+}
+
+// Recursive processing of nodes of Assimp data structure: we collect the meshes in the order of the nodes, and they
+// are converted afterwards (in parallel, since each one is independent)
+static void processNode(aiNode *node, const aiScene *scene, vector<aiMesh *> &meshes)
+{
+    // we process each mesh inside the current node
+    for (GLuint i = 0; i < node->mNumMeshes; i++)
+    {
+        // the "node" object contains only the indices to objects in the scene
+        // "Scene" contains all the data. Class node is used only to point to one or more mesh inside the scene and to maintain informations on relations between nodes
+        meshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+    }
+    // we then recursively process each of the children nodes
+    for (GLuint i = 0; i < node->mNumChildren; i++)
+    {
+        processNode(node->mChildren[i], scene, meshes);
+    }
+}
+
+bool ImportModel(const string &path, vector<MeshData> &meshes, JobSystem *jobs)
+{
+    // each call uses its own importer, so different models can be imported in parallel
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+
+    // check for errors (see comment above)
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
+    {
+        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        return false;
+    }
+
+    vector<aiMesh *> sceneMeshes;
+    processNode(scene->mRootNode, scene, sceneMeshes);
+    const size_t first = meshes.size();
+    meshes.resize(first + sceneMeshes.size());
+    auto convert = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            meshes[first + i] = processMesh(sceneMeshes[i]);
+    };
+    if (jobs)
+        jobs->ParallelFor(sceneMeshes.size(), 1, convert);
+    else
+        convert(0, sceneMeshes.size());
+
+    // MATERIALS
+    if (!scene->HasMaterials())
+    {
+        cout << "Model has not any material" << endl;
+    }
+    return true;
+}
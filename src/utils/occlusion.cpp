@@ -0,0 +1,142 @@
+#include <utils/occlusion.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+OcclusionCuller::OcclusionCuller(const GLchar *vertexPath, const GLchar *fragmentPath) : _shader(vertexPath, fragmentPath)
+{
+    // unit cube in [-1, 1], scaled and translated on the AABB in the vertex shader
+    const GLfloat vertices[] = {
+        -1.0f, -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f,
+        -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f, 1.0f, 1.0f};
+    const GLuint indices[] = {
+        0, 1, 2, 2, 3, 0, // -z
+        4, 6, 5, 6, 4, 7, // +z
+        0, 3, 7, 7, 4, 0, // -x
+        1, 5, 6, 6, 2, 1, // +x
+        0, 4, 5, 5, 1, 0, // -y
+        3, 2, 6, 6, 7, 3  // +y
+    };
+
+    glGenVertexArrays(1, &_VAO);
+    glGenBuffers(1, &_VBO);
+    glGenBuffers(1, &_EBO);
+    glBindVertexArray(_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, _VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid *)0);
+    glBindVertexArray(0);
+
+    _modelMatrixLocation = glGetUniformLocation(_shader.Program, "modelMatrix");
+}
+
+OcclusionCuller::~OcclusionCuller() noexcept
+{
+    for (auto &q : _queries)
+        glDeleteQueries(1, &q.Query);
+    glDeleteVertexArrays(1, &_VAO);
+    glDeleteBuffers(1, &_VBO);
+    glDeleteBuffers(1, &_EBO);
+    _shader.Delete();
+}
+
+void OcclusionCuller::Resize(size_t objectCount)
+{
+    while (_queries.size() < objectCount)
+    {
+        ObjectQuery q;
+        glGenQueries(1, &q.Query);
+        _queries.push_back(q);
+    }
+}
+
+void OcclusionCuller::CollectResults()
+{
+    for (auto &q : _queries)
+    {
+        q.Issued = false;
+        if (!q.Pending)
+            continue;
+
+        // we never ask for the result before it is available, to avoid stalling the pipeline
+        GLuint available = 0;
+        glGetQueryObjectuiv(q.Query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+
+        GLuint anySamples = 0;
+        glGetQueryObjectuiv(q.Query, GL_QUERY_RESULT, &anySamples);
+        q.Occluded = anySamples == 0;
+        q.Pending = false;
+    }
+}
+
+bool OcclusionCuller::IsOccluded(size_t objectIndex) const
+{
+    return _queries[objectIndex].Occluded;
+}
+
+void OcclusionCuller::BeginQueries(const glm::mat4 &viewProjection)
+{
+    _queriesIssued = 0;
+    _shader.Use();
+    glUniformMatrix4fv(glGetUniformLocation(_shader.Program, "viewProjectionMatrix"), 1, GL_FALSE, glm::value_ptr(viewProjection));
+    // the boxes only test the depth buffer
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(_VAO);
+}
+
+bool OcclusionCuller::QueryBox(size_t objectIndex, const AABB &worldBox, const glm::vec3 &cameraPos, float nearPlane)
+{
+    ObjectQuery &q = _queries[objectIndex];
+
+    // if the camera is inside the box, the front faces are clipped by the near plane and the test is not reliable
+    if (worldBox.Fattened(nearPlane * 2.0f).Contains(AABB(cameraPos, cameraPos)))
+    {
+        q.Occluded = false;
+        return false;
+    }
+    if (q.Pending)
+        return false;
+
+    glm::mat4 modelMatrix = glm::translate(glm::mat4(1.0f), worldBox.Center());
+    modelMatrix = glm::scale(modelMatrix, worldBox.Extents());
+    glUniformMatrix4fv(_modelMatrixLocation, 1, GL_FALSE, glm::value_ptr(modelMatrix));
+
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, q.Query);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+    q.Pending = true;
+    q.Issued = true;
+    _queriesIssued++;
+    return true;
+}
+
+void OcclusionCuller::EndQueries()
+{
+    glBindVertexArray(0);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthMask(GL_TRUE);
+}
+
+GLuint OcclusionCuller::GetConditionQuery(size_t objectIndex) const
+{
+    return _queries[objectIndex].Issued ? _queries[objectIndex].Query : 0;
+}
+
+int OcclusionCuller::GetQueriesIssued() const
+{
+    return _queriesIssued;
+}
+
+int OcclusionCuller::GetOccludedCount() const
+{
+    int count = 0;
+    for (const auto &q : _queries)
+        count += q.Occluded ? 1 : 0;
+    return count;
+}
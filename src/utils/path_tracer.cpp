@@ -0,0 +1,676 @@
+#include <utils/path_tracer.h>
+#include <utils/frame_capture.h>
+#include <utils/profiler.h>
+#include <stb_image/stb_image.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+using std::string;
+using std::vector;
+
+namespace
+{
+    const float PI = 3.14159265359f;
+    // distance of the origin of the shadow rays from the surfaces, against the self intersections
+    const float RayOffset = 1e-3f;
+    // the paths are ended at random after this number of scattering events, with the probability of their throughput
+    const int RouletteBounces = 3;
+
+    float maxComponent(const glm::vec3 &v)
+    {
+        return std::max(std::max(v.x, v.y), v.z);
+    }
+
+    float average(const glm::vec3 &v)
+    {
+        return (v.x + v.y + v.z) / 3.0f;
+    }
+
+    // PCG hash: the sequence of each pixel depends only on the pixel and the pass, so the image does not depend on the
+    // tiles or on the threads
+    uint32_t hash(uint32_t value)
+    {
+        const uint32_t state = value * 747796405u + 2891336453u;
+        const uint32_t word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+        return (word >> 22u) ^ word;
+    }
+
+    // uniform in [0, 1)
+    float random(uint32_t &state)
+    {
+        state = hash(state);
+        return (state >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // entry and exit distances of the ray in the box (entry > exit if it misses it)
+    glm::vec2 intersectBox(const AABB &box, const glm::vec3 &origin, const glm::vec3 &direction)
+    {
+        glm::vec3 invDirection;
+        for (int i = 0; i < 3; i++)
+            invDirection[i] = 1.0f / (std::abs(direction[i]) > 1e-6f ? direction[i] : 1e-6f);
+        const glm::vec3 t0 = (box.Min - origin) * invDirection;
+        const glm::vec3 t1 = (box.Max - origin) * invDirection;
+        const glm::vec3 tNear = glm::min(t0, t1);
+        const glm::vec3 tFar = glm::max(t0, t1);
+        return glm::vec2(std::max(std::max(tNear.x, tNear.y), tNear.z), std::min(std::min(tFar.x, tFar.y), tFar.z));
+    }
+
+    // direction at the given cosine from the axis, with a uniform azimuth
+    glm::vec3 directionAround(const glm::vec3 &axis, float cosTheta, float u)
+    {
+        // orthonormal basis of Duff et al.
+        const float sign = std::copysign(1.0f, axis.z);
+        const float a = -1.0f / (sign + axis.z);
+        const float b = axis.x * axis.y * a;
+        const glm::vec3 tangent(1.0f + sign * axis.x * axis.x * a, sign * b, -sign * axis.x);
+        const glm::vec3 bitangent(b, sign + axis.y * axis.y * a, -axis.y);
+        const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        const float phi = 2.0f * PI * u;
+        return glm::normalize(axis * cosTheta + (tangent * std::cos(phi) + bitangent * std::sin(phi)) * sinTheta);
+    }
+
+    // contribution of a light fading to 0 at its range (rangeWindow of the shaders)
+    float rangeWindow(const PointLight &light, float dist)
+    {
+        const float x = glm::clamp(1.0f - std::pow(dist / light.Range, 4.0f), 0.0f, 1.0f);
+        return x * x;
+    }
+
+    // Schlick-GGX geometry term of the illumination shader
+    float geometryTerm(float cosine, float alpha)
+    {
+        const float r = alpha + 1.0f;
+        const float k = r * r / 8.0f;
+        return cosine / (cosine * (1.0f - k) + k);
+    }
+}
+
+//////////////////////////////////////////
+// PHASE FUNCTIONS
+float EvaluatePhase(int phaseFunction, float g, float cosTheta)
+{
+    switch (phaseFunction)
+    {
+    case 0:
+    {
+        // Henyey-Greenstein
+        const float denominator = 4.0f * PI * std::pow(1.0f + g * g - 2.0f * g * cosTheta, 1.5f);
+        return (1.0f - g * g) / denominator;
+    }
+    case 1:
+        return 3.0f / (16.0f * PI) * (1.0f + cosTheta * cosTheta);
+    case 2:
+    {
+        const float k = 1.55f * g - 0.55f * g * g * g;
+        const float denominator = 1.0f + k * cosTheta;
+        return (1.0f - k * k) / (4.0f * PI * denominator * denominator);
+    }
+    default:
+        return 1.0f / (4.0f * PI);
+    }
+}
+
+float SamplePhaseCosine(int phaseFunction, float g, float u)
+{
+    switch (phaseFunction)
+    {
+    case 0:
+    {
+        if (std::abs(g) < 1e-3f)
+            return 1.0f - 2.0f * u;
+        const float s = (1.0f - g * g) / (1.0f - g + 2.0f * g * u);
+        return glm::clamp((1.0f + g * g - s * s) / (2.0f * g), -1.0f, 1.0f);
+    }
+    case 1:
+    {
+        // the CDF is (c^3 + 3c) / 8 + 1/2: the cubic is solved with Cardano's formula
+        const float z = 4.0f * u - 2.0f;
+        const float root = std::sqrt(z * z + 1.0f);
+        return glm::clamp(std::cbrt(z + root) + std::cbrt(z - root), -1.0f, 1.0f);
+    }
+    case 2:
+    {
+        const float k = 1.55f * g - 0.55f * g * g * g;
+        if (std::abs(k) < 1e-3f)
+            return 1.0f - 2.0f * u;
+        return glm::clamp(((1.0f - k * k) / (1.0f + k - 2.0f * k * u) - 1.0f) / k, -1.0f, 1.0f);
+    }
+    default:
+        return 1.0f - 2.0f * u;
+    }
+}
+
+//////////////////////////////////////////
+// SCENE
+void ReferenceScene::AddMesh(const vector<Vertex> &vertices, const vector<GLuint> &indices, const glm::mat4 &model)
+{
+    const glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        for (int v = 0; v < 3; v++)
+        {
+            const Vertex &vertex = vertices[indices[i + v]];
+            _positions.push_back(glm::vec3(model * glm::vec4(vertex.Position, 1.0f)));
+            _normals.push_back(glm::normalize(normalMatrix * vertex.Normal));
+            _texCoords.push_back(vertex.TexCoords);
+        }
+    }
+}
+
+void ReferenceScene::AddVolume(const DensityData &data)
+{
+    // padded to the size of the texture of the volume, with the same bounds
+    Volume volume;
+    volume.Size = ((data.Size + OccupancyBrickSize - 1) / OccupancyBrickSize) * OccupancyBrickSize;
+    const glm::vec3 voxelSize = (data.Bounds.Max - data.Bounds.Min) / glm::vec3(data.Size);
+    volume.Bounds = AABB(data.Bounds.Min, data.Bounds.Min + voxelSize * glm::vec3(volume.Size));
+    volume.Voxels.assign((size_t)volume.Size.x * volume.Size.y * volume.Size.z, 0.0f);
+    for (int z = 0; z < data.Size.z; z++)
+        for (int y = 0; y < data.Size.y; y++)
+            for (int x = 0; x < data.Size.x; x++)
+            {
+                const float density = data.Voxels[((size_t)z * data.Size.y + y) * data.Size.x + x];
+                volume.Voxels[((size_t)z * volume.Size.y + y) * volume.Size.x + x] = density;
+                volume.MaxDensity = std::max(volume.MaxDensity, density);
+            }
+    _volumes.push_back(std::move(volume));
+}
+
+void ReferenceScene::SetMaterial(const ReferenceMaterial &material)
+{
+    _material = material;
+}
+
+void ReferenceScene::SetEnvironment(const std::array<string, 6> &facePaths)
+{
+    _environmentPaths = facePaths;
+}
+
+void ReferenceScene::Build()
+{
+    _bvh.Build(_positions);
+    std::cout << "Reference scene: " << _bvh.GetTriangleCount() << " triangles, " << _bvh.GetNodeCount()
+              << " BVH nodes, depth " << _bvh.GetDepth() << std::endl;
+}
+
+bool ReferenceScene::LoadImages()
+{
+    std::call_once(_imagesOnce, [this] {
+        auto load = [](const string &path, Image &image) {
+            int channels = 0;
+            unsigned char *data = stbi_load(path.c_str(), &image.Width, &image.Height, &channels, STBI_rgb);
+            if (!data)
+            {
+                std::cout << "ERROR::PATH_TRACER::IMAGE_NOT_LOADED: " << path << std::endl;
+                image.Width = image.Height = 0;
+                return false;
+            }
+            image.Texels.resize((size_t)image.Width * image.Height);
+            for (size_t i = 0; i < image.Texels.size(); i++)
+                image.Texels[i] = glm::vec3(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]) / 255.0f;
+            stbi_image_free(data);
+            return true;
+        };
+        _imagesLoaded = load(_material.AlbedoPath, _albedo);
+        for (int face = 0; face < 6; face++)
+            _imagesLoaded = load(_environmentPaths[face], _environment[face]) && _imagesLoaded;
+    });
+    return _imagesLoaded;
+}
+
+const TriangleBVH &ReferenceScene::GetBVH() const
+{
+    return _bvh;
+}
+
+size_t ReferenceScene::GetVolumeCount() const
+{
+    return _volumes.size();
+}
+
+// texel centers at half integers, as the linear filter of OpenGL; a missing image is black
+glm::vec3 ReferenceScene::Image::SampleBilinear(float s, float t, bool repeat) const
+{
+    if (Texels.empty())
+        return glm::vec3(0.0f);
+    const float x = s * Width - 0.5f, y = t * Height - 0.5f;
+    const int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+    const float fx = x - x0, fy = y - y0;
+    auto texel = [&](int tx, int ty) {
+        if (repeat)
+        {
+            tx = ((tx % Width) + Width) % Width;
+            ty = ((ty % Height) + Height) % Height;
+        }
+        else
+        {
+            tx = glm::clamp(tx, 0, Width - 1);
+            ty = glm::clamp(ty, 0, Height - 1);
+        }
+        return Texels[(size_t)ty * Width + tx];
+    };
+    return glm::mix(glm::mix(texel(x0, y0), texel(x0 + 1, y0), fx), glm::mix(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fx), fy);
+}
+
+// trilinear filter with the edges clamped, as the 3D texture (the padding voxels are empty)
+float ReferenceScene::Volume::Sample(const glm::vec3 &position) const
+{
+    const glm::vec3 uvw = (position - Bounds.Min) / (Bounds.Max - Bounds.Min);
+    if (glm::any(glm::lessThan(uvw, glm::vec3(0.0f))) || glm::any(glm::greaterThan(uvw, glm::vec3(1.0f))))
+        return 0.0f;
+    const glm::vec3 coords = uvw * glm::vec3(Size) - 0.5f;
+    const glm::ivec3 base = glm::ivec3(glm::floor(coords));
+    const glm::vec3 f = coords - glm::vec3(base);
+    float result = 0.0f;
+    for (int i = 0; i < 8; i++)
+    {
+        const glm::ivec3 offset(i & 1, (i >> 1) & 1, (i >> 2) & 1);
+        const glm::ivec3 voxel = glm::clamp(base + offset, glm::ivec3(0), Size - 1);
+        const float weight = (offset.x ? f.x : 1.0f - f.x) * (offset.y ? f.y : 1.0f - f.y) * (offset.z ? f.z : 1.0f - f.z);
+        result += weight * Voxels[((size_t)voxel.z * Size.y + voxel.y) * Size.x + voxel.x];
+    }
+    return result;
+}
+
+// face and coordinates of the direction, with the rules of the OpenGL cube maps
+glm::vec3 ReferenceScene::sampleEnvironment(const glm::vec3 &direction) const
+{
+    const glm::vec3 a = glm::abs(direction);
+    int face;
+    float sc, tc, ma;
+    if (a.x >= a.y && a.x >= a.z)
+    {
+        face = direction.x > 0.0f ? 0 : 1;
+        ma = a.x;
+        sc = direction.x > 0.0f ? -direction.z : direction.z;
+        tc = -direction.y;
+    }
+    else if (a.y >= a.z)
+    {
+        face = direction.y > 0.0f ? 2 : 3;
+        ma = a.y;
+        sc = direction.x;
+        tc = direction.y > 0.0f ? direction.z : -direction.z;
+    }
+    else
+    {
+        face = direction.z > 0.0f ? 4 : 5;
+        ma = a.z;
+        sc = direction.z > 0.0f ? direction.x : -direction.x;
+        tc = -direction.y;
+    }
+    return _environment[face].SampleBilinear((sc / ma + 1.0f) * 0.5f, (tc / ma + 1.0f) * 0.5f, false);
+}
+
+//////////////////////////////////////////
+// RENDERER
+ReferenceRenderer::ReferenceRenderer(ReferenceScene &scene, JobSystem &jobs) : _scene(scene), _jobs(jobs)
+{
+}
+
+ReferenceRenderer::~ReferenceRenderer() noexcept
+{
+    stop();
+}
+
+void ReferenceRenderer::Render(const ReferenceFrame &frame, const ReferenceSettings &settings)
+{
+    stop();
+    setup(frame, settings);
+    renderPasses();
+}
+
+void ReferenceRenderer::Start(const ReferenceFrame &frame, const ReferenceSettings &settings)
+{
+    stop();
+    setup(frame, settings);
+    _jobs.Run([this] { renderPasses(); }, &_running, JobPriority::BACKGROUND);
+}
+
+void ReferenceRenderer::Cancel()
+{
+    _cancel = true;
+}
+
+bool ReferenceRenderer::IsRunning() const
+{
+    return !_running.IsDone();
+}
+
+int ReferenceRenderer::GetCompletedSamples() const
+{
+    return _completedSamples;
+}
+
+double ReferenceRenderer::GetElapsedMs() const
+{
+    const int64_t end = IsRunning() ? ProfilerNow() : _endUs.load();
+    return (end - _startUs) / 1000.0;
+}
+
+int ReferenceRenderer::GetWidth() const
+{
+    return _frame.Width;
+}
+
+int ReferenceRenderer::GetHeight() const
+{
+    return _frame.Height;
+}
+
+vector<float> ReferenceRenderer::GetImage() const
+{
+    vector<float> rgba(_sum.size() * 4, 1.0f);
+    const float scale = _completedSamples > 0 ? 1.0f / _completedSamples : 0.0f;
+    for (size_t i = 0; i < _sum.size(); i++)
+    {
+        for (int c = 0; c < 3; c++)
+            rgba[i * 4 + c] = _sum[i][c] * scale;
+    }
+    return rgba;
+}
+
+void ReferenceRenderer::stop()
+{
+    _cancel = true;
+    _jobs.Wait(_running);
+    _cancel = false;
+}
+
+void ReferenceRenderer::setup(const ReferenceFrame &frame, const ReferenceSettings &settings)
+{
+    _frame = frame;
+    _settings = settings;
+    _settings.TileSize = std::max(_settings.TileSize, 1);
+    _inverseViewProjection = glm::inverse(frame.Projection * frame.View);
+    _extinction = frame.AbsorptionCoeff + frame.ScatteringCoeff;
+    _tileColumns = (frame.Width + _settings.TileSize - 1) / _settings.TileSize;
+    _tileRows = (frame.Height + _settings.TileSize - 1) / _settings.TileSize;
+    _sum.assign((size_t)frame.Width * frame.Height, glm::vec3(0.0f));
+    _completedSamples = 0;
+    _startUs = _endUs = ProfilerNow();
+}
+
+// a pass is a sample per pixel: the image can be read (and the render cancelled) between two passes
+void ReferenceRenderer::renderPasses()
+{
+    _scene.LoadImages();
+    const size_t tileCount = (size_t)_tileColumns * _tileRows;
+    for (int pass = 0; pass < _settings.Samples && !_cancel; pass++)
+    {
+        _jobs.ParallelFor(tileCount, 1, [this, pass](size_t begin, size_t end) {
+            for (size_t tile = begin; tile < end; tile++)
+                renderTile(tile, pass);
+        });
+        _completedSamples++;
+    }
+    _endUs = ProfilerNow();
+}
+
+void ReferenceRenderer::renderTile(size_t tile, int pass)
+{
+    PROFILE_SCOPE("Reference tile");
+    const int x0 = (int)(tile % _tileColumns) * _settings.TileSize;
+    const int y0 = (int)(tile / _tileColumns) * _settings.TileSize;
+    const int x1 = std::min(x0 + _settings.TileSize, _frame.Width);
+    const int y1 = std::min(y0 + _settings.TileSize, _frame.Height);
+    for (int y = y0; y < y1; y++)
+    {
+        for (int x = x0; x < x1; x++)
+        {
+            const size_t pixel = (size_t)y * _frame.Width + x;
+            uint32_t rng = hash((uint32_t)pixel ^ hash((uint32_t)pass));
+
+            // a random point of the pixel (box filter), on the near and far planes
+            const glm::vec2 ndc = (glm::vec2(x + random(rng), y + random(rng)) / glm::vec2(_frame.Width, _frame.Height)) * 2.0f - 1.0f;
+            const glm::vec4 nearPoint = _inverseViewProjection * glm::vec4(ndc, -1.0f, 1.0f);
+            const glm::vec4 farPoint = _inverseViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+            const glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - glm::vec3(nearPoint) / nearPoint.w);
+
+            const glm::vec3 radiance = tracePath(_frame.CameraPos, direction, rng);
+            // the rare invalid samples (degenerate geometry) would stay in the pixel for all the passes
+            if (std::isfinite(radiance.x) && std::isfinite(radiance.y) && std::isfinite(radiance.z))
+                _sum[pixel] += radiance;
+        }
+    }
+}
+
+// direction goes from the camera into the scene, opposite to the propagation of the light
+glm::vec3 ReferenceRenderer::tracePath(glm::vec3 origin, glm::vec3 direction, uint32_t &rng) const
+{
+    glm::vec3 radiance(0.0f), throughput(1.0f);
+    for (int bounce = 0;; bounce++)
+    {
+        const float exit = mediumExit(origin, direction);
+        TriangleHit hit;
+        const bool surface = _scene._bvh.Intersect(origin, direction, exit, hit);
+        const float tMax = surface ? hit.T : exit;
+
+        // delta tracking: the collisions with the majorant are absorptions, scatterings or null collisions
+        const float majorant = maxComponent(_extinction) * majorantDensity(origin, direction, tMax);
+        bool scattered = false;
+        float t = 0.0f;
+        while (majorant > 0.0f)
+        {
+            t -= std::log(1.0f - random(rng)) / majorant;
+            if (t >= tMax)
+                break;
+            const float localDensity = density(origin + direction * t);
+            const glm::vec3 absorption = _frame.AbsorptionCoeff * localDensity;
+            const glm::vec3 scattering = _frame.ScatteringCoeff * localDensity;
+            const glm::vec3 null = glm::max(glm::vec3(majorant) - absorption - scattering, glm::vec3(0.0f));
+            const float absorptionProbability = average(absorption) / majorant;
+            const float scatteringProbability = average(scattering) / majorant;
+            const float u = random(rng);
+            if (u < absorptionProbability)
+                return radiance;
+            if (u < absorptionProbability + scatteringProbability)
+            {
+                throughput *= scattering / (majorant * scatteringProbability);
+                scattered = true;
+                break;
+            }
+            throughput *= null / (majorant * (1.0f - absorptionProbability - scatteringProbability));
+        }
+
+        if (!scattered)
+        {
+            if (surface)
+                return radiance + throughput * shadeSurface(hit, origin + direction * hit.T, -direction, rng);
+            return radiance + throughput * _scene.sampleEnvironment(direction);
+        }
+
+        // the light reaches the point along -lightDir, and goes on towards the previous vertex along -direction
+        origin += direction * t;
+        glm::vec3 lightDir;
+        const glm::vec3 light = sampleLight(origin, rng, lightDir, false);
+        if (light != glm::vec3(0.0f))
+            radiance += throughput * light * EvaluatePhase(_frame.PhaseFunction, _frame.G, glm::dot(lightDir, direction));
+
+        if (bounce + 1 >= _settings.MaxBounces)
+            return radiance;
+        if (bounce + 1 >= RouletteBounces)
+        {
+            const float survival = std::min(maxComponent(throughput), 0.95f);
+            if (random(rng) >= survival)
+                return radiance;
+            throughput /= survival;
+        }
+        // the phase function is sampled exactly: its value and its density cancel
+        const float cosTheta = SamplePhaseCosine(_frame.PhaseFunction, _frame.G, random(rng));
+        direction = directionAround(direction, cosTheta, random(rng));
+    }
+}
+
+// a light chosen uniformly, weighted by the number of lights. In the medium the radiance of the light is the one of the
+// media shaders, which also scale the in-scattering by PI; on the surfaces it has no falloff
+glm::vec3 ReferenceRenderer::sampleLight(const glm::vec3 &position, uint32_t &rng, glm::vec3 &lightDir, bool surface) const
+{
+    if (_frame.Lights.empty())
+        return glm::vec3(0.0f);
+    const size_t count = _frame.Lights.size();
+    const PointLight &light = _frame.Lights[std::min((size_t)(random(rng) * count), count - 1)];
+    const glm::vec3 toLight = light.Position - position;
+    const float dist = glm::length(toLight);
+    if (dist >= light.Range || dist <= 2.0f * RayOffset)
+        return glm::vec3(0.0f);
+    lightDir = toLight / dist;
+
+    glm::vec3 radiance = light.Color * rangeWindow(light, dist);
+    if (!surface)
+        radiance *= PI * ReferenceLightRadius * ReferenceLightRadius / (dist * dist + 0.1f);
+    if (_scene._bvh.Occluded(position + lightDir * RayOffset, lightDir, dist - 2.0f * RayOffset))
+        return glm::vec3(0.0f);
+    // only the part of the shadow ray inside the medium is attenuated
+    const float mediumLength = std::min(dist, mediumExit(position, lightDir));
+    return radiance * estimateTransmittance(position, lightDir, mediumLength, rng) * (float)count;
+}
+
+// ratio tracking: the product of the probabilities of null collision at the collisions with the majorant, ended by
+// Russian roulette when it is small
+glm::vec3 ReferenceRenderer::estimateTransmittance(const glm::vec3 &origin, const glm::vec3 &direction, float tMax,
+                                                   uint32_t &rng) const
+{
+    const float majorant = maxComponent(_extinction) * majorantDensity(origin, direction, tMax);
+    glm::vec3 transmittance(1.0f);
+    if (majorant <= 0.0f)
+        return transmittance;
+    for (float t = 0.0f;;)
+    {
+        t -= std::log(1.0f - random(rng)) / majorant;
+        if (t >= tMax)
+            return transmittance;
+        transmittance *= glm::max(1.0f - _extinction * density(origin + direction * t) / majorant, glm::vec3(0.0f));
+        if (maxComponent(transmittance) < 0.1f)
+        {
+            if (random(rng) >= 0.5f)
+                return glm::vec3(0.0f);
+            transmittance *= 2.0f;
+        }
+    }
+}
+
+// ambient density plus the volumes, as mediumDensity of the shaders
+float ReferenceRenderer::density(const glm::vec3 &position) const
+{
+    float result = _frame.Medium.AmbientDensity;
+    if (!_frame.Medium.VolumesEnabled)
+        return result;
+    for (size_t i = 0; i < _scene._volumes.size() && i < (size_t)MaxDensityVolumes; i++)
+        result += _scene._volumes[i].Sample(position) * _frame.Medium.VolumeDensity[i];
+    return result;
+}
+
+float ReferenceRenderer::majorantDensity(const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const
+{
+    float result = _frame.Medium.AmbientDensity;
+    if (!_frame.Medium.VolumesEnabled)
+        return result;
+    for (size_t i = 0; i < _scene._volumes.size() && i < (size_t)MaxDensityVolumes; i++)
+    {
+        const glm::vec2 interval = intersectBox(_scene._volumes[i].Bounds, origin, direction);
+        if (interval.x <= interval.y && interval.y >= 0.0f && interval.x <= tMax)
+            result += _scene._volumes[i].MaxDensity * _frame.Medium.VolumeDensity[i];
+    }
+    return result;
+}
+
+float ReferenceRenderer::mediumExit(const glm::vec3 &origin, const glm::vec3 &direction) const
+{
+    const glm::vec3 offset = origin - _frame.CameraPos;
+    const float b = glm::dot(offset, direction);
+    const float discriminant = b * b - (glm::dot(offset, offset) - _frame.MediumRadius * _frame.MediumRadius);
+    if (discriminant < 0.0f)
+        return 0.0f;
+    return std::max(-b + std::sqrt(discriminant), 0.0f);
+}
+
+// direct light of the surface, with the Lambert and GGX terms of calculateSurfaceReflection in the illumination shader
+glm::vec3 ReferenceRenderer::shadeSurface(const TriangleHit &hit, const glm::vec3 &position, const glm::vec3 &viewDir,
+                                          uint32_t &rng) const
+{
+    const size_t vertex = (size_t)hit.Triangle * 3;
+    const float w = 1.0f - hit.U - hit.V;
+    const glm::vec3 N = glm::normalize(_scene._normals[vertex] * w + _scene._normals[vertex + 1] * hit.U + _scene._normals[vertex + 2] * hit.V);
+    const glm::vec2 uv = _scene._texCoords[vertex] * w + _scene._texCoords[vertex + 1] * hit.U + _scene._texCoords[vertex + 2] * hit.V;
+
+    glm::vec3 L;
+    const glm::vec3 light = sampleLight(position, rng, L, true);
+    const float NdotL = glm::dot(N, L);
+    if (light == glm::vec3(0.0f) || NdotL <= 0.0f)
+        return glm::vec3(0.0f);
+
+    const ReferenceMaterial &material = _scene._material;
+    const glm::vec2 repeated = glm::fract(uv * material.Repeat);
+    const glm::vec3 albedo = _scene._albedo.Texels.empty() ? glm::vec3(1.0f) : _scene._albedo.SampleBilinear(repeated.x, repeated.y, true);
+    const glm::vec3 lambert = material.Kd * albedo / PI;
+
+    const glm::vec3 H = glm::normalize(L + viewDir);
+    const float NdotH = std::max(glm::dot(N, H), 0.0f);
+    const float NdotV = std::max(glm::dot(N, viewDir), 0.0f);
+    const float VdotH = std::max(glm::dot(viewDir, H), 0.0f);
+    const float alphaSquared = material.Alpha * material.Alpha;
+    const float G2 = geometryTerm(NdotV, material.Alpha) * geometryTerm(NdotL, material.Alpha);
+    const float denominator = NdotH * NdotH * (alphaSquared - 1.0f) + 1.0f;
+    const float D = alphaSquared / (PI * denominator * denominator);
+    const float F = std::pow(1.0f - VdotH, 5.0f) * (1.0f - material.F0) + material.F0;
+    const float specular = NdotV > 0.0f ? F * G2 * D / (4.0f * NdotV * NdotL) : 0.0f;
+
+    return (lambert + glm::vec3(specular)) * NdotL * light;
+}
+
+//////////////////////////////////////////
+// COMPARISON
+ImageError CompareImages(const vector<float> &gpu, const vector<float> &reference, bool clampReference, vector<float> *errorImage)
+{
+    ImageError error;
+    const size_t pixels = std::min(gpu.size(), reference.size()) / 4;
+    if (errorImage)
+        errorImage->assign(pixels * 4, 1.0f);
+    if (pixels == 0)
+        return error;
+
+    double squared = 0.0, relative = 0.0, absolute = 0.0;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            const double expected = clampReference ? glm::clamp(reference[i * 4 + c], 0.0f, 1.0f) : reference[i * 4 + c];
+            const double difference = gpu[i * 4 + c] - expected;
+            squared += difference * difference;
+            relative += difference * difference / (expected * expected + 0.01);
+            absolute += std::abs(difference);
+            if (errorImage)
+                (*errorImage)[i * 4 + c] = (float)std::abs(difference);
+        }
+    }
+    const double samples = (double)pixels * 3.0;
+    error.Rmse = std::sqrt(squared / samples);
+    error.RelMse = relative / samples;
+    error.MeanAbsolute = absolute / samples;
+    return error;
+}
+
+bool LoadCapturedImage(const string &path, int &width, int &height, vector<float> &rgba)
+{
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".exr") == 0)
+        return ReadExr(path, width, height, rgba);
+
+    int channels = 0;
+    unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (!data)
+    {
+        std::cout << "ERROR::PATH_TRACER::IMAGE_NOT_LOADED: " << path << std::endl;
+        return false;
+    }
+    // the files have the rows from the top
+    rgba.resize((size_t)width * height * 4);
+    for (int y = 0; y < height; y++)
+    {
+        const unsigned char *row = data + (size_t)(height - 1 - y) * width * 4;
+        for (int i = 0; i < width * 4; i++)
+            rgba[(size_t)y * width * 4 + i] = row[i] / 255.0f;
+    }
+    stbi_image_free(data);
+    return true;
+}
@@ -0,0 +1,271 @@
+#include <utils/profiler.h>
+#include <utils/gl_call_accounting.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+using std::string;
+using std::vector;
+
+namespace
+{
+    struct ProfileEvent
+    {
+        const char *Name;
+        int64_t Start;
+        int64_t Duration;
+        int Depth;
+    };
+
+    // zones of a thread: only the owner thread writes, and it publishes a zone by incrementing the count
+    struct ThreadBuffer
+    {
+        static constexpr size_t Capacity = 1 << 16;
+
+        std::unique_ptr<ProfileEvent[]> Events{new ProfileEvent[Capacity]};
+        std::atomic<size_t> Count{0};
+        string Name;
+        int Id = 0;
+    };
+
+    const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    std::atomic<bool> capturing{false};
+    std::atomic<size_t> dropped{0};
+
+    // the buffers are registered once per thread, and never freed (a thread may end before the export)
+    std::mutex registryMutex;
+    vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+    thread_local ThreadBuffer *localBuffer = nullptr;
+    thread_local int localDepth = 0;
+
+    ThreadBuffer *getThreadBuffer()
+    {
+        if (localBuffer == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+            localBuffer = threadBuffers.back().get();
+            localBuffer->Id = (int)threadBuffers.size();
+            localBuffer->Name = "Thread " + std::to_string(localBuffer->Id);
+        }
+        return localBuffer;
+    }
+
+    void pushEvent(ThreadBuffer &buffer, const ProfileEvent &event)
+    {
+        const size_t index = buffer.Count.load(std::memory_order_relaxed);
+        if (index >= ThreadBuffer::Capacity)
+        {
+            dropped++;
+            return;
+        }
+        buffer.Events[index] = event;
+        buffer.Count.store(index + 1, std::memory_order_release);
+    }
+
+    // GPU ZONES
+    // ring of query pairs: the zones complete in order, so they are read from the oldest one
+    const int GpuZoneCapacity = 256;
+    struct GpuZone
+    {
+        const char *Name = nullptr;
+        int Depth = 0;
+        bool Pending = false;
+    };
+    GpuZone gpuZones[GpuZoneCapacity];
+    GLuint gpuQueries[GpuZoneCapacity * 2] = {};
+    int gpuNext = 0, gpuOldest = 0, gpuDepth = 0;
+    bool gpuReady = false;
+    // CPU time (microseconds) - GPU time (nanoseconds / 1000)
+    int64_t gpuOffset = 0;
+    ThreadBuffer *gpuBuffer = nullptr;
+
+    void writeEscaped(std::ofstream &file, const string &text)
+    {
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                file << '\\';
+            file << c;
+        }
+    }
+}
+
+void BeginProfilerCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        // a new capture starts from empty buffers (the threads do not record outside a capture)
+        for (auto &buffer : threadBuffers)
+            buffer->Count.store(0, std::memory_order_relaxed);
+    }
+    dropped = 0;
+    capturing = true;
+}
+
+bool EndProfilerCapture(const string &path)
+{
+    capturing = false;
+
+    std::ofstream file(path);
+    if (!file)
+    {
+        std::cout << "ERROR::PROFILER::FILE_NOT_WRITTEN: " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto &buffer : threadBuffers)
+    {
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->Id
+             << ",\"args\":{\"name\":\"";
+        writeEscaped(file, buffer->Name);
+        file << "\"}}";
+        first = false;
+
+        // only the zones published before this point: a thread may still be closing a zone
+        const size_t count = buffer->Count.load(std::memory_order_acquire);
+        for (size_t i = 0; i < count; i++)
+        {
+            const ProfileEvent &event = buffer->Events[i];
+            file << ",\n{\"name\":\"";
+            writeEscaped(file, event.Name);
+            file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->Id << ",\"ts\":" << event.Start
+                 << ",\"dur\":" << event.Duration << ",\"args\":{\"depth\":" << event.Depth << "}}";
+        }
+    }
+    file << "\n]}\n";
+
+    std::cout << "Trace written: " << path << " (" << dropped << " zones dropped)" << std::endl;
+    return (bool)file;
+}
+
+bool IsProfilerCapturing()
+{
+    return capturing.load(std::memory_order_relaxed);
+}
+
+void SetProfilerThreadName(const char *name)
+{
+    ThreadBuffer *buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer->Name = name;
+}
+
+int64_t ProfilerNow()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+size_t GetProfilerDroppedCount()
+{
+    return dropped;
+}
+
+//////////////////////////////////////////
+
+void CalibrateGpuProfiler()
+{
+    if (!gpuReady)
+    {
+        glGenQueries(GpuZoneCapacity * 2, gpuQueries);
+        std::lock_guard<std::mutex> lock(registryMutex);
+        // the GPU zones have their own track, written only by the GL thread
+        threadBuffers.push_back(std::make_unique<ThreadBuffer>());
+        gpuBuffer = threadBuffers.back().get();
+        gpuBuffer->Id = (int)threadBuffers.size();
+        gpuBuffer->Name = "GPU";
+    }
+
+    // the timestamp is read when the previous commands have been executed
+    glFinish();
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    gpuOffset = ProfilerNow() - gpuTime / 1000;
+    gpuReady = true;
+}
+
+void CollectGpuProfileZones()
+{
+    if (!gpuReady)
+        return;
+    while (gpuZones[gpuOldest].Pending)
+    {
+        GpuZone &zone = gpuZones[gpuOldest];
+        GLint available = 0;
+        glGetQueryObjectiv(gpuQueries[gpuOldest * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(gpuQueries[gpuOldest * 2], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(gpuQueries[gpuOldest * 2 + 1], GL_QUERY_RESULT, &end);
+        zone.Pending = false;
+        if (IsProfilerCapturing())
+            pushEvent(*gpuBuffer, {zone.Name, (int64_t)(begin / 1000) + gpuOffset, (int64_t)((end - begin) / 1000), zone.Depth});
+        gpuOldest = (gpuOldest + 1) % GpuZoneCapacity;
+    }
+}
+
+void ReleaseGpuProfiler()
+{
+    if (!gpuReady)
+        return;
+    glDeleteQueries(GpuZoneCapacity * 2, gpuQueries);
+    for (GpuZone &zone : gpuZones)
+        zone.Pending = false;
+    gpuNext = gpuOldest = 0;
+    gpuReady = false;
+}
+
+//////////////////////////////////////////
+
+ProfileScope::ProfileScope(const char *name) : _name(name), _start(-1)
+{
+    if (!IsProfilerCapturing())
+        return;
+    _start = ProfilerNow();
+    localDepth++;
+}
+
+ProfileScope::~ProfileScope() noexcept
+{
+    if (_start < 0)
+        return;
+    localDepth--;
+    if (IsProfilerCapturing())
+        pushEvent(*getThreadBuffer(), {_name, _start, ProfilerNow() - _start, localDepth});
+}
+
+GpuProfileScope::GpuProfileScope(const char *name) : _zone(-1)
+{
+    BeginGLCallPass(name);
+    if (!IsProfilerCapturing() || !gpuReady)
+        return;
+    // the ring is full of zones not read yet
+    if (gpuZones[gpuNext].Pending)
+    {
+        dropped++;
+        return;
+    }
+    _zone = gpuNext;
+    gpuNext = (gpuNext + 1) % GpuZoneCapacity;
+    GpuZone &zone = gpuZones[_zone];
+    zone.Name = name;
+    zone.Depth = gpuDepth++;
+    glQueryCounter(gpuQueries[_zone * 2], GL_TIMESTAMP);
+}
+
+GpuProfileScope::~GpuProfileScope() noexcept
+{
+    EndGLCallPass();
+    if (_zone < 0)
+        return;
+    gpuDepth--;
+    glQueryCounter(gpuQueries[_zone * 2 + 1], GL_TIMESTAMP);
+    gpuZones[_zone].Pending = true;
+}
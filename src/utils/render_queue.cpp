@@ -0,0 +1,131 @@
+#include <utils/render_queue.h>
+using std::vector;
+
+void RadixSortKeys(const vector<uint64_t> &keys, vector<uint32_t> &order, vector<uint32_t> &scratch)
+{
+    const size_t count = keys.size();
+    order.resize(count);
+    scratch.resize(count);
+    for (size_t i = 0; i < count; i++)
+        order[i] = (uint32_t)i;
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        size_t histogram[256] = {};
+        for (uint64_t key : keys)
+            histogram[(key >> shift) & 0xFF]++;
+        // all the keys have the same digit: the pass would not change the order
+        if (count == 0 || histogram[(keys[0] >> shift) & 0xFF] == count)
+            continue;
+
+        size_t offset = 0;
+        for (size_t &bucket : histogram)
+        {
+            size_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+        for (uint32_t index : order)
+            scratch[histogram[(keys[index] >> shift) & 0xFF]++] = index;
+        order.swap(scratch);
+    }
+}
+
+//////////////////////////////////////////
+
+RenderQueue::RenderQueue(GLStateCache &state, UniformRingBuffer &uniforms) : _state(state), _uniforms(uniforms) {}
+
+void RenderQueue::SetPassUniforms(const PassUniforms &pass)
+{
+    const size_t offset = _uniforms.Allocate(&pass, sizeof(pass));
+    if (offset != UniformRingBuffer::InvalidOffset)
+        _state.BindUniformBufferRange(PassBlockBinding, _uniforms.GetBuffer(), offset, sizeof(pass));
+}
+
+uint64_t RenderQueue::makeKey(const DrawItem &item)
+{
+    // from the most significant bits: layer (4), depth function (2), program (12), textures (8), vertex array (16)
+    const uint64_t depth = item.DepthFunc == GL_LESS ? 0 : (item.DepthFunc == GL_LEQUAL ? 1 : 2);
+    const uint64_t textures = item.Textures ? item.Textures->Id : 0;
+    return ((uint64_t)(item.Layer & 0xF) << 60) | (depth << 58) | ((uint64_t)(item.Program & 0xFFF) << 46) |
+           (textures << 38) | ((uint64_t)(item.VertexArray & 0xFFFF) << 22);
+}
+
+void RenderQueue::Submit(const DrawItem &item)
+{
+    _items.push_back(item);
+    _keys.push_back(makeKey(item));
+}
+
+void RenderQueue::Submit(const DrawItem &base, const Mesh &mesh, GLsizei indexCount)
+{
+    DrawItem item = base;
+    item.VertexArray = mesh.VAO;
+    item.IndexCount = indexCount;
+    Submit(item);
+}
+
+void RenderQueue::Flush()
+{
+    RadixSortKeys(_keys, _order, _scratch);
+
+    // the constants of all the draws are appended to the ring in draw order, and uploaded with a single copy
+    _objectOffsets.assign(_items.size(), UniformRingBuffer::InvalidOffset);
+    for (uint32_t index : _order)
+    {
+        const DrawItem &item = _items[index];
+        if (!item.HasTransform && item.FaceMask < 0)
+            continue;
+        ObjectUniforms object = {};
+        object.ModelMatrix = item.ModelMatrix;
+        object.NormalMatrix = glm::mat4(item.NormalMatrix);
+        object.FaceMask = item.FaceMask;
+        _objectOffsets[index] = _uniforms.Allocate(&object, sizeof(object));
+    }
+    _uniforms.Upload();
+
+    for (uint32_t index : _order)
+    {
+        const DrawItem &item = _items[index];
+        const size_t objectOffset = _objectOffsets[index];
+        // the ring is full: the draw would read the constants of another object
+        if ((item.HasTransform || item.FaceMask >= 0) && objectOffset == UniformRingBuffer::InvalidOffset)
+            continue;
+
+        _state.UseProgram(item.Program);
+        if (item.Subroutine != GL_INVALID_INDEX)
+            _state.UniformSubroutine(GL_FRAGMENT_SHADER, item.Subroutine);
+        if (item.Textures)
+        {
+            for (const TextureBinding &binding : item.Textures->Bindings)
+                _state.BindTexture(binding.Unit, binding.Target, binding.Texture);
+        }
+        _state.DepthFunc(item.DepthFunc);
+
+        if (objectOffset != UniformRingBuffer::InvalidOffset)
+            _state.BindUniformBufferRange(ObjectBlockBinding, _uniforms.GetBuffer(), objectOffset, sizeof(ObjectUniforms));
+
+        // the vertex array stays bound after the draw: the next item with the same mesh does not bind it again
+        _state.BindVertexArray(item.VertexArray);
+        // GL_QUERY_NO_WAIT: if the result is not ready yet, the object is simply drawn
+        if (item.ConditionQuery)
+            glBeginConditionalRender(item.ConditionQuery, GL_QUERY_NO_WAIT);
+        glDrawElements(GL_TRIANGLES, item.IndexCount, GL_UNSIGNED_INT, 0);
+        if (item.ConditionQuery)
+            glEndConditionalRender();
+    }
+    _drawCount += _items.size();
+
+    _items.clear();
+    _keys.clear();
+}
+
+size_t RenderQueue::GetDrawCount() const
+{
+    return _drawCount;
+}
+
+void RenderQueue::ResetStats()
+{
+    _drawCount = 0;
+}
@@ -1,4 +1,5 @@
 #include <utils/shader.h>
+#include <utils/profiler.h>
 using std::string;
 using std::ifstream;
 using std::stringstream;
@@ -6,6 +7,7 @@ using std::cout;
 using std::endl;
 
 Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* geometryPath) {
+    PROFILE_SCOPE("Shader::Shader");
     // Step 1: we retrieve shaders source code from provided filepaths
     string vertexCode;
     string fragmentCode;
@@ -90,6 +92,7 @@ Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLcha
 
 Shader::Shader(const GLchar *vertexPath, const GLchar *fragmentPath)
 {
+    PROFILE_SCOPE("Shader::Shader");
     // Step 1: we retrieve shaders source code from provided filepaths
     string vertexCode;
     string fragmentCode;
@@ -0,0 +1,92 @@
+#include <utils/sky_cache.h>
+#include <utils/gpu_memory.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+using std::vector;
+
+SkyCache::SkyCache(int size) : _size(size)
+{
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, _texture);
+    for (int face = 0; face < 6; face++)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_HALF_FLOAT, NULL);
+    TrackGpuMemory(MemoryCategory::RENDER_TARGET, _texture, GetTextureBytes(GL_RGBA16F, size, size, 6));
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    // the bilinear filter reads across the edges of the faces, so the seams of the cube are not visible
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    glGenFramebuffers(1, &_FBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, _FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X, _texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::SKY_CACHE::Framebuffer is not complete" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+SkyCache::~SkyCache() noexcept
+{
+    glDeleteFramebuffers(1, &_FBO);
+    UntrackGpuMemory(MemoryCategory::RENDER_TARGET, _texture);
+    glDeleteTextures(1, &_texture);
+}
+
+bool SkyCache::IsStale(const glm::vec3 &cameraPos, const vector<float> &parameters, float moveThreshold) const
+{
+    return !_valid || parameters != _parameters || glm::length(cameraPos - _cameraPos) > moveThreshold;
+}
+
+void SkyCache::Invalidate()
+{
+    _valid = false;
+}
+
+void SkyCache::BindFace(int face)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, _FBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, _texture, 0);
+    glViewport(0, 0, _size, _size);
+}
+
+void SkyCache::MarkRendered(const glm::vec3 &cameraPos, const vector<float> &parameters)
+{
+    _valid = true;
+    _cameraPos = cameraPos;
+    _parameters = parameters;
+    _renderCount++;
+}
+
+// same orientation of the faces of the shadow cubes
+glm::mat4 SkyCache::GetFaceView(int face)
+{
+    static const glm::vec3 directions[6] = {glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+                                            glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+    static const glm::vec3 ups[6] = {glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+                                     glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)};
+    return glm::lookAt(glm::vec3(0.0f), directions[face], ups[face]);
+}
+
+// the skybox is projected at the far plane (z = w), so only the field of view matters
+glm::mat4 SkyCache::GetFaceProjection()
+{
+    return glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
+}
+
+GLuint SkyCache::GetTexture() const
+{
+    return _texture;
+}
+
+int SkyCache::GetSize() const
+{
+    return _size;
+}
+
+int SkyCache::GetRenderCount() const
+{
+    return _renderCount;
+}
@@ -1,5 +1,11 @@
 #include <utils/texture2D.h>
+#include <utils/asset_streamer.h>
+#include <utils/gpu_memory.h>
+#include <utils/profiler.h>
+#include <utils/texture_cache.h>
 #include <stb_image/stb_image.h>
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 Texture2D::Texture2D(string path, Texture2DType type) : _path(path), _type(type)  {
@@ -7,26 +13,60 @@ Texture2D::Texture2D(string path, Texture2DType type) : _path(path), _type(type)
 
 bool Texture2D::Load()
 {
-    int w, h, channels;
-    unsigned char *image;
+    PROFILE_SCOPE("Texture2D::Load");
     printf("Loading texture from path: %s\n", this->_path.c_str());
-    image = stbi_load(this->_path.c_str(), &w, &h, &channels, STBI_rgb);
 
-    if (image == nullptr)
+    // the image is decoded and its mipmaps are computed only the first time, then they are read from the cache
+    TextureCacheFile cache;
+    if (LoadTextureCache({_path}, _path + TextureCacheExtension, cache))
     {
-        std::cout << "Failed to load texture at: " << this->_path << std::endl;
-        return false;
+        glGenTextures(1, &_textureID);
+        glBindTexture(GL_TEXTURE_2D, _textureID);
+
+        // all the levels are precomputed, so we do not need glGenerateMipmap
+        cache.Upload(GL_TEXTURE_2D);
+        TrackGpuMemory(MemoryCategory::TEXTURE, _textureID, cache.GetTotalSize());
     }
+    else
+    {
+        // if the cache cannot be built (e.g. the folder is read-only) we decode the image and generate the mipmaps here
+        int w, h, channels;
+        unsigned char *image = stbi_load(this->_path.c_str(), &w, &h, &channels, 0);
+        if (image == nullptr || (channels != 3 && channels != 4))
+        {
+            stbi_image_free(image);
+            std::cout << "Failed to load texture at: " << this->_path << std::endl;
+            return false;
+        }
 
-    glGenTextures(1, &_textureID);
-    glBindTexture(GL_TEXTURE_2D, _textureID);
+        glGenTextures(1, &_textureID);
+        glBindTexture(GL_TEXTURE_2D, _textureID);
+        if (channels == 3)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        stbi_image_free(image);
+        const int levels = (int)std::floor(std::log2((float)std::max(w, h))) + 1;
+        TrackGpuMemory(MemoryCategory::TEXTURE, _textureID, GetTextureBytes(GL_RGBA8, w, h, 1, levels));
+    }
 
-    if (channels == 3)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    else if (channels == 4)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, _wrapS);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, _wrapT);
 
-    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _magFilter);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return true;
+}
+
+void Texture2D::LoadAsync(AssetStreamer &streamer)
+{
+    printf("Streaming texture from path: %s\n", this->_path.c_str());
+    glGenTextures(1, &_textureID);
+    glBindTexture(GL_TEXTURE_2D, _textureID);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, _wrapS);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, _wrapT);
@@ -34,10 +74,10 @@ bool Texture2D::Load()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, _minFilter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, _magFilter);
 
-    stbi_image_free(image);
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    return true;
+    // the texture id is valid from now on: it shows a placeholder until the cached levels are uploaded
+    streamer.StreamTexture2D(_textureID, _path);
 }
 
 GLenum Texture2D::GetMinFilter() const
@@ -0,0 +1,456 @@
+#include <utils/texture_cache.h>
+#include <utils/block_compression.h>
+#include <stb_image/stb_image.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace
+{
+    const char CacheMagic[4] = {'R', 'T', 'C', 'T'};
+    const uint32_t CacheVersion = 1;
+    // the data of each level is aligned, so the offsets can be used directly in the unpack buffers
+    const uint64_t LevelAlignment = 16;
+
+    // the header is followed by the table of the levels (face by face) and by the data of the levels
+    struct CacheHeader
+    {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t Format;
+        uint32_t FaceCount;
+        uint32_t LevelCount;
+        uint32_t Reserved[3];
+    };
+
+    // modification time of the file, 0 if it does not exist
+    time_t modificationTime(const string &path)
+    {
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            return 0;
+        return info.st_mtime;
+    }
+
+    // box filter of the previous level; odd sizes repeat the last row and column
+    void downsample(const vector<uint8_t> &src, int width, int height, vector<uint8_t> &dst, int dstWidth, int dstHeight)
+    {
+        dst.resize((size_t)dstWidth * dstHeight * 4);
+        for (int y = 0; y < dstHeight; y++)
+        {
+            int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < dstWidth; x++)
+            {
+                int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = src[((size_t)y0 * width + x0) * 4 + c] + src[((size_t)y0 * width + x1) * 4 + c] +
+                              src[((size_t)y1 * width + x0) * 4 + c] + src[((size_t)y1 * width + x1) * 4 + c];
+                    dst[((size_t)y * dstWidth + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    void encodeLevel(TextureCacheFormat format, const vector<uint8_t> &rgba, int width, int height, vector<uint8_t> &out)
+    {
+        switch (format)
+        {
+        case TextureCacheFormat::BC1:
+            CompressBC1(rgba.data(), width, height, out);
+            break;
+        case TextureCacheFormat::BC3:
+            CompressBC3(rgba.data(), width, height, out);
+            break;
+        case TextureCacheFormat::BC7:
+            CompressBC7(rgba.data(), width, height, out);
+            break;
+        default:
+            out = rgba;
+            break;
+        }
+    }
+
+    const char *formatName(TextureCacheFormat format)
+    {
+        static const char *names[] = {"RGBA8", "BC1", "BC3", "BC7"};
+        return names[(uint32_t)format];
+    }
+}
+
+//////////////////////////////////////////
+
+bool IsTextureCacheFormatSupported(TextureCacheFormat format)
+{
+    switch (format)
+    {
+    case TextureCacheFormat::RGBA8:
+        return true;
+    case TextureCacheFormat::BC1:
+    case TextureCacheFormat::BC3:
+#ifdef GL_EXT_texture_compression_s3tc
+        return GLAD_GL_EXT_texture_compression_s3tc != 0;
+#else
+        return false;
+#endif
+    case TextureCacheFormat::BC7:
+#ifdef GL_ARB_texture_compression_bptc
+        return GLAD_GL_ARB_texture_compression_bptc != 0;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+TextureCacheFormat ChooseTextureCacheFormat(bool hasAlpha)
+{
+    if (IsTextureCacheFormatSupported(TextureCacheFormat::BC7))
+        return TextureCacheFormat::BC7;
+    if (hasAlpha && IsTextureCacheFormatSupported(TextureCacheFormat::BC3))
+        return TextureCacheFormat::BC3;
+    if (!hasAlpha && IsTextureCacheFormatSupported(TextureCacheFormat::BC1))
+        return TextureCacheFormat::BC1;
+    return TextureCacheFormat::RGBA8;
+}
+
+//////////////////////////////////////////
+
+TextureCacheFile::~TextureCacheFile() noexcept
+{
+    Close();
+}
+
+bool TextureCacheFile::Build(const vector<string> &sourcePaths, const string &cachePath, JobSystem *jobs)
+{
+    // the loops over the faces and the levels are parallel with a job system
+    auto parallelFor = [jobs](size_t count, const std::function<void(size_t)> &body) {
+        auto range = [&body](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                body(i);
+        };
+        if (jobs)
+            jobs->ParallelFor(count, 1, range);
+        else
+            range(0, count);
+    };
+
+    // all the faces are decoded as RGBA, and must have the same size
+    const size_t faceCount = sourcePaths.size();
+    vector<vector<uint8_t>> faces(faceCount);
+    vector<int> widths(faceCount, 0), heights(faceCount, 0);
+    parallelFor(faceCount, [&](size_t i) {
+        int channels;
+        unsigned char *image = stbi_load(sourcePaths[i].c_str(), &widths[i], &heights[i], &channels, STBI_rgb_alpha);
+        if (image == nullptr)
+            return;
+        faces[i].assign(image, image + (size_t)widths[i] * heights[i] * 4);
+        stbi_image_free(image);
+    });
+
+    const int width = widths.empty() ? 0 : widths[0], height = heights.empty() ? 0 : heights[0];
+    bool hasAlpha = false;
+    for (size_t i = 0; i < faceCount; i++)
+    {
+        if (faces[i].empty())
+        {
+            cout << "Failed to load texture at: " << sourcePaths[i] << endl;
+            return false;
+        }
+        if (widths[i] != width || heights[i] != height)
+        {
+            cout << "Texture faces with different sizes at: " << sourcePaths[i] << endl;
+            return false;
+        }
+        for (size_t j = 3; j < faces[i].size() && !hasAlpha; j += 4)
+            hasAlpha = faces[i][j] != 255;
+    }
+
+    const TextureCacheFormat format = ChooseTextureCacheFormat(hasAlpha);
+    uint32_t levelCount = 1;
+    while ((std::max(width, height) >> levelCount) > 0)
+        levelCount++;
+
+    // full mipmap chain of each face (each level from the previous one), then every level is encoded in the cache format
+    vector<vector<uint8_t>> levelData(faceCount * levelCount);
+    vector<TextureCacheLevel> levels(faceCount * levelCount);
+    parallelFor(faceCount, [&](size_t face) {
+        int w = width, h = height;
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            vector<uint8_t> &rgba = levelData[face * levelCount + level];
+            if (level == 0)
+            {
+                rgba = std::move(faces[face]);
+            }
+            else
+            {
+                const int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+                downsample(levelData[face * levelCount + level - 1], w, h, rgba, nw, nh);
+                w = nw;
+                h = nh;
+            }
+            levels[face * levelCount + level].Width = (uint32_t)w;
+            levels[face * levelCount + level].Height = (uint32_t)h;
+        }
+    });
+    parallelFor(levelData.size(), [&](size_t i) {
+        vector<uint8_t> encoded;
+        encodeLevel(format, levelData[i], (int)levels[i].Width, (int)levels[i].Height, encoded);
+        levelData[i].swap(encoded);
+    });
+
+    uint64_t offset = sizeof(CacheHeader) + sizeof(TextureCacheLevel) * levels.size();
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        offset = (offset + LevelAlignment - 1) / LevelAlignment * LevelAlignment;
+        levels[i].Offset = offset;
+        levels[i].Size = levelData[i].size();
+        offset += levels[i].Size;
+    }
+
+    // we write a temporary file and then we replace the cache, so an interrupted build never leaves a broken cache
+    const string tempPath = cachePath + ".tmp";
+    FILE *file = fopen(tempPath.c_str(), "wb");
+    if (file == nullptr)
+    {
+        cout << "Failed to write texture cache at: " << cachePath << endl;
+        return false;
+    }
+    CacheHeader header = {};
+    memcpy(header.Magic, CacheMagic, sizeof(CacheMagic));
+    header.Version = CacheVersion;
+    header.Format = (uint32_t)format;
+    header.FaceCount = (uint32_t)faceCount;
+    header.LevelCount = levelCount;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && fwrite(levels.data(), sizeof(TextureCacheLevel), levels.size(), file) == levels.size();
+    uint64_t position = sizeof(CacheHeader) + sizeof(TextureCacheLevel) * levels.size();
+    const char padding[LevelAlignment] = {};
+    for (size_t i = 0; i < levels.size() && ok; i++)
+    {
+        ok = fwrite(padding, 1, levels[i].Offset - position, file) == levels[i].Offset - position;
+        ok = ok && fwrite(levelData[i].data(), 1, levelData[i].size(), file) == levelData[i].size();
+        position = levels[i].Offset + levels[i].Size;
+    }
+    ok = fclose(file) == 0 && ok;
+
+    remove(cachePath.c_str());
+    if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        cout << "Failed to write texture cache at: " << cachePath << endl;
+        return false;
+    }
+    cout << "Built texture cache " << cachePath << " (" << formatName(format) << ", " << levelCount << " levels)" << endl;
+    return true;
+}
+
+bool TextureCacheFile::Open(const string &cachePath)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(cachePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    HANDLE fileMapping = GetFileSizeEx(file, &size) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    void *mapping = fileMapping ? MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (mapping == nullptr)
+    {
+        if (fileMapping)
+            CloseHandle(fileMapping);
+        CloseHandle(file);
+        return false;
+    }
+    _file = file;
+    _fileMapping = fileMapping;
+    _mapping = mapping;
+    _mappingSize = (size_t)size.QuadPart;
+#else
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    void *mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0)
+        mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+    _mapping = mapping;
+    _mappingSize = (size_t)info.st_size;
+#endif
+
+    // we validate the header and the table of the levels, so a truncated file is rebuilt instead of read out of bounds
+    const CacheHeader *header = static_cast<const CacheHeader *>(_mapping);
+    bool valid = _mappingSize >= sizeof(CacheHeader) && memcmp(header->Magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+                 header->Version == CacheVersion && header->Format <= (uint32_t)TextureCacheFormat::BC7 &&
+                 (header->FaceCount == 1 || header->FaceCount == 6) && header->LevelCount > 0 && header->LevelCount <= 32 &&
+                 _mappingSize >= sizeof(CacheHeader) + sizeof(TextureCacheLevel) * header->FaceCount * header->LevelCount;
+    if (valid)
+    {
+        _format = (TextureCacheFormat)header->Format;
+        _faceCount = (int)header->FaceCount;
+        _levelCount = (int)header->LevelCount;
+        _levels = reinterpret_cast<const TextureCacheLevel *>(static_cast<const char *>(_mapping) + sizeof(CacheHeader));
+        for (int i = 0; i < _faceCount * _levelCount && valid; i++)
+            valid = _levels[i].Offset <= _mappingSize && _levels[i].Size <= _mappingSize - _levels[i].Offset;
+    }
+    if (!valid)
+    {
+        cout << "Invalid texture cache at: " << cachePath << endl;
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void TextureCacheFile::Close()
+{
+    if (_mapping == nullptr)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(_mapping);
+    CloseHandle(_fileMapping);
+    CloseHandle(_file);
+    _file = nullptr;
+    _fileMapping = nullptr;
+#else
+    munmap(_mapping, _mappingSize);
+#endif
+    _mapping = nullptr;
+    _mappingSize = 0;
+    _faceCount = 0;
+    _levelCount = 0;
+    _levels = nullptr;
+}
+
+bool TextureCacheFile::IsOpen() const
+{
+    return _mapping != nullptr;
+}
+
+void TextureCacheFile::Upload(GLenum target) const
+{
+    for (int face = 0; face < _faceCount; face++)
+    {
+        for (int level = 0; level < _levelCount; level++)
+            UploadLevel(target, face, level, GetLevelData(face, level));
+    }
+}
+
+void TextureCacheFile::UploadLevel(GLenum target, int face, int level, const void *pixels) const
+{
+    const TextureCacheLevel &info = GetLevel(face, level);
+    const GLenum faceTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)face : target;
+    if (IsCompressed())
+        glCompressedTexImage2D(faceTarget, level, GetInternalFormat(), info.Width, info.Height, 0, (GLsizei)info.Size, pixels);
+    else
+        glTexImage2D(faceTarget, level, GL_RGBA8, info.Width, info.Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+    // the texture is complete only when the last level is defined
+    if (face == _faceCount - 1 && level == _levelCount - 1)
+    {
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, _levelCount - 1);
+    }
+}
+
+TextureCacheFormat TextureCacheFile::GetFormat() const
+{
+    return _format;
+}
+
+bool TextureCacheFile::IsCompressed() const
+{
+    return _format != TextureCacheFormat::RGBA8;
+}
+
+GLenum TextureCacheFile::GetInternalFormat() const
+{
+    switch (_format)
+    {
+#ifdef GL_EXT_texture_compression_s3tc
+    case TextureCacheFormat::BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureCacheFormat::BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+#endif
+#ifdef GL_ARB_texture_compression_bptc
+    case TextureCacheFormat::BC7:
+        return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+#endif
+    default:
+        return GL_RGBA8;
+    }
+}
+
+int TextureCacheFile::GetFaceCount() const
+{
+    return _faceCount;
+}
+
+int TextureCacheFile::GetLevelCount() const
+{
+    return _levelCount;
+}
+
+const TextureCacheLevel &TextureCacheFile::GetLevel(int face, int level) const
+{
+    return _levels[face * _levelCount + level];
+}
+
+size_t TextureCacheFile::GetTotalSize() const
+{
+    size_t size = 0;
+    for (int i = 0; i < _faceCount * _levelCount; i++)
+        size += _levels[i].Size;
+    return size;
+}
+
+const unsigned char *TextureCacheFile::GetLevelData(int face, int level) const
+{
+    return static_cast<const unsigned char *>(_mapping) + GetLevel(face, level).Offset;
+}
+
+//////////////////////////////////////////
+
+bool LoadTextureCache(const vector<string> &sourcePaths, const string &cachePath, TextureCacheFile &cache, JobSystem *jobs)
+{
+    // a missing source does not invalidate the cache: it can be distributed without the original images
+    const time_t cacheTime = modificationTime(cachePath);
+    bool current = cacheTime != 0;
+    for (const string &path : sourcePaths)
+        current = current && modificationTime(path) <= cacheTime;
+
+    if (current && cache.Open(cachePath))
+    {
+        if (IsTextureCacheFormatSupported(cache.GetFormat()))
+            return true;
+        // the cache has been built on a context with different compression formats
+        cache.Close();
+    }
+
+    if (!TextureCacheFile::Build(sourcePaths, cachePath, jobs))
+        return false;
+    return cache.Open(cachePath);
+}
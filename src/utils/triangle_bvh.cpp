@@ -0,0 +1,250 @@
+#include <utils/triangle_bvh.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+using std::vector;
+
+namespace
+{
+    const int BinCount = 16;
+    // the leaves are split while the heuristic finds a cheaper split, and always above this size
+    const uint32_t MaxLeafTriangles = 16;
+    // cost of visiting a node, relative to the test of a triangle
+    const float TraversalCost = 1.0f;
+    const int MaxDepth = 64;
+
+    // distance where the ray enters the box, or a negative value if it misses it before tMax
+    float intersectBox(const AABB &box, const glm::vec3 &origin, const glm::vec3 &invDirection, float tMax)
+    {
+        const glm::vec3 t0 = (box.Min - origin) * invDirection;
+        const glm::vec3 t1 = (box.Max - origin) * invDirection;
+        const glm::vec3 tNear = glm::min(t0, t1);
+        const glm::vec3 tFar = glm::max(t0, t1);
+        const float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+        return enter <= exit ? enter : -1.0f;
+    }
+}
+
+void TriangleBVH::Build(const vector<glm::vec3> &positions)
+{
+    _nodes.clear();
+    _triangles.clear();
+    _depth = 0;
+    const uint32_t count = (uint32_t)(positions.size() / 3);
+    if (count == 0)
+        return;
+
+    vector<AABB> boxes(count);
+    vector<glm::vec3> centroids(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        for (int v = 0; v < 3; v++)
+            boxes[i].Expand(positions[i * 3 + v]);
+        centroids[i] = boxes[i].Center();
+    }
+
+    vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    // a binary tree has less than 2 nodes per triangle
+    _nodes.reserve((size_t)count * 2);
+    buildNode(order, boxes, centroids, 0, count, 1);
+
+    _triangles.reserve(count);
+    for (uint32_t index : order)
+    {
+        const glm::vec3 &v0 = positions[index * 3];
+        _triangles.push_back({v0, positions[index * 3 + 1] - v0, positions[index * 3 + 2] - v0, index});
+    }
+}
+
+uint32_t TriangleBVH::buildNode(vector<uint32_t> &order, const vector<AABB> &boxes, const vector<glm::vec3> &centroids,
+                                uint32_t first, uint32_t count, int depth)
+{
+    _depth = std::max(_depth, depth);
+    const uint32_t nodeIndex = (uint32_t)_nodes.size();
+    _nodes.push_back({AABB(), first, count});
+
+    AABB box, centroidBox;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        box.Expand(boxes[order[i]]);
+        centroidBox.Expand(centroids[order[i]]);
+    }
+    _nodes[nodeIndex].Box = box;
+
+    // the best split over the bins of the 3 axes, by the areas of the two sides times their triangles
+    const glm::vec3 extents = centroidBox.Max - centroidBox.Min;
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = (float)count;
+    for (int axis = 0; axis < 3 && count > 2; axis++)
+    {
+        if (extents[axis] <= 0.0f)
+            continue;
+        AABB binBoxes[BinCount];
+        uint32_t binCounts[BinCount] = {};
+        const float scale = BinCount / extents[axis];
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            const int bin = std::min((int)((centroids[order[i]][axis] - centroidBox.Min[axis]) * scale), BinCount - 1);
+            binBoxes[bin].Expand(boxes[order[i]]);
+            binCounts[bin]++;
+        }
+
+        // areas and counts of the bins on the right of each split, then a sweep from the left
+        float rightAreas[BinCount];
+        uint32_t rightCounts[BinCount];
+        AABB right;
+        uint32_t rightCount = 0;
+        for (int bin = BinCount - 1; bin > 0; bin--)
+        {
+            right.Expand(binBoxes[bin]);
+            rightCount += binCounts[bin];
+            rightAreas[bin] = right.IsValid() ? right.SurfaceArea() : 0.0f;
+            rightCounts[bin] = rightCount;
+        }
+        AABB left;
+        uint32_t leftCount = 0;
+        for (int bin = 1; bin < BinCount; bin++)
+        {
+            left.Expand(binBoxes[bin - 1]);
+            leftCount += binCounts[bin - 1];
+            if (leftCount == 0 || rightCounts[bin] == 0)
+                continue;
+            const float cost = TraversalCost + (left.SurfaceArea() * leftCount + rightAreas[bin] * rightCounts[bin]) / box.SurfaceArea();
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = bin;
+            }
+        }
+    }
+
+    uint32_t leftCount = 0;
+    if (bestAxis >= 0)
+    {
+        const float scale = BinCount / extents[bestAxis];
+        auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&](uint32_t index) {
+            return std::min((int)((centroids[index][bestAxis] - centroidBox.Min[bestAxis]) * scale), BinCount - 1) < bestBin;
+        });
+        leftCount = (uint32_t)(middle - (order.begin() + first));
+    }
+    else if (count > MaxLeafTriangles && depth < MaxDepth)
+    {
+        // no split is cheaper, but the leaf is too large: the triangles are halved along the longest axis (their
+        // centroids may all be equal, then the order is arbitrary)
+        const int axis = extents.x >= extents.y && extents.x >= extents.z ? 0 : (extents.y >= extents.z ? 1 : 2);
+        leftCount = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + leftCount, order.begin() + first + count,
+                         [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+    if (leftCount == 0 || leftCount == count || depth >= MaxDepth)
+        return nodeIndex;
+
+    // the left child follows its parent
+    buildNode(order, boxes, centroids, first, leftCount, depth + 1);
+    const uint32_t rightIndex = buildNode(order, boxes, centroids, first + leftCount, count - leftCount, depth + 1);
+    _nodes[nodeIndex].Offset = rightIndex;
+    _nodes[nodeIndex].Count = 0;
+    return nodeIndex;
+}
+
+bool TriangleBVH::Intersect(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, TriangleHit &hit) const
+{
+    return traverse<false>(origin, direction, tMax, hit);
+}
+
+bool TriangleBVH::Occluded(const glm::vec3 &origin, const glm::vec3 &direction, float tMax) const
+{
+    TriangleHit hit;
+    return traverse<true>(origin, direction, tMax, hit);
+}
+
+// the nearer child is visited first, so the farther one is often culled by the closest hit found
+template <bool AnyHit>
+bool TriangleBVH::traverse(const glm::vec3 &origin, const glm::vec3 &direction, float tMax, TriangleHit &hit) const
+{
+    if (_nodes.empty())
+        return false;
+    // the components equal to 0 are replaced by a small value, to keep the divisions finite
+    glm::vec3 invDirection;
+    for (int i = 0; i < 3; i++)
+        invDirection[i] = 1.0f / (std::abs(direction[i]) > 1e-9f ? direction[i] : 1e-9f);
+
+    bool found = false;
+    uint32_t stack[MaxDepth * 2];
+    int stackSize = 0;
+    if (intersectBox(_nodes[0].Box, origin, invDirection, tMax) < 0.0f)
+        return false;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const Node &node = _nodes[stack[--stackSize]];
+        if (node.Count == 0)
+        {
+            const uint32_t left = (uint32_t)(&node - _nodes.data()) + 1, right = node.Offset;
+            const float tLeft = intersectBox(_nodes[left].Box, origin, invDirection, tMax);
+            const float tRight = intersectBox(_nodes[right].Box, origin, invDirection, tMax);
+            if (tLeft >= 0.0f && tRight >= 0.0f)
+            {
+                stack[stackSize++] = tLeft <= tRight ? right : left;
+                stack[stackSize++] = tLeft <= tRight ? left : right;
+            }
+            else if (tLeft >= 0.0f)
+                stack[stackSize++] = left;
+            else if (tRight >= 0.0f)
+                stack[stackSize++] = right;
+            continue;
+        }
+
+        // Moller-Trumbore
+        for (uint32_t i = node.Offset; i < node.Offset + node.Count; i++)
+        {
+            const Triangle &triangle = _triangles[i];
+            const glm::vec3 p = glm::cross(direction, triangle.Edge2);
+            const float determinant = glm::dot(triangle.Edge1, p);
+            if (std::abs(determinant) < 1e-12f)
+                continue;
+            const float invDeterminant = 1.0f / determinant;
+            const glm::vec3 s = origin - triangle.V0;
+            const float u = glm::dot(s, p) * invDeterminant;
+            if (u < 0.0f || u > 1.0f)
+                continue;
+            const glm::vec3 q = glm::cross(s, triangle.Edge1);
+            const float v = glm::dot(direction, q) * invDeterminant;
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+            const float t = glm::dot(triangle.Edge2, q) * invDeterminant;
+            if (t <= 0.0f || t >= tMax)
+                continue;
+            if (AnyHit)
+                return true;
+            tMax = t;
+            hit = {t, triangle.Index, u, v};
+            found = true;
+        }
+    }
+    return found;
+}
+
+const AABB &TriangleBVH::GetBounds() const
+{
+    static const AABB empty;
+    return _nodes.empty() ? empty : _nodes[0].Box;
+}
+
+size_t TriangleBVH::GetTriangleCount() const
+{
+    return _triangles.size();
+}
+
+size_t TriangleBVH::GetNodeCount() const
+{
+    return _nodes.size();
+}
+
+int TriangleBVH::GetDepth() const
+{
+    return _depth;
+}
@@ -0,0 +1,121 @@
+#include <utils/uniform_ring.h>
+#include <utils/gpu_memory.h>
+#include <cstring>
+#include <iostream>
+using std::cout;
+using std::endl;
+
+UniformRingBuffer::UniformRingBuffer(size_t frameSize, size_t frameCount) : _fences(frameCount, nullptr)
+{
+    // the offsets of glBindBufferRange must be multiples of the alignment required by the implementation
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    if (alignment > 0)
+        _alignment = (size_t)alignment;
+    _frameSize = (frameSize + _alignment - 1) / _alignment * _alignment;
+    _staging.resize(_frameSize);
+    // the first BeginFrame moves to slot 0
+    _slot = frameCount - 1;
+
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    glBufferData(GL_UNIFORM_BUFFER, _frameSize * frameCount, nullptr, GL_STREAM_DRAW);
+    TrackGpuMemory(MemoryCategory::BUFFER, _buffer, _frameSize * frameCount);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+UniformRingBuffer::~UniformRingBuffer() noexcept
+{
+    for (GLsync fence : _fences)
+    {
+        if (fence)
+            glDeleteSync(fence);
+    }
+    UntrackGpuMemory(MemoryCategory::BUFFER, _buffer);
+    glDeleteBuffers(1, &_buffer);
+}
+
+void UniformRingBuffer::BeginFrame()
+{
+    _slot = (_slot + 1) % _fences.size();
+    GLsync &fence = _fences[_slot];
+    if (fence)
+    {
+        // with enough slots the fence is already signaled; otherwise we are more frames ahead than the ring allows
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    _cursor = 0;
+    _uploaded = 0;
+    _overflowReported = false;
+}
+
+void UniformRingBuffer::EndFrame()
+{
+    Upload();
+    _fences[_slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+size_t UniformRingBuffer::Allocate(const void *data, size_t size)
+{
+    const size_t offset = (_cursor + _alignment - 1) / _alignment * _alignment;
+    if (offset + size > _frameSize)
+    {
+        if (!_overflowReported)
+            cout << "Uniform ring buffer full: " << _frameSize << " bytes per frame are not enough" << endl;
+        _overflowReported = true;
+        return InvalidOffset;
+    }
+    memcpy(_staging.data() + offset, data, size);
+    _cursor = offset + size;
+    return _slot * _frameSize + offset;
+}
+
+void UniformRingBuffer::Upload()
+{
+    if (_cursor == _uploaded)
+        return;
+
+    // binding to the generic target does not change the indexed bindings used by the draws
+    glBindBuffer(GL_UNIFORM_BUFFER, _buffer);
+    void *ptr = glMapBufferRange(GL_UNIFORM_BUFFER, _slot * _frameSize + _uploaded, _cursor - _uploaded,
+                                 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (ptr)
+    {
+        memcpy(ptr, _staging.data() + _uploaded, _cursor - _uploaded);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    else
+    {
+        glBufferSubData(GL_UNIFORM_BUFFER, _slot * _frameSize + _uploaded, _cursor - _uploaded, _staging.data() + _uploaded);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    _uploaded = _cursor;
+}
+
+GLuint UniformRingBuffer::GetBuffer() const
+{
+    return _buffer;
+}
+
+size_t UniformRingBuffer::GetFrameUsage() const
+{
+    return _cursor;
+}
+
+size_t UniformRingBuffer::GetFrameSize() const
+{
+    return _frameSize;
+}
+
+//////////////////////////////////////////
+
+void BindUniformBlock(GLuint program, const char *blockName, GLuint bindingPoint)
+{
+    // blocks not used by the program are optimized out by the compiler
+    const GLuint index = glGetUniformBlockIndex(program, blockName);
+    if (index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, bindingPoint);
+}